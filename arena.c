@@ -0,0 +1,62 @@
+#define _POSIX_C_SOURCE 200809L
+#include "gmdh.h"
+
+// every block starts with its header padded to one alignment unit
+#define ARENA_HEADER ARENA_ALIGN
+
+static arena_block_t* new_block(size_t size) {
+    void *p = NULL;
+    if (posix_memalign(&p, ARENA_ALIGN, ARENA_HEADER + size) != 0) {
+        return NULL;
+    }
+    arena_block_t *b = p;
+    b->next = NULL;
+    b->size = size;
+    b->used = 0;
+    return b;
+}
+
+gmdh_arena_t* arena_create(size_t block_size) {
+    gmdh_arena_t *a = malloc(sizeof(gmdh_arena_t));
+    a->block_size = block_size < 4096 ? 4096 : block_size;
+    a->head = new_block(a->block_size);
+    a->refs = 1;
+    return a;
+}
+
+// bump-allocate `bytes`, aligned to ARENA_ALIGN. memory is zeroed and lives
+// until the arena is released
+void* arena_alloc(gmdh_arena_t *a, size_t bytes) {
+    size_t need = (bytes + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    arena_block_t *b = a->head;
+
+    if (!b || b->used + need > b->size) {
+        size_t size = need > a->block_size ? need : a->block_size;
+        arena_block_t *fresh = new_block(size);
+        if (!fresh) return NULL;
+        fresh->next = a->head;
+        a->head = fresh;
+        b = fresh;
+    }
+
+    char *p = (char*)b + ARENA_HEADER + b->used;
+    b->used += need;
+    memset(p, 0, need);
+    return p;
+}
+
+void arena_retain(gmdh_arena_t *a) {
+    a->refs++;
+}
+
+// drop one reference; the last one frees every block
+void arena_release(gmdh_arena_t *a) {
+    if (!a || --a->refs > 0) return;
+    arena_block_t *b = a->head;
+    while (b) {
+        arena_block_t *next = b->next;
+        free(b);
+        b = next;
+    }
+    free(a);
+}
@@ -0,0 +1,582 @@
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include "gmdh.h"
+
+// benchmark harness: times the main entry points over a grid of synthetic
+// datasets and writes one json record per case. every repetition of a
+// case is timed against a fixed reference kernel run beside it, and the
+// median of those ratios is what --baseline compares, flagging the cases
+// whose ratio grew by more than the threshold. a baseline from a faster or
+// slower machine, or one at another clock, so still compares. on a shared
+// machine the ratios still drift by a fifth or more from run to run, so
+// the comparison is for information unless --strict: then a flagged case
+// is measured again and the run exits 1 if it stays over the threshold.
+// a baseline without ratios is compared by wall clock, for information
+// only. allocations are counted by wrapping malloc, calloc, realloc and
+// posix_memalign at link time (see make bench), so only calls made by this
+// program's own objects are seen
+
+// cases are regressions only when slower by at least this much as well,
+// so sub-millisecond noise never fails a run
+#define BENCH_MIN_REGRESSION_MS 1.0
+
+#define BENCH_MAX_REPS 64
+#define BENCH_MAX_CASES 64
+
+// untimed runs of a case before its repetitions, to warm the caches, the
+// page tables and the thread pool
+#define BENCH_WARMUP 2
+
+// doubles the reference kernel streams over, and its passes
+#define BENCH_REF_WORDS 16384
+#define BENCH_REF_PASSES 32
+
+// times a case over the threshold is measured again under --strict, from
+// a fresh dataset, before it counts: a regression must show every time
+#define BENCH_CONFIRM 2
+
+static uint64_t n_allocs;
+static uint64_t alloc_bytes;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void *p, size_t size);
+int __real_posix_memalign(void **p, size_t align, size_t size);
+
+void* __wrap_malloc(size_t size) {
+    __atomic_add_fetch(&n_allocs, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&alloc_bytes, size, __ATOMIC_RELAXED);
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t n, size_t size) {
+    __atomic_add_fetch(&n_allocs, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&alloc_bytes, n * size, __ATOMIC_RELAXED);
+    return __real_calloc(n, size);
+}
+
+void* __wrap_realloc(void *p, size_t size) {
+    __atomic_add_fetch(&n_allocs, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&alloc_bytes, size, __ATOMIC_RELAXED);
+    return __real_realloc(p, size);
+}
+
+// dataset arenas take their blocks from here
+int __wrap_posix_memalign(void **p, size_t align, size_t size) {
+    __atomic_add_fetch(&n_allocs, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&alloc_bytes, size, __ATOMIC_RELAXED);
+    return __real_posix_memalign(p, align, size);
+}
+
+// shape of a synthetic dataset
+typedef struct {
+    int n_samples;
+    int n_features;
+    double collinearity;    // correlation of every feature with a shared latent
+    double noise;           // target noise, relative to the signal's spread
+    uint64_t seed;
+} synth_spec_t;
+
+static uint64_t rng_next(uint64_t *s) {
+    // xorshift64*
+    *s ^= *s >> 12;
+    *s ^= *s << 25;
+    *s ^= *s >> 27;
+    return *s * 0x2545f4914f6cdd1dULL;
+}
+
+static double rng_uniform(uint64_t *s) {
+    return (rng_next(s) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double rng_normal(uint64_t *s) {
+    double u = rng_uniform(s), v = rng_uniform(s);
+    return sqrt(-2 * log(u + 1e-300)) * cos(6.283185307179586 * v);
+}
+
+// features x_f = c z + sqrt(1 - c²) e_f with a shared latent z, so every
+// pair correlates by c². the target is a quadratic in the first three
+// features plus gaussian noise
+static dataset_t* synth_dataset(const synth_spec_t *spec) {
+    uint64_t s = spec->seed | 1;
+    int m = spec->n_features;
+    dataset_t *ds = dataset_create(spec->n_samples, m);
+    double c = spec->collinearity, d = sqrt(1 - c * c);
+
+    for (int r = 0; r < spec->n_samples; r++) {
+        double z = rng_normal(&s);
+        for (int f = 0; f < m; f++) {
+            ds->cols[f][r] = c * z + d * rng_normal(&s);
+        }
+        double a = ds->cols[0][r];
+        double b = m > 1 ? ds->cols[1][r] : 0;
+        double e = m > 2 ? ds->cols[2][r] : 0;
+        ds->target[r] = 1 + 0.8 * a - 0.5 * b + 0.3 * a * b + 0.2 * e * e +
+                        spec->noise * rng_normal(&s);
+    }
+    for (int f = 0; f < m; f++) {
+        char name[16];
+        snprintf(name, sizeof(name), "x%d", f);
+        ds->feature_names[f] = arena_alloc(ds->arena, strlen(name) + 1);
+        strcpy(ds->feature_names[f], name);
+    }
+    return ds;
+}
+
+static int write_csv(const dataset_t *ds, const char *path) {
+    FILE *fp = fopen(path, "w");
+    if (!fp) return 0;
+    for (int f = 0; f < ds->n_features; f++) {
+        fprintf(fp, "%s,", ds->feature_names[f]);
+    }
+    fprintf(fp, "y\n");
+    for (int r = 0; r < ds->n_samples; r++) {
+        for (int f = 0; f < ds->n_features; f++) {
+            fprintf(fp, "%.17g,", ds->cols[f][r]);
+        }
+        fprintf(fp, "%.17g\n", ds->target[r]);
+    }
+    return fclose(fp) == 0;
+}
+
+// one timed entry point: run once on a dataset and return the number of
+// candidates it evaluated
+typedef struct {
+    dataset_t *ds;
+    dataset_t *train;
+    dataset_t *valid;
+    const char *csv_path;
+    gmdh_context_t *ctx;    // kept across repetitions
+    long n_subsets;         // of the linear searches, counted up front
+} bench_input_t;
+
+typedef long (*bench_fn)(bench_input_t *in);
+
+// the dataset of spec, its split and its csv at csv_path. 0 when the csv
+// cannot be written
+static int bench_input_open(bench_input_t *in, const synth_spec_t *spec,
+                            const char *csv_path) {
+    in->ds = synth_dataset(spec);
+    in->csv_path = csv_path;
+    split_dataset(in->ds, &in->train, &in->valid, 0.7);
+    in->ctx = gmdh_context_create(NULL);
+    in->n_subsets = (long)linear_subset_count(spec->n_features, 1, 3);
+    return write_csv(in->ds, csv_path);
+}
+
+static void bench_input_close(bench_input_t *in) {
+    remove(in->csv_path);
+    gmdh_context_free(in->ctx);
+    free_dataset(in->train);
+    free_dataset(in->valid);
+    free_dataset(in->ds);
+}
+
+static long bench_load_csv(bench_input_t *in) {
+    dataset_t *ds = load_csv(in->csv_path, in->ds->n_features);
+    long rows = ds ? ds->n_samples : 0;
+    free_dataset(ds);
+    return rows;
+}
+
+static long bench_fit_polynomial(bench_input_t *in) {
+    dataset_t *t = in->train;
+    long fits = 0;
+    double coeffs[6];
+    for (int i = 0; i < t->n_features; i++) {
+        for (int j = i + 1; j < t->n_features; j++) {
+            fit_polynomial(t->cols[i], t->cols[j], t->target, t->n_samples, coeffs);
+            fits++;
+        }
+    }
+    return fits;
+}
+
+static long bench_combinatorial(bench_input_t *in) {
+    int n_models;
+    free(combinatorial_gmdh(in->train, in->valid, &n_models));
+    return n_models;
+}
+
+static long bench_linear(bench_input_t *in) {
+    int n_models;
+    linear_model_t *models = linear_combinatorial_gmdh(in->train, in->valid, 1, 3, &n_models);
+    free_linear_models(models, n_models);
+    return (long)linear_subset_count(in->train->n_features, 1, 3);
+}
+
+static long bench_multirow(bench_input_t *in) {
+    int n_layers = 3, per_layer = 8;
+    gmdh_layer_t *layers = multirow_gmdh(in->train, in->valid, n_layers, per_layer);
+    long m = in->train->n_features;
+    long candidates = m * (m - 1) / 2;
+    for (int l = 0; l < n_layers; l++) {
+        // later layers pair the models kept by the one before
+        if (l > 0) {
+            long k = layers[l - 1].n_models;
+            candidates += k * (k - 1) / 2;
+        }
+        if (layers[l].n_models > 0) free(layers[l].models);
+    }
+    free(layers);
+    // drop cached layer outputs so every repetition does the same work
+    multirow_cache_clear();
+    return candidates;
+}
+
+// the three searches again through one context, as a retraining loop
+// would run them: after the warm-up every repetition reuses its pool
+static long bench_context(bench_input_t *in) {
+    int n_pairs, n_linear;
+    gmdh_context_combinatorial(in->ctx, in->train, in->valid, &n_pairs);
+    gmdh_context_linear(in->ctx, in->train, in->valid, 1, 3, &n_linear);
+    const gmdh_layer_t *layers = gmdh_context_multirow(in->ctx, in->train, in->valid, 3, 8);
+    long candidates = 2L * n_pairs + in->n_subsets;
+    for (int l = 1; l < 3; l++) {
+        long k = layers[l - 1].n_models;
+        candidates += k * (k - 1) / 2;
+    }
+    return candidates;
+}
+
+typedef struct {
+    char name[96];
+    int reps;
+    double median_ms;
+    double p95_ms;
+    double ref_ms;          // median time of the reference kernel
+    double ratio;           // median of the repetitions over the reference, gated
+    long candidates;
+    double candidates_per_s;
+    uint64_t allocs;
+    uint64_t alloc_bytes;
+    long peak_rss_kb;
+} bench_result_t;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec * 1e-6;
+}
+
+static int compare_doubles(const void *pa, const void *pb) {
+    double a = *(const double*)pa, b = *(const double*)pb;
+    return (a > b) - (a < b);
+}
+
+static double median_of(double *times, int n) {
+    qsort(times, n, sizeof(double), compare_doubles);
+    return n % 2 ? times[n / 2] : (times[n / 2 - 1] + times[n / 2]) / 2;
+}
+
+// the yardstick the cases are timed against: streaming multiply-adds
+// over a cache-resident block, the mix of loads and flops the searches
+// spend their time on, in code no change to the library can move
+static double ref_data[BENCH_REF_WORDS];
+static volatile double ref_sink;
+
+static void reference_kernel(void) {
+    double acc = 0;
+    for (int p = 0; p < BENCH_REF_PASSES; p++) {
+        double a = 1 + p * 1e-3;
+        for (int i = 0; i < BENCH_REF_WORDS; i++) {
+            ref_data[i] = ref_data[i] * 0.999 + a;
+            acc += ref_data[i] * ref_data[(i * 7) & (BENCH_REF_WORDS - 1)];
+        }
+    }
+    ref_sink = acc;
+}
+
+// the algorithms report progress on stdout; keep it out of the way while
+// timing
+static int quiet_stdout(void) {
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+    close(null);
+    return saved;
+}
+
+static void restore_stdout(int saved) {
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+}
+
+static void run_case(bench_result_t *res, const char *name, bench_fn fn, bench_input_t *in,
+                     int reps) {
+    double times[BENCH_MAX_REPS];
+    double ref_times[BENCH_MAX_REPS];
+    double ratios[BENCH_MAX_REPS];
+    snprintf(res->name, sizeof(res->name), "%s", name);
+    res->reps = reps;
+
+    int saved = quiet_stdout();
+    for (int w = 0; w < BENCH_WARMUP; w++) {
+        reference_kernel();
+        fn(in);
+    }
+    // the reference runs right before and right after each repetition, so
+    // the two see the same clock speed and the same neighbours
+    double t0 = now_ms();
+    reference_kernel();
+    double ref_before = now_ms() - t0;
+    for (int r = 0; r < reps; r++) {
+        uint64_t allocs = n_allocs, bytes = alloc_bytes;
+        t0 = now_ms();
+        res->candidates = fn(in);
+        times[r] = now_ms() - t0;
+        res->allocs = n_allocs - allocs;
+        res->alloc_bytes = alloc_bytes - bytes;
+
+        t0 = now_ms();
+        reference_kernel();
+        double ref_after = now_ms() - t0;
+        ref_times[r] = (ref_before + ref_after) / 2;
+        ratios[r] = ref_times[r] > 0 ? times[r] / ref_times[r] : 0;
+        ref_before = ref_after;
+    }
+    restore_stdout(saved);
+
+    res->ref_ms = median_of(ref_times, reps);
+    res->median_ms = median_of(times, reps);
+    res->ratio = median_of(ratios, reps);
+    // nearest rank
+    int rank = (int)ceil(0.95 * reps) - 1;
+    res->p95_ms = times[rank < 0 ? 0 : rank];
+    res->candidates_per_s = res->median_ms > 0 ? res->candidates / (res->median_ms / 1e3) : 0;
+
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    res->peak_rss_kb = ru.ru_maxrss;
+}
+
+static void write_results(FILE *fp, const bench_result_t *res, int n) {
+    fprintf(fp, "{\n  \"threads\": %d,\n  \"cases\": [\n", gmdh_thread_count());
+    for (int i = 0; i < n; i++) {
+        const bench_result_t *r = &res[i];
+        fprintf(fp, "    {\"name\": \"%s\", \"reps\": %d, \"median_ms\": %.4f, \"p95_ms\": %.4f, "
+                    "\"ref_ms\": %.4f, \"ratio\": %.4f, "
+                    "\"candidates\": %ld, \"candidates_per_s\": %.1f, \"allocs\": %llu, "
+                    "\"alloc_bytes\": %llu, \"peak_rss_kb\": %ld}%s\n",
+                r->name, r->reps, r->median_ms, r->p95_ms, r->ref_ms, r->ratio,
+                r->candidates, r->candidates_per_s,
+                (unsigned long long)r->allocs, (unsigned long long)r->alloc_bytes,
+                r->peak_rss_kb, i + 1 < n ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+}
+
+// field `field` ("median_ms", say) of case `name` in a results file
+// written by write_results, or a negative value when the file has no such
+// case or the case no such field
+static double baseline_field(const char *text, const char *name, const char *field) {
+    char key[128];
+    snprintf(key, sizeof(key), "\"name\": \"%.96s\"", name);
+    const char *p = strstr(text, key);
+    if (!p) return -1;
+    snprintf(key, sizeof(key), "\"%s\": ", field);
+    const char *m = strstr(p, key);
+    const char *eol = strchr(p, '\n');
+    if (!m || (eol && m > eol)) return -1;
+    return strtod(m + strlen(key), NULL);
+}
+
+static char* read_file(const char *path) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return NULL;
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char *text = malloc(size + 1);
+    size_t got = fread(text, 1, size, fp);
+    text[got] = '\0';
+    fclose(fp);
+    return text;
+}
+
+// compare every case against the baseline by its ratio to the reference
+// kernel, flagging in slower those over the threshold, and print the table
+// if asked. a baseline without ratios is compared by median time, for
+// information only. returns the number of regressions, -1 when nothing
+// was checked
+static int compare_baseline(const bench_result_t *res, int n, const char *path,
+                            double threshold, char *slower, int print) {
+    char *text = read_file(path);
+    if (!text) {
+        fprintf(stderr, "no baseline at %s, nothing to compare\n", path);
+        return -1;
+    }
+    int advisory = strstr(text, "\"ratio\": ") == NULL;
+    if (advisory && print) {
+        printf("\n%s has no reference ratios: wall-clock comparison, not checked\n", path);
+    }
+    int regressions = 0;
+    if (print) {
+        printf("\n%-40s %10s %10s %8s\n", "case", advisory ? "base ms" : "base", "now",
+               "change");
+    }
+    for (int i = 0; i < n; i++) {
+        double base = baseline_field(text, res[i].name, advisory ? "median_ms" : "ratio");
+        double now = advisory ? res[i].median_ms : res[i].ratio;
+        slower[i] = 0;
+        if (base < 0) {
+            if (print) printf("%-40s %10s %10.2f %8s\n", res[i].name, "-", now, "new");
+            continue;
+        }
+        double change = base > 0 ? now / base - 1 : 0;
+        // the baseline's time for this case, at this run's reference speed
+        double base_ms = advisory ? base : base * res[i].ref_ms;
+        slower[i] = change > threshold && res[i].median_ms - base_ms > BENCH_MIN_REGRESSION_MS;
+        if (print) {
+            printf("%-40s %10.2f %10.2f %+7.1f%%%s\n", res[i].name, base, now, 100 * change,
+                   slower[i] ? (advisory ? "  slower" : "  REGRESSION") : "");
+        }
+        if (!advisory) regressions += slower[i];
+    }
+    free(text);
+    return advisory ? -1 : regressions;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [--out FILE] [--baseline FILE] [--threshold FRACTION]\n"
+                    "          [--strict] [--reps N] [--threads N] [--quick]\n", prog);
+}
+
+int main(int argc, char **argv) {
+    const char *out_path = NULL;
+    const char *baseline_path = NULL;
+    double threshold = 0.25;
+    int reps = 15;
+    int quick = 0;
+    int strict = 0;
+
+    for (int i = 1; i < argc; i++) {
+        int has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--out") == 0 && has_value) {
+            out_path = argv[++i];
+        } else if (strcmp(argv[i], "--baseline") == 0 && has_value) {
+            baseline_path = argv[++i];
+        } else if (strcmp(argv[i], "--threshold") == 0 && has_value) {
+            threshold = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--reps") == 0 && has_value) {
+            reps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && has_value) {
+            gmdh_options.n_threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--quick") == 0) {
+            quick = 1;
+        } else if (strcmp(argv[i], "--strict") == 0) {
+            strict = 1;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (reps < 1) reps = 1;
+    if (reps > BENCH_MAX_REPS) reps = BENCH_MAX_REPS;
+
+    // parse every repetition, not a cached binary copy
+    gmdh_options.csv_cache = 0;
+
+    int sizes[2] = {2000, 20000};
+    int widths[2] = {8, 24};
+    struct {
+        const char *name;
+        bench_fn fn;
+    } entries[] = {
+        {"load_csv", bench_load_csv},
+        {"fit_polynomial", bench_fit_polynomial},
+        {"combinatorial_gmdh", bench_combinatorial},
+        {"linear_combinatorial_gmdh", bench_linear},
+        {"multirow_gmdh", bench_multirow},
+        {"context_gmdh", bench_context},
+    };
+    int n_entries = sizeof(entries) / sizeof(entries[0]);
+
+    bench_result_t results[BENCH_MAX_CASES];
+    synth_spec_t result_spec[BENCH_MAX_CASES];
+    int result_entry[BENCH_MAX_CASES];
+    int n_results = 0;
+    char csv_path[64];
+    snprintf(csv_path, sizeof(csv_path), "/tmp/gmdh-bench-%d.csv", (int)getpid());
+
+    for (int si = 0; si < (quick ? 1 : 2); si++) {
+        for (int wi = 0; wi < 2; wi++) {
+            synth_spec_t spec = {sizes[si], widths[wi], 0.5, 0.1, 42};
+            bench_input_t in;
+            if (!bench_input_open(&in, &spec, csv_path)) {
+                fprintf(stderr, "cannot write %s\n", csv_path);
+                return 1;
+            }
+
+            for (int e = 0; e < n_entries; e++) {
+                char name[96];
+                snprintf(name, sizeof(name), "%s/n=%d/m=%d", entries[e].name,
+                         spec.n_samples, spec.n_features);
+                result_spec[n_results] = spec;
+                result_entry[n_results] = e;
+                bench_result_t *r = &results[n_results++];
+                run_case(r, name, entries[e].fn, &in, reps);
+                printf("%-40s median %9.2f ms  p95 %9.2f ms  x%8.2f ref  %12.0f cand/s  "
+                       "%8llu allocs\n", r->name, r->median_ms, r->p95_ms, r->ratio,
+                       r->candidates_per_s, (unsigned long long)r->allocs);
+                fflush(stdout);
+            }
+
+            bench_input_close(&in);
+        }
+    }
+
+    // a strict run measures a case over the threshold again and keeps its
+    // best, so one slow stretch does not fail the run
+    char slower[BENCH_MAX_CASES];
+    int regressions = baseline_path && strict ?
+                      compare_baseline(results, n_results, baseline_path, threshold, slower, 0) : -1;
+    for (int round = 0; round < BENCH_CONFIRM && regressions > 0; round++) {
+        printf("\nmeasuring %d case%s over the threshold again\n", regressions,
+               regressions > 1 ? "s" : "");
+        for (int i = 0; i < n_results; i++) {
+            if (!slower[i]) continue;
+            bench_input_t in;
+            bench_result_t again;
+            if (!bench_input_open(&in, &result_spec[i], csv_path)) {
+                fprintf(stderr, "cannot write %s\n", csv_path);
+                return 1;
+            }
+            run_case(&again, results[i].name, entries[result_entry[i]].fn, &in, reps);
+            bench_input_close(&in);
+            printf("%-40s median %9.2f ms  x%8.2f ref\n", again.name, again.median_ms,
+                   again.ratio);
+            if (again.ratio < results[i].ratio) results[i] = again;
+        }
+        regressions = compare_baseline(results, n_results, baseline_path, threshold, slower, 0);
+    }
+
+    if (out_path) {
+        FILE *fp = fopen(out_path, "w");
+        if (!fp) {
+            fprintf(stderr, "cannot write %s\n", out_path);
+            return 1;
+        }
+        write_results(fp, results, n_results);
+        fclose(fp);
+        printf("\nwrote %s\n", out_path);
+    } else {
+        write_results(stdout, results, n_results);
+    }
+
+    if (baseline_path) {
+        regressions = compare_baseline(results, n_results, baseline_path, threshold, slower, 1);
+        if (regressions > 0) {
+            printf("\n%d case%s regressed by more than %.0f%%%s\n", regressions,
+                   regressions > 1 ? "s" : "", 100 * threshold,
+                   strict ? "" : " (for information: --strict to fail on it)");
+            if (strict) return 1;
+        }
+        if (regressions == 0) printf("\nno regressions beyond %.0f%%\n", 100 * threshold);
+    }
+    return 0;
+}
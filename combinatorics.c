@@ -0,0 +1,158 @@
+#include "gmdh.h"
+
+// pascal's triangle up to n items and k_max picks. counts that do not
+// fit 64 bits saturate at UINT64_MAX instead of wrapping
+comb_table_t* comb_table_create(int n, int k_max) {
+    if (k_max > n) k_max = n;
+    if (k_max < 0) k_max = 0;
+
+    comb_table_t *t = gmdh_alloc(sizeof(comb_table_t));
+    t->n = n;
+    t->k_max = k_max;
+    t->table = gmdh_calloc((size_t)(n + 1) * (k_max + 1), sizeof(uint64_t));
+
+    for (int i = 0; i <= n; i++) {
+        uint64_t *row = t->table + (size_t)i * (k_max + 1);
+        uint64_t *prev = row - (k_max + 1);
+        row[0] = 1;
+        for (int k = 1; k <= k_max && k <= i; k++) {
+            uint64_t a = prev[k - 1], b = k < i ? prev[k] : 0;
+            row[k] = a > UINT64_MAX - b ? UINT64_MAX : a + b;
+        }
+    }
+    return t;
+}
+
+// C(n, k), for n <= t->n and k <= t->k_max
+uint64_t comb_count(const comb_table_t *t, int n, int k) {
+    if (k < 0 || k > n || n < 0) return 0;
+    return t->table[(size_t)n * (t->k_max + 1) + k];
+}
+
+// the k-subset of {0..n-1} with lexicographic rank `rank` (combinatorial
+// number system), without stepping through the subsets before it
+void comb_unrank(const comb_table_t *t, int n, int k, uint64_t rank, int *indices) {
+    int c = 0;
+    for (int pos = 0; pos < k; pos++) {
+        for (;;) {
+            uint64_t below = comb_count(t, n - c - 1, k - pos - 1);
+            if (rank < below) break;
+            rank -= below;
+            c++;
+        }
+        indices[pos] = c++;
+    }
+}
+
+// inverse of comb_unrank for sorted indices
+uint64_t comb_rank(const comb_table_t *t, int n, int k, const int *indices) {
+    uint64_t rank = 0;
+    int c = 0;
+    for (int pos = 0; pos < k; pos++) {
+        for (; c < indices[pos]; c++) {
+            rank += comb_count(t, n - c - 1, k - pos - 1);
+        }
+        c++;
+    }
+    return rank;
+}
+
+// advance to the next combination in lexicographic order, 0 after the last
+int comb_next(int n, int k, int *indices) {
+    int i = k - 1;
+    while (i >= 0 && indices[i] == n - k + i) {
+        i--;
+    }
+    if (i < 0) return 0;
+    indices[i]++;
+    for (int j = i + 1; j < k; j++) {
+        indices[j] = indices[j - 1] + 1;
+    }
+    return 1;
+}
+
+// revolving-door order (kreher & stinson, algorithms 2.11-2.13): every
+// k-subset differs from the one before it by swapping a single element.
+// the routines below work on sorted 0-based indices
+
+// rank of a subset in revolving-door order
+uint64_t revdoor_rank(const comb_table_t *t, int k, const int *indices) {
+    uint64_t rank = 0;
+    int sign = (k % 2 == 0) ? -1 : 1; // (-1)^(k-i) for i = 1
+    for (int i = 1; i <= k; i++) {
+        uint64_t term = comb_count(t, indices[i - 1] + 1, i) - 1;
+        rank = sign > 0 ? rank + term : rank - term;
+        sign = -sign;
+    }
+    return rank;
+}
+
+// the subset of revolving-door rank `rank`
+void revdoor_unrank(const comb_table_t *t, int n, int k, uint64_t rank, int *indices) {
+    int x = n;
+    for (int i = k; i >= 1; i--) {
+        while (comb_count(t, x, i) > rank) {
+            x--;
+        }
+        indices[i - 1] = x; // t_i = x + 1, shifted to 0-based
+        rank = comb_count(t, x + 1, i) - rank - 1;
+    }
+}
+
+// step to the next subset in revolving-door order, wrapping after the
+// last. reports the element that left and the one that entered
+void revdoor_next(int n, int k, int *indices, int *removed, int *added) {
+    int t[k + 2];
+    int old[k + 1];
+
+    // work on the 1-based form of the algorithm, with t[k+1] = n + 1
+    for (int i = 0; i < k; i++) {
+        t[i + 1] = indices[i] + 1;
+        old[i] = indices[i];
+    }
+    t[k + 1] = n + 1;
+
+    int j = 1;
+    while (j <= k && t[j] == j) {
+        j++;
+    }
+    if ((k - j) % 2 != 0) {
+        if (j == 1) {
+            t[1]--;
+        } else {
+            t[j - 1] = j;
+            if (j > 2) t[j - 2] = j - 1;
+        }
+    } else if (t[j + 1] != t[j] + 1) {
+        t[j - 1] = t[j];
+        t[j]++;
+    } else {
+        t[j + 1] = t[j];
+        t[j] = j;
+    }
+
+    for (int i = 0; i < k; i++) {
+        indices[i] = t[i + 1] - 1;
+    }
+
+    // both sets are sorted, so one merge finds the swapped pair
+    *removed = -1;
+    *added = -1;
+    int a = 0, b = 0;
+    while (a < k || b < k) {
+        if (b >= k || (a < k && old[a] < indices[b])) {
+            *removed = old[a++];
+        } else if (a >= k || indices[b] < old[a]) {
+            *added = indices[b++];
+        } else {
+            a++;
+            b++;
+        }
+    }
+}
+
+void free_comb_table(comb_table_t *t) {
+    if (!t) return;
+    gmdh_free(t->table);
+    gmdh_free(t);
+}
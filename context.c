@@ -0,0 +1,258 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdarg.h>
+#include "gmdh.h"
+
+// a context owns everything a repeated run needs: its options, where its
+// progress text goes, the results of its last run and a workspace pool.
+// the algorithms take their scratch from gmdh_alloc, which inside a
+// context run reuses the blocks earlier runs gave back. once a run has
+// been made on data of a given shape, repeating it allocates nothing
+
+// smallest workspace block; blocks come in powers of two from here
+#define WS_MIN_BYTES 64
+#define WS_CLASSES 48
+
+// every block starts with its header padded to one alignment unit, as in
+// arena.c, so the memory handed out is ARENA_ALIGN-aligned
+#define WS_HEADER ARENA_ALIGN
+
+// longest piece of progress text passed to a log sink in one call
+#define LOG_LINE_BYTES 1024
+
+typedef struct ws_block {
+    struct ws_block *next;  // free list, while not handed out
+    int cls;
+} ws_block_t;
+
+struct gmdh_context {
+    gmdh_options_t options;
+    gmdh_log_fn log;        // NULL: progress text is dropped
+    void *log_user;
+
+    pthread_mutex_t ws_lock;    // workers may allocate too
+    ws_block_t *free_blocks[WS_CLASSES];
+    uint64_t allocs;        // blocks taken from the system
+    uint64_t bytes;
+
+    // results of the last run of each kind, released by the next
+    polynomial_model_t *pairs;
+    linear_model_t *linear;
+    int n_linear;
+    gmdh_layer_t *layers;
+    int n_layers;
+
+    gmdh_context_t *outer;  // context of the thread before this run
+};
+
+// context of the run this thread is working for, if any
+static __thread gmdh_context_t *current;
+
+gmdh_context_t* gmdh_context_current(void) {
+    return current;
+}
+
+// the options the algorithms read: the context's during a context run,
+// gmdh_options otherwise. contexts never touch gmdh_options, so runs of
+// different contexts, and plain calls beside them, proceed independently
+const gmdh_options_t* gmdh_current_options(void) {
+    return current ? &current->options : &gmdh_options;
+}
+
+// make ctx this thread's context (NULL for none), returning the previous
+// one. parallel_for workers take on their caller's this way
+gmdh_context_t* gmdh_context_swap(gmdh_context_t *ctx) {
+    gmdh_context_t *prev = current;
+    current = ctx;
+    return prev;
+}
+
+static int size_class(size_t bytes) {
+    int cls = 0;
+    for (size_t cap = WS_MIN_BYTES; cap < bytes && cls < WS_CLASSES - 1; cap <<= 1) {
+        cls++;
+    }
+    return cls;
+}
+
+// scratch memory for the algorithms. outside a context run this is
+// malloc; inside one it comes from the context's pool, rounded up to a
+// power of two, and must go back through gmdh_free during a run of the
+// same context
+void* gmdh_alloc(size_t bytes) {
+    gmdh_context_t *ctx = current;
+    if (!ctx) return malloc(bytes);
+
+    int cls = size_class(bytes);
+    pthread_mutex_lock(&ctx->ws_lock);
+    ws_block_t *b = ctx->free_blocks[cls];
+    if (b) {
+        ctx->free_blocks[cls] = b->next;
+    }
+    pthread_mutex_unlock(&ctx->ws_lock);
+
+    if (!b) {
+        size_t size = (size_t)WS_MIN_BYTES << cls;
+        void *p = NULL;
+        if (size < bytes || posix_memalign(&p, ARENA_ALIGN, WS_HEADER + size) != 0) {
+            return NULL;
+        }
+        b = p;
+        b->cls = cls;
+        pthread_mutex_lock(&ctx->ws_lock);
+        ctx->allocs++;
+        ctx->bytes += WS_HEADER + size;
+        pthread_mutex_unlock(&ctx->ws_lock);
+    }
+    return (char*)b + WS_HEADER;
+}
+
+void* gmdh_calloc(size_t n, size_t size) {
+    void *p = gmdh_alloc(n * size);
+    if (p) memset(p, 0, n * size);
+    return p;
+}
+
+void gmdh_free(void *p) {
+    gmdh_context_t *ctx = current;
+    if (!p) return;
+    if (!ctx) {
+        free(p);
+        return;
+    }
+    ws_block_t *b = (ws_block_t*)((char*)p - WS_HEADER);
+    pthread_mutex_lock(&ctx->ws_lock);
+    b->next = ctx->free_blocks[b->cls];
+    ctx->free_blocks[b->cls] = b;
+    pthread_mutex_unlock(&ctx->ws_lock);
+}
+
+// progress text: to stdout outside a context run, to the context's log
+// sink inside one
+void gmdh_log(const char *fmt, ...) {
+    gmdh_context_t *ctx = current;
+    va_list ap;
+    va_start(ap, fmt);
+    if (!ctx) {
+        vprintf(fmt, ap);
+    } else if (ctx->log) {
+        char text[LOG_LINE_BYTES];
+        vsnprintf(text, sizeof(text), fmt, ap);
+        ctx->log(ctx->log_user, text);
+    }
+    va_end(ap);
+}
+
+// a context running with opts (the current gmdh_options when NULL) and no
+// log sink
+gmdh_context_t* gmdh_context_create(const gmdh_options_t *opts) {
+    gmdh_context_t *ctx = calloc(1, sizeof(gmdh_context_t));
+    ctx->options = opts ? *opts : gmdh_options;
+    pthread_mutex_init(&ctx->ws_lock, NULL);
+    return ctx;
+}
+
+// the options of ctx's runs, to change between runs
+gmdh_options_t* gmdh_context_options(gmdh_context_t *ctx) {
+    return &ctx->options;
+}
+
+// send ctx's progress text to log, NULL to drop it
+void gmdh_context_set_log(gmdh_context_t *ctx, gmdh_log_fn log, void *user) {
+    ctx->log = log;
+    ctx->log_user = user;
+}
+
+// blocks ctx has taken from the system so far. steady for repeated runs
+uint64_t gmdh_context_allocs(const gmdh_context_t *ctx) {
+    return ctx->allocs;
+}
+
+// hand results back to the pool. these run with ctx current
+static void release_pairs(gmdh_context_t *ctx) {
+    gmdh_free(ctx->pairs);
+    ctx->pairs = NULL;
+}
+
+static void release_linear(gmdh_context_t *ctx) {
+    free_linear_models(ctx->linear, ctx->n_linear);
+    ctx->linear = NULL;
+    ctx->n_linear = 0;
+}
+
+static void release_layers(gmdh_context_t *ctx) {
+    if (ctx->layers) {
+        for (int l = 0; l < ctx->n_layers; l++) {
+            gmdh_free(ctx->layers[l].models);
+        }
+        gmdh_free(ctx->layers);
+    }
+    ctx->layers = NULL;
+    ctx->n_layers = 0;
+}
+
+// a context runs on one thread at a time; distinct contexts may run
+// concurrently
+static void run_begin(gmdh_context_t *ctx) {
+    ctx->outer = gmdh_context_swap(ctx);
+}
+
+static void run_end(gmdh_context_t *ctx) {
+    gmdh_context_swap(ctx->outer);
+}
+
+// combinatorial_gmdh under ctx. the models belong to ctx and last until
+// its next combinatorial run, and likewise for the other kinds of run
+const polynomial_model_t* gmdh_context_combinatorial(gmdh_context_t *ctx, dataset_t *train,
+                                                     dataset_t *valid, int *n_models) {
+    run_begin(ctx);
+    release_pairs(ctx);
+    ctx->pairs = combinatorial_gmdh(train, valid, n_models);
+    run_end(ctx);
+    return ctx->pairs;
+}
+
+// linear_combinatorial_gmdh under ctx
+const linear_model_t* gmdh_context_linear(gmdh_context_t *ctx, dataset_t *train,
+                                          dataset_t *valid, int min_features,
+                                          int max_features, int *n_models) {
+    run_begin(ctx);
+    release_linear(ctx);
+    ctx->linear = linear_combinatorial_gmdh(train, valid, min_features, max_features,
+                                            &ctx->n_linear);
+    *n_models = ctx->n_linear;
+    run_end(ctx);
+    return ctx->linear;
+}
+
+// multirow_gmdh under ctx: n_layers layers, empty ones past the last
+// that could be bred
+const gmdh_layer_t* gmdh_context_multirow(gmdh_context_t *ctx, dataset_t *train,
+                                          dataset_t *valid, int n_layers,
+                                          int models_per_layer) {
+    run_begin(ctx);
+    release_layers(ctx);
+    ctx->layers = multirow_gmdh(train, valid, n_layers, models_per_layer);
+    ctx->n_layers = n_layers;
+    run_end(ctx);
+    return ctx->layers;
+}
+
+void gmdh_context_free(gmdh_context_t *ctx) {
+    if (!ctx) return;
+    gmdh_context_t *outer = gmdh_context_swap(ctx);
+    release_pairs(ctx);
+    release_linear(ctx);
+    release_layers(ctx);
+    gmdh_context_swap(outer);
+    for (int c = 0; c < WS_CLASSES; c++) {
+        ws_block_t *b = ctx->free_blocks[c];
+        while (b) {
+            ws_block_t *next = b->next;
+            free(b);
+            b = next;
+        }
+    }
+    pthread_mutex_destroy(&ctx->ws_lock);
+    free(ctx);
+}
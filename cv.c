@@ -0,0 +1,487 @@
+#include "gmdh.h"
+
+// cross-validation from fold statistics. the rows are cut into contiguous
+// segments and the sufficient statistics of each segment are gathered in
+// one pass; the training statistics of every fold are then sums and
+// differences of those, and every fold's validation error follows from
+// its validation statistics in closed form. leave one out needs no folds
+// at all: the prediction residual sum of squares (press) rescales each
+// residual of the full fit by its leverage, 1 / (1 - h_ii)
+
+// leverages this close to 1 mean a row decides its own fit, and its left
+// out residual is unbounded
+#define CV_LEVERAGE_MAX (1 - 1e-10)
+
+// cut n_rows rows into the segments of a scheme: segment s is rows
+// [bounds[s], bounds[s + 1]). k-fold gives its k folds; rolling origin
+// gives the first training window and then its validation windows;
+// leave one out gives none. bounds holds cv->k + 2 entries. returns the
+// number of segments
+int cv_segments(const gmdh_cv_t *cv, int n_rows, int *bounds) {
+    int k = cv->k;
+    switch (cv->kind) {
+    case GMDH_CV_KFOLD:
+        if (k > n_rows) k = n_rows;
+        if (k < 2) return 0;
+        for (int f = 0; f <= k; f++) {
+            bounds[f] = (int)((int64_t)n_rows * f / k);
+        }
+        return k;
+    case GMDH_CV_ROLLING: {
+        int w = cv->min_train > 0 ? cv->min_train : n_rows / 2;
+        if (w > n_rows - 1) w = n_rows - 1;
+        if (k > n_rows - w) k = n_rows - w;
+        if (w < 1 || k < 1) return 0;
+        bounds[0] = 0;
+        for (int f = 0; f <= k; f++) {
+            bounds[f + 1] = w + (int)((int64_t)(n_rows - w) * f / k);
+        }
+        return k + 1;
+    }
+    default:
+        return 0;
+    }
+}
+
+const char* cv_describe(const gmdh_cv_t *cv, char *buf, size_t size) {
+    switch (cv->kind) {
+    case GMDH_CV_KFOLD:
+        snprintf(buf, size, "%d-fold cross-validation", cv->k);
+        break;
+    case GMDH_CV_ROLLING:
+        snprintf(buf, size, "rolling-origin validation over %d windows", cv->k);
+        break;
+    default:
+        snprintf(buf, size, "leave-one-out cross-validation");
+    }
+    return buf;
+}
+
+// rmse and r² over every validation row: sse pooled over the folds, and
+// the total sum of squares from the pooled n, sum y and sum y²
+static void cv_finish(double sse, double n, double sy, double syy, double *rmse, double *r2) {
+    double sst = syy - sy * sy / n;
+    *rmse = n > 0 ? sqrt(sse / n) : INFINITY;
+    *r2 = 1.0 - sse / sst;
+}
+
+// inverse of the n x n normal matrix a, column by column
+static void invert_normal(const double *a, double *inv, int n) {
+    double e[n];
+    double col[n];
+    for (int c = 0; c < n; c++) {
+        for (int r = 0; r < n; r++) {
+            e[r] = r == c;
+        }
+        solve_info_t info;
+        solve_normal(a, e, col, n, &info);
+        for (int r = 0; r < n; r++) {
+            inv[(size_t)r * n + c] = col[r];
+        }
+    }
+}
+
+// x' inv x for a row of a symmetric n x n inverse: the row's leverage
+static double leverage(const double *inv, const double *x, int n) {
+    double h = 0;
+    for (int r = 0; r < n; r++) {
+        double t = 0;
+        for (int c = 0; c < n; c++) {
+            t += inv[(size_t)r * n + c] * x[c];
+        }
+        h += x[r] * t;
+    }
+    return h;
+}
+
+// pair statistics for cv over ds: per segment, in one pass over the rows
+// however many folds there are, then combined into the training
+// statistics of every fold
+pair_folds_t* pair_folds_compute(dataset_t *ds, const gmdh_cv_t *cv) {
+    int m = ds->n_features;
+    pair_folds_t *pf = gmdh_calloc(1, sizeof(pair_folds_t));
+    pf->cv = *cv;
+    pf->ds = ds;
+
+    int bounds[(cv->k > 0 ? cv->k : 0) + 2];
+    int n_seg = cv_segments(cv, ds->n_samples, bounds);
+    if (n_seg == 0) {
+        pf->total = gram_stats_compute(ds);
+        return pf;
+    }
+
+    double **cols = gmdh_alloc((m + 1) * sizeof(double*));
+    dataset_t part;
+    gram_stats_t **seg = gmdh_alloc(n_seg * sizeof(gram_stats_t*));
+    pf->total = gram_stats_create(m);
+    for (int s = 0; s < n_seg; s++) {
+        seg[s] = gram_stats_create(m);
+        dataset_slice(ds, bounds[s], bounds[s + 1] - bounds[s], &part, cols);
+        gram_stats_accumulate(seg[s], &part);
+        gram_stats_combine(pf->total, pf->total, seg[s], 1);
+    }
+    gmdh_free(cols);
+
+    if (cv->kind == GMDH_CV_KFOLD) {
+        // train on everything but the fold: the total less the fold
+        pf->n_folds = n_seg;
+        pf->train = gmdh_alloc(n_seg * sizeof(gram_stats_t*));
+        pf->valid = seg;
+        for (int f = 0; f < n_seg; f++) {
+            pf->train[f] = gram_stats_create(m);
+            gram_stats_combine(pf->train[f], pf->total, seg[f], -1);
+        }
+    } else {
+        // train on everything before the window: a running sum
+        pf->n_folds = n_seg - 1;
+        pf->train = gmdh_alloc(pf->n_folds * sizeof(gram_stats_t*));
+        pf->valid = gmdh_alloc(pf->n_folds * sizeof(gram_stats_t*));
+        for (int f = 0; f < pf->n_folds; f++) {
+            pf->valid[f] = seg[f + 1];
+            if (f == 0) {
+                pf->train[f] = seg[0];
+            } else {
+                pf->train[f] = gram_stats_create(m);
+                gram_stats_combine(pf->train[f], pf->train[f - 1], seg[f], 1);
+            }
+        }
+        gmdh_free(seg);
+    }
+    return pf;
+}
+
+// leave-one-out error of the neuron fitted on every row: each residual
+// over 1 - its leverage under the full fit's normal matrix
+static void press_pair(const pair_folds_t *pf, const quad_moments_t *mom,
+                       polynomial_model_t *model) {
+    dataset_t *ds = pf->ds;
+    const double *xa = ds->cols[model->feature1], *xb = ds->cols[model->feature2];
+    double XtX[36], Xty[6], inv[36], row[6];
+    quadratic_normal_equations(mom, XtX, Xty);
+    invert_normal(XtX, inv, 6);
+
+    double press = 0, n = 0, sy = 0, syy = 0;
+    for (int r = 0; r < ds->n_samples; r++) {
+        double a = xa[r], b = xb[r], t = ds->target[r];
+        if (isnan(a) || isnan(b) || isnan(t)) continue;
+        row[0] = 1; row[1] = a; row[2] = b;
+        row[3] = a * a; row[4] = b * b; row[5] = a * b;
+        double h = leverage(inv, row, 6);
+        double e = t - predict_polynomial(a, b, model->coeffs);
+        double d = h < CV_LEVERAGE_MAX ? e / (1 - h) : INFINITY;
+        press += d * d;
+        n += 1;
+        sy += t;
+        syy += t * t;
+    }
+    cv_finish(press, n, sy, syy, &model->error, &model->r2);
+}
+
+// fit pair (i, j) on every row and score it by the scheme of pf
+void cv_score_pair(const pair_folds_t *pf, int i, int j, polynomial_model_t *model) {
+    quad_moments_t mom;
+    gram_pair_moments(pf->total, i, j, &mom);
+    model->feature1 = i;
+    model->feature2 = j;
+    model->cond = fit_quadratic_moments(&mom, model->coeffs);
+
+    if (pf->n_folds == 0) {
+        press_pair(pf, &mom, model);
+        return;
+    }
+
+    double sse = 0, n = 0, sy = 0, syy = 0;
+    for (int f = 0; f < pf->n_folds; f++) {
+        double b[6];
+        gram_pair_moments(pf->train[f], i, j, &mom);
+        fit_quadratic_moments(&mom, b);
+        gram_pair_moments(pf->valid[f], i, j, &mom);
+        sse += sse_quadratic_moments(&mom, b);
+        n += mom.n;
+        sy += mom.y;
+        syy += mom.yy;
+    }
+    cv_finish(sse, n, sy, syy, &model->error, &model->r2);
+}
+
+void free_pair_folds(pair_folds_t *pf) {
+    if (!pf) return;
+    for (int f = 0; f < pf->n_folds; f++) {
+        free_gram_stats(pf->train[f]);
+        free_gram_stats(pf->valid[f]);
+    }
+    gmdh_free(pf->train);
+    gmdh_free(pf->valid);
+    free_gram_stats(pf->total);
+    gmdh_free(pf);
+}
+
+// linear grams for cv over ds, laid out like pair_folds_compute's
+linear_folds_t* linear_folds_compute(dataset_t *ds, const gmdh_cv_t *cv) {
+    int m = ds->n_features;
+    linear_folds_t *lf = gmdh_calloc(1, sizeof(linear_folds_t));
+    lf->cv = *cv;
+    lf->ds = ds;
+    lf->masks = column_masks_build(ds);
+
+    int bounds[(cv->k > 0 ? cv->k : 0) + 2];
+    int n_seg = cv_segments(cv, ds->n_samples, bounds);
+    if (n_seg == 0) {
+        lf->total = linear_gram_compute(ds);
+        return lf;
+    }
+
+    double **cols = gmdh_alloc((m + 1) * sizeof(double*));
+    dataset_t part;
+    linear_gram_t **seg = gmdh_alloc(n_seg * sizeof(linear_gram_t*));
+    lf->total = linear_gram_create(m);
+    for (int s = 0; s < n_seg; s++) {
+        seg[s] = linear_gram_create(m);
+        dataset_slice(ds, bounds[s], bounds[s + 1] - bounds[s], &part, cols);
+        linear_gram_accumulate(seg[s], &part);
+        linear_gram_combine(lf->total, lf->total, seg[s], 1);
+    }
+    gmdh_free(cols);
+
+    if (cv->kind == GMDH_CV_KFOLD) {
+        lf->n_folds = n_seg;
+        lf->train = gmdh_alloc(n_seg * sizeof(linear_gram_t*));
+        lf->valid = seg;
+        for (int f = 0; f < n_seg; f++) {
+            lf->train[f] = linear_gram_create(m);
+            linear_gram_combine(lf->train[f], lf->total, seg[f], -1);
+        }
+    } else {
+        lf->n_folds = n_seg - 1;
+        lf->train = gmdh_alloc(lf->n_folds * sizeof(linear_gram_t*));
+        lf->valid = gmdh_alloc(lf->n_folds * sizeof(linear_gram_t*));
+        for (int f = 0; f < lf->n_folds; f++) {
+            lf->valid[f] = seg[f + 1];
+            if (f == 0) {
+                lf->train[f] = seg[0];
+            } else {
+                lf->train[f] = linear_gram_create(m);
+                linear_gram_combine(lf->train[f], lf->train[f - 1], seg[f], 1);
+            }
+        }
+        gmdh_free(seg);
+    }
+    return lf;
+}
+
+// leave-one-out error of the subset fitted on every row, as press_pair,
+// under the subset's normal matrix a
+static void press_subset(const linear_folds_t *lf, linear_model_t *model, const double *a) {
+    dataset_t *ds = lf->ds;
+    int k = model->n_features;
+    int n_coeffs = k + 1;
+    const int *features = model->feature_indices;
+    double inv[(size_t)n_coeffs * n_coeffs];
+    double row[n_coeffs];
+    invert_normal(a, inv, n_coeffs);
+
+    double press = 0, n = 0, sy = 0, syy = 0;
+    for (int r = 0; r < ds->n_samples; r++) {
+        double t = ds->target[r];
+        if (isnan(t)) continue;
+        row[0] = 1;
+        double pred = model->coeffs[0];
+        int present = 1;
+        for (int j = 0; j < k; j++) {
+            row[j + 1] = ds->cols[features[j]][r];
+            present &= !isnan(row[j + 1]);
+            pred += model->coeffs[j + 1] * row[j + 1];
+        }
+        if (!present) continue;
+        double h = leverage(inv, row, n_coeffs);
+        double d = h < CV_LEVERAGE_MAX ? (t - pred) / (1 - h) : INFINITY;
+        press += d * d;
+        n += 1;
+        sy += t;
+        syy += t * t;
+    }
+    cv_finish(press, n, sy, syy, &model->error, &model->r2);
+}
+
+// a subset over columns with gaps has nan sums in the grams. it is fitted
+// listwise instead, on the rows where all of its columns and the target
+// are present, from sums of its own normal equations per segment: n x n
+// x'x, then x'y, then y'y, with n = k + 1 and the intercept first, so
+// the count of rows is the first entry and their sum of y the first of
+// x'y, as in a gram
+#define SUMS_LEN(n) ((size_t)(n) * (n) + (n) + 1)
+
+// add the rows of [begin, end) set in rows to the subset's sums
+static void subset_sums_rows(const dataset_t *ds, const int *features, int k,
+                             const uint64_t *rows, int begin, int end, double *sums) {
+    int n = k + 1;
+    double *a = sums, *c = sums + (size_t)n * n, *yy = c + n;
+    double x[n];
+    x[0] = 1;
+    for (int r = begin; r < end; r++) {
+        if (!(rows[r / MASK_BITS] >> (r % MASK_BITS) & 1)) continue;
+        for (int j = 0; j < k; j++) {
+            x[j + 1] = ds->cols[features[j]][r];
+        }
+        double y = ds->target[r];
+        for (int p = 0; p < n; p++) {
+            for (int q = 0; q < n; q++) {
+                a[(size_t)p * n + q] += x[p] * x[q];
+            }
+            c[p] += x[p] * y;
+        }
+        *yy += y * y;
+    }
+}
+
+static void subset_sums_combine(double *dst, const double *a, const double *b, double sign,
+                                int n) {
+    for (size_t i = 0; i < SUMS_LEN(n); i++) {
+        dst[i] = a[i] + sign * b[i];
+    }
+}
+
+// least squares fit from a subset's sums; zero coefficients when rank
+// deficient, as linear_gram_fit. returns the condition estimate
+static double subset_sums_fit(const double *sums, int n, double *coeffs) {
+    solve_info_t info;
+    if (!solve_normal(sums, sums + (size_t)n * n, coeffs, n, &info)) {
+        for (int j = 0; j < n; j++) {
+            coeffs[j] = 0;
+        }
+    }
+    return info.cond;
+}
+
+// residual sum of squares of coeffs over the rows behind sums, as
+// linear_gram_sse
+static double subset_sums_sse(const double *sums, int n, const double *coeffs) {
+    const double *a = sums, *c = sums + (size_t)n * n;
+    double sse = c[n];
+    for (int p = 0; p < n; p++) {
+        double quad = 0;
+        for (int q = 0; q < n; q++) {
+            quad += a[(size_t)p * n + q] * coeffs[q];
+        }
+        sse += coeffs[p] * (quad - 2 * c[p]);
+    }
+    return sse < 0 ? 0 : sse;
+}
+
+// cv_score_subset for a subset over columns with gaps: one pass over the
+// subset's complete rows sums every segment, and the folds' training sums
+// are combined from those as the fold grams are
+static void cv_score_subset_rows(const linear_folds_t *lf, linear_model_t *model) {
+    dataset_t *ds = lf->ds;
+    const column_masks_t *cm = lf->masks;
+    int k = model->n_features;
+    int n = k + 1;
+    const int *features = model->feature_indices;
+
+    uint64_t *rows = gmdh_alloc((cm->n_words + 1) * sizeof(uint64_t));
+    memcpy(rows, column_mask(cm, ds->n_features), cm->n_words * sizeof(uint64_t));
+    for (int j = 0; j < k; j++) {
+        const uint64_t *bits = column_mask(cm, features[j]);
+        for (int w = 0; w < cm->n_words; w++) {
+            rows[w] &= bits[w];
+        }
+    }
+
+    int bounds[(lf->cv.k > 0 ? lf->cv.k : 0) + 2];
+    int n_seg = cv_segments(&lf->cv, ds->n_samples, bounds);
+    if (n_seg == 0) {
+        bounds[0] = 0;
+        bounds[1] = ds->n_samples;
+    }
+    size_t len = SUMS_LEN(n);
+    int n_sums = n_seg > 0 ? n_seg : 1;
+    // a sum per segment, then the total and a fold's training sums
+    double *seg = gmdh_calloc((n_sums + 2) * len, sizeof(double));
+    double *total = seg + n_sums * len, *train = total + len;
+    for (int s = 0; s < n_sums; s++) {
+        subset_sums_rows(ds, features, k, rows, bounds[s], bounds[s + 1], seg + s * len);
+        subset_sums_combine(total, total, seg + s * len, 1, n);
+    }
+    gmdh_free(rows);
+    model->cond = subset_sums_fit(total, n, model->coeffs);
+
+    if (n_seg == 0) {
+        press_subset(lf, model, total);
+        gmdh_free(seg);
+        return;
+    }
+
+    double sse = 0, rows_n = 0, sy = 0, syy = 0;
+    double b[n];
+    for (int f = 0; f < lf->n_folds; f++) {
+        const double *v;
+        if (lf->cv.kind == GMDH_CV_KFOLD) {
+            // everything but the fold
+            v = seg + f * len;
+            subset_sums_combine(train, total, v, -1, n);
+        } else if (f == 0) {
+            // everything before the window, a running sum
+            v = seg + len;
+            memcpy(train, seg, len * sizeof(double));
+        } else {
+            v = seg + (f + 1) * len;
+            subset_sums_combine(train, train, seg + f * len, 1, n);
+        }
+        subset_sums_fit(train, n, b);
+        sse += subset_sums_sse(v, n, b);
+        rows_n += v[0];
+        sy += v[(size_t)n * n];
+        syy += v[len - 1];
+    }
+    cv_finish(sse, rows_n, sy, syy, &model->error, &model->r2);
+    gmdh_free(seg);
+}
+
+// fit the candidate's subset on every row and score it by the scheme of lf
+void cv_score_subset(const linear_folds_t *lf, linear_model_t *model) {
+    int k = model->n_features;
+    const int *features = model->feature_indices;
+    int gaps = 0;
+    for (int j = 0; j < k; j++) {
+        gaps |= !lf->masks->complete[features[j]];
+    }
+    if (gaps) {
+        cv_score_subset_rows(lf, model);
+        return;
+    }
+    model->cond = linear_gram_fit(lf->total, features, k, model->coeffs);
+
+    if (lf->n_folds == 0) {
+        int n = k + 1;
+        double a[(size_t)n * n];
+        double c[n];
+        linear_gram_subset(lf->total, features, k, a, c);
+        press_subset(lf, model, a);
+        return;
+    }
+
+    double sse = 0, n = 0, sy = 0, syy = 0;
+    double b[k + 1];
+    for (int f = 0; f < lf->n_folds; f++) {
+        const linear_gram_t *v = lf->valid[f];
+        linear_gram_fit(lf->train[f], features, k, b);
+        sse += linear_gram_sse(v, features, k, b);
+        n += v->xtx[0];
+        sy += v->xty[0];
+        syy += v->yy;
+    }
+    cv_finish(sse, n, sy, syy, &model->error, &model->r2);
+}
+
+void free_linear_folds(linear_folds_t *lf) {
+    if (!lf) return;
+    for (int f = 0; f < lf->n_folds; f++) {
+        free_linear_gram(lf->train[f]);
+        free_linear_gram(lf->valid[f]);
+    }
+    gmdh_free(lf->train);
+    gmdh_free(lf->valid);
+    free_linear_gram(lf->total);
+    free_column_masks(lf->masks);
+    gmdh_free(lf);
+}
@@ -1,181 +1,652 @@
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "gmdh.h"
 
-dataset_t* load_csv(const char *filename, int target_col) {
-    FILE *fp = fopen(filename, "r");
-    if (!fp) {
-        fprintf(stderr, "failed to open %s\n", filename);
-        return NULL;
-    }
-    
+// doubles per column, padded so that every column starts 64-byte aligned
+static size_t column_stride(int n_samples) {
+    size_t per_line = ARENA_ALIGN / sizeof(double);
+    return ((size_t)n_samples + per_line - 1) / per_line * per_line;
+}
+
+// allocate a dataset with one contiguous, column-major block holding every
+// feature column followed by the target column. names start out NULL
+dataset_t* dataset_create(int n_samples, int n_features) {
+    size_t stride = column_stride(n_samples);
+    size_t block = (size_t)(n_features + 1) * stride * sizeof(double);
+
     dataset_t *ds = malloc(sizeof(dataset_t));
+    ds->arena = arena_create(block + (n_features + 1) * (sizeof(double*) + sizeof(char*)) + 4096);
+    PROF_ALLOC(block);
+    ds->n_samples = n_samples;
+    ds->n_features = n_features;
     ds->data = NULL;
-    ds->target = NULL;
-    ds->feature_names = NULL;
-    ds->n_samples = 0;
-    ds->n_features = 0;
-    
-    char line[MAX_LINE];
-    int line_num = 0;
-    int total_cols = 0;
-    
-    // first pass: count samples and features
-    while (fgets(line, MAX_LINE, fp)) {
-        if (line_num == 0) {
-            // count columns from header
-            char *token = strtok(line, ",\n");
-            while (token) {
-                total_cols++;
-                token = strtok(NULL, ",\n");
-            }
-            ds->n_features = total_cols - 1; // exclude target
-        } else {
-            ds->n_samples++;
-        }
-        line_num++;
+    ds->target_name = NULL;
+
+    double *values = arena_alloc(ds->arena, block);
+    ds->cols = arena_alloc(ds->arena, (n_features + 1) * sizeof(double*));
+    for (int f = 0; f < n_features; f++) {
+        ds->cols[f] = values + (size_t)f * stride;
+    }
+    ds->target = values + (size_t)n_features * stride;
+    ds->feature_names = arena_alloc(ds->arena, (n_features + 1) * sizeof(char*));
+
+    return ds;
+}
+
+// a window of `length` samples starting at `offset`, sharing the parent's
+// storage. the view keeps that storage alive after the parent is freed
+dataset_t* dataset_view(dataset_t *ds, int offset, int length) {
+    dataset_t *view = malloc(sizeof(dataset_t));
+    view->arena = ds->arena;
+    arena_retain(view->arena);
+    view->n_samples = length;
+    view->n_features = ds->n_features;
+    view->data = NULL;
+    view->feature_names = ds->feature_names;
+    view->target_name = ds->target_name;
+    view->target = ds->target + offset;
+    view->cols = arena_alloc(view->arena, (ds->n_features + 1) * sizeof(double*));
+    for (int f = 0; f < ds->n_features; f++) {
+        view->cols[f] = ds->cols[f] + offset;
     }
-    
-    // allocate memory
-    ds->data = malloc(ds->n_samples * sizeof(double*));
+    return view;
+}
+
+// like dataset_view, but into caller-owned storage: out and its cols
+// array (n_features entries). nothing is allocated, so a stream can slice
+// every block it reads
+void dataset_slice(dataset_t *ds, int offset, int length, dataset_t *out, double **cols) {
+    *out = *ds;
+    out->data = NULL;
+    out->n_samples = length;
+    out->target = ds->target + offset;
+    out->cols = cols;
+    for (int f = 0; f < ds->n_features; f++) {
+        cols[f] = ds->cols[f] + offset;
+    }
+}
+
+// view of ds over k of its features, features[0] becoming feature 0, into
+// caller-owned storage as dataset_slice: out and its cols and names arrays
+// (k entries each)
+void dataset_select_features(dataset_t *ds, const int *features, int k, dataset_t *out,
+                             double **cols, char **names) {
+    *out = *ds;
+    out->data = NULL;
+    out->n_features = k;
+    out->cols = cols;
+    out->feature_names = names;
+    for (int j = 0; j < k; j++) {
+        cols[j] = ds->cols[features[j]];
+        names[j] = ds->feature_names[features[j]];
+    }
+}
+
+// adapter for code written against the row-pointer layout: materialises
+// ds->data (row-major copies) on first use and returns it
+double** dataset_rows(dataset_t *ds) {
+    if (ds->data) return ds->data;
+
+    int m = ds->n_features;
+    double *rows = arena_alloc(ds->arena, ((size_t)ds->n_samples * m + 1) * sizeof(double));
+    ds->data = arena_alloc(ds->arena, (ds->n_samples + 1) * sizeof(double*));
     for (int i = 0; i < ds->n_samples; i++) {
-        ds->data[i] = malloc(ds->n_features * sizeof(double));
-    }
-    ds->target = malloc(ds->n_samples * sizeof(double));
-    ds->feature_names = malloc(ds->n_features * sizeof(char*));
-    
-    // second pass: read data
-    rewind(fp);
-    line_num = 0;
-    int sample_idx = 0;
-    
-    while (fgets(line, MAX_LINE, fp)) {
-        if (line_num == 0) {
-            // read feature names
-            char *token = strtok(line, ",\n");
-            int col = 0, feat_idx = 0;
-            while (token) {
-                if (col != target_col) {
-                    ds->feature_names[feat_idx] = malloc(256);
-                    strncpy(ds->feature_names[feat_idx], token, 255);
-                    feat_idx++;
-                }
-                col++;
-                token = strtok(NULL, ",\n");
-            }
-        } else {
-            // read data row
-            char *token = strtok(line, ",\n");
-            int col = 0, feat_idx = 0;
-            
-            while (token) {
-                if (col == target_col) {
-                    if (strcmp(token, "?") == 0) {
-                        ds->target[sample_idx] = NAN;
-                    } else {
-                        ds->target[sample_idx] = atof(token);
-                    }
-                } else {
-                    if (strcmp(token, "?") == 0) {
-                        ds->data[sample_idx][feat_idx] = NAN;
-                    } else {
-                        ds->data[sample_idx][feat_idx] = atof(token);
+        ds->data[i] = rows + (size_t)i * m;
+        for (int f = 0; f < m; f++) {
+            ds->data[i][f] = ds->cols[f][i];
+        }
+    }
+    return ds->data;
+}
+
+static char* arena_strndup(gmdh_arena_t *arena, const char *s, size_t len) {
+    char *copy = arena_alloc(arena, len + 1);
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+// input bytes per parser task. chunks are cut just after a newline
+#define CSV_CHUNK_BYTES (1 << 20)
+
+// powers of ten that are exact in a double
+static const double exact_pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static int is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static int span_is_blank(const char *p, const char *end) {
+    for (; p < end; p++) {
+        if (!is_space(*p)) return 0;
+    }
+    return 1;
+}
+
+// strtod on a field that is not nul-terminated
+static double parse_slow(const char *p, const char *end) {
+    char buf[128];
+    size_t len = end - p;
+    char *copy = len < sizeof(buf) ? buf : malloc(len + 1);
+    memcpy(copy, p, len);
+    copy[len] = '\0';
+    double v = strtod(copy, NULL);
+    if (copy != buf) free(copy);
+    return v;
+}
+
+// parse one field. empty fields and "?" are missing. plain decimals of up
+// to 15 significant digits with a small exponent take the exact fast path
+// (one multiply or divide by an exact power of ten, correctly rounded);
+// anything else goes through strtod, so values match atof bit for bit
+double csv_parse_field(const char *p, const char *end) {
+    while (p < end && is_space(*p)) p++;
+    while (end > p && is_space(end[-1])) end--;
+    if (p == end || (end - p == 1 && *p == '?')) return NAN;
+
+    const char *s = p;
+    int neg = 0;
+    if (*s == '-' || *s == '+') {
+        neg = *s == '-';
+        s++;
+    }
+
+    uint64_t mant = 0;
+    int digits = 0, scale = 0, seen = 0;
+    for (; s < end && *s >= '0' && *s <= '9'; s++, seen++) {
+        mant = mant * 10 + (*s - '0');
+        if (mant) digits++;
+    }
+    if (s < end && *s == '.') {
+        for (s++; s < end && *s >= '0' && *s <= '9'; s++, seen++) {
+            mant = mant * 10 + (*s - '0');
+            if (mant) digits++;
+            scale--;
+        }
+    }
+    if (!seen || digits > 15) return parse_slow(p, end);
+
+    if (s < end && (*s == 'e' || *s == 'E')) {
+        const char *e = s + 1;
+        int eneg = 0, exp = 0, edigits = 0;
+        if (e < end && (*e == '-' || *e == '+')) {
+            eneg = *e == '-';
+            e++;
+        }
+        for (; e < end && *e >= '0' && *e <= '9' && edigits < 6; e++, edigits++) {
+            exp = exp * 10 + (*e - '0');
+        }
+        if (!edigits) return parse_slow(p, end);
+        scale += eneg ? -exp : exp;
+        s = e;
+    }
+    if (s != end || scale < -22 || scale > 22) return parse_slow(p, end);
+
+    double v = (double)mant;
+    v = scale >= 0 ? v * exact_pow10[scale] : v / exact_pow10[-scale];
+    return neg ? -v : v;
+}
+
+// one newline-aligned slice of the input and the rows it holds
+typedef struct {
+    const char *begin;
+    const char *end;
+    int first_row;
+    int n_rows;
+} csv_chunk_t;
+
+typedef struct {
+    csv_chunk_t *chunks;
+    dataset_t *table;
+} csv_job_t;
+
+static void count_rows_worker(void *arg, int thread_id, long begin, long end) {
+    csv_job_t *job = arg;
+    (void)thread_id;
+
+    for (long c = begin; c < end; c++) {
+        csv_chunk_t *ch = &job->chunks[c];
+        const char *p = ch->begin;
+        int n = 0;
+        while (p < ch->end) {
+            const char *nl = memchr(p, '\n', ch->end - p);
+            const char *eol = nl ? nl : ch->end;
+            if (!span_is_blank(p, eol)) n++;
+            p = eol + 1;
+        }
+        ch->n_rows = n;
+    }
+}
+
+// split each line on commas and write the fields straight into their
+// columns. fields past the end of a short line stay missing
+static void parse_rows_worker(void *arg, int thread_id, long begin, long end) {
+    csv_job_t *job = arg;
+    dataset_t *table = job->table;
+    (void)thread_id;
+
+    for (long c = begin; c < end; c++) {
+        csv_chunk_t *ch = &job->chunks[c];
+        const char *p = ch->begin;
+        int row = ch->first_row;
+        while (p < ch->end) {
+            const char *nl = memchr(p, '\n', ch->end - p);
+            const char *eol = nl ? nl : ch->end;
+            if (!span_is_blank(p, eol)) {
+                int col = 0;
+                const char *field = p;
+                for (;;) {
+                    const char *comma = memchr(field, ',', eol - field);
+                    const char *field_end = comma ? comma : eol;
+                    if (col < table->n_features) {
+                        table->cols[col++][row] = csv_parse_field(field, field_end);
                     }
-                    feat_idx++;
+                    if (!comma) break;
+                    field = comma + 1;
+                }
+                for (; col < table->n_features; col++) {
+                    table->cols[col][row] = NAN;
                 }
-                col++;
-                token = strtok(NULL, ",\n");
+                row++;
             }
-            sample_idx++;
+            p = eol + 1;
         }
-        line_num++;
     }
-    
-    fclose(fp);
-    
-    // remove samples with missing target
-    int valid_count = 0;
-    for (int i = 0; i < ds->n_samples; i++) {
-        if (!isnan(ds->target[i])) {
-            if (i != valid_count) {
-                memcpy(ds->data[valid_count], ds->data[i], ds->n_features * sizeof(double));
-                ds->target[valid_count] = ds->target[i];
-            }
-            valid_count++;
+}
+
+static double elapsed_seconds(const struct timespec *t0) {
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return (t1.tv_sec - t0->tv_sec) + (t1.tv_nsec - t0->tv_nsec) * 1e-9;
+}
+
+// memory-map the file and parse it in newline-aligned chunks on the
+// thread pool: one pass counts each chunk's rows, a prefix sum gives
+// every chunk its first row, and a second pass parses into the columns.
+// returns every csv column as a feature, the target left unset
+static dataset_t* parse_csv(const char *filename, size_t *bytes) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "failed to open %s\n", filename);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        fprintf(stderr, "failed to read %s\n", filename);
+        close(fd);
+        return NULL;
+    }
+    size_t size = st.st_size;
+    const char *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "failed to map %s\n", filename);
+        return NULL;
+    }
+    const char *end = map + size;
+    *bytes = size;
+
+    // header: one field per column
+    const char *nl = memchr(map, '\n', size);
+    const char *header_end = nl ? nl : end;
+    int total_cols = 1;
+    for (const char *p = map; p < header_end; p++) {
+        if (*p == ',') total_cols++;
+    }
+
+    // cut the body into chunks ending just after a newline
+    const char *body = nl ? nl + 1 : end;
+    int n_chunks = (int)((end - body) / CSV_CHUNK_BYTES) + 1;
+    csv_chunk_t *chunks = malloc(n_chunks * sizeof(csv_chunk_t));
+    const char *p = body;
+    int used = 0;
+    for (int c = 0; c < n_chunks && p < end; c++) {
+        const char *cut = c == n_chunks - 1 ? end : body + (size_t)(c + 1) * CSV_CHUNK_BYTES;
+        if (cut < p) cut = p;
+        if (cut < end) {
+            const char *next = memchr(cut, '\n', end - cut);
+            cut = next ? next + 1 : end;
         }
+        chunks[used].begin = p;
+        chunks[used].end = cut;
+        used++;
+        p = cut;
+    }
+    n_chunks = used;
+
+    csv_job_t job;
+    job.chunks = chunks;
+    int n_threads = gmdh_thread_count();
+    parallel_for(n_chunks, 1, n_threads, count_rows_worker, &job);
+
+    int n_samples = 0;
+    for (int c = 0; c < n_chunks; c++) {
+        chunks[c].first_row = n_samples;
+        n_samples += chunks[c].n_rows;
+    }
+
+    dataset_t *table = dataset_create(n_samples, total_cols);
+    job.table = table;
+
+    // read column names
+    const char *field = map;
+    for (int col = 0; col < total_cols; col++) {
+        const char *comma = memchr(field, ',', header_end - field);
+        const char *field_end = comma ? comma : header_end;
+        const char *name_end = field_end;
+        while (name_end > field && is_space(name_end[-1])) name_end--;
+        table->feature_names[col] = arena_strndup(table->arena, field, name_end - field);
+        field = field_end + 1;
     }
-    ds->n_samples = valid_count;
-    
+
+    parallel_for(n_chunks, 1, n_threads, parse_rows_worker, &job);
+
+    munmap((void*)map, size);
+    free(chunks);
+    return table;
+}
+
+// copy src into dst, keeping only the rows set in the presence bitmap keep
+static void copy_present(const double *src, const uint64_t *keep, int n_rows, int n_present,
+                         double *dst) {
+    if (n_present == n_rows) {
+        memcpy(dst, src, n_rows * sizeof(double));
+        return;
+    }
+    mask_gather(src, keep, n_rows, dst);
+}
+
+// build a dataset from a table of n_cols columns with column target_col as
+// the target, dropping the rows where it is missing. every other column
+// becomes a feature, in table order. NULL if target_col is out of range
+dataset_t* dataset_select_target(double **cols, char **names, int n_cols, int n_rows,
+                                 int target_col) {
+    if (target_col < 0 || target_col >= n_cols) {
+        fprintf(stderr, "bad target column %d\n", target_col);
+        return NULL;
+    }
+    const double *y = cols[target_col];
+    uint64_t *keep = malloc((mask_words(n_rows) + 1) * sizeof(uint64_t));
+    mask_build(y, n_rows, keep);
+    int n = mask_count(keep, mask_words(n_rows));
+
+    dataset_t *ds = dataset_create(n, n_cols - 1);
+    int f = 0;
+    for (int c = 0; c < n_cols && f < ds->n_features; c++) {
+        if (c == target_col) continue;
+        copy_present(cols[c], keep, n_rows, n, ds->cols[f]);
+        ds->feature_names[f] = arena_strndup(ds->arena, names[c], strlen(names[c]));
+        f++;
+    }
+    copy_present(y, keep, n_rows, n, ds->target);
+    ds->target_name = arena_strndup(ds->arena, names[target_col], strlen(names[target_col]));
+    free(keep);
     return ds;
 }
 
-void free_dataset(dataset_t *ds) {
-    if (!ds) return;
-    
-    if (ds->data) {
-        for (int i = 0; i < ds->n_samples; i++) {
-            free(ds->data[i]);
+// several targets from a table of n_cols columns: the rows where every
+// target column is present, every other column a feature in table order.
+// NULL if a target column is out of range or repeated
+multi_dataset_t* multi_dataset_select(double **cols, char **names, int n_cols, int n_rows,
+                                      const int *target_cols, int n_targets) {
+    char *is_target = calloc(n_cols + 1, 1);
+    for (int t = 0; t < n_targets; t++) {
+        int c = target_cols[t];
+        if (c < 0 || c >= n_cols || is_target[c]) {
+            fprintf(stderr, "bad or repeated target column %d\n", c);
+            free(is_target);
+            return NULL;
+        }
+        is_target[c] = 1;
+    }
+    if (n_targets < 1) {
+        free(is_target);
+        return NULL;
+    }
+
+    // the rows every target has: the and of the targets' bitmaps
+    int n_words = mask_words(n_rows);
+    uint64_t *present = malloc((2 * (size_t)n_words + 1) * sizeof(uint64_t));
+    uint64_t *bits = present + n_words;
+    for (int t = 0; t < n_targets; t++) {
+        mask_build(cols[target_cols[t]], n_rows, t == 0 ? present : bits);
+        for (int w = 0; w < n_words && t > 0; w++) {
+            present[w] &= bits[w];
+        }
+    }
+    int n = mask_count(present, n_words);
+
+    multi_dataset_t *md = malloc(sizeof(multi_dataset_t));
+    dataset_t *ds = dataset_create(n, n_cols - n_targets);
+    md->features = ds;
+    md->n_targets = n_targets;
+    md->targets = arena_alloc(ds->arena, n_targets * sizeof(double*));
+    md->target_names = arena_alloc(ds->arena, n_targets * sizeof(char*));
+    int f = 0;
+    for (int c = 0; c < n_cols; c++) {
+        if (is_target[c]) continue;
+        copy_present(cols[c], present, n_rows, n, ds->cols[f]);
+        ds->feature_names[f] = arena_strndup(ds->arena, names[c], strlen(names[c]));
+        f++;
+    }
+    for (int t = 0; t < n_targets; t++) {
+        int c = target_cols[t];
+        md->targets[t] = t == 0 ? ds->target
+                       : arena_alloc(ds->arena, column_stride(n) * sizeof(double));
+        copy_present(cols[c], present, n_rows, n, md->targets[t]);
+        md->target_names[t] = arena_strndup(ds->arena, names[c], strlen(names[c]));
+    }
+    ds->target_name = md->target_names[0];
+
+    free(present);
+    free(is_target);
+    return md;
+}
+
+// parse a csv into a table of every column, keeping its binary copy
+// current when gmdh_options.csv_cache is set. t0 is when loading began
+static dataset_t* read_csv_table(const char *filename, const struct timespec *t0) {
+    size_t size = 0;
+    PROF_BEGIN(PROF_LOAD);
+    dataset_t *table = parse_csv(filename, &size);
+    PROF_END(PROF_LOAD);
+    if (!table) return NULL;
+    PROF_COUNT(PROF_BYTES_TOUCHED, size);
+
+    double secs = elapsed_seconds(t0);
+    if (secs <= 0) secs = 1e-9;
+    int n_rows = table->n_samples;
+    gmdh_log("loaded %s: %d rows, %.2f MB in %.3f s (%.0f rows/s, %.1f MB/s)\n",
+              filename, n_rows, size / 1e6, secs, n_rows / secs, size / 1e6 / secs);
+
+    if (gmdh_current_options()->csv_cache) {
+        csv_cache_store(filename, table);
+    }
+    return table;
+}
+
+// load a csv with column target_col as the target. with
+// gmdh_options.csv_cache set, a binary copy of every column is kept next
+// to the file and reused while the csv is unchanged
+dataset_t* load_csv(const char *filename, int target_col) {
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    if (gmdh_current_options()->csv_cache) {
+        dataset_t *ds = csv_cache_load(filename, target_col);
+        if (ds) {
+            gmdh_log("loaded %s from cache: %d samples in %.3f s\n",
+                      filename, ds->n_samples, elapsed_seconds(&t0));
+            return ds;
         }
-        free(ds->data);
-    }
-    
-    if (ds->target) free(ds->target);
-    
-    if (ds->feature_names) {
-        for (int i = 0; i < ds->n_features; i++) {
-            free(ds->feature_names[i]);
+    }
+
+    dataset_t *table = read_csv_table(filename, &t0);
+    if (!table) return NULL;
+    dataset_t *ds = dataset_select_target(table->cols, table->feature_names,
+                                          table->n_features, table->n_samples, target_col);
+    free_dataset(table);
+    return ds;
+}
+
+// load a csv with several target columns, as multi_dataset_select, from
+// the same cache as load_csv
+multi_dataset_t* load_csv_targets(const char *filename, const int *target_cols, int n_targets) {
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    if (gmdh_current_options()->csv_cache) {
+        multi_dataset_t *md = csv_cache_load_targets(filename, target_cols, n_targets);
+        if (md) {
+            gmdh_log("loaded %s from cache: %d samples in %.3f s\n",
+                      filename, md->features->n_samples, elapsed_seconds(&t0));
+            return md;
         }
-        free(ds->feature_names);
     }
-    
+
+    dataset_t *table = read_csv_table(filename, &t0);
+    if (!table) return NULL;
+    multi_dataset_t *md = multi_dataset_select(table->cols, table->feature_names,
+                                               table->n_features, table->n_samples,
+                                               target_cols, n_targets);
+    free_dataset(table);
+    return md;
+}
+
+void free_dataset(dataset_t *ds) {
+    if (!ds) return;
+    arena_release(ds->arena);
     free(ds);
 }
 
+// ordered split into views: no sample is copied
 void split_dataset(dataset_t *ds, dataset_t **train, dataset_t **test, double train_ratio) {
     int n_train = (int)(ds->n_samples * train_ratio);
     int n_test = ds->n_samples - n_train;
-    
-    *train = malloc(sizeof(dataset_t));
-    *test = malloc(sizeof(dataset_t));
-    
-    (*train)->n_samples = n_train;
-    (*train)->n_features = ds->n_features;
-    (*test)->n_samples = n_test;
-    (*test)->n_features = ds->n_features;
-    
-    // allocate train
-    (*train)->data = malloc(n_train * sizeof(double*));
-    for (int i = 0; i < n_train; i++) {
-        (*train)->data[i] = malloc(ds->n_features * sizeof(double));
-        memcpy((*train)->data[i], ds->data[i], ds->n_features * sizeof(double));
-    }
-    (*train)->target = malloc(n_train * sizeof(double));
-    memcpy((*train)->target, ds->target, n_train * sizeof(double));
-    
-    // allocate test
-    (*test)->data = malloc(n_test * sizeof(double*));
-    for (int i = 0; i < n_test; i++) {
-        (*test)->data[i] = malloc(ds->n_features * sizeof(double));
-        memcpy((*test)->data[i], ds->data[n_train + i], ds->n_features * sizeof(double));
-    }
-    (*test)->target = malloc(n_test * sizeof(double));
-    memcpy((*test)->target, ds->target + n_train, n_test * sizeof(double));
-    
-    // copy feature names
-    (*train)->feature_names = malloc(ds->n_features * sizeof(char*));
-    (*test)->feature_names = malloc(ds->n_features * sizeof(char*));
-    for (int i = 0; i < ds->n_features; i++) {
-        (*train)->feature_names[i] = malloc(256);
-        (*test)->feature_names[i] = malloc(256);
-        strcpy((*train)->feature_names[i], ds->feature_names[i]);
-        strcpy((*test)->feature_names[i], ds->feature_names[i]);
+
+    *train = dataset_view(ds, 0, n_train);
+    *test = dataset_view(ds, n_train, n_test);
+}
+
+static multi_dataset_t* multi_dataset_view(multi_dataset_t *md, int offset, int length) {
+    multi_dataset_t *view = malloc(sizeof(multi_dataset_t));
+    view->features = dataset_view(md->features, offset, length);
+    view->n_targets = md->n_targets;
+    view->target_names = md->target_names;
+    view->targets = arena_alloc(view->features->arena, md->n_targets * sizeof(double*));
+    for (int t = 0; t < md->n_targets; t++) {
+        view->targets[t] = md->targets[t] + offset;
+    }
+    return view;
+}
+
+// split_dataset for every target at once: the same cut, views again
+void split_multi_dataset(multi_dataset_t *md, multi_dataset_t **train, multi_dataset_t **test,
+                         double train_ratio) {
+    int n_train = (int)(md->features->n_samples * train_ratio);
+    *train = multi_dataset_view(md, 0, n_train);
+    *test = multi_dataset_view(md, n_train, md->features->n_samples - n_train);
+}
+
+// the dataset of target t: md's features with targets[t] as the target,
+// written to out, which borrows md's columns. nothing is allocated
+dataset_t* multi_dataset_target(const multi_dataset_t *md, int t, dataset_t *out) {
+    *out = *md->features;
+    out->data = NULL;
+    out->target = md->targets[t];
+    out->target_name = md->target_names[t];
+    return out;
+}
+
+void free_multi_dataset(multi_dataset_t *md) {
+    if (!md) return;
+    free_dataset(md->features);
+    free(md);
+}
+
+// float32 copy of every column and the target, in one block with the
+// same column stride rules as dataset_create. each column is centered and
+// scaled by its mean and standard deviation over the present rows, or by
+// like's when given, so validation rows share the training transform. the
+// target is only centered, so errors keep their units. nan stays nan
+dataset_f32_t* dataset_to_f32(const dataset_t *ds, const dataset_f32_t *like) {
+    int n = ds->n_samples, m = ds->n_features;
+    // pad columns to a cache line of floats
+    size_t stride = ((size_t)n + 15) & ~(size_t)15;
+
+    dataset_f32_t *f = gmdh_alloc(sizeof(dataset_f32_t));
+    f->n_samples = n;
+    f->n_features = m;
+    f->block = gmdh_alloc(((m + 1) * stride + 1) * sizeof(float));
+    f->cols = gmdh_alloc((m + 1) * sizeof(float*));
+    f->center = gmdh_alloc(2 * (m + 1) * sizeof(double));
+    f->scale = f->center + (m + 1);
+    PROF_ALLOC((m + 1) * stride * sizeof(float));
+    for (int c = 0; c <= m; c++) {
+        float *dst = f->block + (size_t)c * stride;
+        const double *src = c < m ? ds->cols[c] : ds->target;
+        if (like) {
+            f->center[c] = like->center[c];
+            f->scale[c] = like->scale[c];
+        } else {
+            double sum = 0, sum_sq = 0;
+            int used = 0;
+            for (int r = 0; r < n; r++) {
+                if (isnan(src[r])) continue;
+                sum += src[r];
+                used++;
+            }
+            f->center[c] = used > 0 ? sum / used : 0;
+            for (int r = 0; r < n; r++) {
+                if (isnan(src[r])) continue;
+                double d = src[r] - f->center[c];
+                sum_sq += d * d;
+            }
+            double sd = used > 0 ? sqrt(sum_sq / used) : 0;
+            f->scale[c] = c < m && sd > 0 ? sd : 1;
+        }
+        double center = f->center[c], inv_scale = 1.0 / f->scale[c];
+        for (int r = 0; r < n; r++) {
+            dst[r] = (float)((src[r] - center) * inv_scale);
+        }
+        if (c < m) f->cols[c] = dst;
+    }
+    f->target = f->block + (size_t)m * stride;
+    return f;
+}
+
+void free_dataset_f32(dataset_f32_t *ds) {
+    if (!ds) return;
+    gmdh_free(ds->block);
+    gmdh_free(ds->cols);
+    gmdh_free(ds->center);
+    gmdh_free(ds);
+}
+
+// mean of the present targets, 0 when there are none
+double dataset_target_mean(const dataset_t *ds) {
+    double sum = 0;
+    int n = 0;
+    for (int r = 0; r < ds->n_samples; r++) {
+        if (isnan(ds->target[r])) continue;
+        sum += ds->target[r];
+        n++;
     }
+    return n > 0 ? sum / n : 0;
 }
 
 void print_dataset_info(dataset_t *ds) {
-    printf("dataset: %d samples, %d features\n", ds->n_samples, ds->n_features);
-    printf("features: ");
+    gmdh_log("dataset: %d samples, %d features\n", ds->n_samples, ds->n_features);
+    gmdh_log("features: ");
     for (int i = 0; i < ds->n_features && i < 5; i++) {
-        printf("%s%s", ds->feature_names[i], i < 4 ? ", " : "");
+        gmdh_log("%s%s", ds->feature_names[i], i < 4 ? ", " : "");
     }
-    if (ds->n_features > 5) printf("...");
-    printf("\n");
+    if (ds->n_features > 5) gmdh_log("...");
+    gmdh_log("\n");
 }
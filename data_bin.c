@@ -0,0 +1,368 @@
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "gmdh.h"
+
+// binary dataset file: a bin_header_t followed by four sections, each
+// starting on a 64-byte boundary so the columns can be used straight from
+// the mapping:
+//   names    n_cols nul-terminated column names
+//   stats    n_cols column_stats_t
+//   present  n_cols bitmaps of bin_present_words() uint64, bit set = value present
+//   data     n_cols columns of `stride` doubles, the first n_rows in use
+
+// identity of the csv a cache file was built from
+typedef struct {
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint64_t size;
+    uint64_t hash;
+} source_stamp_t;
+
+// a mapped binary dataset file
+typedef struct {
+    const char *map;
+    size_t size;
+    const bin_header_t *hdr;
+    char **names;               // malloc'd array pointing into the mapping
+    double **cols;              // malloc'd array pointing into the mapping
+} bin_file_t;
+
+static uint64_t align_up(uint64_t x) {
+    return (x + ARENA_ALIGN - 1) & ~(uint64_t)(ARENA_ALIGN - 1);
+}
+
+uint64_t bin_present_words(uint64_t n_rows) {
+    return (n_rows + 63) / 64;
+}
+
+// 64-bit fnv-1a over 8-byte words, bytes for the tail
+static uint64_t hash_bytes(const char *p, size_t n) {
+    const uint64_t prime = 0x100000001b3ull;
+    uint64_t h = 0xcbf29ce484222325ull;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t w;
+        memcpy(&w, p + i, 8);
+        h = (h ^ w) * prime;
+    }
+    for (; i < n; i++) {
+        h = (h ^ (unsigned char)p[i]) * prime;
+    }
+    return h;
+}
+
+// mtime and size of a file; hash only when want_hash is set
+static int stamp_file(const char *path, int want_hash, source_stamp_t *stamp) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return 0;
+    }
+    stamp->mtime_sec = st.st_mtim.tv_sec;
+    stamp->mtime_nsec = st.st_mtim.tv_nsec;
+    stamp->size = st.st_size;
+    stamp->hash = 0;
+    if (want_hash && st.st_size > 0) {
+        const char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            close(fd);
+            return 0;
+        }
+        stamp->hash = hash_bytes(map, st.st_size);
+        munmap((void*)map, st.st_size);
+    }
+    close(fd);
+    return 1;
+}
+
+static void compute_stats(const double *x, uint64_t n_rows, uint64_t *present,
+                          column_stats_t *st) {
+    double sum = 0, lo = INFINITY, hi = -INFINITY;
+    int64_t count = 0;
+    mask_build(x, (int)n_rows, present);
+    for (uint64_t r = 0; r < n_rows; r++) {
+        if (isnan(x[r])) continue;
+        sum += x[r];
+        if (x[r] < lo) lo = x[r];
+        if (x[r] > hi) hi = x[r];
+        count++;
+    }
+    double mean = count > 0 ? sum / count : NAN;
+    double ss = 0;
+    for (uint64_t r = 0; r < n_rows; r++) {
+        if (!isnan(x[r])) ss += (x[r] - mean) * (x[r] - mean);
+    }
+    st->min = count > 0 ? lo : NAN;
+    st->max = count > 0 ? hi : NAN;
+    st->mean = mean;
+    st->std = count > 0 ? sqrt(ss / count) : NAN;
+    st->n_missing = (int64_t)n_rows - count;
+}
+
+static int write_padding(FILE *fp, uint64_t *pos, uint64_t to) {
+    static const char zeros[ARENA_ALIGN] = {0};
+    while (*pos < to) {
+        uint64_t n = to - *pos < ARENA_ALIGN ? to - *pos : ARENA_ALIGN;
+        if (fwrite(zeros, 1, n, fp) != n) return 0;
+        *pos += n;
+    }
+    return 1;
+}
+
+// write a table to `path` through a temporary file renamed into place, so
+// readers never see a partial file. returns 1 on success
+static int write_bin(const char *path, double **cols, char **names, int n_cols, int n_rows,
+                     int target_col, const source_stamp_t *stamp) {
+    bin_header_t h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, BIN_MAGIC, 8);
+    h.version = BIN_VERSION;
+    h.byte_order = BIN_BYTE_ORDER;
+    h.n_cols = n_cols;
+    h.target_col = target_col;
+    h.n_rows = n_rows;
+    h.stride = align_up((uint64_t)n_rows * sizeof(double)) / sizeof(double);
+    if (stamp) {
+        h.src_mtime_sec = stamp->mtime_sec;
+        h.src_mtime_nsec = stamp->mtime_nsec;
+        h.src_size = stamp->size;
+        h.src_hash = stamp->hash;
+    }
+
+    uint64_t names_bytes = 0;
+    for (int c = 0; c < n_cols; c++) {
+        names_bytes += strlen(names[c]) + 1;
+    }
+    uint64_t words = bin_present_words(n_rows);
+    h.names_offset = align_up(sizeof(bin_header_t));
+    h.stats_offset = align_up(h.names_offset + names_bytes);
+    h.present_offset = align_up(h.stats_offset + n_cols * sizeof(column_stats_t));
+    h.data_offset = align_up(h.present_offset + n_cols * words * sizeof(uint64_t));
+    h.file_size = h.data_offset + (uint64_t)n_cols * h.stride * sizeof(double);
+
+    column_stats_t *stats = calloc(n_cols + 1, sizeof(column_stats_t));
+    uint64_t *present = calloc((size_t)n_cols * words + 1, sizeof(uint64_t));
+    for (int c = 0; c < n_cols; c++) {
+        compute_stats(cols[c], n_rows, present + (size_t)c * words, &stats[c]);
+    }
+
+    size_t tmp_len = strlen(path) + 32;
+    char *tmp = malloc(tmp_len);
+    snprintf(tmp, tmp_len, "%s.%ld.tmp", path, (long)getpid());
+
+    int ok = 0;
+    FILE *fp = fopen(tmp, "wb");
+    if (fp) {
+        uint64_t pos = 0;
+        ok = fwrite(&h, sizeof(h), 1, fp) == 1;
+        pos += sizeof(h);
+        ok = ok && write_padding(fp, &pos, h.names_offset);
+        for (int c = 0; ok && c < n_cols; c++) {
+            size_t len = strlen(names[c]) + 1;
+            ok = fwrite(names[c], 1, len, fp) == len;
+            pos += len;
+        }
+        ok = ok && write_padding(fp, &pos, h.stats_offset);
+        ok = ok && fwrite(stats, sizeof(column_stats_t), n_cols, fp) == (size_t)n_cols;
+        pos += n_cols * sizeof(column_stats_t);
+        ok = ok && write_padding(fp, &pos, h.present_offset);
+        ok = ok && fwrite(present, sizeof(uint64_t), (size_t)n_cols * words, fp)
+                   == (size_t)n_cols * words;
+        pos += (uint64_t)n_cols * words * sizeof(uint64_t);
+        for (int c = 0; ok && c < n_cols; c++) {
+            ok = write_padding(fp, &pos, h.data_offset + (uint64_t)c * h.stride * sizeof(double));
+            ok = ok && fwrite(cols[c], sizeof(double), n_rows, fp) == (size_t)n_rows;
+            pos += (uint64_t)n_rows * sizeof(double);
+        }
+        ok = ok && write_padding(fp, &pos, h.file_size);
+        ok = (fclose(fp) == 0) && ok;
+        ok = ok && rename(tmp, path) == 0;
+        if (!ok) remove(tmp);
+    }
+
+    free(tmp);
+    free(stats);
+    free(present);
+    return ok;
+}
+
+// map a binary dataset file and check that its sections fit. returns 0,
+// quietly, for a missing or foreign file
+static int open_bin(const char *path, bin_file_t *bf) {
+    memset(bf, 0, sizeof(*bf));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(bin_header_t)) {
+        close(fd);
+        return 0;
+    }
+    const char *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return 0;
+
+    const bin_header_t *h = (const bin_header_t*)map;
+    uint64_t words = bin_present_words(h->n_rows);
+    int ok = memcmp(h->magic, BIN_MAGIC, 8) == 0 && h->version == BIN_VERSION &&
+             h->byte_order == BIN_BYTE_ORDER && h->file_size == (uint64_t)st.st_size &&
+             h->n_cols > 0 && h->n_rows <= INT_MAX && h->stride >= h->n_rows &&
+             h->names_offset < h->stats_offset &&
+             h->stats_offset + h->n_cols * sizeof(column_stats_t) <= h->present_offset &&
+             h->present_offset + h->n_cols * words * sizeof(uint64_t) <= h->data_offset &&
+             h->data_offset + h->n_cols * h->stride * sizeof(double) <= h->file_size &&
+             h->data_offset % ARENA_ALIGN == 0;
+    if (!ok) {
+        munmap((void*)map, st.st_size);
+        return 0;
+    }
+
+    bf->map = map;
+    bf->size = st.st_size;
+    bf->hdr = h;
+    bf->names = malloc(h->n_cols * sizeof(char*));
+    bf->cols = malloc(h->n_cols * sizeof(double*));
+    const char *name = map + h->names_offset;
+    const char *names_end = map + h->stats_offset;
+    for (int c = 0; c < h->n_cols; c++) {
+        const char *nul = memchr(name, '\0', names_end - name);
+        if (!nul) {
+            free(bf->names);
+            free(bf->cols);
+            munmap((void*)map, st.st_size);
+            return 0;
+        }
+        bf->names[c] = (char*)name;
+        bf->cols[c] = (double*)(map + h->data_offset + c * h->stride * sizeof(double));
+        name = nul + 1;
+    }
+    return 1;
+}
+
+static void close_bin(bin_file_t *bf) {
+    free(bf->names);
+    free(bf->cols);
+    munmap((void*)bf->map, bf->size);
+}
+
+// save every feature column and the target to `path`. returns 1 on success
+int save_dataset_bin(dataset_t *ds, const char *path) {
+    int n_cols = ds->n_features + 1;
+    double **cols = malloc(n_cols * sizeof(double*));
+    char **names = malloc(n_cols * sizeof(char*));
+    for (int f = 0; f < ds->n_features; f++) {
+        cols[f] = ds->cols[f];
+        names[f] = ds->feature_names[f] ? ds->feature_names[f] : "";
+    }
+    cols[ds->n_features] = ds->target;
+    names[ds->n_features] = ds->target_name ? ds->target_name : "target";
+
+    int ok = write_bin(path, cols, names, n_cols, ds->n_samples, ds->n_features, NULL);
+    free(cols);
+    free(names);
+    return ok;
+}
+
+// load a binary dataset file with column target_col as the target, or the
+// column it was saved with when target_col is negative
+dataset_t* load_dataset_bin(const char *path, int target_col) {
+    bin_file_t bf;
+    if (!open_bin(path, &bf)) {
+        fprintf(stderr, "failed to read binary dataset %s\n", path);
+        return NULL;
+    }
+    if (target_col < 0) target_col = bf.hdr->target_col;
+    dataset_t *ds = dataset_select_target(bf.cols, bf.names, bf.hdr->n_cols,
+                                          (int)bf.hdr->n_rows, target_col);
+    close_bin(&bf);
+    return ds;
+}
+
+// the per-column summaries stored in a binary dataset file; free() the
+// result
+column_stats_t* dataset_bin_stats(const char *path, int *n_cols) {
+    bin_file_t bf;
+    if (!open_bin(path, &bf)) return NULL;
+    *n_cols = bf.hdr->n_cols;
+    column_stats_t *stats = malloc(bf.hdr->n_cols * sizeof(column_stats_t));
+    memcpy(stats, bf.map + bf.hdr->stats_offset, bf.hdr->n_cols * sizeof(column_stats_t));
+    close_bin(&bf);
+    return stats;
+}
+
+static char* cache_path(const char *csv_path) {
+    size_t len = strlen(csv_path);
+    char *path = malloc(len + 5);
+    memcpy(path, csv_path, len);
+    memcpy(path + len, ".bin", 5);
+    return path;
+}
+
+// map the cache next to csv_path into bf, returning 0 if there is none
+// or it is stale. matching mtime and size are trusted as is; otherwise the
+// csv is hashed, and a cache whose hash still matches (a touched but
+// unchanged file) is kept and restamped
+static int open_cache(const char *csv_path, bin_file_t *bf) {
+    char *path = cache_path(csv_path);
+    source_stamp_t now;
+    if (!stamp_file(csv_path, 0, &now) || !open_bin(path, bf)) {
+        free(path);
+        return 0;
+    }
+
+    const bin_header_t *h = bf->hdr;
+    int fresh = h->src_size == now.size && h->src_mtime_sec == now.mtime_sec &&
+                h->src_mtime_nsec == now.mtime_nsec;
+    if (!fresh && h->src_size == now.size && stamp_file(csv_path, 1, &now) &&
+        h->src_hash == now.hash) {
+        fresh = 1;
+        bin_header_t updated = *h;
+        updated.src_mtime_sec = now.mtime_sec;
+        updated.src_mtime_nsec = now.mtime_nsec;
+        FILE *fp = fopen(path, "r+b");
+        if (fp) {
+            fwrite(&updated, sizeof(updated), 1, fp);
+            fclose(fp);
+        }
+    }
+    free(path);
+    if (!fresh) close_bin(bf);
+    return fresh;
+}
+
+// the dataset from the cache next to csv_path, or NULL if there is none
+// or it is stale
+dataset_t* csv_cache_load(const char *csv_path, int target_col) {
+    bin_file_t bf;
+    if (!open_cache(csv_path, &bf)) return NULL;
+    dataset_t *ds = dataset_select_target(bf.cols, bf.names, bf.hdr->n_cols,
+                                          (int)bf.hdr->n_rows, target_col);
+    close_bin(&bf);
+    return ds;
+}
+
+// csv_cache_load for several targets (see multi_dataset_select)
+multi_dataset_t* csv_cache_load_targets(const char *csv_path, const int *target_cols,
+                                        int n_targets) {
+    bin_file_t bf;
+    if (!open_cache(csv_path, &bf)) return NULL;
+    multi_dataset_t *md = multi_dataset_select(bf.cols, bf.names, bf.hdr->n_cols,
+                                               (int)bf.hdr->n_rows, target_cols, n_targets);
+    close_bin(&bf);
+    return md;
+}
+
+// write every column of a freshly parsed csv (table->cols, all of them,
+// target included) to the cache next to it. failures only cost the cache
+void csv_cache_store(const char *csv_path, dataset_t *table) {
+    source_stamp_t stamp;
+    if (!stamp_file(csv_path, 1, &stamp)) return;
+    char *path = cache_path(csv_path);
+    write_bin(path, table->cols, table->feature_names, table->n_features,
+              table->n_samples, -1, &stamp);
+    free(path);
+}
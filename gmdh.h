@@ -6,25 +6,81 @@
 #include <string.h>
 #include <math.h>
 #include <time.h>
+#include <stdint.h>
+#include <limits.h>
 
 #define MAX_FEATURES 64
-#define MAX_SAMPLES 2048
-#define MAX_LINE 8192
 
+#define ARENA_ALIGN 64
+
+typedef struct arena_block {
+    struct arena_block *next;
+    size_t size;
+    size_t used;
+} arena_block_t;
+
+// bump allocator owning a dataset's storage. allocations are 64-byte
+// aligned and freed together when the last reference is released
+typedef struct {
+    arena_block_t *head;
+    size_t block_size;
+    int refs;
+} gmdh_arena_t;
+
+// column-major dataset: cols[f] is feature f's contiguous column and
+// target is one more column of the same block. views made by split_dataset
+// point into their parent's columns and share its arena
 typedef struct {
-    double **data;
+    double **data;          // row pointers, NULL until dataset_rows() builds them
     double *target;
     int n_samples;
     int n_features;
     char **feature_names;
+    char *target_name;      // NULL when unknown
+    double **cols;
+    gmdh_arena_t *arena;
 } dataset_t;
 
+// several targets over one set of feature columns, as load_csv_targets
+// gives them. features is an ordinary dataset whose target is
+// targets[0]; rows missing any target are dropped, so every target covers
+// the same rows and one set of feature statistics serves them all
+typedef struct {
+    dataset_t *features;
+    int n_targets;
+    double **targets;       // n_targets columns parallel to the features
+    char **target_names;
+} multi_dataset_t;
+
+// rows per word of a presence bitmap (mask.c)
+#define MASK_BITS 64
+
+// presence bitmaps of a dataset's columns: the features, then the target
+// at index n_features
+typedef struct {
+    int n_rows;
+    int n_words;        // per column, mask_words(n_rows)
+    int n_cols;
+    uint64_t *bits;     // column c's words start at c * n_words
+    char *complete;     // per column: no row is missing
+} column_masks_t;
+
+// summary of one column of a binary dataset file, over its present values
+typedef struct {
+    double min;
+    double max;
+    double mean;
+    double std;
+    int64_t n_missing;
+} column_stats_t;
+
 typedef struct {
     double coeffs[6];
     int feature1;
     int feature2;
     double error;
     double r2;
+    double cond;        // condition estimate of the fit's normal equations
 } polynomial_model_t;
 
 typedef struct {
@@ -39,32 +95,749 @@ typedef struct {
     int n_features;
     double error;
     double r2;
+    double cond;        // condition estimate of the fit's normal equations
 } linear_model_t;
 
+// what multi_target_gmdh found for one target
+typedef struct {
+    const char *target_name;
+    polynomial_model_t *pairs;  // ranked, as from combinatorial_gmdh
+    int n_pairs;
+    linear_model_t *linear;     // NULL when no linear search was asked for
+    int n_linear;
+    gmdh_layer_t *layers;       // NULL when no multi-row search was asked for
+    int n_layers;
+} target_models_t;
+
+// fits whose condition estimate exceeds this are flagged when printed
+#define GMDH_COND_WARN 1e8
+
+// normal equations with a larger condition estimate are not trusted to
+// cholesky and are re-solved by pivoted qr
+#define SOLVER_COND_MAX 1e10
+
+// pivots (on the scale of the equilibrated normal matrix) below this
+// fraction of the largest mark a column as linearly dependent
+#define SOLVER_RANK_TOL 1e-12
+
+// residual floors worked out from moments are lowered by this fraction of
+// y'y to cover rounding before they are trusted to rule a candidate out
+#define FLOOR_SLACK 1e-9
+
+typedef enum {
+    SOLVE_CHOLESKY,
+    SOLVE_QR            // pivoted qr, after cholesky failed or was not trusted
+} solve_method_t;
+
+// how a dense solve went
+typedef struct {
+    double cond;        // condition estimate of the equilibrated normal matrix
+    int rank;
+    solve_method_t method;
+} solve_info_t;
+
+// raw sums needed to fit y = a0 + a1*a + a2*b + a3*a² + a4*b² + a5*a*b,
+// taken over the rows where a, b and y are all present
+typedef struct {
+    double n;
+    double a1, a2, a3, a4;
+    double b1, b2, b3, b4;
+    double ab, a2b, ab2, a3b, ab3, a2b2;
+    double y, ay, by, a2y, b2y, aby;
+    double yy;          // sum y², for the residual of a fit
+} quad_moments_t;
+
+// sufficient statistics for every quadratic pair of a dataset, computed once.
+// every array is n_features x n_features, indexed [i * n_features + j] and
+// restricted to rows where x_i, x_j and the target are all present
+typedef struct {
+    int n_features;
+    double *block;      // single allocation backing every array below
+    double *pw[5];      // pw[p][i,j] = sum x_i^p (pw[0] is the row count)
+    double *py[3];      // py[p][i,j] = sum x_i^p * y
+    double *s11;        // sum x_i * x_j
+    double *s21;        // sum x_i² * x_j
+    double *s31;        // sum x_i³ * x_j
+    double *s22;        // sum x_i² * x_j²
+    double *s11y;       // sum x_i * x_j * y
+    double *yy;         // sum y²
+} gram_stats_t;
+
+// output columns of one quadratic neuron over the training and validation
+// rows, as held by a neuron_cache_t
+typedef struct {
+    uint64_t key;       // neuron_key(in1, in2, coeffs)
+    uint64_t in1, in2;  // keys of the input columns
+    double coeffs[6];
+    int n_train;
+    int n_valid;
+    double *train;      // n_train outputs, followed by the n_valid of valid
+    double *valid;
+    uint64_t used;      // last run that asked for it
+} neuron_entry_t;
+
+// neuron output columns shared by the layers of multirow runs, keyed by
+// what they were computed from
+typedef struct {
+    neuron_entry_t **slots; // open addressing, a power of two of them
+    int n_slots;
+    int n_entries;
+    size_t bytes;       // column storage held
+    size_t max_bytes;   // what neuron_cache_trim shrinks it to
+    uint64_t run;
+    uint64_t hits;
+    uint64_t misses;
+} neuron_cache_t;
+
+// binomial coefficients for ranking and unranking k-subsets
+typedef struct {
+    int n;
+    int k_max;
+    uint64_t *table;    // (n + 1) x (k_max + 1), saturating at UINT64_MAX
+} comb_table_t;
+
+// normal equations of every linear subset: the gram matrix of the design
+// [1, x_0 .. x_{m-1}] (intercept first) and its cross products with y
+typedef struct {
+    int n_features;
+    int dim;            // n_features + 1
+    double *xtx;        // dim x dim
+    double *xty;        // dim
+    double yy;          // y'y
+} linear_gram_t;
+
+// grams of a stream's rows split by the features each row lacks, so a
+// subset over features with gaps is fitted on the rows that have all of
+// it: the sum of the grams of the patterns that have it
+typedef struct {
+    int n_features;
+    int n_patterns;
+    int capacity;
+    char *absent;           // n_features flags per pattern
+    linear_gram_t **grams;  // per pattern, absent features summed as 0
+    linear_gram_t *rest;    // rows of patterns past capacity, summed as linear_gram_accumulate
+    int64_t n_rest;
+    char *gapped;           // per feature: some row lacks it
+} linear_gram_patterns_t;
+
+// cholesky factor R of one subset's normal equations, updated in place as
+// columns enter and leave
+typedef struct {
+    int size;           // factored gram columns
+    int capacity;
+    int *order;         // gram column at each factor position
+    double *r;          // upper triangular, capacity x capacity
+    double *work;
+} subset_chol_t;
+
+// how linear_combinatorial_gmdh fits each subset
+typedef enum {
+    GMDH_LINEAR_REFIT,  // gather the subset's columns and solve from the data
+    GMDH_LINEAR_GRAY,   // revolving-door walk with cholesky column updates
+    GMDH_LINEAR_BEAM    // multistage search: the best beam_width subsets of each size grow by one feature
+} gmdh_linear_mode_t;
+
+// instruction set used by the column kernels. a level the cpu lacks falls
+// back to the best one it has
+typedef enum {
+    GMDH_SIMD_AUTO,     // best level reported by cpuid
+    GMDH_SIMD_SCALAR,
+    GMDH_SIMD_AVX2,
+    GMDH_SIMD_AVX512
+} gmdh_simd_t;
+
+// arithmetic of the quadratic pair searches
+typedef enum {
+    GMDH_PRECISION_DOUBLE,  // every statistic and score in double
+    GMDH_PRECISION_MIXED    // screen in float32, refit the survivors in double
+} gmdh_precision_t;
+
+// float32 copy of a dataset's columns, the screening input of
+// GMDH_PRECISION_MIXED. column-major like dataset_t, half the bytes.
+// values are stored as (x - center) / scale, which leaves the error of
+// any quadratic fit unchanged but keeps the pair statistics within reach
+// of float precision; the target's entries are at index n_features
+typedef struct {
+    float *block;
+    float **cols;
+    float *target;
+    double *center;
+    double *scale;
+    int n_samples;
+    int n_features;
+} dataset_f32_t;
+
+// running sums behind score_predictions, which can also be fed block by
+// block. targets are shifted by `shift` (the first target of the set) so
+// the one-pass total sum of squares does not cancel
+typedef struct {
+    double n_actual;    // rows with a target
+    double s_actual;    // sum of shifted targets over those rows
+    double n;           // rows with both a target and a prediction
+    double s;           // sum of shifted targets over them
+    double ss;          // sum of squared shifted targets over them
+    double res;         // sum of squared residuals over them
+} score_sums_t;
+
+// one neuron of a compiled model. inputs are slots: slot s < n_inputs is
+// the model's s-th input column, slot n_inputs + k the output of node k
+typedef enum {
+    GMDH_NODE_QUADRATIC,    // coeffs[6] over inputs[0], inputs[1]
+    GMDH_NODE_LINEAR        // coeffs[0] + sum coeffs[j + 1] * inputs[j]
+} gmdh_node_kind_t;
+
+typedef struct {
+    gmdh_node_kind_t kind;
+    int n_inputs;
+    int *inputs;
+    double *coeffs;
+} gmdh_node_t;
+
+// a trained network flattened for inference: only the neurons the output
+// depends on, in evaluation order, the output being the last node
+typedef struct {
+    int n_inputs;
+    int *input_features;    // training dataset column of each input
+    char **input_names;     // its name, "" when unknown
+    int n_nodes;
+    gmdh_node_t *nodes;
+} gmdh_model_t;
+
+// rows per model_eval_batch call in model_predict; every node's output for
+// a batch stays in cache until the nodes that read it have run
+#define MODEL_BATCH_ROWS 1024
+
+// frames of the gmdh-serve protocol (server.c), in native byte order. a
+// request is followed by n_values doubles: for SERVE_OP_PREDICT, n_rows
+// rows of the model's inputs in input slot order. a response is followed
+// by its n_values doubles
+#define SERVE_OP_PREDICT 0
+#define SERVE_OP_INFO 1         // response values: n_inputs, n_nodes
+#define SERVE_MAX_ROWS 4096
+#define SERVE_MAX_VALUES (1u << 20)
+
+typedef struct {
+    uint32_t id;                // echoed in the response
+    uint16_t op;
+    uint16_t model;             // position on the gmdh-serve command line
+    uint32_t n_rows;
+    uint32_t n_values;
+} serve_request_t;
+
+typedef enum {
+    SERVE_OK = 0,
+    SERVE_NO_MODEL = -1,
+    SERVE_BAD_SHAPE = -2,
+    SERVE_BAD_OP = -3
+} serve_status_t;
+
+typedef struct {
+    uint32_t id;
+    int32_t status;             // serve_status_t
+    uint32_t n_values;
+    uint32_t reserved;
+} serve_response_t;
+
+typedef struct gmdh_server gmdh_server_t;
+
+// header of a binary dataset file (data_bin.c)
+#define BIN_MAGIC "GMDHCOL1"
+#define BIN_VERSION 1
+#define BIN_BYTE_ORDER 0x01020304u
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    int32_t n_cols;
+    int32_t target_col;         // -1: the table has no designated target
+    uint64_t n_rows;
+    uint64_t stride;            // doubles per column
+    int64_t src_mtime_sec;      // source csv, for cache files; zero otherwise
+    int64_t src_mtime_nsec;
+    uint64_t src_size;
+    uint64_t src_hash;
+    uint64_t names_offset;
+    uint64_t stats_offset;
+    uint64_t present_offset;
+    uint64_t data_offset;
+    uint64_t file_size;
+} bin_header_t;
+
+// sequential reader over a csv or binary dataset file, one block of at
+// most block_rows rows at a time. rows without a target are skipped, the
+// rest land in `block`, which is reused for every block
+typedef struct {
+    int binary;
+    int fd;                 // binary files, read with pread
+    bin_header_t hdr;
+    int64_t next_row;       // binary files: next file row to read
+    FILE *fp;               // csv files
+    long body_offset;       // csv files: first byte after the header
+    char *buf;              // csv files: bytes read but not yet parsed
+    size_t buf_cap;
+    size_t buf_len;
+    size_t buf_pos;
+    int eof;
+    int error;              // a read failed: the rows seen are not the whole file. kept across rewinds
+    int n_cols;             // columns in the file, target included
+    int target_col;
+    int block_rows;
+    dataset_t *block;
+} row_stream_t;
+
+// cross-validation schemes. folds are contiguous blocks of rows in file
+// order, like split_dataset's cut. a scheme the rows cannot hold (fewer
+// than two folds, say) falls back to leave one out
+typedef enum {
+    GMDH_CV_KFOLD,      // each of k blocks validates a fit on the other k - 1
+    GMDH_CV_LOO,        // leave one out, from the prediction residual sum of squares
+    GMDH_CV_ROLLING     // rolling origin: each window validates a fit on every row before it
+} gmdh_cv_kind_t;
+
+typedef struct {
+    gmdh_cv_kind_t kind;
+    int k;              // folds, or rolling-origin validation windows
+    int min_train;      // rolling origin: rows of the first training window, 0 = half
+} gmdh_cv_t;
+
+// pair statistics of every fold, read by the cross-validated pair sweeps.
+// the training statistics of a fold are derived from the others (by
+// subtraction from the total, or by accumulation for rolling origin)
+// instead of being gathered from the rows again
+typedef struct {
+    gmdh_cv_t cv;
+    int n_folds;        // 0 for leave one out
+    gram_stats_t *total;    // every row: the fit that is kept
+    gram_stats_t **train;   // per fold
+    gram_stats_t **valid;
+    dataset_t *ds;      // rows of the leave-one-out residuals
+} pair_folds_t;
+
+// the same for linear subsets
+typedef struct {
+    gmdh_cv_t cv;
+    int n_folds;
+    linear_gram_t *total;
+    linear_gram_t **train;
+    linear_gram_t **valid;
+    dataset_t *ds;
+    column_masks_t *masks;  // of ds: subsets over columns with gaps are fitted from the rows
+} linear_folds_t;
+
+// how much of a candidate sweep may be skipped. every mode keeps exactly
+// the models an unpruned sweep would: only candidates that provably rank
+// below the kept ones lose their exact score
+typedef enum {
+    GMDH_PRUNE_OFF,     // score every candidate on all validation rows
+    GMDH_PRUNE_ABANDON, // stop scoring once the partial error cannot make the cut
+    GMDH_PRUNE_BOUND    // also skip candidates whose best possible validation fit cannot
+} gmdh_prune_t;
+
+// how candidates are scored on the validation rows. both give the same
+// error over the same rows, up to rounding
+typedef enum {
+    GMDH_SCORE_ROWS,    // predict every validation row, O(rows) per candidate
+    GMDH_SCORE_MOMENTS  // sse and r² as quadratic forms in the validation moments, O(1) in the rows
+} gmdh_scoring_t;
+
+// what screen_features ranks features by
+typedef enum {
+    GMDH_SCREEN_CORR,   // |pearson correlation| with the target
+    GMDH_SCREEN_MI      // mutual information with the target, from a binned histogram
+} gmdh_screen_rank_t;
+
+// why screen_features kept a feature out of the search
+typedef enum {
+    SCREEN_KEPT,
+    SCREEN_CONSTANT,    // fewer than two distinct present values
+    SCREEN_DUPLICATE,   // the same values, gaps included, as an earlier feature
+    SCREEN_CORRELATED,  // correlated within screen_corr with a better-ranked kept feature
+    SCREEN_BUDGET       // ranked below the first screen_budget
+} screen_verdict_t;
+
+// outcome of screening a dataset's features
+typedef struct {
+    int n_features;
+    int n_kept;
+    int *kept;              // the survivors' indices, ascending
+    double *score;          // per feature: its association with the target, 0 if constant
+    screen_verdict_t *verdict;  // per feature
+    int *twin;              // per feature: the one a duplicate or correlated feature follows, else -1
+    void **views;           // cols and names of screen_for_search's views, NULL otherwise
+} feature_screen_t;
+
+// phases timed by the profiler (build with -DGMDH_PROFILE, make
+// PROFILE=1). sweep spans a whole candidate search and so includes the
+// solve and score time of its candidates
+typedef enum {
+    PROF_LOAD,          // csv parsing
+    PROF_GATHER,        // building input columns (multirow layer outputs)
+    PROF_NORMAL,        // normal-equation statistics: pair moments, grams, fold sums
+    PROF_SOLVE,         // solving one candidate's fit
+    PROF_SCORE,         // validation scoring of one candidate
+    PROF_SORT,          // ranking candidates
+    PROF_SWEEP,         // one candidate search, end to end
+    PROF_PHASES
+} prof_phase_t;
+
+typedef enum {
+    PROF_CANDIDATES,    // candidates fitted
+    PROF_ALLOCS,        // buffers allocated by the algorithms
+    PROF_ALLOC_BYTES,
+    PROF_BYTES_TOUCHED, // column data read, estimated per pass
+    PROF_COUNTERS
+} prof_counter_t;
+
+#ifdef GMDH_PROFILE
+#define PROF_BEGIN(phase) uint64_t prof_start_##phase = profile_now()
+#define PROF_END(phase) profile_phase(phase, prof_start_##phase)
+#define PROF_COUNT(counter, n) profile_count(counter, (uint64_t)(n))
+#define PROF_ALLOC(bytes) (profile_count(PROF_ALLOCS, 1), \
+                           profile_count(PROF_ALLOC_BYTES, (uint64_t)(bytes)))
+#define PROF_LANE(lane) profile_lane(lane)
+#else
+#define PROF_BEGIN(phase) ((void)0)
+#define PROF_END(phase) ((void)0)
+#define PROF_COUNT(counter, n) ((void)0)
+#define PROF_ALLOC(bytes) ((void)0)
+#define PROF_LANE(lane) ((void)0)
+#endif
+
+// run-time options read by every algorithm
+typedef struct {
+    int n_threads;      // workers for candidate sweeps, 0 = one per cpu
+    int top_k;          // models kept by the linear search and combinatorial_gmdh's pruning cut, 0 = all
+    gmdh_linear_mode_t linear_mode;
+    gmdh_simd_t simd;
+    int csv_cache;      // keep a binary copy of each csv next to it
+    gmdh_prune_t prune;
+    size_t neuron_cache_bytes;  // multirow layer outputs kept between runs
+    gmdh_precision_t precision;
+    gmdh_scoring_t scoring;
+    int screen_budget;  // features combinatorial_gmdh and linear_combinatorial_gmdh search at most, 0 = no screening
+    double screen_corr; // |correlation| at which a feature follows a better-ranked one out
+    gmdh_screen_rank_t screen_rank;
+    int beam_width;     // subsets of each size GMDH_LINEAR_BEAM extends
+    int beam_swaps;     // rounds of one-feature swaps refining each beam, 0 = none
+} gmdh_options_t;
+
+extern gmdh_options_t gmdh_options;
+
+// reusable state for repeated runs (context.c): options, a log sink, the
+// last run's results and a pool the algorithms' scratch is drawn from
+typedef struct gmdh_context gmdh_context_t;
+
+// log sink of a context: gets the progress text the algorithms would
+// print, a piece at a time
+typedef void (*gmdh_log_fn)(void *user, const char *text);
+
+// body of a parallel loop: handles tasks [begin, end) on worker thread_id
+typedef void (*parallel_fn)(void *ctx, int thread_id, long begin, long end);
+
+// options
+void gmdh_default_options(gmdh_options_t *opts);
+
+// parallel execution
+int gmdh_thread_count(void);
+void parallel_for(long n_tasks, long grain, int n_threads, parallel_fn fn, void *ctx);
+double shared_bound_read(double *bound);
+void shared_bound_lower(double *bound, double value);
+
+// contexts and workspaces
+gmdh_context_t* gmdh_context_create(const gmdh_options_t *opts);
+gmdh_options_t* gmdh_context_options(gmdh_context_t *ctx);
+void gmdh_context_set_log(gmdh_context_t *ctx, gmdh_log_fn log, void *user);
+uint64_t gmdh_context_allocs(const gmdh_context_t *ctx);
+const polynomial_model_t* gmdh_context_combinatorial(gmdh_context_t *ctx, dataset_t *train,
+                                                     dataset_t *valid, int *n_models);
+const linear_model_t* gmdh_context_linear(gmdh_context_t *ctx, dataset_t *train,
+                                          dataset_t *valid, int min_features,
+                                          int max_features, int *n_models);
+const gmdh_layer_t* gmdh_context_multirow(gmdh_context_t *ctx, dataset_t *train,
+                                          dataset_t *valid, int n_layers,
+                                          int models_per_layer);
+void gmdh_context_free(gmdh_context_t *ctx);
+gmdh_context_t* gmdh_context_current(void);
+const gmdh_options_t* gmdh_current_options(void);
+gmdh_context_t* gmdh_context_swap(gmdh_context_t *ctx);
+void* gmdh_alloc(size_t bytes);
+void* gmdh_calloc(size_t n, size_t size);
+void gmdh_free(void *p);
+void gmdh_log(const char *fmt, ...);
+
+// profiling (functions are no-ops unless built with GMDH_PROFILE)
+uint64_t profile_now(void);
+void profile_phase(prof_phase_t phase, uint64_t start);
+void profile_count(prof_counter_t counter, uint64_t n);
+void profile_lane(int lane);
+void profile_report(FILE *out);
+int profile_write_trace(const char *path);
+void profile_reset(void);
+
+// ranking
+typedef int (*rank_before_fn)(const void *a, const void *b);
+int polynomial_model_before(const void *a, const void *b);
+int linear_model_before(const void *a, const void *b);
+int error_before(const void *a, const void *b);
+void rank_sort(void *items, size_t n, size_t size, rank_before_fn before);
+void rank_select(void *items, size_t n, size_t size, size_t k, rank_before_fn before);
+size_t rank_top(void *items, size_t n, size_t size, size_t k, rank_before_fn before);
+void rank_heap_sift_up(void *heap, size_t i, size_t size, rank_before_fn before);
+void rank_heap_sift_down(void *heap, size_t n, size_t i, size_t size, rank_before_fn before);
+int rank_heap_offer(void *heap, size_t *n, size_t capacity, size_t size, const void *item,
+                    rank_before_fn before);
+
+// combinations
+comb_table_t* comb_table_create(int n, int k_max);
+uint64_t comb_count(const comb_table_t *t, int n, int k);
+void comb_unrank(const comb_table_t *t, int n, int k, uint64_t rank, int *indices);
+uint64_t comb_rank(const comb_table_t *t, int n, int k, const int *indices);
+int comb_next(int n, int k, int *indices);
+uint64_t revdoor_rank(const comb_table_t *t, int k, const int *indices);
+void revdoor_unrank(const comb_table_t *t, int n, int k, uint64_t rank, int *indices);
+void revdoor_next(int n, int k, int *indices, int *removed, int *added);
+void free_comb_table(comb_table_t *t);
+
+// arena allocation
+gmdh_arena_t* arena_create(size_t block_size);
+void* arena_alloc(gmdh_arena_t *a, size_t bytes);
+void arena_retain(gmdh_arena_t *a);
+void arena_release(gmdh_arena_t *a);
+
 // data loading
 dataset_t* load_csv(const char *filename, int target_col);
+dataset_t* dataset_create(int n_samples, int n_features);
+dataset_t* dataset_view(dataset_t *ds, int offset, int length);
+double** dataset_rows(dataset_t *ds);
 void free_dataset(dataset_t *ds);
 void split_dataset(dataset_t *ds, dataset_t **train, dataset_t **test, double train_ratio);
+dataset_f32_t* dataset_to_f32(const dataset_t *ds, const dataset_f32_t *like);
+void free_dataset_f32(dataset_f32_t *ds);
 void normalize_dataset(dataset_t *ds, double *mean, double *std);
+double dataset_target_mean(const dataset_t *ds);
+double csv_parse_field(const char *p, const char *end);
+dataset_t* dataset_select_target(double **cols, char **names, int n_cols, int n_rows,
+                                 int target_col);
+multi_dataset_t* load_csv_targets(const char *filename, const int *target_cols, int n_targets);
+multi_dataset_t* multi_dataset_select(double **cols, char **names, int n_cols, int n_rows,
+                                      const int *target_cols, int n_targets);
+void split_multi_dataset(multi_dataset_t *md, multi_dataset_t **train, multi_dataset_t **test,
+                         double train_ratio);
+dataset_t* multi_dataset_target(const multi_dataset_t *md, int t, dataset_t *out);
+void free_multi_dataset(multi_dataset_t *md);
+
+// presence bitmaps
+int mask_words(int n_rows);
+uint64_t mask_word(const double *x, int len);
+uint64_t mask_full_word(int n_rows, int w);
+void mask_build(const double *x, int n_rows, uint64_t *bits);
+int mask_count(const uint64_t *bits, int n_words);
+int mask_gather(const double *src, const uint64_t *bits, int n_rows, double *dst);
+column_masks_t* column_masks_build(const dataset_t *ds);
+const uint64_t* column_mask(const column_masks_t *cm, int c);
+void free_column_masks(column_masks_t *cm);
+
+// feature screening
+feature_screen_t* screen_features(dataset_t *ds, int budget);
+feature_screen_t* screen_for_search(dataset_t *train, dataset_t *valid, int min_kept,
+                                    dataset_t *train_out, dataset_t *valid_out);
+void screen_map_pairs(const feature_screen_t *fs, polynomial_model_t *models, int n_models);
+void screen_map_linear(const feature_screen_t *fs, linear_model_t *models, int n_models);
+void free_feature_screen(feature_screen_t *fs);
+
+// binary dataset files
+int save_dataset_bin(dataset_t *ds, const char *path);
+dataset_t* load_dataset_bin(const char *path, int target_col);
+column_stats_t* dataset_bin_stats(const char *path, int *n_cols);
+dataset_t* csv_cache_load(const char *csv_path, int target_col);
+multi_dataset_t* csv_cache_load_targets(const char *csv_path, const int *target_cols,
+                                        int n_targets);
+void csv_cache_store(const char *csv_path, dataset_t *table);
+uint64_t bin_present_words(uint64_t n_rows);
+
+// block streams
+row_stream_t* row_stream_open(const char *path, int target_col, int block_rows);
+dataset_t* row_stream_next(row_stream_t *s);
+int row_stream_rewind(row_stream_t *s);
+int64_t row_stream_count(row_stream_t *s);
+void row_stream_close(row_stream_t *s);
+void dataset_slice(dataset_t *ds, int offset, int length, dataset_t *out, double **cols);
+void dataset_select_features(dataset_t *ds, const int *features, int k, dataset_t *out,
+                             double **cols, char **names);
 
 // polynomial regression
 void fit_polynomial(double *x1, double *x2, double *y, int n, double *coeffs);
 double predict_polynomial(double x1, double x2, double *coeffs);
 double calculate_rmse(double *pred, double *actual, int n);
 double calculate_r2(double *pred, double *actual, int n);
+void quadratic_normal_equations(const quad_moments_t *mom, double *XtX, double *Xty);
+double fit_quadratic_moments(const quad_moments_t *mom, double *coeffs);
+double floor_quadratic_moments(const quad_moments_t *mom);
+double sse_quadratic_moments(const quad_moments_t *mom, const double *coeffs);
+double fit_polynomial_columns(const double *x1, const double *x2, const double *y, int n,
+                              double *coeffs);
+void quad_moments_masked(const double *a, const double *b, const double *y, int n,
+                         const uint64_t *ma, const uint64_t *mb, const uint64_t *my,
+                         quad_moments_t *mom);
+
+// dense solvers
+int solve_normal(const double *a, const double *b, double *x, int n, solve_info_t *info);
+int solve_least_squares(const double *const *cols, const double *y, int n_rows, int k,
+                        double *work, double *x, solve_info_t *info);
+
+// column kernels
+gmdh_simd_t simd_level(void);
+void score_accumulate(const double *pred, const double *actual, int n, double shift,
+                      score_sums_t *acc);
+void score_finish(const score_sums_t *acc, double *rmse, double *r2);
+void predict_polynomial_column(const double *x1, const double *x2, const double *coeffs,
+                               double *out, int n);
+void score_predictions(const double *pred, const double *actual, int n,
+                       double *rmse, double *r2);
+void cross_sums_f32(const float *a, const float *b, const float *y, int n, double *sums);
+double sse_polynomial_f32(const float *x1, const float *x2, const double *coeffs,
+                          const float *y, int n, double *n_used);
+
+// pair gram statistics
+gram_stats_t* gram_stats_create(int m);
+void gram_stats_accumulate(gram_stats_t *gs, dataset_t *ds);
+gram_stats_t* gram_stats_compute(dataset_t *ds);
+gram_stats_t* gram_stats_compute_f32(const dataset_f32_t *ds);
+gram_stats_t* gram_stats_compute_shifted(dataset_t *ds, double shift);
+gram_stats_t** gram_stats_compute_targets(dataset_t *ds, double **targets, int n_targets);
+void gram_pair_moments(const gram_stats_t *gs, int i, int j, quad_moments_t *mom);
+double gram_fit_pair(const gram_stats_t *gs, int i, int j, double *coeffs);
+double gram_pair_floor(const gram_stats_t *gs, int i, int j);
+void gram_score_pair(const gram_stats_t *gs, int i, int j, const double *coeffs, double shift,
+                     double *rmse, double *r2);
+void gram_stats_combine(gram_stats_t *dst, const gram_stats_t *a, const gram_stats_t *b,
+                        double sign);
+void free_gram_stats(gram_stats_t *gs);
+void pair_from_index(int n, long index, int *i, int *j);
 
 // combinatorial gmdh (quadratic pairs)
 polynomial_model_t* combinatorial_gmdh(dataset_t *train, dataset_t *valid, int *n_models);
+polynomial_model_t* combinatorial_gmdh_stream(row_stream_t *s, double train_ratio,
+                                              int *n_models);
+polynomial_model_t* combinatorial_gmdh_gram(dataset_t *train, dataset_t *valid,
+                                            const gram_stats_t *gs, int *n_models);
+void sweep_quadratic_pairs(dataset_t *train, dataset_t *valid, polynomial_model_t *models,
+                           int keep);
+void sweep_quadratic_pairs_gram(dataset_t *train, dataset_t *valid, const gram_stats_t *gs,
+                                polynomial_model_t *models, int keep);
+polynomial_model_t* combinatorial_gmdh_cv(dataset_t *ds, const gmdh_cv_t *cv, int *n_models);
+void sweep_quadratic_pairs_cv(dataset_t *ds, const gmdh_cv_t *cv, polynomial_model_t *models);
 
 // combinatorial gmdh (linear multivariate)
 linear_model_t* linear_combinatorial_gmdh(dataset_t *train, dataset_t *valid,
                                           int min_features, int max_features,
                                           int *n_models);
+linear_model_t* linear_combinatorial_gmdh_stream(row_stream_t *s, double train_ratio,
+                                                 int min_features, int max_features,
+                                                 int *n_models_out);
+linear_model_t* linear_combinatorial_gmdh_range(dataset_t *train, dataset_t *valid,
+                                                int min_features, int max_features,
+                                                uint64_t rank_begin, uint64_t rank_end,
+                                                int *n_models);
+linear_model_t* linear_combinatorial_gmdh_gram(dataset_t *train, dataset_t *valid,
+                                               const linear_gram_t *gram, int min_features,
+                                               int max_features, int *n_models);
+linear_model_t* linear_combinatorial_gmdh_cv(dataset_t *ds, const gmdh_cv_t *cv,
+                                             int min_features, int max_features,
+                                             int *n_models);
+uint64_t linear_subset_count(int n_features, int min_features, int max_features);
+linear_model_t* linear_models_merge(linear_model_t *a, int n_a, linear_model_t *b, int n_b,
+                                    int k, int *n_models);
 void print_linear_model(linear_model_t *model, char **feature_names);
 void free_linear_models(linear_model_t *models, int n_models);
 
+// linear subset normal equations
+linear_gram_t* linear_gram_create(int m);
+void linear_gram_accumulate(linear_gram_t *g, dataset_t *ds);
+linear_gram_t* linear_gram_compute(dataset_t *ds);
+linear_gram_t* linear_gram_compute_shifted(dataset_t *ds, double shift);
+linear_gram_t** linear_gram_compute_targets(dataset_t *ds, double **targets, int n_targets);
+void free_linear_gram(linear_gram_t *g);
+void subset_chol_init(subset_chol_t *c, int capacity);
+void subset_chol_free(subset_chol_t *c);
+void subset_chol_copy(subset_chol_t *dst, const subset_chol_t *src);
+int subset_chol_factor(subset_chol_t *c, const linear_gram_t *g, const int *features, int k);
+int subset_chol_add(subset_chol_t *c, const linear_gram_t *g, int col);
+void subset_chol_remove(subset_chol_t *c, int col);
+int subset_chol_solve(subset_chol_t *c, const linear_gram_t *g, double *coeffs, double *cond);
+double linear_gram_floor(const linear_gram_t *g, const int *features, int k);
+void linear_gram_subset(const linear_gram_t *g, const int *features, int k,
+                        double *a, double *c);
+double linear_gram_fit(const linear_gram_t *g, const int *features, int k, double *coeffs);
+double linear_gram_sse(const linear_gram_t *g, const int *features, int k,
+                       const double *coeffs);
+void linear_gram_combine(linear_gram_t *dst, const linear_gram_t *a, const linear_gram_t *b,
+                         double sign);
+linear_gram_patterns_t* linear_gram_patterns_create(int m);
+void linear_gram_patterns_accumulate(linear_gram_patterns_t *lp, dataset_t *ds);
+linear_gram_t* linear_gram_patterns_total(const linear_gram_patterns_t *lp);
+void linear_gram_patterns_subset(const linear_gram_patterns_t *lp, const int *features, int k,
+                                 double *a, double *c, double *yy);
+void free_linear_gram_patterns(linear_gram_patterns_t *lp);
+
 // multi-row gmdh
 gmdh_layer_t* multirow_gmdh(dataset_t *train, dataset_t *valid, int n_layers, int models_per_layer);
+gmdh_layer_t* multirow_gmdh_gram(dataset_t *train, dataset_t *valid, const gram_stats_t *gs,
+                                 int n_layers, int models_per_layer);
+gmdh_layer_t* multirow_gmdh_cv(dataset_t *ds, const gmdh_cv_t *cv, int n_layers,
+                               int models_per_layer);
+void multirow_cache_stats(uint64_t *hits, uint64_t *misses);
+void multirow_cache_clear(void);
+
+// multi-target gmdh
+target_models_t* multi_target_gmdh(multi_dataset_t *train, multi_dataset_t *valid,
+                                   int min_features, int max_features,
+                                   int n_layers, int models_per_layer);
+void free_target_models(target_models_t *models, int n_targets);
+
+// cross-validation
+int cv_segments(const gmdh_cv_t *cv, int n_rows, int *bounds);
+const char* cv_describe(const gmdh_cv_t *cv, char *buf, size_t size);
+pair_folds_t* pair_folds_compute(dataset_t *ds, const gmdh_cv_t *cv);
+void cv_score_pair(const pair_folds_t *pf, int i, int j, polynomial_model_t *model);
+void free_pair_folds(pair_folds_t *pf);
+linear_folds_t* linear_folds_compute(dataset_t *ds, const gmdh_cv_t *cv);
+void cv_score_subset(const linear_folds_t *lf, linear_model_t *model);
+void free_linear_folds(linear_folds_t *lf);
+
+// neuron output cache
+uint64_t column_key(const double *train, int n_train, const double *valid, int n_valid);
+uint64_t neuron_key(uint64_t in1, uint64_t in2, const double *coeffs);
+neuron_cache_t* neuron_cache_create(size_t max_bytes);
+neuron_entry_t* neuron_cache_get(neuron_cache_t *c, uint64_t in1, uint64_t in2,
+                                 const double *coeffs,
+                                 const double *x1_train, const double *x2_train, int n_train,
+                                 const double *x1_valid, const double *x2_valid, int n_valid);
+void neuron_cache_begin_run(neuron_cache_t *c);
+void neuron_cache_trim(neuron_cache_t *c);
+void free_neuron_cache(neuron_cache_t *c);
+
+// compiled models and batch inference
+gmdh_model_t* model_from_polynomial(const polynomial_model_t *m, char **feature_names);
+gmdh_model_t* model_from_linear(const linear_model_t *m, char **feature_names);
+gmdh_model_t* model_from_multirow(const gmdh_layer_t *layers, int layer, int index,
+                                  char **feature_names);
+int save_model(const gmdh_model_t *model, const char *path);
+gmdh_model_t* load_model(const char *path);
+int model_predict(const gmdh_model_t *model, dataset_t *ds, double *out);
+void model_eval_batch(const gmdh_model_t *model, const double **slots, double *scratch,
+                      double *out, int n);
+void free_model(gmdh_model_t *model);
+
+// prediction server
+gmdh_server_t* serve_create(const char *socket_path, char **model_paths, int n_models);
+int serve_run(gmdh_server_t *server);
+void serve_stop(gmdh_server_t *server);
+void serve_free(gmdh_server_t *server);
+int serve_connect(const char *socket_path);
+int serve_call(int fd, const serve_request_t *req, const double *values,
+               serve_response_t *resp, double *out, uint32_t max_out);
 
 // utils
 void print_model(polynomial_model_t *model, char **feature_names);
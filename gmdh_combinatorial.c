@@ -1,68 +1,577 @@
 #include "gmdh.h"
 
-// combinatorial gmdh: try all pairs of features
-polynomial_model_t* combinatorial_gmdh(dataset_t *train, dataset_t *valid, int *n_models) {
-    int n_pairs = (train->n_features * (train->n_features - 1)) / 2;
-    polynomial_model_t *models = malloc(n_pairs * sizeof(polynomial_model_t));
-    
-    int model_idx = 0;
-    
-    printf("combinatorial gmdh: trying %d feature pairs...\n", n_pairs);
+// GMDH_PRECISION_MIXED refits this many times the kept number of pairs in
+// double, so pairs the float screen ranks a little too low still compete
+#define MIXED_REFIT_FACTOR 2
+
+// validation rows scored per step of a pruned sweep before the partial
+// error is checked against the cut. a multiple of every vector width, so
+// blockwise predictions match whole-column ones bit for bit
+#define PRUNE_BLOCK_ROWS 256
+
+// shared state of a parallel pair sweep
+typedef struct {
+    dataset_t *train;
+    dataset_t *valid;
+    const gram_stats_t *gs;
+    gram_stats_t *valid_gs; // GMDH_PRUNE_BOUND: floors from the validation rows
+    gram_stats_t *valid_moments;    // GMDH_SCORE_MOMENTS: centred validation statistics
+    double valid_mean;      // the validation target mean they are centred on
+    polynomial_model_t *models;
+    double **predictions;   // per-thread scratch, one validation column each
+    int keep;               // pruning cut, 0 when every pair is scored in full
+    double n_target;        // validation rows with a target
+    double bound;           // rmse the keep best pairs are known to reach
+    double **kept;          // per-thread heaps of the best errors, keep each
+    size_t *n_kept;
+} pair_sweep_t;
+
+// score a pair on the validation rows a block at a time, giving up as
+// soon as the residual sum of squares shows its rmse must exceed bound.
+// a pair that gets through is scored exactly as in an unpruned sweep.
+// returns 0 if the pair was abandoned
+static int score_pair_bounded(pair_sweep_t *sw, polynomial_model_t *model,
+                              double *predictions, double bound) {
+    dataset_t *valid = sw->valid;
+    const double *x1 = valid->cols[model->feature1];
+    const double *x2 = valid->cols[model->feature2];
+    // rmse² = sse / rows scored, and at most n_target rows are scored
+    double limit = bound * bound * sw->n_target;
+    int n = valid->n_samples;
+
+    if (sw->valid_gs && gram_pair_floor(sw->valid_gs, model->feature1, model->feature2) > limit) {
+        return 0;
+    }
+
+    score_sums_t acc = {0, 0, 0, 0, 0, 0};
+    for (int b = 0; b < n; b += PRUNE_BLOCK_ROWS) {
+        int len = n - b < PRUNE_BLOCK_ROWS ? n - b : PRUNE_BLOCK_ROWS;
+        predict_polynomial_column(x1 + b, x2 + b, model->coeffs, predictions + b, len);
+        score_accumulate(predictions + b, valid->target + b, len, 0, &acc);
+        if (acc.res > limit) return 0;
+    }
+    score_predictions(predictions, valid->target, n, &model->error, &model->r2);
+    return 1;
+}
+
+static void pair_sweep_worker(void *arg, int thread_id, long begin, long end) {
+    pair_sweep_t *sw = arg;
+    dataset_t *valid = sw->valid;
+    double *predictions = sw->predictions[thread_id];
+    int i, j;
     
-    for (int i = 0; i < train->n_features; i++) {
-        for (int j = i + 1; j < train->n_features; j++) {
-            // extract features
-            double *x1_train = malloc(train->n_samples * sizeof(double));
-            double *x2_train = malloc(train->n_samples * sizeof(double));
-            
-            for (int k = 0; k < train->n_samples; k++) {
-                x1_train[k] = train->data[k][i];
-                x2_train[k] = train->data[k][j];
-            }
-            
-            // fit model
-            polynomial_model_t *model = &models[model_idx];
-            model->feature1 = i;
-            model->feature2 = j;
-            
-            fit_polynomial(x1_train, x2_train, train->target, train->n_samples, model->coeffs);
-            
-            // evaluate on validation set
-            double *predictions = malloc(valid->n_samples * sizeof(double));
-            for (int k = 0; k < valid->n_samples; k++) {
-                predictions[k] = predict_polynomial(
-                    valid->data[k][i],
-                    valid->data[k][j],
-                    model->coeffs
-                );
+    PROF_COUNT(PROF_CANDIDATES, end - begin);
+    pair_from_index(sw->train->n_features, begin, &i, &j);
+    for (long p = begin; p < end; p++) {
+        // fit model from the precomputed pair statistics
+        polynomial_model_t *model = &sw->models[p];
+        model->feature1 = i;
+        model->feature2 = j;
+        
+        model->cond = gram_fit_pair(sw->gs, i, j, model->coeffs);
+        
+        // evaluate on validation set
+        PROF_BEGIN(PROF_SCORE);
+        if (sw->valid_moments) {
+            gram_score_pair(sw->valid_moments, i, j, model->coeffs, sw->valid_mean,
+                            &model->error, &model->r2);
+        } else if (sw->keep > 0) {
+            double *heap = sw->kept[thread_id];
+            size_t *size = &sw->n_kept[thread_id];
+            double bound = shared_bound_read(&sw->bound);
+            if (*size == (size_t)sw->keep && heap[0] < bound) bound = heap[0];
+
+            if (score_pair_bounded(sw, model, predictions, bound)) {
+                double e = isnan(model->error) ? INFINITY : model->error;
+                rank_heap_offer(heap, size, sw->keep, sizeof(double), &e, error_before);
+                if (*size == (size_t)sw->keep) shared_bound_lower(&sw->bound, heap[0]);
+            } else {
+                model->error = INFINITY;
+                model->r2 = NAN;
             }
-            
-            model->error = calculate_rmse(predictions, valid->target, valid->n_samples);
-            model->r2 = calculate_r2(predictions, valid->target, valid->n_samples);
-            
-            free(x1_train);
-            free(x2_train);
-            free(predictions);
-            
-            model_idx++;
+        } else {
+            predict_polynomial_column(valid->cols[i], valid->cols[j], model->coeffs,
+                                      predictions, valid->n_samples);
+            score_predictions(predictions, valid->target, valid->n_samples,
+                              &model->error, &model->r2);
+        }
+        PROF_END(PROF_SCORE);
+        
+        if (++j == sw->train->n_features) {
+            i++;
+            j = i + 1;
+        }
+    }
+}
+
+// give every pair worse than the keep-th best error an infinite one, so
+// exactly the keep best (and any tied with the last) remain
+static void cut_to_keep(polynomial_model_t *models, long n_pairs, int keep) {
+    PROF_BEGIN(PROF_SORT);
+    double *errors = gmdh_alloc(n_pairs * sizeof(double));
+    for (long p = 0; p < n_pairs; p++) {
+        errors[p] = isnan(models[p].error) ? INFINITY : models[p].error;
+    }
+    rank_select(errors, n_pairs, sizeof(double), keep - 1, error_before);
+    double cut = errors[keep - 1];
+    for (long p = 0; p < n_pairs; p++) {
+        if (models[p].error > cut) {
+            models[p].error = INFINITY;
+            models[p].r2 = NAN;
+        }
+    }
+    gmdh_free(errors);
+    PROF_END(PROF_SORT);
+}
+
+// shared state of a mixed-precision sweep
+typedef struct {
+    dataset_t *train;
+    dataset_t *valid;
+    dataset_f32_t *valid32;
+    gram_stats_t *gs;       // from the float32 training columns
+    polynomial_model_t *models;
+    long *refit;            // pairs refitted in double
+    double **predictions;   // per-thread scratch, one validation column each
+} mixed_sweep_t;
+
+// screen: fit from the float-summed statistics of the standardized
+// columns, score in float. the coefficients are only good for the
+// standardized columns, the error for the original ones
+static void mixed_screen_worker(void *arg, int thread_id, long begin, long end) {
+    mixed_sweep_t *sw = arg;
+    dataset_f32_t *valid = sw->valid32;
+    int i, j;
+    (void)thread_id;
+
+    PROF_COUNT(PROF_CANDIDATES, end - begin);
+    pair_from_index(sw->train->n_features, begin, &i, &j);
+    for (long p = begin; p < end; p++) {
+        polynomial_model_t *model = &sw->models[p];
+        model->feature1 = i;
+        model->feature2 = j;
+        model->cond = gram_fit_pair(sw->gs, i, j, model->coeffs);
+
+        PROF_BEGIN(PROF_SCORE);
+        double used;
+        double sse = sse_polynomial_f32(valid->cols[i], valid->cols[j], model->coeffs,
+                                        valid->target, valid->n_samples, &used);
+        model->error = used > 0 ? sqrt(sse / used) : INFINITY;
+        model->r2 = NAN;
+        PROF_END(PROF_SCORE);
+
+        if (++j == sw->train->n_features) {
+            i++;
+            j = i + 1;
+        }
+    }
+}
+
+// refit a screened survivor from the double columns and score it exactly
+static void mixed_refit_worker(void *arg, int thread_id, long begin, long end) {
+    mixed_sweep_t *sw = arg;
+    dataset_t *train = sw->train, *valid = sw->valid;
+    double *predictions = sw->predictions[thread_id];
+
+    for (long r = begin; r < end; r++) {
+        polynomial_model_t *model = &sw->models[sw->refit[r]];
+        int i = model->feature1, j = model->feature2;
+        model->cond = fit_polynomial_columns(train->cols[i], train->cols[j], train->target,
+                                             train->n_samples, model->coeffs);
+        PROF_BEGIN(PROF_SCORE);
+        predict_polynomial_column(valid->cols[i], valid->cols[j], model->coeffs,
+                                  predictions, valid->n_samples);
+        score_predictions(predictions, valid->target, valid->n_samples,
+                          &model->error, &model->r2);
+        PROF_END(PROF_SCORE);
+    }
+}
+
+// sweep_quadratic_pairs under GMDH_PRECISION_MIXED: every pair is fitted
+// and scored from float32 copies of the columns, the best
+// MIXED_REFIT_FACTOR * keep are refitted and rescored in double, and the
+// keep best of those are kept. the rest get an infinite error, as under
+// pruning, so every model left with a finite error holds a double fit
+static void sweep_quadratic_pairs_mixed(dataset_t *train, dataset_t *valid,
+                                        polynomial_model_t *models, int keep) {
+    long n_pairs = (long)train->n_features * (train->n_features - 1) / 2;
+    int n_threads = gmdh_thread_count();
+    PROF_BEGIN(PROF_SWEEP);
+
+    mixed_sweep_t sw;
+    sw.train = train;
+    sw.valid = valid;
+    sw.models = models;
+    PROF_BEGIN(PROF_NORMAL);
+    dataset_f32_t *train32 = dataset_to_f32(train, NULL);
+    sw.gs = gram_stats_compute_f32(train32);
+    PROF_END(PROF_NORMAL);
+    sw.valid32 = dataset_to_f32(valid, train32);
+    free_dataset_f32(train32);
+
+    parallel_for(n_pairs, 16, n_threads, mixed_screen_worker, &sw);
+    free_dataset_f32(sw.valid32);
+    free_gram_stats(sw.gs);
+
+    // survivors of the screen: every pair up to the n_refit-th best error
+    long n_refit = (long)MIXED_REFIT_FACTOR * keep;
+    double *errors = gmdh_alloc(n_pairs * sizeof(double));
+    for (long p = 0; p < n_pairs; p++) {
+        errors[p] = models[p].error;
+    }
+    rank_select(errors, n_pairs, sizeof(double), n_refit - 1, error_before);
+    double cut = errors[n_refit - 1];
+    gmdh_free(errors);
+
+    sw.refit = gmdh_alloc(n_pairs * sizeof(long));
+    long n_survivors = 0;
+    for (long p = 0; p < n_pairs; p++) {
+        if (models[p].error <= cut) {
+            sw.refit[n_survivors++] = p;
+        } else {
+            models[p].error = INFINITY;
+            models[p].r2 = NAN;
         }
     }
+
+    sw.predictions = gmdh_alloc(n_threads * sizeof(double*));
+    for (int t = 0; t < n_threads; t++) {
+        sw.predictions[t] = gmdh_alloc((valid->n_samples + 1) * sizeof(double));
+    }
+    parallel_for(n_survivors, 4, n_threads, mixed_refit_worker, &sw);
+    cut_to_keep(models, n_pairs, keep);
+
+    for (int t = 0; t < n_threads; t++) {
+        gmdh_free(sw.predictions[t]);
+    }
+    gmdh_free(sw.predictions);
+    gmdh_free(sw.refit);
+    PROF_END(PROF_SWEEP);
+}
+
+// fit and score every feature pair, models[p] holding the p-th pair in
+// i/j loop order whatever the number of threads. with keep > 0 and
+// gmdh_options.prune set, only pairs that can rank among the best keep are
+// scored exactly; the rest get an infinite error. which pairs those are
+// depends on the schedule, so afterwards every pair worse than the
+// keep-th best error is cut to infinity too, the same set on any run.
+// under GMDH_SCORE_MOMENTS every pair is scored from the validation
+// moments in O(1), which leaves nothing for pruning to save. under
+// GMDH_PRECISION_MIXED the pairs are screened in float32 instead (see
+// sweep_quadratic_pairs_mixed), when keep leaves any to screen out
+void sweep_quadratic_pairs(dataset_t *train, dataset_t *valid, polynomial_model_t *models,
+                           int keep) {
+    sweep_quadratic_pairs_gram(train, valid, NULL, models, keep);
+}
+
+// sweep_quadratic_pairs fitting from gs, pair statistics of train's rows
+// and target computed elsewhere (shared between targets, say), or from
+// statistics of its own when gs is NULL. the float screen of
+// GMDH_PRECISION_MIXED always sums its own
+void sweep_quadratic_pairs_gram(dataset_t *train, dataset_t *valid, const gram_stats_t *gs,
+                                polynomial_model_t *models, int keep) {
+    const gmdh_options_t *opts = gmdh_current_options();
+    long n_pairs = (long)train->n_features * (train->n_features - 1) / 2;
+    if (opts->precision == GMDH_PRECISION_MIXED && keep > 0 &&
+        (long)MIXED_REFIT_FACTOR * keep < n_pairs) {
+        sweep_quadratic_pairs_mixed(train, valid, models, keep);
+        return;
+    }
+    int n_threads = gmdh_thread_count();
+    PROF_BEGIN(PROF_SWEEP);
     
-    *n_models = model_idx;
+    pair_sweep_t sw;
+    memset(&sw, 0, sizeof(sw));
+    sw.train = train;
+    sw.valid = valid;
+    sw.models = models;
+    gram_stats_t *own = NULL;
+    if (!gs) {
+        PROF_BEGIN(PROF_NORMAL);
+        gs = own = gram_stats_compute(train);
+        PROF_END(PROF_NORMAL);
+        PROF_COUNT(PROF_BYTES_TOUCHED, (uint64_t)(train->n_features + 1) * train->n_samples *
+                                       sizeof(double));
+    }
+    sw.gs = gs;
+    if (opts->scoring == GMDH_SCORE_MOMENTS) {
+        PROF_BEGIN(PROF_NORMAL);
+        sw.valid_mean = dataset_target_mean(valid);
+        sw.valid_moments = gram_stats_compute_shifted(valid, sw.valid_mean);
+        PROF_END(PROF_NORMAL);
+    } else if (opts->prune != GMDH_PRUNE_OFF && keep > 0 && keep < n_pairs) {
+        sw.keep = keep;
+    }
+    sw.bound = INFINITY;
+    sw.predictions = gmdh_alloc(n_threads * sizeof(double*));
+    for (int t = 0; t < n_threads; t++) {
+        sw.predictions[t] = NULL;
+        if (!sw.valid_moments) {
+            sw.predictions[t] = gmdh_alloc((valid->n_samples + 1) * sizeof(double));
+            PROF_ALLOC((valid->n_samples + 1) * sizeof(double));
+        }
+    }
+    if (sw.keep > 0) {
+        for (int r = 0; r < valid->n_samples; r++) {
+            sw.n_target += !isnan(valid->target[r]);
+        }
+        if (opts->prune == GMDH_PRUNE_BOUND) {
+            sw.valid_gs = gram_stats_compute(valid);
+        }
+        sw.kept = gmdh_alloc(n_threads * sizeof(double*));
+        sw.n_kept = gmdh_calloc(n_threads, sizeof(size_t));
+        for (int t = 0; t < n_threads; t++) {
+            sw.kept[t] = gmdh_alloc(sw.keep * sizeof(double));
+        }
+    }
     
-    // sort by error (ascending)
-    for (int i = 0; i < model_idx - 1; i++) {
-        for (int j = 0; j < model_idx - i - 1; j++) {
-            if (models[j].error > models[j + 1].error) {
-                polynomial_model_t tmp = models[j];
-                models[j] = models[j + 1];
-                models[j + 1] = tmp;
-            }
+    parallel_for(n_pairs, 16, n_threads, pair_sweep_worker, &sw);
+    
+    if (sw.keep > 0) {
+        // the keep best errors are all exact: each one beat every bound
+        // it was checked against
+        cut_to_keep(models, n_pairs, sw.keep);
+        for (int t = 0; t < n_threads; t++) {
+            gmdh_free(sw.kept[t]);
         }
+        gmdh_free(sw.kept);
+        gmdh_free(sw.n_kept);
+        free_gram_stats(sw.valid_gs);
     }
+    for (int t = 0; t < n_threads; t++) {
+        gmdh_free(sw.predictions[t]);
+    }
+    gmdh_free(sw.predictions);
+    free_gram_stats(own);
+    free_gram_stats(sw.valid_moments);
+    PROF_END(PROF_SWEEP);
+}
+
+// shared state of a cross-validated pair sweep
+typedef struct {
+    pair_folds_t *folds;
+    polynomial_model_t *models;
+    int n_features;
+} pair_cv_sweep_t;
+
+static void pair_cv_worker(void *arg, int thread_id, long begin, long end) {
+    pair_cv_sweep_t *sw = arg;
+    int i, j;
+    (void)thread_id;
+
+    PROF_COUNT(PROF_CANDIDATES, end - begin);
+    pair_from_index(sw->n_features, begin, &i, &j);
+    for (long p = begin; p < end; p++) {
+        PROF_BEGIN(PROF_SCORE);
+        cv_score_pair(sw->folds, i, j, &sw->models[p]);
+        PROF_END(PROF_SCORE);
+        if (++j == sw->n_features) {
+            i++;
+            j = i + 1;
+        }
+    }
+}
+
+// sweep_quadratic_pairs with a cross-validated error: every pair is fitted
+// on all of ds and scored by cv from the fold statistics
+void sweep_quadratic_pairs_cv(dataset_t *ds, const gmdh_cv_t *cv, polynomial_model_t *models) {
+    long n_pairs = (long)ds->n_features * (ds->n_features - 1) / 2;
+
+    PROF_BEGIN(PROF_SWEEP);
+    pair_cv_sweep_t sw;
+    PROF_BEGIN(PROF_NORMAL);
+    sw.folds = pair_folds_compute(ds, cv);
+    PROF_END(PROF_NORMAL);
+    sw.models = models;
+    sw.n_features = ds->n_features;
+    parallel_for(n_pairs, 16, gmdh_thread_count(), pair_cv_worker, &sw);
+    free_pair_folds(sw.folds);
+    PROF_END(PROF_SWEEP);
+}
+
+// combinatorial gmdh: try all pairs of features, or of those that pass
+// screening when gmdh_options.screen_budget is set. models name features
+// of train either way
+polynomial_model_t* combinatorial_gmdh(dataset_t *train, dataset_t *valid, int *n_models) {
+    dataset_t tr, va;
+    feature_screen_t *fs = screen_for_search(train, valid, 2, &tr, &va);
+    if (!fs) return combinatorial_gmdh_gram(train, valid, NULL, n_models);
+
+    polynomial_model_t *models = combinatorial_gmdh_gram(&tr, &va, NULL, n_models);
+    screen_map_pairs(fs, models, *n_models);
+    free_feature_screen(fs);
+    return models;
+}
+
+// combinatorial gmdh fitting from the given pair statistics of train, as
+// sweep_quadratic_pairs_gram
+polynomial_model_t* combinatorial_gmdh_gram(dataset_t *train, dataset_t *valid,
+                                            const gram_stats_t *gs, int *n_models) {
+    int n_pairs = (train->n_features * (train->n_features - 1)) / 2;
+    polynomial_model_t *models = gmdh_alloc(n_pairs * sizeof(polynomial_model_t));
+    PROF_ALLOC(n_pairs * sizeof(polynomial_model_t));
+    
+    gmdh_log("combinatorial gmdh: trying %d feature pairs...\n", n_pairs);
     
-    printf("best model: ");
+    sweep_quadratic_pairs_gram(train, valid, gs, models, gmdh_current_options()->top_k);
+    
+    int model_idx = n_pairs;
+    *n_models = model_idx;
+    
+    PROF_BEGIN(PROF_SORT);
+    rank_sort(models, model_idx, sizeof(polynomial_model_t), polynomial_model_before);
+    PROF_END(PROF_SORT);
+    
+    gmdh_log("best model: ");
     print_model(&models[0], train->feature_names);
     
     return models;
 }
+
+// combinatorial gmdh with a cross-validated external criterion in place
+// of a validation set
+polynomial_model_t* combinatorial_gmdh_cv(dataset_t *ds, const gmdh_cv_t *cv, int *n_models) {
+    int n_pairs = (ds->n_features * (ds->n_features - 1)) / 2;
+    polynomial_model_t *models = gmdh_alloc((n_pairs + 1) * sizeof(polynomial_model_t));
+    char scheme[64];
+
+    gmdh_log("combinatorial gmdh: trying %d feature pairs, %s...\n", n_pairs,
+           cv_describe(cv, scheme, sizeof(scheme)));
+
+    sweep_quadratic_pairs_cv(ds, cv, models);
+    *n_models = n_pairs;
+    PROF_BEGIN(PROF_SORT);
+    rank_sort(models, n_pairs, sizeof(polynomial_model_t), polynomial_model_before);
+    PROF_END(PROF_SORT);
+
+    if (n_pairs > 0) {
+        gmdh_log("best model: ");
+        print_model(&models[0], ds->feature_names);
+    }
+    return models;
+}
+
+// shared state of a streamed validation pass: every fitted pair adds one
+// block of validation rows at a time to its own score sums
+typedef struct {
+    dataset_t *valid;
+    polynomial_model_t *models;
+    score_sums_t *sums;
+    double shift;
+    double **predictions;   // per-thread scratch, one block each
+} pair_score_t;
+
+static void pair_score_worker(void *arg, int thread_id, long begin, long end) {
+    pair_score_t *job = arg;
+    dataset_t *valid = job->valid;
+    double *predictions = job->predictions[thread_id];
+
+    for (long p = begin; p < end; p++) {
+        polynomial_model_t *model = &job->models[p];
+        predict_polynomial_column(valid->cols[model->feature1], valid->cols[model->feature2],
+                                  model->coeffs, predictions, valid->n_samples);
+        score_accumulate(predictions, valid->target, valid->n_samples, job->shift,
+                         &job->sums[p]);
+    }
+}
+
+// combinatorial gmdh over a stream too large to hold in memory. the first
+// train_ratio of the rows train and the rest validate, as with
+// split_dataset. pass 1 adds the training blocks to the pair statistics
+// and fits every pair from them; pass 2 scores every fitted pair on the
+// validation blocks. memory is bounded by the block size and the number
+// of pairs, whatever the number of rows. NULL when a read of the stream
+// failed
+polynomial_model_t* combinatorial_gmdh_stream(row_stream_t *s, double train_ratio,
+                                              int *n_models) {
+    int m = s->block->n_features;
+    int n_pairs = (m * (m - 1)) / 2;
+    int64_t n_rows = row_stream_count(s);
+    int64_t n_train = (int64_t)(n_rows * train_ratio);
+    int n_threads = gmdh_thread_count();
+
+    gmdh_log("combinatorial gmdh: streaming %lld rows (%lld training), trying %d feature pairs...\n",
+           (long long)n_rows, (long long)n_train, n_pairs);
+
+    double **cols = gmdh_alloc((m + 1) * sizeof(double*));
+    dataset_t part;
+    dataset_t *blk;
+    int64_t seen = 0;
+
+    // pass 1: pair statistics of the training rows
+    gram_stats_t *gs = gram_stats_create(m);
+    while (seen < n_train && (blk = row_stream_next(s))) {
+        int k = n_train - seen < blk->n_samples ? (int)(n_train - seen) : blk->n_samples;
+        dataset_slice(blk, 0, k, &part, cols);
+        gram_stats_accumulate(gs, &part);
+        seen += blk->n_samples;
+    }
+
+    polynomial_model_t *models = gmdh_alloc((n_pairs + 1) * sizeof(polynomial_model_t));
+    for (int p = 0; p < n_pairs; p++) {
+        int i, j;
+        pair_from_index(m, p, &i, &j);
+        models[p].feature1 = i;
+        models[p].feature2 = j;
+        models[p].cond = gram_fit_pair(gs, i, j, models[p].coeffs);
+    }
+    free_gram_stats(gs);
+
+    // pass 2: validation sums of every fitted pair
+    pair_score_t job;
+    job.models = models;
+    job.sums = gmdh_calloc(n_pairs + 1, sizeof(score_sums_t));
+    job.shift = 0;
+    job.predictions = gmdh_alloc(n_threads * sizeof(double*));
+    for (int t = 0; t < n_threads; t++) {
+        job.predictions[t] = gmdh_alloc((s->block_rows + 1) * sizeof(double));
+    }
+
+    row_stream_rewind(s);
+    seen = 0;
+    int first = 1;
+    while ((blk = row_stream_next(s))) {
+        // training rows still ahead of this block's validation rows
+        int64_t ahead = n_train - seen;
+        int begin = ahead <= 0 ? 0 : ahead < blk->n_samples ? (int)ahead : blk->n_samples;
+        seen += blk->n_samples;
+        if (begin == blk->n_samples) continue;
+
+        dataset_slice(blk, begin, blk->n_samples - begin, &part, cols);
+        if (first) {
+            // stream rows always have a target
+            job.shift = part.target[0];
+            first = 0;
+        }
+        job.valid = &part;
+        parallel_for(n_pairs, 16, n_threads, pair_score_worker, &job);
+    }
+
+    for (int p = 0; p < n_pairs; p++) {
+        score_finish(&job.sums[p], &models[p].error, &models[p].r2);
+    }
+
+    for (int t = 0; t < n_threads; t++) {
+        gmdh_free(job.predictions[t]);
+    }
+    gmdh_free(job.predictions);
+    gmdh_free(job.sums);
+    gmdh_free(cols);
+    if (s->error) {
+        // a damaged file: statistics of part of it are not a result
+        gmdh_free(models);
+        *n_models = 0;
+        return NULL;
+    }
+
+    *n_models = n_pairs;
+    PROF_BEGIN(PROF_SORT);
+    rank_sort(models, n_pairs, sizeof(polynomial_model_t), polynomial_model_before);
+    PROF_END(PROF_SORT);
+
+    if (n_pairs > 0) {
+        gmdh_log("best model: ");
+        print_model(&models[0], s->block->feature_names);
+    }
+    return models;
+}
@@ -1,236 +1,1440 @@
 #include "gmdh.h"
 
-// fit linear model: y = a0 + a1*x1 + a2*x2 + ... + an*xn
-static void fit_linear_multivariate(double **X, double *y, int n_samples, int n_features, double *coeffs) {
+// fit linear model: y = a0 + a1*x1 + a2*x2 + ... + an*xn, where xj is
+// column features[j - 1] of cols, over the rows where every one of them
+// and y is present. masks holds the presence bitmaps of cols and y (y's
+// last); the columns are read in place when none of the subset's has
+// gaps, and otherwise the rows they share are found by and-ing their
+// bitmaps into rows (masks->n_words words) and gathered into work. the
+// normal equations are solved by cholesky; when they are too
+// ill-conditioned for that the fit is redone by qr on the columns
+// themselves, in work past the gathered rows (n_samples * (n_features +
+// 2) doubles). a rank-deficient subset gets zero coefficients, like a
+// singular factor in gray mode. returns the condition estimate
+static double fit_linear_multivariate(double **cols, const int *features, double *y,
+                                      int n_samples, int n_features, double *coeffs,
+                                      const column_masks_t *masks, uint64_t *rows,
+                                      double *work) {
     int n_coeffs = n_features + 1; // +1 for intercept
 
-    // build design matrix with intercept column
-    double **design = malloc(n_samples * sizeof(double*));
-    for (int i = 0; i < n_samples; i++) {
-        design[i] = malloc(n_coeffs * sizeof(double));
-        design[i][0] = 1.0; // intercept
+    // design columns; NULL stands for the intercept
+    const double *design[n_coeffs];
+    design[0] = NULL;
+    for (int j = 0; j < n_features; j++) {
+        design[j + 1] = cols[features[j]];
+    }
+
+    int y_col = masks->n_cols - 1;
+    int gaps = !masks->complete[y_col];
+    for (int j = 0; j < n_features; j++) {
+        gaps |= !masks->complete[features[j]];
+    }
+    if (gaps) {
+        int n_words = masks->n_words;
+        memcpy(rows, column_mask(masks, y_col), n_words * sizeof(uint64_t));
         for (int j = 0; j < n_features; j++) {
-            design[i][j + 1] = X[i][j];
+            const uint64_t *bits = column_mask(masks, features[j]);
+            for (int w = 0; w < n_words; w++) {
+                rows[w] &= bits[w];
+            }
         }
+        int n = mask_count(rows, n_words);
+        for (int j = 0; j < n_features; j++) {
+            mask_gather(design[j + 1], rows, n_samples, work);
+            design[j + 1] = work;
+            work += n;
+        }
+        mask_gather(y, rows, n_samples, work);
+        y = work;
+        work += n;
+        n_samples = n;
     }
 
     // build normal equations: X'X * coeffs = X'y
-    double **XtX = malloc(n_coeffs * sizeof(double*));
-    double *Xty = malloc(n_coeffs * sizeof(double));
-
+    double XtX[(size_t)n_coeffs * n_coeffs];
+    double Xty[n_coeffs];
     for (int i = 0; i < n_coeffs; i++) {
-        XtX[i] = malloc(n_coeffs * sizeof(double));
+        const double *xi = design[i];
         for (int j = 0; j < n_coeffs; j++) {
-            XtX[i][j] = 0;
+            const double *xj = design[j];
+            double sum = 0;
             for (int k = 0; k < n_samples; k++) {
-                XtX[i][j] += design[k][i] * design[k][j];
+                sum += (xi ? xi[k] : 1.0) * (xj ? xj[k] : 1.0);
             }
+            XtX[(size_t)i * n_coeffs + j] = sum;
         }
-        Xty[i] = 0;
+        double sum = 0;
         for (int k = 0; k < n_samples; k++) {
-            Xty[i] += design[k][i] * y[k];
+            sum += (xi ? xi[k] : 1.0) * y[k];
         }
+        Xty[i] = sum;
     }
 
-    // solve using gaussian elimination
-    double **aug = malloc(n_coeffs * sizeof(double*));
-    for (int i = 0; i < n_coeffs; i++) {
-        aug[i] = malloc((n_coeffs + 1) * sizeof(double));
-        memcpy(aug[i], XtX[i], n_coeffs * sizeof(double));
-        aug[i][n_coeffs] = Xty[i];
+    solve_info_t info;
+    int full_rank = solve_normal(XtX, Xty, coeffs, n_coeffs, &info);
+    if (info.method == SOLVE_QR) {
+        full_rank = solve_least_squares(design, y, n_samples, n_coeffs, work, coeffs, &info);
+    }
+    if (!full_rank) {
+        // singular matrix, set coeffs to 0
+        for (int j = 0; j < n_coeffs; j++) {
+            coeffs[j] = 0;
+        }
     }
+    return info.cond;
+}
 
-    // forward elimination
-    for (int i = 0; i < n_coeffs; i++) {
-        int max_row = i;
-        for (int k = i + 1; k < n_coeffs; k++) {
-            if (fabs(aug[k][i]) > fabs(aug[max_row][i])) {
-                max_row = k;
-            }
+// bounded max-heap of the best subsets seen so far. the worst kept model
+// sits at the root, so a better candidate replaces it in O(log k)
+typedef struct {
+    linear_model_t *slots;  // coeffs/feature_indices preallocated per slot
+    int size;
+    int capacity;
+} linear_topk_t;
+
+static void topk_init(linear_topk_t *h, int capacity, int max_features) {
+    h->slots = gmdh_alloc(capacity * sizeof(linear_model_t));
+    h->size = 0;
+    h->capacity = capacity;
+    for (int i = 0; i < capacity; i++) {
+        h->slots[i].coeffs = gmdh_alloc((max_features + 1) * sizeof(double));
+        h->slots[i].feature_indices = gmdh_alloc((max_features + 1) * sizeof(int));
+    }
+}
+
+static void topk_free(linear_topk_t *h) {
+    for (int i = 0; i < h->capacity; i++) {
+        gmdh_free(h->slots[i].coeffs);
+        gmdh_free(h->slots[i].feature_indices);
+    }
+    gmdh_free(h->slots);
+}
+
+static void copy_linear_model(linear_model_t *dst, const linear_model_t *src) {
+    memcpy(dst->coeffs, src->coeffs, (src->n_features + 1) * sizeof(double));
+    memcpy(dst->feature_indices, src->feature_indices, src->n_features * sizeof(int));
+    dst->n_features = src->n_features;
+    dst->error = src->error;
+    dst->r2 = src->r2;
+    dst->cond = src->cond;
+}
+
+// keep a copy of the candidate if it ranks among the best seen so far
+static void topk_offer(linear_topk_t *h, const linear_model_t *cand) {
+    int i;
+    if (h->size < h->capacity) {
+        // sift the new leaf up past better-ranked parents
+        i = h->size++;
+        copy_linear_model(&h->slots[i], cand);
+        rank_heap_sift_up(h->slots, i, sizeof(linear_model_t), linear_model_before);
+        return;
+    }
+
+    if (!linear_model_before(cand, &h->slots[0])) return;
+
+    // replace the worst and sift it down
+    copy_linear_model(&h->slots[0], cand);
+    rank_heap_sift_down(h->slots, h->size, 0, sizeof(linear_model_t), linear_model_before);
+}
+
+// per-thread buffers, sized for the largest subset
+typedef struct {
+    double *predictions;
+    linear_model_t candidate;
+    linear_topk_t best;
+    subset_chol_t chol;     // gray mode: factor of the current subset
+    double *chol_coeffs;    // gray mode: coefficients by factor position
+    double *qr_work;        // refits: gathered rows and design copy for qr fallbacks
+    uint64_t *rows;         // refits: bitmap of the rows a subset has complete
+} linear_scratch_t;
+
+// shared state of a parallel subset search. rank r is the r-th subset when
+// sizes min..max are enumerated in turn; each size is walked in
+// lexicographic order, or revolving-door order in gray mode
+typedef struct {
+    dataset_t *train;       // NULL when fitting from fold grams or a stream
+    column_masks_t *train_masks;    // presence bitmaps of train's columns
+    dataset_t *valid;       // NULL when every subset is scored from valid_gram
+    int n_features;
+    int min_features;
+    int max_features;
+    comb_table_t *comb;
+    uint64_t *size_offset;  // rank of the first subset of each size
+    uint64_t rank_begin;
+    const linear_gram_t *gram;  // gray mode only
+    linear_gram_t *valid_gram;  // closed-form validation scoring
+    double valid_shift;     // taken off the targets behind valid_gram
+    char *valid_missing;    // features with gaps in valid, which valid_gram cannot score
+    linear_gram_t *floor_gram;  // GMDH_PRUNE_BOUND: floors from the validation rows
+    linear_folds_t *folds;  // cross-validation: fit and score from fold grams
+    const linear_gram_patterns_t *train_patterns;   // stream: grams by missing features
+    const linear_gram_patterns_t *valid_patterns;
+    int prune;              // abandon candidates that cannot make the top_k
+    double n_target;        // validation rows with a target
+    double bound;           // rmse the top_k subsets are known to reach
+    linear_scratch_t *scratch;
+} linear_search_t;
+
+// validation error of a fitted model from the validation gram alone:
+// sse = y'y - 2 b'X'y + b'X'X b over the subset's columns, in O(k²). the
+// gram's targets have shift taken off, so the intercept is too
+static void score_from_gram(const linear_gram_t *vg, double shift, linear_model_t *model) {
+    int k = model->n_features + 1;
+    int col[k];
+    col[0] = 0;
+    for (int j = 0; j < model->n_features; j++) {
+        col[j + 1] = model->feature_indices[j] + 1;
+    }
+
+    double b[k];
+    memcpy(b, model->coeffs, k * sizeof(double));
+    b[0] -= shift;
+    double sse = vg->yy;
+    for (int a = 0; a < k; a++) {
+        const double *row = vg->xtx + (size_t)col[a] * vg->dim;
+        double quad = 0;
+        for (int c = 0; c < k; c++) {
+            quad += row[col[c]] * b[c];
         }
-        double *tmp = aug[i];
-        aug[i] = aug[max_row];
-        aug[max_row] = tmp;
+        sse += b[a] * (quad - 2 * vg->xty[col[a]]);
+    }
+    if (sse < 0) sse = 0;
+
+    double n = vg->xtx[0];
+    double sst = vg->yy - vg->xty[0] * vg->xty[0] / n;
+    model->error = n > 0 ? sqrt(sse / n) : INFINITY;
+    model->r2 = 1.0 - sse / sst;
+}
 
-        if (fabs(aug[i][i]) < 1e-10) {
-            // singular matrix, set coeffs to 0
-            for (int j = 0; j < n_coeffs; j++) {
-                coeffs[j] = 0;
+// validation rows predicted per step of a pruned search before the
+// partial error is checked against the cut
+#define PRUNE_BLOCK_ROWS 256
+
+// score the fitted candidate a block of validation rows at a time, giving
+// up once its residual sum of squares shows it cannot beat the worst kept
+// model here or the bound shared by every thread. a candidate that gets
+// through is scored exactly as in an unpruned search. returns 0 if the
+// candidate was abandoned
+static int score_bounded(linear_search_t *ls, linear_scratch_t *sc) {
+    dataset_t *valid = ls->valid;
+    linear_model_t *model = &sc->candidate;
+    const int *indices = model->feature_indices;
+    int n = valid->n_samples;
+
+    double bound = shared_bound_read(&ls->bound);
+    if (sc->best.size == sc->best.capacity && sc->best.slots[0].error < bound) {
+        bound = sc->best.slots[0].error;
+    }
+    // rmse² = sse / rows scored, and at most n_target rows are scored
+    double limit = bound * bound * ls->n_target;
+    if (ls->floor_gram && linear_gram_floor(ls->floor_gram, indices, model->n_features) > limit) {
+        return 0;
+    }
+
+    score_sums_t acc = {0, 0, 0, 0, 0, 0};
+    for (int b = 0; b < n; b += PRUNE_BLOCK_ROWS) {
+        int len = n - b < PRUNE_BLOCK_ROWS ? n - b : PRUNE_BLOCK_ROWS;
+        double *pred = sc->predictions + b;
+        for (int i = 0; i < len; i++) {
+            pred[i] = model->coeffs[0];
+        }
+        for (int j = 0; j < model->n_features; j++) {
+            const double *x = valid->cols[indices[j]] + b;
+            double c = model->coeffs[j + 1];
+            for (int i = 0; i < len; i++) {
+                pred[i] += c * x[i];
             }
-            goto cleanup;
         }
+        score_accumulate(pred, valid->target + b, len, 0, &acc);
+        if (acc.res > limit) return 0;
+    }
+    score_predictions(sc->predictions, valid->target, n, &model->error, &model->r2);
+    return 1;
+}
 
-        for (int k = i + 1; k < n_coeffs; k++) {
-            double factor = aug[k][i] / aug[i][i];
-            for (int j = i; j <= n_coeffs; j++) {
-                aug[k][j] -= factor * aug[i][j];
+// keep the scored candidate if it ranks among the best seen by this
+// thread. a beam search also scores the subsets it grows through below
+// min_features, which are not results
+static void keep_candidate(linear_search_t *ls, linear_scratch_t *sc) {
+    if (sc->candidate.n_features < ls->min_features) return;
+    topk_offer(&sc->best, &sc->candidate);
+}
+
+// score the fitted candidate on the validation set and keep it if it
+// ranks among the best seen by this thread
+static void score_candidate(linear_search_t *ls, linear_scratch_t *sc) {
+    dataset_t *valid = ls->valid;
+    linear_model_t *model = &sc->candidate;
+    int *indices = model->feature_indices;
+
+    int from_gram = ls->valid_gram != NULL;
+    for (int j = 0; j < model->n_features && from_gram && ls->valid_missing; j++) {
+        from_gram = !ls->valid_missing[indices[j]];
+    }
+    if (from_gram) {
+        score_from_gram(ls->valid_gram, ls->valid_shift, model);
+        keep_candidate(ls, sc);
+        return;
+    }
+
+    if (ls->prune) {
+        if (score_bounded(ls, sc)) {
+            keep_candidate(ls, sc);
+            if (sc->best.size == sc->best.capacity) {
+                shared_bound_lower(&ls->bound, sc->best.slots[0].error);
             }
         }
+        return;
     }
 
-    // back substitution
-    for (int i = n_coeffs - 1; i >= 0; i--) {
-        coeffs[i] = aug[i][n_coeffs];
-        for (int j = i + 1; j < n_coeffs; j++) {
-            coeffs[i] -= aug[i][j] * coeffs[j];
+    for (int i = 0; i < valid->n_samples; i++) {
+        sc->predictions[i] = model->coeffs[0]; // intercept
+    }
+    for (int j = 0; j < model->n_features; j++) {
+        const double *x = valid->cols[indices[j]];
+        double c = model->coeffs[j + 1];
+        for (int i = 0; i < valid->n_samples; i++) {
+            sc->predictions[i] += c * x[i];
         }
-        coeffs[i] /= aug[i][i];
     }
 
-cleanup:
-    for (int i = 0; i < n_samples; i++) {
-        free(design[i]);
+    score_predictions(sc->predictions, valid->target, valid->n_samples,
+                      &model->error, &model->r2);
+
+    keep_candidate(ls, sc);
+}
+
+// fit and score a subset over features with gaps in a streamed search,
+// on the training and validation rows that have all of it, from the
+// grams of their missing-feature patterns
+static void fit_from_patterns(linear_search_t *ls, linear_model_t *model) {
+    int k = model->n_features;
+    int n = k + 1;
+    const int *indices = model->feature_indices;
+    double a[(size_t)n * n];
+    double c[n];
+    double yy;
+
+    linear_gram_patterns_subset(ls->train_patterns, indices, k, a, c, &yy);
+    solve_info_t info;
+    if (!solve_normal(a, c, model->coeffs, n, &info)) {
+        for (int j = 0; j < n; j++) {
+            model->coeffs[j] = 0;
+        }
     }
-    free(design);
-    for (int i = 0; i < n_coeffs; i++) {
-        free(XtX[i]);
-        free(aug[i]);
+    model->cond = info.cond;
+
+    linear_gram_patterns_subset(ls->valid_patterns, indices, k, a, c, &yy);
+    double sse = yy;
+    for (int r = 0; r < n; r++) {
+        double quad = 0;
+        for (int q = 0; q < n; q++) {
+            quad += a[(size_t)r * n + q] * model->coeffs[q];
+        }
+        sse += model->coeffs[r] * (quad - 2 * c[r]);
     }
-    free(XtX);
-    free(Xty);
-    free(aug);
+    if (sse < 0) sse = 0;
+
+    double rows = a[0];
+    double sst = yy - c[0] * c[0] / rows;
+    model->error = rows > 0 ? sqrt(sse / rows) : INFINITY;
+    model->r2 = 1.0 - sse / sst;
 }
 
-static double predict_linear(double *x, double *coeffs, int n_features) {
-    double result = coeffs[0]; // intercept
-    for (int i = 0; i < n_features; i++) {
-        result += coeffs[i + 1] * x[i];
+static void evaluate_subset(linear_search_t *ls, linear_scratch_t *sc) {
+    dataset_t *train = ls->train;
+    linear_model_t *model = &sc->candidate;
+
+    if (ls->folds || ls->train_patterns) {
+        PROF_BEGIN(PROF_SCORE);
+        if (ls->folds) {
+            cv_score_subset(ls->folds, model);
+        } else {
+            fit_from_patterns(ls, model);
+        }
+        keep_candidate(ls, sc);
+        PROF_END(PROF_SCORE);
+        return;
     }
-    return result;
+
+    // fit model straight from the training columns
+    PROF_BEGIN(PROF_SOLVE);
+    model->cond = fit_linear_multivariate(train->cols, model->feature_indices, train->target,
+                                          train->n_samples, model->n_features, model->coeffs,
+                                          ls->train_masks, sc->rows, sc->qr_work);
+    PROF_END(PROF_SOLVE);
+    PROF_COUNT(PROF_BYTES_TOUCHED, (uint64_t)(model->n_features + 1) * train->n_samples *
+                                   sizeof(double));
+
+    PROF_BEGIN(PROF_SCORE);
+    score_candidate(ls, sc);
+    PROF_END(PROF_SCORE);
 }
 
-// combinatorial linear gmdh: try all subsets of features
-linear_model_t* linear_combinatorial_gmdh(dataset_t *train, dataset_t *valid,
-                                          int min_features, int max_features,
-                                          int *n_models_out) {
-    // count total combinations
-    int total_combinations = 0;
+// whether a subset reads a training column with gaps, or in a stream a
+// validation column too. the grams' sums over such a column are nan, so a
+// gray walk refits these from the rows or the pattern grams
+static int subset_has_gaps(const linear_search_t *ls, const int *indices, int k) {
+    int gaps = 0;
+    for (int j = 0; j < k; j++) {
+        if (ls->train_masks) gaps |= !ls->train_masks->complete[indices[j]];
+        if (ls->train_patterns) {
+            gaps |= ls->train_patterns->gapped[indices[j]] |
+                    ls->valid_patterns->gapped[indices[j]];
+        }
+    }
+    return gaps;
+}
+
+// find the first subset of a chunk: returns its size, fills indices
+static int locate_rank(linear_search_t *ls, uint64_t rank, int gray, int *indices) {
+    int n = ls->n_features;
+    int subset_size = ls->min_features;
+    while (rank >= ls->size_offset[subset_size + 1]) {
+        subset_size++;
+    }
+    uint64_t local = rank - ls->size_offset[subset_size];
+    if (gray) {
+        revdoor_unrank(ls->comb, n, subset_size, local, indices);
+    } else {
+        comb_unrank(ls->comb, n, subset_size, local, indices);
+    }
+    return subset_size;
+}
+
+static void linear_search_worker(void *arg, int thread_id, long begin, long end) {
+    linear_search_t *ls = arg;
+    linear_scratch_t *sc = &ls->scratch[thread_id];
+    int n = ls->n_features;
+    int *indices = sc->candidate.feature_indices;
+
+    // jump straight to the first subset of this chunk
+    int subset_size = locate_rank(ls, ls->rank_begin + (uint64_t)begin, 0, indices);
+    PROF_COUNT(PROF_CANDIDATES, end - begin);
+
+    for (long t = begin; t < end; t++) {
+        sc->candidate.n_features = subset_size;
+        evaluate_subset(ls, sc);
+
+        if (!comb_next(n, subset_size, indices)) {
+            subset_size++;
+            for (int i = 0; i < subset_size && subset_size <= ls->max_features; i++) {
+                indices[i] = i;
+            }
+        }
+    }
+}
+
+// solve the factored subset and map the coefficients from factor order
+// back to the sorted feature order of the candidate
+static int fit_from_factor(linear_search_t *ls, linear_scratch_t *sc) {
+    linear_model_t *model = &sc->candidate;
+    subset_chol_t *chol = &sc->chol;
+
+    if (!subset_chol_solve(chol, ls->gram, sc->chol_coeffs, &model->cond)) {
+        // singular matrix, set coeffs to 0
+        for (int j = 0; j <= model->n_features; j++) {
+            model->coeffs[j] = 0;
+        }
+        return 0;
+    }
+    if (model->cond > SOLVER_COND_MAX) {
+        // too ill-conditioned to trust the updated factor: solve the
+        // subset's normal equations afresh, which falls back to qr
+        int k = model->n_features + 1;
+        double a[(size_t)k * k];
+        double b[k];
+        for (int r = 0; r < k; r++) {
+            int gr = r == 0 ? 0 : model->feature_indices[r - 1] + 1;
+            for (int c = 0; c < k; c++) {
+                int gc = c == 0 ? 0 : model->feature_indices[c - 1] + 1;
+                a[(size_t)r * k + c] = ls->gram->xtx[(size_t)gr * ls->gram->dim + gc];
+            }
+            b[r] = ls->gram->xty[gr];
+        }
+        solve_info_t info;
+        int full_rank = solve_normal(a, b, model->coeffs, k, &info);
+        model->cond = info.cond;
+        if (!full_rank) {
+            for (int j = 0; j < k; j++) {
+                model->coeffs[j] = 0;
+            }
+        }
+        return full_rank;
+    }
+
+    for (int pos = 0; pos < chol->size; pos++) {
+        int col = chol->order[pos];
+        if (col == 0) {
+            model->coeffs[0] = sc->chol_coeffs[pos];
+            continue;
+        }
+        for (int j = 0; j < model->n_features; j++) {
+            if (model->feature_indices[j] == col - 1) {
+                model->coeffs[j + 1] = sc->chol_coeffs[pos];
+                break;
+            }
+        }
+    }
+    return 1;
+}
+
+// gray mode: consecutive subsets differ by one swap, so the cholesky factor
+// of the normal equations is updated by removing one column and appending
+// another (O(k²)) instead of refitting from the data (O(n k²))
+static void gray_search_worker(void *arg, int thread_id, long begin, long end) {
+    linear_search_t *ls = arg;
+    linear_scratch_t *sc = &ls->scratch[thread_id];
+    int n = ls->n_features;
+    int *indices = sc->candidate.feature_indices;
+
+    uint64_t rank = ls->rank_begin + (uint64_t)begin;
+    int subset_size = locate_rank(ls, rank, 1, indices);
+    uint64_t local = rank - ls->size_offset[subset_size];
+    uint64_t size_count = comb_count(ls->comb, n, subset_size);
+    int stale = 1; // factor must be rebuilt before use
+    PROF_COUNT(PROF_CANDIDATES, end - begin);
+
+    for (long t = begin; t < end; t++) {
+        sc->candidate.n_features = subset_size;
+        if (subset_has_gaps(ls, indices, subset_size)) {
+            evaluate_subset(ls, sc);
+            stale = 1;
+        } else {
+            PROF_BEGIN(PROF_SOLVE);
+            if (stale) {
+                subset_chol_factor(&sc->chol, ls->gram, indices, subset_size);
+            }
+            stale = !fit_from_factor(ls, sc);
+            PROF_END(PROF_SOLVE);
+            PROF_BEGIN(PROF_SCORE);
+            score_candidate(ls, sc);
+            PROF_END(PROF_SCORE);
+        }
+
+        if (++local == size_count) {
+            // first subset of the next size: {0, 1, .., k - 1}
+            subset_size++;
+            for (int i = 0; i < subset_size && subset_size <= ls->max_features; i++) {
+                indices[i] = i;
+            }
+            local = 0;
+            size_count = subset_size <= ls->max_features ? comb_count(ls->comb, n, subset_size) : 0;
+            stale = 1;
+        } else {
+            int removed, added;
+            revdoor_next(n, subset_size, indices, &removed, &added);
+            if (!stale) {
+                subset_chol_remove(&sc->chol, removed + 1);
+                stale = !subset_chol_add(&sc->chol, ls->gram, added + 1);
+            }
+        }
+    }
+}
+
+// number of subsets searched for sizes min_features..max_features,
+// saturating at UINT64_MAX
+uint64_t linear_subset_count(int n_features, int min_features, int max_features) {
+    if (max_features > n_features) max_features = n_features;
+    comb_table_t *comb = comb_table_create(n_features, max_features);
+    uint64_t total = 0;
     for (int s = min_features; s <= max_features; s++) {
-        // approximate C(n,k) for counting
-        int count = 1;
-        for (int i = 0; i < s; i++) {
-            count = count * (train->n_features - i) / (i + 1);
+        uint64_t c = comb_count(comb, n_features, s);
+        total = total > UINT64_MAX - c ? UINT64_MAX : total + c;
+    }
+    free_comb_table(comb);
+    return total;
+}
+
+// per-thread buffers of a search keeping up to capacity models each
+static void scratch_create(linear_search_t *ls, int n_valid, int capacity) {
+    int max_features = ls->max_features;
+    int n_threads = gmdh_thread_count();
+
+    // refits need room for the qr fallback's design copy, and subsets
+    // over columns with gaps for their complete rows ahead of it. a walk
+    // over a gram only refits those subsets
+    size_t work_doubles = 0;
+    if (ls->train_masks) {
+        int gaps = 0;
+        for (int c = 0; c < ls->train_masks->n_cols; c++) {
+            gaps |= !ls->train_masks->complete[c];
+        }
+        size_t n = (size_t)ls->train->n_samples;
+        if (!ls->gram || gaps) {
+            work_doubles = n * (max_features + 2) + (gaps ? n * (max_features + 1) : 0) + 1;
         }
-        total_combinations += count;
     }
 
-    printf("testing up to %d feature combinations...\n", total_combinations);
+    ls->scratch = gmdh_alloc(n_threads * sizeof(linear_scratch_t));
+    for (int t = 0; t < n_threads; t++) {
+        linear_scratch_t *sc = &ls->scratch[t];
+        sc->predictions = gmdh_alloc((n_valid + 1) * sizeof(double));
+        sc->candidate.coeffs = gmdh_alloc((max_features + 1) * sizeof(double));
+        sc->candidate.feature_indices = gmdh_alloc((max_features + 1) * sizeof(int));
+        topk_init(&sc->best, capacity, max_features);
+        subset_chol_init(&sc->chol, max_features + 1);
+        sc->chol_coeffs = gmdh_alloc((max_features + 1) * sizeof(double));
+        sc->qr_work = work_doubles > 0 ? gmdh_alloc(work_doubles * sizeof(double)) : NULL;
+        sc->rows = work_doubles > 0
+            ? gmdh_alloc((ls->train_masks->n_words + 1) * sizeof(uint64_t)) : NULL;
+        PROF_ALLOC((n_valid + 1 + work_doubles) * sizeof(double));
+    }
+}
 
-    linear_model_t *models = malloc(total_combinations * sizeof(linear_model_t));
+// gather every thread's survivors, keep the overall best capacity of them
+// and release the per-thread buffers
+static linear_model_t* scratch_collect(linear_search_t *ls, int capacity, int *n_models_out) {
+    int n_threads = gmdh_thread_count();
+    int n_kept = 0;
+    for (int t = 0; t < n_threads; t++) {
+        n_kept += ls->scratch[t].best.size;
+    }
+    linear_model_t *models = gmdh_alloc((n_kept + 1) * sizeof(linear_model_t));
     int model_idx = 0;
+    for (int t = 0; t < n_threads; t++) {
+        linear_topk_t *h = &ls->scratch[t].best;
+        for (int i = 0; i < h->size; i++) {
+            // ownership of the slot buffers moves to models
+            models[model_idx++] = h->slots[i];
+            h->slots[i].coeffs = NULL;
+            h->slots[i].feature_indices = NULL;
+        }
+    }
+    PROF_BEGIN(PROF_SORT);
+    int n_best = (int)rank_top(models, model_idx, sizeof(linear_model_t), capacity,
+                               linear_model_before);
+    PROF_END(PROF_SORT);
+    if (model_idx > n_best) {
+        for (int i = n_best; i < model_idx; i++) {
+            gmdh_free(models[i].coeffs);
+            gmdh_free(models[i].feature_indices);
+        }
+        model_idx = n_best;
+    }
+
+    for (int t = 0; t < n_threads; t++) {
+        linear_scratch_t *sc = &ls->scratch[t];
+        gmdh_free(sc->predictions);
+        gmdh_free(sc->candidate.coeffs);
+        gmdh_free(sc->candidate.feature_indices);
+        topk_free(&sc->best);
+        subset_chol_free(&sc->chol);
+        gmdh_free(sc->chol_coeffs);
+        gmdh_free(sc->qr_work);
+        gmdh_free(sc->rows);
+    }
+    gmdh_free(ls->scratch);
+    *n_models_out = model_idx;
+    return models;
+}
+
+// run the search set up in ls over the subsets of global rank
+// [rank_begin, rank_end): a gray walk when ls->gram is set, fold grams
+// when ls->folds is, refits otherwise. n_valid sizes the prediction buffers
+static linear_model_t* search_subsets(linear_search_t *ls, int n_valid,
+                                      uint64_t rank_begin, uint64_t rank_end,
+                                      int *n_models_out) {
+    int n_features = ls->n_features;
+    int min_features = ls->min_features;
+    int max_features = ls->max_features;
+    PROF_BEGIN(PROF_SWEEP);
 
-    // iterate through all subset sizes
-    for (int subset_size = min_features; subset_size <= max_features; subset_size++) {
-        // generate all combinations of subset_size features
-        int *indices = malloc(subset_size * sizeof(int));
-        for (int i = 0; i < subset_size; i++) {
-            indices[i] = i;
+    comb_table_t *comb = comb_table_create(n_features, max_features);
+    uint64_t *size_offset = gmdh_calloc(max_features + 2, sizeof(uint64_t));
+    for (int s = 0; s <= max_features; s++) {
+        uint64_t c = s >= min_features ? comb_count(comb, n_features, s) : 0;
+        size_offset[s + 1] = size_offset[s] > UINT64_MAX - c ? UINT64_MAX : size_offset[s] + c;
+    }
+    uint64_t total = size_offset[max_features + 1];
+    if (rank_end > total) rank_end = total;
+    if (rank_begin > rank_end) rank_begin = rank_end;
+    uint64_t n_candidates = rank_end - rank_begin;
+
+    int capacity = gmdh_current_options()->top_k;
+    if (capacity <= 0 || (uint64_t)capacity > n_candidates) {
+        if (n_candidates > INT_MAX / 2) {
+            fprintf(stderr, "linear gmdh: %llu subsets cannot all be kept, set top_k\n",
+                    (unsigned long long)n_candidates);
+            gmdh_free(size_offset);
+            free_comb_table(comb);
+            PROF_END(PROF_SWEEP);
+            *n_models_out = 0;
+            return NULL;
         }
+        capacity = n_candidates > 0 ? (int)n_candidates : 1;
+    }
+
+    gmdh_log("testing up to %llu feature combinations...\n", (unsigned long long)n_candidates);
 
-        int done = 0;
-        while (!done) {
-            // extract features for this combination
-            double **X_train = malloc(train->n_samples * sizeof(double*));
-            double **X_valid = malloc(valid->n_samples * sizeof(double*));
+    // pruning only pays, and is only exact, when some candidates are dropped
+    ls->prune = gmdh_current_options()->prune != GMDH_PRUNE_OFF && ls->valid && !ls->valid_gram &&
+                (uint64_t)capacity < n_candidates;
+    ls->bound = INFINITY;
+    ls->n_target = 0;
+    if (ls->prune) {
+        for (int r = 0; r < ls->valid->n_samples; r++) {
+            ls->n_target += !isnan(ls->valid->target[r]);
+        }
+    }
+
+    ls->comb = comb;
+    ls->size_offset = size_offset;
+    ls->rank_begin = rank_begin;
+    scratch_create(ls, n_valid, capacity);
+
+    if (ls->gram) {
+        // larger chunks amortise the refactorisation at each chunk start
+        parallel_for((long)n_candidates, 512, gmdh_thread_count(), gray_search_worker, ls);
+    } else {
+        parallel_for((long)n_candidates, 64, gmdh_thread_count(), linear_search_worker, ls);
+    }
+
+    linear_model_t *models = scratch_collect(ls, capacity, n_models_out);
+    gmdh_free(size_offset);
+    free_comb_table(comb);
+    PROF_END(PROF_SWEEP);
+    return models;
+}
 
-            for (int i = 0; i < train->n_samples; i++) {
-                X_train[i] = malloc(subset_size * sizeof(double));
-                for (int j = 0; j < subset_size; j++) {
-                    X_train[i][j] = train->data[i][indices[j]];
+// subsets of one size a beam search has met, each with its validation
+// error, so none is fitted twice: open addressing on the sorted indices
+typedef struct {
+    int k;              // size of every subset held
+    int stride;         // ints per entry, max_features
+    int *indices;
+    double *errors;     // set once the entry has been evaluated
+    int size;
+    int capacity;
+    int *slots;         // entry + 1, 0 = empty
+    int n_slots;        // power of two, more than twice size
+} subset_set_t;
+
+static void subset_set_init(subset_set_t *s, int max_features) {
+    memset(s, 0, sizeof(*s));
+    s->stride = max_features > 0 ? max_features : 1;
+}
+
+static void subset_set_free(subset_set_t *s) {
+    gmdh_free(s->indices);
+    gmdh_free(s->errors);
+    gmdh_free(s->slots);
+}
+
+// empty the set for subsets of size k
+static void subset_set_clear(subset_set_t *s, int k) {
+    s->k = k;
+    s->size = 0;
+    if (s->slots) memset(s->slots, 0, s->n_slots * sizeof(int));
+}
+
+static const int* subset_set_indices(const subset_set_t *s, int entry) {
+    return s->indices + (size_t)entry * s->stride;
+}
+
+static uint64_t subset_hash(const int *indices, int k) {
+    uint64_t h = 1469598103934665603ull;
+    for (int j = 0; j < k; j++) {
+        h = (h ^ (uint64_t)indices[j]) * 1099511628211ull;
+    }
+    return h ^ (h >> 32);
+}
+
+static void subset_set_rehash(subset_set_t *s, int n_slots) {
+    gmdh_free(s->slots);
+    s->slots = gmdh_calloc(n_slots, sizeof(int));
+    s->n_slots = n_slots;
+    uint64_t mask = (uint64_t)n_slots - 1;
+    for (int e = 0; e < s->size; e++) {
+        uint64_t h = subset_hash(subset_set_indices(s, e), s->k) & mask;
+        while (s->slots[h]) {
+            h = (h + 1) & mask;
+        }
+        s->slots[h] = e + 1;
+    }
+}
+
+// the entry of the k sorted indices, added if the set lacks them. *added
+// tells which
+static int subset_set_insert(subset_set_t *s, const int *indices, int *added) {
+    int k = s->k;
+    if (2 * (s->size + 1) > s->n_slots) {
+        subset_set_rehash(s, s->n_slots > 0 ? 2 * s->n_slots : 256);
+    }
+    uint64_t mask = (uint64_t)s->n_slots - 1;
+    uint64_t h = subset_hash(indices, k) & mask;
+    while (s->slots[h]) {
+        int e = s->slots[h] - 1;
+        if (memcmp(subset_set_indices(s, e), indices, k * sizeof(int)) == 0) {
+            *added = 0;
+            return e;
+        }
+        h = (h + 1) & mask;
+    }
+
+    if (s->size == s->capacity) {
+        int capacity = s->capacity > 0 ? 2 * s->capacity : 128;
+        int *grown = gmdh_alloc((size_t)capacity * s->stride * sizeof(int));
+        double *errors = gmdh_alloc(capacity * sizeof(double));
+        if (s->size > 0) {
+            memcpy(grown, s->indices, (size_t)s->size * s->stride * sizeof(int));
+            memcpy(errors, s->errors, s->size * sizeof(double));
+        }
+        gmdh_free(s->indices);
+        gmdh_free(s->errors);
+        s->indices = grown;
+        s->errors = errors;
+        s->capacity = capacity;
+    }
+    int e = s->size++;
+    memcpy(s->indices + (size_t)e * s->stride, indices, k * sizeof(int));
+    s->errors[e] = NAN;
+    s->slots[h] = e + 1;
+    *added = 1;
+    return e;
+}
+
+// one subset a beam step fits: the beam member `parent` with feature
+// `removed` swapped for `added`, or just extended by it when removed < 0
+typedef struct {
+    int parent;
+    int removed;
+    int added;
+    int entry;          // the subset's subset_set_t entry
+} beam_move_t;
+
+// a subset of the level ranked for the beam: lower error first (NaN
+// last), then the lower feature indices
+typedef struct {
+    double error;
+    const int *indices;
+    int k;
+    int entry;
+} beam_rank_t;
+
+static int beam_rank_before(const void *pa, const void *pb) {
+    const beam_rank_t *a = pa, *b = pb;
+    double ea = isnan(a->error) ? INFINITY : a->error;
+    double eb = isnan(b->error) ? INFINITY : b->error;
+    if (ea != eb) return ea < eb;
+    for (int j = 0; j < a->k; j++) {
+        if (a->indices[j] != b->indices[j]) return a->indices[j] < b->indices[j];
+    }
+    return 0;
+}
+
+// shared state of a beam search. the members are subsets of the current
+// size, each held with the cholesky factor its candidates start from
+typedef struct {
+    linear_search_t *ls;
+    subset_set_t set;
+    int width;
+    int n_members;
+    int *members;           // width x max_features sorted indices
+    int *member_entry;      // the member's entry in set, -1 for the empty subset
+    subset_chol_t *factors;
+    char *factor_ok;        // 0: factor singular or over gaps, refactor the candidates
+    beam_move_t *moves;     // candidates of the current step
+    int n_moves;
+    int move_capacity;
+    uint64_t n_fitted;
+} beam_search_t;
+
+// queue the sorted subset child for fitting from member parent, unless
+// this level has met it already. returns its entry
+static int beam_push(beam_search_t *bs, const int *child, int parent, int removed, int added) {
+    int is_new;
+    int entry = subset_set_insert(&bs->set, child, &is_new);
+    if (!is_new) return entry;
+    if (bs->n_moves == bs->move_capacity) {
+        int capacity = bs->move_capacity > 0 ? 2 * bs->move_capacity : 256;
+        beam_move_t *grown = gmdh_alloc(capacity * sizeof(beam_move_t));
+        if (bs->n_moves > 0) memcpy(grown, bs->moves, bs->n_moves * sizeof(beam_move_t));
+        gmdh_free(bs->moves);
+        bs->moves = grown;
+        bs->move_capacity = capacity;
+    }
+    beam_move_t *mv = &bs->moves[bs->n_moves++];
+    mv->parent = parent;
+    mv->removed = removed;
+    mv->added = added;
+    mv->entry = entry;
+    return entry;
+}
+
+// the sorted k-subset member without feature removed (none when < 0) and
+// with feature added
+static void beam_child(const int *member, int k_member, int removed, int added, int *child) {
+    int k = 0;
+    int placed = 0;
+    for (int j = 0; j < k_member; j++) {
+        if (member[j] == removed) continue;
+        if (!placed && added < member[j]) {
+            child[k++] = added;
+            placed = 1;
+        }
+        child[k++] = member[j];
+    }
+    if (!placed) child[k] = added;
+}
+
+// fit and score queued candidates: the parent's factor is copied and
+// updated by one column out and one in, O(k²), rather than refitted
+static void beam_worker(void *arg, int thread_id, long begin, long end) {
+    beam_search_t *bs = arg;
+    linear_search_t *ls = bs->ls;
+    linear_scratch_t *sc = &ls->scratch[thread_id];
+    linear_model_t *model = &sc->candidate;
+    int k = bs->set.k;
+    PROF_COUNT(PROF_CANDIDATES, end - begin);
+
+    for (long t = begin; t < end; t++) {
+        const beam_move_t *mv = &bs->moves[t];
+        memcpy(model->feature_indices, subset_set_indices(&bs->set, mv->entry), k * sizeof(int));
+        model->n_features = k;
+        if (subset_has_gaps(ls, model->feature_indices, k)) {
+            evaluate_subset(ls, sc);
+        } else {
+            PROF_BEGIN(PROF_SOLVE);
+            if (bs->factor_ok[mv->parent]) {
+                subset_chol_copy(&sc->chol, &bs->factors[mv->parent]);
+                if (mv->removed >= 0) subset_chol_remove(&sc->chol, mv->removed + 1);
+                subset_chol_add(&sc->chol, ls->gram, mv->added + 1);
+            } else {
+                subset_chol_factor(&sc->chol, ls->gram, model->feature_indices, k);
+            }
+            fit_from_factor(ls, sc);
+            PROF_END(PROF_SOLVE);
+            PROF_BEGIN(PROF_SCORE);
+            score_candidate(ls, sc);
+            PROF_END(PROF_SCORE);
+        }
+        bs->set.errors[mv->entry] = model->error;
+    }
+}
+
+static void beam_fit_moves(beam_search_t *bs) {
+    parallel_for(bs->n_moves, 16, gmdh_thread_count(), beam_worker, bs);
+    bs->n_fitted += bs->n_moves;
+    bs->n_moves = 0;
+}
+
+// make entry the beam's member m, factored afresh
+static void beam_set_member(beam_search_t *bs, int m, int entry) {
+    linear_search_t *ls = bs->ls;
+    int k = bs->set.k;
+    int *member = bs->members + (size_t)m * bs->set.stride;
+    memcpy(member, subset_set_indices(&bs->set, entry), k * sizeof(int));
+    bs->member_entry[m] = entry;
+    bs->factor_ok[m] = !subset_has_gaps(ls, member, k) &&
+                       subset_chol_factor(&bs->factors[m], ls->gram, member, k);
+}
+
+static beam_rank_t beam_rank(const beam_search_t *bs, int entry) {
+    beam_rank_t r;
+    r.error = bs->set.errors[entry];
+    r.indices = subset_set_indices(&bs->set, entry);
+    r.k = bs->set.k;
+    r.entry = entry;
+    return r;
+}
+
+// rounds of swap refinement of a new beam: every member's neighbours,
+// one feature out and another in, are fitted from its factor, and each
+// member moves to its best neighbour when that ranks before it and is not
+// already in the beam. stops early once no member moves
+static void beam_refine(beam_search_t *bs, int *child, int *neighbours) {
+    int n = bs->ls->n_features;
+    int k = bs->set.k;
+    int stride = bs->set.stride;
+
+    for (int round = 0; round < gmdh_current_options()->beam_swaps; round++) {
+        int n_neighbours = 0;
+        for (int m = 0; m < bs->n_members; m++) {
+            const int *member = bs->members + (size_t)m * stride;
+            for (int j = 0; j < k; j++) {
+                for (int f = 0, p = 0; f < n; f++) {
+                    if (p < k && member[p] == f) {
+                        p++;
+                        continue;
+                    }
+                    beam_child(member, k, member[j], f, child);
+                    neighbours[n_neighbours++] = beam_push(bs, child, m, member[j], f);
                 }
             }
+        }
+        beam_fit_moves(bs);
 
-            for (int i = 0; i < valid->n_samples; i++) {
-                X_valid[i] = malloc(subset_size * sizeof(double));
-                for (int j = 0; j < subset_size; j++) {
-                    X_valid[i][j] = valid->data[i][indices[j]];
+        int moved = 0;
+        int per_member = k * (n - k);
+        for (int m = 0; m < bs->n_members; m++) {
+            beam_rank_t best = beam_rank(bs, bs->member_entry[m]);
+            int best_entry = -1;
+            for (int i = 0; i < per_member; i++) {
+                int e = neighbours[m * per_member + i];
+                beam_rank_t r = beam_rank(bs, e);
+                if (!beam_rank_before(&r, &best)) continue;
+                int member = 0;
+                for (int o = 0; o < bs->n_members && !member; o++) {
+                    member = bs->member_entry[o] == e;
                 }
+                if (member) continue;
+                best = r;
+                best_entry = e;
+            }
+            if (best_entry >= 0) {
+                beam_set_member(bs, m, best_entry);
+                moved = 1;
             }
+        }
+        if (!moved) break;
+    }
+}
 
-            // fit model
-            double *coeffs = malloc((subset_size + 1) * sizeof(double));
-            fit_linear_multivariate(X_train, train->target, train->n_samples, subset_size, coeffs);
+// multistage (combi/mia-style) search under GMDH_LINEAR_BEAM: from the
+// empty subset, each size's beam is the best beam_width subsets reached
+// by adding one feature to a member of the last, refined by swaps. every
+// subset fitted is offered to the top_k as in the exhaustive search, so
+// the cost is polynomial in the feature count, roughly beam_width * n *
+// (1 + beam_swaps * k) fits at size k
+static linear_model_t* beam_search(linear_search_t *ls, int n_valid, int *n_models_out) {
+    int n = ls->n_features;
+    int max_features = ls->max_features;
+    const gmdh_options_t *opts = gmdh_current_options();
+    int width = opts->beam_width > 0 ? opts->beam_width : 1;
+    PROF_BEGIN(PROF_SWEEP);
 
-            // evaluate on validation set
-            double *predictions = malloc(valid->n_samples * sizeof(double));
-            for (int i = 0; i < valid->n_samples; i++) {
-                predictions[i] = predict_linear(X_valid[i], coeffs, subset_size);
+    // at most width * n extensions and width * k * (n - k) swaps per
+    // round at size k, and never more subsets than there are
+    comb_table_t *comb = comb_table_create(n, max_features);
+    uint64_t bound = 0;
+    for (int k = ls->min_features; k <= max_features; k++) {
+        uint64_t fits = (uint64_t)width * n * (1 + (uint64_t)opts->beam_swaps * k);
+        uint64_t c = comb_count(comb, n, k);
+        bound += c < fits ? c : fits;
+    }
+    free_comb_table(comb);
+
+    int capacity = opts->top_k;
+    if (capacity <= 0 || (uint64_t)capacity > bound) {
+        if (bound > INT_MAX / 2) {
+            fprintf(stderr, "linear gmdh: %llu subsets cannot all be kept, set top_k\n",
+                    (unsigned long long)bound);
+            PROF_END(PROF_SWEEP);
+            *n_models_out = 0;
+            return NULL;
+        }
+        capacity = bound > 0 ? (int)bound : 1;
+    }
+
+    gmdh_log("beam search over %d features: width %d, %d swap rounds\n", n, width,
+             opts->beam_swaps);
+
+    beam_search_t bs;
+    memset(&bs, 0, sizeof(bs));
+    bs.ls = ls;
+    bs.width = width;
+    subset_set_init(&bs.set, max_features);
+    bs.members = gmdh_alloc((size_t)width * bs.set.stride * sizeof(int));
+    bs.member_entry = gmdh_alloc(width * sizeof(int));
+    bs.factor_ok = gmdh_alloc(width);
+    bs.factors = gmdh_alloc(width * sizeof(subset_chol_t));
+    for (int m = 0; m < width; m++) {
+        subset_chol_init(&bs.factors[m], max_features + 1);
+    }
+    int *child = gmdh_alloc((max_features + 1) * sizeof(int));
+    int *neighbours = gmdh_alloc(((size_t)width * max_features * n + 1) * sizeof(int));
+    beam_rank_t *ranked = NULL;
+    int ranked_capacity = 0;
+    scratch_create(ls, n_valid, capacity);
+
+    // the empty subset, whose factor holds just the intercept
+    bs.n_members = 1;
+    bs.member_entry[0] = -1;
+    bs.factor_ok[0] = subset_chol_factor(&bs.factors[0], ls->gram, NULL, 0);
+
+    for (int k = 1; k <= max_features; k++) {
+        subset_set_clear(&bs.set, k);
+        for (int m = 0; m < bs.n_members; m++) {
+            const int *member = bs.members + (size_t)m * bs.set.stride;
+            for (int f = 0, p = 0; f < n; f++) {
+                if (p < k - 1 && member[p] == f) {
+                    p++;
+                    continue;
+                }
+                beam_child(member, k - 1, -1, f, child);
+                beam_push(&bs, child, m, -1, f);
             }
+        }
+        beam_fit_moves(&bs);
 
-            double error = calculate_rmse(predictions, valid->target, valid->n_samples);
-            double r2 = calculate_r2(predictions, valid->target, valid->n_samples);
+        // the next beam: the best of this size's subsets
+        if (bs.set.size > ranked_capacity) {
+            gmdh_free(ranked);
+            ranked_capacity = bs.set.size;
+            ranked = gmdh_alloc(ranked_capacity * sizeof(beam_rank_t));
+        }
+        for (int e = 0; e < bs.set.size; e++) {
+            ranked[e] = beam_rank(&bs, e);
+        }
+        bs.n_members = (int)rank_top(ranked, bs.set.size, sizeof(beam_rank_t), width,
+                                     beam_rank_before);
+        for (int m = 0; m < bs.n_members; m++) {
+            beam_set_member(&bs, m, ranked[m].entry);
+        }
+        beam_refine(&bs, child, neighbours);
+    }
 
-            // store model
-            models[model_idx].coeffs = coeffs;
-            models[model_idx].feature_indices = malloc(subset_size * sizeof(int));
-            memcpy(models[model_idx].feature_indices, indices, subset_size * sizeof(int));
-            models[model_idx].n_features = subset_size;
-            models[model_idx].error = error;
-            models[model_idx].r2 = r2;
+    gmdh_log("fitted %llu feature combinations\n", (unsigned long long)bs.n_fitted);
+    linear_model_t *models = scratch_collect(ls, capacity, n_models_out);
 
-            model_idx++;
+    for (int m = 0; m < width; m++) {
+        subset_chol_free(&bs.factors[m]);
+    }
+    gmdh_free(bs.factors);
+    gmdh_free(bs.factor_ok);
+    gmdh_free(bs.member_entry);
+    gmdh_free(bs.members);
+    gmdh_free(bs.moves);
+    subset_set_free(&bs.set);
+    gmdh_free(child);
+    gmdh_free(neighbours);
+    gmdh_free(ranked);
+    PROF_END(PROF_SWEEP);
+    return models;
+}
 
-            // cleanup
-            for (int i = 0; i < train->n_samples; i++) {
-                free(X_train[i]);
+// the search behind linear_combinatorial_gmdh_range. a gram given is
+// walked as under GMDH_LINEAR_GRAY unless linear_mode is
+// GMDH_LINEAR_BEAM, which grows its beams over the whole rank range: a
+// slice of the exhaustive enumeration is walked exhaustively
+static linear_model_t* search_range(dataset_t *train, dataset_t *valid,
+                                    const linear_gram_t *gram,
+                                    int min_features, int max_features,
+                                    uint64_t rank_begin, uint64_t rank_end,
+                                    int *n_models_out) {
+    if (max_features > train->n_features) max_features = train->n_features;
+    if (min_features < 1) min_features = 1;
+    const gmdh_options_t *opts = gmdh_current_options();
+
+    linear_search_t ls;
+    memset(&ls, 0, sizeof(ls));
+    ls.train = train;
+    ls.train_masks = column_masks_build(train);
+    ls.valid = valid;
+    ls.n_features = train->n_features;
+    ls.min_features = min_features;
+    ls.max_features = max_features;
+    linear_gram_t *own = NULL;
+    if (gram) {
+        ls.gram = gram;
+    } else if (opts->linear_mode != GMDH_LINEAR_REFIT) {
+        PROF_BEGIN(PROF_NORMAL);
+        ls.gram = own = linear_gram_compute(train);
+        PROF_END(PROF_NORMAL);
+    }
+    if (opts->scoring == GMDH_SCORE_MOMENTS) {
+        // subsets over complete validation columns are scored from the
+        // gram, on the same rows a prediction would score; the rest by
+        // predicting
+        PROF_BEGIN(PROF_NORMAL);
+        ls.valid_shift = dataset_target_mean(valid);
+        ls.valid_gram = linear_gram_compute_shifted(valid, ls.valid_shift);
+        PROF_END(PROF_NORMAL);
+        // a feature lacking a value on a row with a target
+        column_masks_t *vm = column_masks_build(valid);
+        const uint64_t *has_target = column_mask(vm, valid->n_features);
+        ls.valid_missing = gmdh_calloc(valid->n_features + 1, 1);
+        for (int f = 0; f < valid->n_features; f++) {
+            const uint64_t *bits = column_mask(vm, f);
+            uint64_t lacking = 0;
+            for (int w = 0; w < vm->n_words; w++) {
+                lacking |= has_target[w] & ~bits[w];
             }
-            free(X_train);
+            ls.valid_missing[f] = lacking != 0;
+        }
+        free_column_masks(vm);
+    } else if (opts->prune == GMDH_PRUNE_BOUND) {
+        ls.floor_gram = linear_gram_compute(valid);
+    }
+
+    linear_model_t *models;
+    if (opts->linear_mode == GMDH_LINEAR_BEAM && rank_begin == 0 &&
+        rank_end == UINT64_MAX) {
+        models = beam_search(&ls, valid->n_samples, n_models_out);
+    } else {
+        models = search_subsets(&ls, valid->n_samples, rank_begin, rank_end, n_models_out);
+    }
+    free_linear_gram(own);
+    free_column_masks(ls.train_masks);
+    free_linear_gram(ls.floor_gram);
+    free_linear_gram(ls.valid_gram);
+    gmdh_free(ls.valid_missing);
+    return models;
+}
+
+// linear gmdh over the subsets of global rank [rank_begin, rank_end).
+// only the best gmdh_options.top_k models are kept, so memory does not
+// grow with the search; independent ranges can run anywhere and be
+// combined with linear_models_merge
+linear_model_t* linear_combinatorial_gmdh_range(dataset_t *train, dataset_t *valid,
+                                                int min_features, int max_features,
+                                                uint64_t rank_begin, uint64_t rank_end,
+                                                int *n_models_out) {
+    return search_range(train, valid, NULL, min_features, max_features, rank_begin, rank_end,
+                        n_models_out);
+}
+
+// linear gmdh walking gram, the gram matrix of train computed elsewhere
+// (shared between targets, say), with no pass over the training rows
+linear_model_t* linear_combinatorial_gmdh_gram(dataset_t *train, dataset_t *valid,
+                                               const linear_gram_t *gram, int min_features,
+                                               int max_features, int *n_models_out) {
+    return search_range(train, valid, gram, min_features, max_features, 0, UINT64_MAX,
+                        n_models_out);
+}
+
+// linear gmdh with a cross-validated external criterion: every subset is
+// fitted on all of ds and scored by cv, both from the fold grams
+linear_model_t* linear_combinatorial_gmdh_cv(dataset_t *ds, const gmdh_cv_t *cv,
+                                             int min_features, int max_features,
+                                             int *n_models_out) {
+    if (max_features > ds->n_features) max_features = ds->n_features;
+    if (min_features < 1) min_features = 1;
+
+    char scheme[64];
+    gmdh_log("linear gmdh: %s\n", cv_describe(cv, scheme, sizeof(scheme)));
+
+    linear_search_t ls;
+    memset(&ls, 0, sizeof(ls));
+    ls.n_features = ds->n_features;
+    ls.min_features = min_features;
+    ls.max_features = max_features;
+    PROF_BEGIN(PROF_NORMAL);
+    ls.folds = linear_folds_compute(ds, cv);
+    PROF_END(PROF_NORMAL);
+
+    linear_model_t *models = search_subsets(&ls, 0, 0, UINT64_MAX, n_models_out);
+    free_linear_folds(ls.folds);
+    return models;
+}
+
+// shared state of a streamed rescoring pass over the surviving models
+typedef struct {
+    dataset_t *valid;
+    linear_model_t *models;
+    score_sums_t *sums;
+    double shift;
+    double **predictions;   // per-thread scratch, one block each
+} linear_rescore_t;
+
+static void linear_rescore_worker(void *arg, int thread_id, long begin, long end) {
+    linear_rescore_t *job = arg;
+    dataset_t *valid = job->valid;
+    double *predictions = job->predictions[thread_id];
+
+    for (long m = begin; m < end; m++) {
+        linear_model_t *model = &job->models[m];
+        for (int i = 0; i < valid->n_samples; i++) {
+            predictions[i] = model->coeffs[0];
+        }
+        for (int j = 0; j < model->n_features; j++) {
+            const double *x = valid->cols[model->feature_indices[j]];
+            double c = model->coeffs[j + 1];
             for (int i = 0; i < valid->n_samples; i++) {
-                free(X_valid[i]);
+                predictions[i] += c * x[i];
             }
-            free(X_valid);
-            free(predictions);
+        }
+        score_accumulate(predictions, valid->target, valid->n_samples, job->shift,
+                         &job->sums[m]);
+    }
+}
 
-            // next combination
-            int i = subset_size - 1;
-            while (i >= 0 && indices[i] == train->n_features - subset_size + i) {
-                i--;
-            }
-            if (i < 0) {
-                done = 1;
-            } else {
-                indices[i]++;
-                for (int j = i + 1; j < subset_size; j++) {
-                    indices[j] = indices[j - 1] + 1;
-                }
-            }
+// linear gmdh over a stream too large to hold in memory, split like
+// split_dataset. pass 1 adds the training blocks to training grams and
+// the validation blocks to validation grams, one per pattern of missing
+// features; every subset is then fitted and ranked from the grams by a
+// gray walk, a subset over features with gaps on the rows that have all
+// of it. pass 2 rescores the top_k survivors on the validation blocks,
+// with the same missing-value rules as the in-memory search. NULL when a
+// read of the stream failed
+linear_model_t* linear_combinatorial_gmdh_stream(row_stream_t *s, double train_ratio,
+                                                 int min_features, int max_features,
+                                                 int *n_models_out) {
+    int m = s->block->n_features;
+    if (max_features > m) max_features = m;
+    if (min_features < 1) min_features = 1;
+
+    int64_t n_rows = row_stream_count(s);
+    int64_t n_train = (int64_t)(n_rows * train_ratio);
+    int n_threads = gmdh_thread_count();
+    gmdh_log("linear gmdh: streaming %lld rows (%lld training)\n",
+           (long long)n_rows, (long long)n_train);
+
+    double **cols = gmdh_alloc((m + 1) * sizeof(double*));
+    dataset_t part;
+    dataset_t *blk;
+    int64_t seen = 0;
+
+    // pass 1: training and validation grams
+    linear_search_t ls;
+    memset(&ls, 0, sizeof(ls));
+    ls.n_features = m;
+    ls.min_features = min_features;
+    ls.max_features = max_features;
+    linear_gram_patterns_t *train_patterns = linear_gram_patterns_create(m);
+    linear_gram_patterns_t *valid_patterns = linear_gram_patterns_create(m);
+    while ((blk = row_stream_next(s))) {
+        int64_t ahead = n_train - seen;
+        int split = ahead <= 0 ? 0 : ahead < blk->n_samples ? (int)ahead : blk->n_samples;
+        seen += blk->n_samples;
+        if (split > 0) {
+            dataset_slice(blk, 0, split, &part, cols);
+            linear_gram_patterns_accumulate(train_patterns, &part);
         }
+        if (split < blk->n_samples) {
+            dataset_slice(blk, split, blk->n_samples - split, &part, cols);
+            linear_gram_patterns_accumulate(valid_patterns, &part);
+        }
+    }
+    if (train_patterns->n_rest || valid_patterns->n_rest) {
+        gmdh_log("linear gmdh: more than %d patterns of missing features, subsets over "
+                 "features that %lld rows lack are left unscored\n", train_patterns->capacity,
+                 (long long)(train_patterns->n_rest + valid_patterns->n_rest));
+    }
 
-        free(indices);
+    linear_gram_t *gram = linear_gram_patterns_total(train_patterns);
+    ls.gram = gram;
+    ls.valid_gram = linear_gram_patterns_total(valid_patterns);
+    ls.train_patterns = train_patterns;
+    ls.valid_patterns = valid_patterns;
+    int n_models = 0;
+    linear_model_t *models = search_subsets(&ls, 0, 0, UINT64_MAX, &n_models);
+    free_linear_gram(gram);
+    free_linear_gram(ls.valid_gram);
+    free_linear_gram_patterns(train_patterns);
+    free_linear_gram_patterns(valid_patterns);
+    if (!models || s->error) {
+        free_linear_models(models, n_models);
+        gmdh_free(cols);
+        *n_models_out = 0;
+        return NULL;
     }
 
-    *n_models_out = model_idx;
+    // pass 2: exact validation sums of the survivors
+    linear_rescore_t job;
+    job.models = models;
+    job.sums = gmdh_calloc(n_models + 1, sizeof(score_sums_t));
+    job.shift = 0;
+    job.predictions = gmdh_alloc(n_threads * sizeof(double*));
+    for (int t = 0; t < n_threads; t++) {
+        job.predictions[t] = gmdh_alloc((s->block_rows + 1) * sizeof(double));
+    }
 
-    // sort by error
-    for (int i = 0; i < model_idx - 1; i++) {
-        for (int j = 0; j < model_idx - i - 1; j++) {
-            if (models[j].error > models[j + 1].error) {
-                linear_model_t tmp = models[j];
-                models[j] = models[j + 1];
-                models[j + 1] = tmp;
-            }
+    row_stream_rewind(s);
+    seen = 0;
+    int first = 1;
+    while ((blk = row_stream_next(s))) {
+        int64_t ahead = n_train - seen;
+        int begin = ahead <= 0 ? 0 : ahead < blk->n_samples ? (int)ahead : blk->n_samples;
+        seen += blk->n_samples;
+        if (begin == blk->n_samples) continue;
+
+        dataset_slice(blk, begin, blk->n_samples - begin, &part, cols);
+        if (first) {
+            job.shift = part.target[0];
+            first = 0;
+        }
+        job.valid = &part;
+        parallel_for(n_models, 4, n_threads, linear_rescore_worker, &job);
+    }
+
+    for (int i = 0; i < n_models; i++) {
+        score_finish(&job.sums[i], &models[i].error, &models[i].r2);
+    }
+    rank_sort(models, n_models, sizeof(linear_model_t), linear_model_before);
+
+    for (int t = 0; t < n_threads; t++) {
+        gmdh_free(job.predictions[t]);
+    }
+    gmdh_free(job.predictions);
+    gmdh_free(job.sums);
+    gmdh_free(cols);
+    if (s->error) {
+        free_linear_models(models, n_models);
+        *n_models_out = 0;
+        return NULL;
+    }
+
+    *n_models_out = n_models;
+    return models;
+}
+
+// combinatorial linear gmdh: try all subsets of features, or of those
+// that pass screening when gmdh_options.screen_budget is set. models name
+// features of train either way
+linear_model_t* linear_combinatorial_gmdh(dataset_t *train, dataset_t *valid,
+                                          int min_features, int max_features,
+                                          int *n_models_out) {
+    dataset_t tr, va;
+    feature_screen_t *fs = screen_for_search(train, valid, 1, &tr, &va);
+    if (!fs) {
+        return linear_combinatorial_gmdh_range(train, valid, min_features, max_features,
+                                               0, UINT64_MAX, n_models_out);
+    }
+
+    linear_model_t *models = linear_combinatorial_gmdh_range(&tr, &va, min_features,
+                                                             max_features, 0, UINT64_MAX,
+                                                             n_models_out);
+    screen_map_linear(fs, models, *n_models_out);
+    free_feature_screen(fs);
+    return models;
+}
+
+// combine the results of two searches (e.g. disjoint rank ranges) into
+// the best k models. takes ownership of both arrays
+linear_model_t* linear_models_merge(linear_model_t *a, int n_a, linear_model_t *b, int n_b,
+                                    int k, int *n_models_out) {
+    linear_model_t *models = gmdh_alloc((n_a + n_b + 1) * sizeof(linear_model_t));
+    if (n_a > 0) memcpy(models, a, n_a * sizeof(linear_model_t));
+    if (n_b > 0) memcpy(models + n_a, b, n_b * sizeof(linear_model_t));
+    gmdh_free(a);
+    gmdh_free(b);
+
+    int n = n_a + n_b;
+    rank_top(models, n, sizeof(linear_model_t), k > 0 ? (size_t)k : (size_t)n,
+             linear_model_before);
+    if (k > 0 && n > k) {
+        for (int i = k; i < n; i++) {
+            gmdh_free(models[i].coeffs);
+            gmdh_free(models[i].feature_indices);
         }
+        n = k;
     }
 
+    *n_models_out = n;
     return models;
 }
 
 void print_linear_model(linear_model_t *model, char **feature_names) {
-    printf("y = %.3f", model->coeffs[0]);
+    gmdh_log("y = %.3f", model->coeffs[0]);
     for (int i = 0; i < model->n_features; i++) {
-        printf(" %c %.3f*%s",
+        gmdh_log(" %c %.3f*%s",
                model->coeffs[i + 1] >= 0 ? '+' : '-',
                fabs(model->coeffs[i + 1]),
                feature_names[model->feature_indices[i]]);
     }
-    printf("\n");
-    printf("  rmse: %.4f, r²: %.4f, features: %d\n", model->error, model->r2, model->n_features);
+    gmdh_log("\n");
+    gmdh_log("  rmse: %.4f, r²: %.4f, features: %d\n", model->error, model->r2, model->n_features);
+    if (model->cond > GMDH_COND_WARN) {
+        gmdh_log("  warning: ill-conditioned fit (cond %.1e)\n", model->cond);
+    }
 }
 
 void free_linear_models(linear_model_t *models, int n_models) {
     for (int i = 0; i < n_models; i++) {
-        free(models[i].coeffs);
-        free(models[i].feature_indices);
+        gmdh_free(models[i].coeffs);
+        gmdh_free(models[i].feature_indices);
     }
-    free(models);
+    gmdh_free(models);
 }
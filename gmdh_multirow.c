@@ -1,205 +1,219 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
 #include "gmdh.h"
 
-// multi-row gmdh: layer-by-layer evolution
-gmdh_layer_t* multirow_gmdh(dataset_t *train, dataset_t *valid, int n_layers, int models_per_layer) {
-    gmdh_layer_t *layers = malloc(n_layers * sizeof(gmdh_layer_t));
-    
-    printf("multi-row gmdh: %d layers, %d models per layer\n", n_layers, models_per_layer);
+// layer outputs shared by every multirow run in the process, so a network
+// retrained on the same data reuses the columns of the neurons it finds
+// again. a run that finds the cache busy works with a private one
+static neuron_cache_t *shared_cache;
+static pthread_mutex_t shared_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static neuron_cache_t* cache_acquire(void) {
+    if (pthread_mutex_trylock(&shared_lock) != 0) {
+        return neuron_cache_create(0);
+    }
+    size_t max_bytes = gmdh_current_options()->neuron_cache_bytes;
+    if (!shared_cache) shared_cache = neuron_cache_create(max_bytes);
+    shared_cache->max_bytes = max_bytes;
+    return shared_cache;
+}
+
+static void cache_release(neuron_cache_t *cache) {
+    if (cache != shared_cache) {
+        free_neuron_cache(cache);
+        return;
+    }
+    neuron_cache_trim(cache);
+    pthread_mutex_unlock(&shared_lock);
+}
+
+// hits and misses of the shared layer output cache so far
+void multirow_cache_stats(uint64_t *hits, uint64_t *misses) {
+    pthread_mutex_lock(&shared_lock);
+    *hits = shared_cache ? shared_cache->hits : 0;
+    *misses = shared_cache ? shared_cache->misses : 0;
+    pthread_mutex_unlock(&shared_lock);
+}
+
+// drop every cached layer output
+void multirow_cache_clear(void) {
+    pthread_mutex_lock(&shared_lock);
+    free_neuron_cache(shared_cache);
+    shared_cache = NULL;
+    pthread_mutex_unlock(&shared_lock);
+}
+
+// fit and score every pair of a layer's inputs: on the validation rows,
+// or by cross-validation over the training rows when cv is set. gs, when
+// given, holds the pair statistics of the inputs
+static void sweep_layer(dataset_t *train, dataset_t *valid, const gmdh_cv_t *cv,
+                        const gram_stats_t *gs, polynomial_model_t *models,
+                        int models_per_layer) {
+    if (cv) {
+        sweep_quadratic_pairs_cv(train, cv, models);
+    } else {
+        sweep_quadratic_pairs_gram(train, valid, gs, models, models_per_layer);
+    }
+}
+
+// multi-row gmdh: layer-by-layer evolution. valid is NULL under
+// cross-validation, where every neuron is fitted on all of train. gs, when
+// given, holds the pair statistics of train for layer 0
+static gmdh_layer_t* evolve_layers(dataset_t *train, dataset_t *valid, const gmdh_cv_t *cv,
+                                   const gram_stats_t *gs, int n_layers,
+                                   int models_per_layer) {
+    gmdh_layer_t *layers = gmdh_calloc(n_layers, sizeof(gmdh_layer_t));
+    int n_valid = valid ? valid->n_samples : 0;
     
     // layer 0: select best models from original features
     int n_pairs = (train->n_features * (train->n_features - 1)) / 2;
-    polynomial_model_t *all_models = malloc(n_pairs * sizeof(polynomial_model_t));
-    
-    int model_idx = 0;
-    for (int i = 0; i < train->n_features; i++) {
-        for (int j = i + 1; j < train->n_features; j++) {
-            double *x1_train = malloc(train->n_samples * sizeof(double));
-            double *x2_train = malloc(train->n_samples * sizeof(double));
-            
-            for (int k = 0; k < train->n_samples; k++) {
-                x1_train[k] = train->data[k][i];
-                x2_train[k] = train->data[k][j];
-            }
-            
-            polynomial_model_t *model = &all_models[model_idx];
-            model->feature1 = i;
-            model->feature2 = j;
-            
-            fit_polynomial(x1_train, x2_train, train->target, train->n_samples, model->coeffs);
-            
-            double *predictions = malloc(valid->n_samples * sizeof(double));
-            for (int k = 0; k < valid->n_samples; k++) {
-                predictions[k] = predict_polynomial(
-                    valid->data[k][i],
-                    valid->data[k][j],
-                    model->coeffs
-                );
-            }
-            
-            model->error = calculate_rmse(predictions, valid->target, valid->n_samples);
-            model->r2 = calculate_r2(predictions, valid->target, valid->n_samples);
-            
-            free(x1_train);
-            free(x2_train);
-            free(predictions);
-            
-            model_idx++;
-        }
-    }
+    polynomial_model_t *all_models = gmdh_alloc(n_pairs * sizeof(polynomial_model_t));
+    PROF_ALLOC(n_pairs * sizeof(polynomial_model_t));
     
-    // sort by error
-    for (int i = 0; i < model_idx - 1; i++) {
-        for (int j = 0; j < model_idx - i - 1; j++) {
-            if (all_models[j].error > all_models[j + 1].error) {
-                polynomial_model_t tmp = all_models[j];
-                all_models[j] = all_models[j + 1];
-                all_models[j + 1] = tmp;
-            }
-        }
-    }
+    sweep_layer(train, valid, cv, gs, all_models, models_per_layer);
+    int model_idx = n_pairs;
     
     // keep top models
-    int n_selected = models_per_layer < model_idx ? models_per_layer : model_idx;
-    layers[0].models = malloc(n_selected * sizeof(polynomial_model_t));
+    PROF_BEGIN(PROF_SORT);
+    int n_selected = (int)rank_top(all_models, model_idx, sizeof(polynomial_model_t),
+                                   models_per_layer, polynomial_model_before);
+    PROF_END(PROF_SORT);
+    layers[0].models = gmdh_alloc(n_selected * sizeof(polynomial_model_t));
     memcpy(layers[0].models, all_models, n_selected * sizeof(polynomial_model_t));
     layers[0].n_models = n_selected;
     layers[0].layer = 0;
     
-    printf("layer 0: selected %d best models, best rmse: %.4f\n", 
+    gmdh_log("layer 0: selected %d best models, best rmse: %.4f\n", 
            n_selected, layers[0].models[0].error);
     
-    free(all_models);
+    gmdh_free(all_models);
     
-    // subsequent layers: breed new features from previous layer outputs
+    // subsequent layers: breed new features from previous layer outputs.
+    // a layer's inputs are views onto the cached output columns of the
+    // previous layer's models; keys name each column for the cache
+    neuron_cache_t *cache = cache_acquire();
+    neuron_cache_begin_run(cache);
+
+    int width = models_per_layer > train->n_features ? models_per_layer : train->n_features;
+    double **cols = gmdh_alloc(4 * (width + 1) * sizeof(double*));
+    double **prev_train_cols = cols, **prev_valid_cols = cols + (width + 1);
+    double **cur_train_cols = cols + 2 * (width + 1), **cur_valid_cols = cols + 3 * (width + 1);
+    uint64_t *keys = gmdh_alloc(2 * (width + 1) * sizeof(uint64_t));
+    uint64_t *prev_keys = keys, *cur_keys = keys + (width + 1);
+
+    for (int f = 0; f < train->n_features; f++) {
+        prev_train_cols[f] = train->cols[f];
+        prev_valid_cols[f] = valid ? valid->cols[f] : NULL;
+        if (n_layers > 1) {
+            prev_keys[f] = column_key(train->cols[f], train->n_samples,
+                                      prev_valid_cols[f], n_valid);
+        }
+    }
+
+    dataset_t layer_train = *train, layer_valid = valid ? *valid : *train;
+    layer_train.data = layer_valid.data = NULL;
+    layer_train.feature_names = layer_valid.feature_names = NULL;
+
     for (int layer = 1; layer < n_layers; layer++) {
         int prev_n_models = layers[layer - 1].n_models;
         
-        // generate new dataset with outputs from previous layer as features
-        dataset_t *new_train = malloc(sizeof(dataset_t));
-        dataset_t *new_valid = malloc(sizeof(dataset_t));
-        
-        new_train->n_samples = train->n_samples;
-        new_train->n_features = prev_n_models;
-        new_train->data = malloc(train->n_samples * sizeof(double*));
-        new_train->target = train->target;
-        
-        new_valid->n_samples = valid->n_samples;
-        new_valid->n_features = prev_n_models;
-        new_valid->data = malloc(valid->n_samples * sizeof(double*));
-        new_valid->target = valid->target;
-        
-        // compute outputs from previous layer
-        for (int i = 0; i < train->n_samples; i++) {
-            new_train->data[i] = malloc(prev_n_models * sizeof(double));
-            for (int j = 0; j < prev_n_models; j++) {
-                polynomial_model_t *prev_model = &layers[layer - 1].models[j];
-                new_train->data[i][j] = predict_polynomial(
-                    train->data[i][prev_model->feature1],
-                    train->data[i][prev_model->feature2],
-                    prev_model->coeffs
-                );
-            }
-        }
-        
-        for (int i = 0; i < valid->n_samples; i++) {
-            new_valid->data[i] = malloc(prev_n_models * sizeof(double));
-            for (int j = 0; j < prev_n_models; j++) {
-                polynomial_model_t *prev_model = &layers[layer - 1].models[j];
-                new_valid->data[i][j] = predict_polynomial(
-                    valid->data[i][prev_model->feature1],
-                    valid->data[i][prev_model->feature2],
-                    prev_model->coeffs
-                );
-            }
+        // outputs of the previous layer's models, one column per model
+        PROF_BEGIN(PROF_GATHER);
+        for (int j = 0; j < prev_n_models; j++) {
+            polynomial_model_t *prev_model = &layers[layer - 1].models[j];
+            int f1 = prev_model->feature1, f2 = prev_model->feature2;
+            neuron_entry_t *e = neuron_cache_get(cache, prev_keys[f1], prev_keys[f2],
+                                                 prev_model->coeffs,
+                                                 prev_train_cols[f1], prev_train_cols[f2],
+                                                 train->n_samples,
+                                                 prev_valid_cols[f1], prev_valid_cols[f2],
+                                                 n_valid);
+            cur_train_cols[j] = e->train;
+            cur_valid_cols[j] = e->valid;
+            cur_keys[j] = e->key;
         }
+        PROF_END(PROF_GATHER);
+        layer_train.cols = cur_train_cols;
+        layer_valid.cols = cur_valid_cols;
+        layer_train.n_features = layer_valid.n_features = prev_n_models;
         
         // try all pairs from new features
         int new_n_pairs = (prev_n_models * (prev_n_models - 1)) / 2;
         if (new_n_pairs == 0) {
-            printf("layer %d: not enough models to continue\n", layer);
+            gmdh_log("layer %d: not enough models to continue\n", layer);
             layers[layer].n_models = 0;
-            free(new_train->data);
-            free(new_train);
-            free(new_valid->data);
-            free(new_valid);
             break;
         }
         
-        polynomial_model_t *new_models = malloc(new_n_pairs * sizeof(polynomial_model_t));
-        model_idx = 0;
-        
-        for (int i = 0; i < prev_n_models; i++) {
-            for (int j = i + 1; j < prev_n_models; j++) {
-                double *x1_train = malloc(new_train->n_samples * sizeof(double));
-                double *x2_train = malloc(new_train->n_samples * sizeof(double));
-                
-                for (int k = 0; k < new_train->n_samples; k++) {
-                    x1_train[k] = new_train->data[k][i];
-                    x2_train[k] = new_train->data[k][j];
-                }
-                
-                polynomial_model_t *model = &new_models[model_idx];
-                model->feature1 = i;
-                model->feature2 = j;
-                
-                fit_polynomial(x1_train, x2_train, new_train->target, 
-                             new_train->n_samples, model->coeffs);
-                
-                double *predictions = malloc(new_valid->n_samples * sizeof(double));
-                for (int k = 0; k < new_valid->n_samples; k++) {
-                    predictions[k] = predict_polynomial(
-                        new_valid->data[k][i],
-                        new_valid->data[k][j],
-                        model->coeffs
-                    );
-                }
-                
-                model->error = calculate_rmse(predictions, new_valid->target, new_valid->n_samples);
-                model->r2 = calculate_r2(predictions, new_valid->target, new_valid->n_samples);
-                
-                free(x1_train);
-                free(x2_train);
-                free(predictions);
-                
-                model_idx++;
-            }
-        }
+        polynomial_model_t *new_models = gmdh_alloc(new_n_pairs * sizeof(polynomial_model_t));
+        PROF_ALLOC(new_n_pairs * sizeof(polynomial_model_t));
+        sweep_layer(&layer_train, &layer_valid, cv, NULL, new_models, models_per_layer);
+        model_idx = new_n_pairs;
         
-        // sort and select best
-        for (int i = 0; i < model_idx - 1; i++) {
-            for (int j = 0; j < model_idx - i - 1; j++) {
-                if (new_models[j].error > new_models[j + 1].error) {
-                    polynomial_model_t tmp = new_models[j];
-                    new_models[j] = new_models[j + 1];
-                    new_models[j + 1] = tmp;
-                }
-            }
-        }
+        // select best
+        PROF_BEGIN(PROF_SORT);
+        n_selected = (int)rank_top(new_models, model_idx, sizeof(polynomial_model_t),
+                                   models_per_layer, polynomial_model_before);
+        PROF_END(PROF_SORT);
         
-        n_selected = models_per_layer < model_idx ? models_per_layer : model_idx;
-        layers[layer].models = malloc(n_selected * sizeof(polynomial_model_t));
+        layers[layer].models = gmdh_alloc(n_selected * sizeof(polynomial_model_t));
         memcpy(layers[layer].models, new_models, n_selected * sizeof(polynomial_model_t));
         layers[layer].n_models = n_selected;
         layers[layer].layer = layer;
         
-        printf("layer %d: selected %d models, best rmse: %.4f\n", 
+        gmdh_log("layer %d: selected %d models, best rmse: %.4f\n", 
                layer, n_selected, layers[layer].models[0].error);
         
-        // cleanup
-        for (int i = 0; i < new_train->n_samples; i++) {
-            free(new_train->data[i]);
-        }
-        free(new_train->data);
-        free(new_train);
-        
-        for (int i = 0; i < new_valid->n_samples; i++) {
-            free(new_valid->data[i]);
-        }
-        free(new_valid->data);
-        free(new_valid);
+        // this layer's columns are the next one's inputs
+        double **t = prev_train_cols;
+        prev_train_cols = cur_train_cols;
+        cur_train_cols = t;
+        t = prev_valid_cols;
+        prev_valid_cols = cur_valid_cols;
+        cur_valid_cols = t;
+        uint64_t *k = prev_keys;
+        prev_keys = cur_keys;
+        cur_keys = k;
         
-        free(new_models);
+        gmdh_free(new_models);
     }
     
+    gmdh_free(cols);
+    gmdh_free(keys);
+    cache_release(cache);
+    
+    return layers;
+}
+
+// multi-row gmdh. with gmdh_options.screen_budget set, layer 0 pairs only
+// the features that pass screening; its models name features of train
+// either way
+gmdh_layer_t* multirow_gmdh(dataset_t *train, dataset_t *valid, int n_layers, int models_per_layer) {
+    dataset_t tr, va;
+    feature_screen_t *fs = screen_for_search(train, valid, 2, &tr, &va);
+    if (!fs) return multirow_gmdh_gram(train, valid, NULL, n_layers, models_per_layer);
+
+    gmdh_layer_t *layers = multirow_gmdh_gram(&tr, &va, NULL, n_layers, models_per_layer);
+    if (n_layers > 0) screen_map_pairs(fs, layers[0].models, layers[0].n_models);
+    free_feature_screen(fs);
     return layers;
 }
+
+// multi-row gmdh with layer 0 fitted from gs, pair statistics of train
+// computed elsewhere (NULL: its own)
+gmdh_layer_t* multirow_gmdh_gram(dataset_t *train, dataset_t *valid, const gram_stats_t *gs,
+                                 int n_layers, int models_per_layer) {
+    gmdh_log("multi-row gmdh: %d layers, %d models per layer\n", n_layers, models_per_layer);
+    return evolve_layers(train, valid, NULL, gs, n_layers, models_per_layer);
+}
+
+// multi-row gmdh selecting every layer by cross-validation over ds. the
+// kept neurons are fitted on every row, and their outputs feed the next
+// layer
+gmdh_layer_t* multirow_gmdh_cv(dataset_t *ds, const gmdh_cv_t *cv, int n_layers,
+                               int models_per_layer) {
+    char scheme[64];
+    gmdh_log("multi-row gmdh: %d layers, %d models per layer, %s\n", n_layers, models_per_layer,
+           cv_describe(cv, scheme, sizeof(scheme)));
+    return evolve_layers(ds, NULL, cv, NULL, n_layers, models_per_layer);
+}
@@ -0,0 +1,35 @@
+#define _POSIX_C_SOURCE 200809L
+#include <signal.h>
+#include "gmdh.h"
+
+static gmdh_server_t *server;
+
+static void on_signal(int sig) {
+    (void)sig;
+    if (server) serve_stop(server);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s SOCKET MODEL [MODEL ...]\n", argv[0]);
+        fprintf(stderr, "  answers prediction requests for each model file written by\n");
+        fprintf(stderr, "  save_model, numbered in command line order, and reloads a\n");
+        fprintf(stderr, "  file when it changes\n");
+        return 2;
+    }
+
+    server = serve_create(argv[1], argv + 2, argc - 2);
+    if (!server) return 1;
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    printf("serving %d model%s on %s\n", argc - 2, argc > 3 ? "s" : "", argv[1]);
+    fflush(stdout);
+    serve_run(server);
+    serve_free(server);
+    return 0;
+}
@@ -0,0 +1,626 @@
+#include "gmdh.h"
+
+// number of n_features x n_features arrays held by gram_stats_t
+#define GRAM_ARRAYS 14
+
+// per-feature sums over every row with a target: x^0..x^4, y, x*y, x²*y, y²
+#define FEAT_SUMS 9
+
+// rows summed in float by gram_stats_compute_f32 before the block's sums
+// are added in double
+#define GRAM_F32_BLOCK_ROWS 256
+
+// add a block's moments of pair (i, j) to the running sums
+static void add_pair(gram_stats_t *gs, int i, int j, const quad_moments_t *mom) {
+    int m = gs->n_features;
+    size_t ij = (size_t)i * m + j;
+    size_t ji = (size_t)j * m + i;
+
+    gs->pw[0][ij] += mom->n;
+    gs->pw[0][ji] = gs->pw[0][ij];
+    gs->pw[1][ij] += mom->a1; gs->pw[1][ji] += mom->b1;
+    gs->pw[2][ij] += mom->a2; gs->pw[2][ji] += mom->b2;
+    gs->pw[3][ij] += mom->a3; gs->pw[3][ji] += mom->b3;
+    gs->pw[4][ij] += mom->a4; gs->pw[4][ji] += mom->b4;
+    gs->py[0][ij] += mom->y;
+    gs->py[0][ji] = gs->py[0][ij];
+    gs->py[1][ij] += mom->ay;  gs->py[1][ji] += mom->by;
+    gs->py[2][ij] += mom->a2y; gs->py[2][ji] += mom->b2y;
+    gs->s11[ij] += mom->ab;
+    gs->s11[ji] = gs->s11[ij];
+    gs->s21[ij] += mom->a2b; gs->s21[ji] += mom->ab2;
+    gs->s31[ij] += mom->a3b; gs->s31[ji] += mom->ab3;
+    gs->s22[ij] += mom->a2b2;
+    gs->s22[ji] = gs->s22[ij];
+    gs->s11y[ij] += mom->aby;
+    gs->s11y[ji] = gs->s11y[ij];
+    gs->yy[ij] += mom->yy;
+    gs->yy[ji] = gs->yy[ij];
+}
+
+// cross sums for a pair of columns without missing values
+static void accumulate_cross(const double *a, const double *b, const double *y, int n,
+                             quad_moments_t *mom) {
+    double ab = 0, a2b = 0, ab2 = 0, a3b = 0, ab3 = 0, a2b2 = 0, aby = 0;
+    for (int k = 0; k < n; k++) {
+        double x1 = a[k], x2 = b[k];
+        double p = x1 * x2;
+        ab += p;
+        a2b += p * x1;
+        ab2 += p * x2;
+        a3b += p * x1 * x1;
+        ab3 += p * x2 * x2;
+        a2b2 += p * p;
+        aby += p * y[k];
+    }
+    mom->ab = ab;
+    mom->a2b = a2b;
+    mom->ab2 = ab2;
+    mom->a3b = a3b;
+    mom->ab3 = ab3;
+    mom->a2b2 = a2b2;
+    mom->aby = aby;
+}
+
+// shared state of the parallel passes in gram_stats_compute
+typedef struct {
+    gram_stats_t *gs;
+    double **cols;      // feature columns over the rows with a target
+    double *y;
+    double *feat;       // FEAT_SUMS sums per complete feature
+    column_masks_t *masks;  // of cols and y
+    int n;
+} gram_job_t;
+
+// per-feature sums, shared by every pair of complete columns
+static void feature_sums_worker(void *arg, int thread_id, long begin, long end) {
+    gram_job_t *job = arg;
+    int n = job->n;
+    (void)thread_id;
+
+    for (long f = begin; f < end; f++) {
+        if (!job->masks->complete[f]) continue;
+        double *x = job->cols[f];
+        double *s = job->feat + (size_t)f * FEAT_SUMS;
+        for (int r = 0; r < n; r++) {
+            double v = x[r], vv = v * v;
+            s[1] += v;
+            s[2] += vv;
+            s[3] += vv * v;
+            s[4] += vv * vv;
+            s[5] += job->y[r];
+            s[6] += v * job->y[r];
+            s[7] += vv * job->y[r];
+            s[8] += job->y[r] * job->y[r];
+        }
+        s[0] = n;
+    }
+}
+
+static void pair_sums_worker(void *arg, int thread_id, long begin, long end) {
+    gram_job_t *job = arg;
+    int m = job->gs->n_features;
+    int n = job->n;
+    int i, j;
+    (void)thread_id;
+
+    pair_from_index(m, begin, &i, &j);
+    for (long p = begin; p < end; p++) {
+        double *a = job->cols[i];
+        double *b = job->cols[j];
+        quad_moments_t mom;
+
+        if (!job->masks->complete[i] || !job->masks->complete[j]) {
+            quad_moments_masked(a, b, job->y, n, column_mask(job->masks, i),
+                                column_mask(job->masks, j), column_mask(job->masks, m), &mom);
+        } else {
+            double *fa = job->feat + (size_t)i * FEAT_SUMS;
+            double *fb = job->feat + (size_t)j * FEAT_SUMS;
+            mom.n = fa[0];
+            mom.a1 = fa[1]; mom.a2 = fa[2]; mom.a3 = fa[3]; mom.a4 = fa[4];
+            mom.b1 = fb[1]; mom.b2 = fb[2]; mom.b3 = fb[3]; mom.b4 = fb[4];
+            mom.y = fa[5];
+            mom.ay = fa[6]; mom.a2y = fa[7];
+            mom.by = fb[6]; mom.b2y = fb[7];
+            mom.yy = fa[8];
+            accumulate_cross(a, b, job->y, n, &mom);
+        }
+
+        add_pair(job->gs, i, j, &mom);
+
+        if (++j == m) {
+            i++;
+            j = i + 1;
+        }
+    }
+}
+
+// per-feature y terms of one more target: s[5..8] as feature_sums_worker
+// leaves them, the same sums in the same order
+static void target_sums_worker(void *arg, int thread_id, long begin, long end) {
+    gram_job_t *job = arg;
+    int n = job->n;
+    (void)thread_id;
+
+    for (long f = begin; f < end; f++) {
+        if (!job->masks->complete[f]) continue;
+        double *x = job->cols[f];
+        double *s = job->feat + (size_t)f * FEAT_SUMS;
+        for (int r = 0; r < n; r++) {
+            double v = x[r], vv = v * v;
+            s[5] += job->y[r];
+            s[6] += v * job->y[r];
+            s[7] += vv * job->y[r];
+            s[8] += job->y[r] * job->y[r];
+        }
+    }
+}
+
+// the y terms of every pair for one more target. every other sum is
+// already in place and gets zero added
+static void pair_target_sums_worker(void *arg, int thread_id, long begin, long end) {
+    gram_job_t *job = arg;
+    int m = job->gs->n_features;
+    int n = job->n;
+    int i, j;
+    (void)thread_id;
+
+    pair_from_index(m, begin, &i, &j);
+    for (long p = begin; p < end; p++) {
+        const double *a = job->cols[i], *b = job->cols[j], *y = job->y;
+        quad_moments_t mom;
+
+        if (!job->masks->complete[i] || !job->masks->complete[j]) {
+            quad_moments_t all;
+            quad_moments_masked(a, b, y, n, column_mask(job->masks, i),
+                                column_mask(job->masks, j), NULL, &all);
+            memset(&mom, 0, sizeof(mom));
+            mom.y = all.y;
+            mom.ay = all.ay; mom.by = all.by;
+            mom.a2y = all.a2y; mom.b2y = all.b2y;
+            mom.aby = all.aby;
+            mom.yy = all.yy;
+        } else {
+            double *fa = job->feat + (size_t)i * FEAT_SUMS;
+            double *fb = job->feat + (size_t)j * FEAT_SUMS;
+            double aby = 0;
+            for (int k = 0; k < n; k++) {
+                double x1 = a[k], x2 = b[k];
+                double q = x1 * x2;
+                aby += q * y[k];
+            }
+            memset(&mom, 0, sizeof(mom));
+            mom.y = fa[5];
+            mom.ay = fa[6]; mom.a2y = fa[7];
+            mom.by = fb[6]; mom.b2y = fb[7];
+            mom.yy = fa[8];
+            mom.aby = aby;
+        }
+
+        add_pair(job->gs, i, j, &mom);
+
+        if (++j == m) {
+            i++;
+            j = i + 1;
+        }
+    }
+}
+
+// empty pair statistics for m features, to be filled by
+// gram_stats_accumulate
+gram_stats_t* gram_stats_create(int m) {
+    size_t mm = (size_t)m * m;
+
+    gram_stats_t *gs = gmdh_alloc(sizeof(gram_stats_t));
+    gs->n_features = m;
+    gs->block = gmdh_calloc(GRAM_ARRAYS * mm + 1, sizeof(double));
+
+    double *p = gs->block;
+    for (int k = 0; k < 5; k++) {
+        gs->pw[k] = p;
+        p += mm;
+    }
+    for (int k = 0; k < 3; k++) {
+        gs->py[k] = p;
+        p += mm;
+    }
+    gs->s11 = p; p += mm;
+    gs->s21 = p; p += mm;
+    gs->s31 = p; p += mm;
+    gs->s22 = p; p += mm;
+    gs->s11y = p; p += mm;
+    gs->yy = p;
+
+    return gs;
+}
+
+// add the rows of ds to the pair statistics. each pair costs a single pass
+// of seven cross products over its two columns, instead of building and
+// multiplying an n x 6 design matrix. every statistic is a plain sum, so a
+// dataset can be fed in blocks of rows
+void gram_stats_accumulate(gram_stats_t *gs, dataset_t *ds) {
+    int m = ds->n_features;
+
+    // columns are read in place; only a target with gaps forces a gather
+    // of the rows that have one
+    uint64_t *has_target = gmdh_alloc((mask_words(ds->n_samples) + 1) * sizeof(uint64_t));
+    mask_build(ds->target, ds->n_samples, has_target);
+    int n = mask_count(has_target, mask_words(ds->n_samples));
+
+    gram_job_t job;
+    job.gs = gs;
+    job.n = n;
+    job.feat = gmdh_calloc((size_t)FEAT_SUMS * m + 1, sizeof(double));
+    job.cols = gmdh_alloc((m + 1) * sizeof(double*));
+
+    double *gathered = NULL;
+    if (n == ds->n_samples) {
+        for (int f = 0; f < m; f++) {
+            job.cols[f] = ds->cols[f];
+        }
+        job.y = ds->target;
+    } else {
+        gathered = gmdh_alloc(((size_t)(m + 1) * n + 1) * sizeof(double));
+        for (int f = 0; f <= m; f++) {
+            double *dst = gathered + (size_t)f * n;
+            mask_gather(f < m ? ds->cols[f] : ds->target, has_target, ds->n_samples, dst);
+            if (f < m) job.cols[f] = dst;
+        }
+        job.y = gathered + (size_t)m * n;
+    }
+    gmdh_free(has_target);
+
+    // pairs over complete columns share the per-feature sums; the rest
+    // take the masked kernel
+    dataset_t view = *ds;
+    view.cols = job.cols;
+    view.target = job.y;
+    view.n_samples = n;
+    job.masks = column_masks_build(&view);
+
+    int n_threads = gmdh_thread_count();
+    parallel_for(m, 1, n_threads, feature_sums_worker, &job);
+    parallel_for((long)m * (m - 1) / 2, 16, n_threads, pair_sums_worker, &job);
+
+    gmdh_free(gathered);
+    gmdh_free(job.cols);
+    free_column_masks(job.masks);
+    gmdh_free(job.feat);
+}
+
+// pair statistics of a whole dataset
+gram_stats_t* gram_stats_compute(dataset_t *ds) {
+    gram_stats_t *gs = gram_stats_create(ds->n_features);
+    gram_stats_accumulate(gs, ds);
+    return gs;
+}
+
+// pair statistics of ds against each of n_targets target columns in place
+// of its own. all but the y terms are sums over the features alone, the
+// same for every target without gaps: they are summed once, with the
+// first such target, and copied, and each further target only adds its
+// y terms, a single product per pair and row. a target with gaps covers
+// other rows and gets a full pass of its own. the statistics match
+// gram_stats_compute's bit for bit
+gram_stats_t** gram_stats_compute_targets(dataset_t *ds, double **targets, int n_targets) {
+    int m = ds->n_features, n = ds->n_samples;
+    size_t mm = (size_t)m * m;
+    gram_stats_t **out = gmdh_alloc((n_targets + 1) * sizeof(gram_stats_t*));
+    gram_stats_t *base = NULL;
+    dataset_t view = *ds;
+
+    gram_job_t job;
+    job.n = n;
+    job.cols = ds->cols;
+    job.masks = NULL;
+    job.feat = NULL;
+    int n_threads = gmdh_thread_count();
+
+    for (int t = 0; t < n_targets; t++) {
+        int complete = 1;
+        for (int r = 0; r < n && complete; r++) {
+            complete = !isnan(targets[t][r]);
+        }
+        if (!complete || !base) {
+            view.target = targets[t];
+            out[t] = gram_stats_compute(&view);
+            if (complete) base = out[t];
+            continue;
+        }
+
+        gram_stats_t *gs = gram_stats_create(m);
+        for (int k = 0; k < 5; k++) {
+            memcpy(gs->pw[k], base->pw[k], mm * sizeof(double));
+        }
+        memcpy(gs->s11, base->s11, mm * sizeof(double));
+        memcpy(gs->s21, base->s21, mm * sizeof(double));
+        memcpy(gs->s31, base->s31, mm * sizeof(double));
+        memcpy(gs->s22, base->s22, mm * sizeof(double));
+
+        if (!job.masks) {
+            job.masks = column_masks_build(ds);
+            job.feat = gmdh_alloc(((size_t)FEAT_SUMS * m + 1) * sizeof(double));
+        }
+        memset(job.feat, 0, (size_t)FEAT_SUMS * m * sizeof(double));
+        job.gs = gs;
+        job.y = targets[t];
+        parallel_for(m, 1, n_threads, target_sums_worker, &job);
+        parallel_for((long)m * (m - 1) / 2, 16, n_threads, pair_target_sums_worker, &job);
+        out[t] = gs;
+    }
+
+    free_column_masks(job.masks);
+    gmdh_free(job.feat);
+    return out;
+}
+
+// pair statistics of ds with shift taken off every target. with the
+// target centred on its mean, the residual sums worked out from the
+// moments do not cancel against a large y'y
+gram_stats_t* gram_stats_compute_shifted(dataset_t *ds, double shift) {
+    dataset_t view = *ds;
+    double *y = gmdh_alloc((ds->n_samples + 1) * sizeof(double));
+    for (int r = 0; r < ds->n_samples; r++) {
+        y[r] = ds->target[r] - shift;
+    }
+    view.target = y;
+    gram_stats_t *gs = gram_stats_compute(&view);
+    gmdh_free(y);
+    return gs;
+}
+
+// shared state of gram_stats_compute_f32
+typedef struct {
+    gram_stats_t *gs;
+    float **cols;       // feature columns over the rows with a target
+    float *y;
+    double *feat;       // FEAT_SUMS sums per complete feature
+    char *missing;
+    double *y_wide;     // the target in double, for pairs with missing values
+    double **wide;      // per-thread scratch: a pair's two columns in double
+    int n;
+} gram_f32_job_t;
+
+// feature_sums_worker over float32 columns, summed in float a block of
+// rows at a time
+static void feature_sums_f32_worker(void *arg, int thread_id, long begin, long end) {
+    gram_f32_job_t *job = arg;
+    int n = job->n;
+    (void)thread_id;
+
+    for (long f = begin; f < end; f++) {
+        if (job->missing[f]) continue;
+        const float *x = job->cols[f];
+        double *s = job->feat + (size_t)f * FEAT_SUMS;
+        for (int r0 = 0; r0 < n; r0 += GRAM_F32_BLOCK_ROWS) {
+            int stop = n - r0 < GRAM_F32_BLOCK_ROWS ? n : r0 + GRAM_F32_BLOCK_ROWS;
+            float b[FEAT_SUMS] = {0, 0, 0, 0, 0, 0, 0, 0, 0};
+            for (int r = r0; r < stop; r++) {
+                float v = x[r], vv = v * v, t = job->y[r];
+                b[1] += v;
+                b[2] += vv;
+                b[3] += vv * v;
+                b[4] += vv * vv;
+                b[5] += t;
+                b[6] += v * t;
+                b[7] += vv * t;
+                b[8] += t * t;
+            }
+            for (int k = 1; k < FEAT_SUMS; k++) {
+                s[k] += b[k];
+            }
+        }
+        s[0] = n;
+    }
+}
+
+static void pair_sums_f32_worker(void *arg, int thread_id, long begin, long end) {
+    gram_f32_job_t *job = arg;
+    int m = job->gs->n_features;
+    int n = job->n;
+    int i, j;
+
+    pair_from_index(m, begin, &i, &j);
+    for (long p = begin; p < end; p++) {
+        quad_moments_t mom;
+
+        if (job->missing[i] || job->missing[j]) {
+            // rare: widen the pair and take the double path
+            double *a = job->wide[thread_id], *b = a + n;
+            for (int r = 0; r < n; r++) {
+                a[r] = job->cols[i][r];
+                b[r] = job->cols[j][r];
+            }
+            quad_moments_masked(a, b, job->y_wide, n, NULL, NULL, NULL, &mom);
+        } else {
+            double *fa = job->feat + (size_t)i * FEAT_SUMS;
+            double *fb = job->feat + (size_t)j * FEAT_SUMS;
+            double cross[7] = {0, 0, 0, 0, 0, 0, 0};
+            cross_sums_f32(job->cols[i], job->cols[j], job->y, n, cross);
+            mom.n = fa[0];
+            mom.a1 = fa[1]; mom.a2 = fa[2]; mom.a3 = fa[3]; mom.a4 = fa[4];
+            mom.b1 = fb[1]; mom.b2 = fb[2]; mom.b3 = fb[3]; mom.b4 = fb[4];
+            mom.y = fa[5];
+            mom.ay = fa[6]; mom.a2y = fa[7];
+            mom.by = fb[6]; mom.b2y = fb[7];
+            mom.yy = fa[8];
+            mom.ab = cross[0];
+            mom.a2b = cross[1];
+            mom.ab2 = cross[2];
+            mom.a3b = cross[3];
+            mom.ab3 = cross[4];
+            mom.a2b2 = cross[5];
+            mom.aby = cross[6];
+        }
+
+        add_pair(job->gs, i, j, &mom);
+
+        if (++j == m) {
+            i++;
+            j = i + 1;
+        }
+    }
+}
+
+// pair statistics from float32 columns, for screening: the products are
+// formed and summed in float, a block of rows at a time, and the block
+// sums carried in double. the result is the usual double gram_stats_t,
+// accurate to roughly float precision per block
+gram_stats_t* gram_stats_compute_f32(const dataset_f32_t *ds) {
+    int m = ds->n_features;
+    gram_stats_t *gs = gram_stats_create(m);
+
+    int n = 0;
+    for (int r = 0; r < ds->n_samples; r++) {
+        if (!isnan(ds->target[r])) n++;
+    }
+
+    gram_f32_job_t job;
+    job.gs = gs;
+    job.n = n;
+    job.missing = gmdh_calloc(m + 1, 1);
+    job.feat = gmdh_calloc((size_t)FEAT_SUMS * m + 1, sizeof(double));
+    job.cols = gmdh_alloc((m + 1) * sizeof(float*));
+
+    float *gathered = NULL;
+    if (n == ds->n_samples) {
+        for (int f = 0; f < m; f++) {
+            job.cols[f] = ds->cols[f];
+        }
+        job.y = ds->target;
+    } else {
+        gathered = gmdh_alloc(((size_t)(m + 1) * n + 1) * sizeof(float));
+        for (int f = 0; f <= m; f++) {
+            const float *src = f < m ? ds->cols[f] : ds->target;
+            float *dst = gathered + (size_t)f * n;
+            int k = 0;
+            for (int r = 0; r < ds->n_samples; r++) {
+                if (!isnan(ds->target[r])) dst[k++] = src[r];
+            }
+            if (f < m) job.cols[f] = dst;
+        }
+        job.y = gathered + (size_t)m * n;
+    }
+
+    int any_missing = 0;
+    for (int f = 0; f < m; f++) {
+        int gaps = 0;
+        for (int r = 0; r < n; r++) {
+            gaps += job.cols[f][r] != job.cols[f][r];
+        }
+        job.missing[f] = gaps > 0;
+        any_missing |= gaps > 0;
+    }
+
+    int n_threads = gmdh_thread_count();
+    job.y_wide = NULL;
+    job.wide = NULL;
+    if (any_missing) {
+        job.y_wide = gmdh_alloc((n + 1) * sizeof(double));
+        for (int r = 0; r < n; r++) {
+            job.y_wide[r] = job.y[r];
+        }
+        job.wide = gmdh_alloc(n_threads * sizeof(double*));
+        for (int t = 0; t < n_threads; t++) {
+            job.wide[t] = gmdh_alloc((2 * (size_t)n + 1) * sizeof(double));
+        }
+    }
+
+    parallel_for(m, 1, n_threads, feature_sums_f32_worker, &job);
+    parallel_for((long)m * (m - 1) / 2, 16, n_threads, pair_sums_f32_worker, &job);
+
+    if (any_missing) {
+        for (int t = 0; t < n_threads; t++) {
+            gmdh_free(job.wide[t]);
+        }
+        gmdh_free(job.wide);
+        gmdh_free(job.y_wide);
+    }
+    gmdh_free(gathered);
+    gmdh_free(job.cols);
+    gmdh_free(job.missing);
+    gmdh_free(job.feat);
+    return gs;
+}
+
+// map a pair index to (i, j), i < j, in the order of the nested i/j loops
+void pair_from_index(int n, long index, int *i, int *j) {
+    int row = 0;
+    while (index >= n - 1 - row) {
+        index -= n - 1 - row;
+        row++;
+    }
+    *i = row;
+    *j = row + 1 + (int)index;
+}
+
+// read back the moments of pair (i, j), with x_i in the role of x1
+void gram_pair_moments(const gram_stats_t *gs, int i, int j, quad_moments_t *mom) {
+    int m = gs->n_features;
+    size_t ij = (size_t)i * m + j;
+    size_t ji = (size_t)j * m + i;
+
+    mom->n = gs->pw[0][ij];
+    mom->a1 = gs->pw[1][ij]; mom->b1 = gs->pw[1][ji];
+    mom->a2 = gs->pw[2][ij]; mom->b2 = gs->pw[2][ji];
+    mom->a3 = gs->pw[3][ij]; mom->b3 = gs->pw[3][ji];
+    mom->a4 = gs->pw[4][ij]; mom->b4 = gs->pw[4][ji];
+    mom->ab = gs->s11[ij];
+    mom->a2b = gs->s21[ij]; mom->ab2 = gs->s21[ji];
+    mom->a3b = gs->s31[ij]; mom->ab3 = gs->s31[ji];
+    mom->a2b2 = gs->s22[ij];
+    mom->y = gs->py[0][ij];
+    mom->ay = gs->py[1][ij]; mom->by = gs->py[1][ji];
+    mom->a2y = gs->py[2][ij]; mom->b2y = gs->py[2][ji];
+    mom->aby = gs->s11y[ij];
+    mom->yy = gs->yy[ij];
+}
+
+// fit the quadratic neuron of pair (i, j) in O(1). returns the condition
+// estimate of the fit
+double gram_fit_pair(const gram_stats_t *gs, int i, int j, double *coeffs) {
+    quad_moments_t mom;
+    gram_pair_moments(gs, i, j, &mom);
+    return fit_quadratic_moments(&mom, coeffs);
+}
+
+// smallest residual sum of squares any quadratic neuron on pair (i, j)
+// reaches over the rows behind gs, or 0 when that cannot be vouched for
+double gram_pair_floor(const gram_stats_t *gs, int i, int j) {
+    quad_moments_t mom;
+    gram_pair_moments(gs, i, j, &mom);
+    return floor_quadratic_moments(&mom);
+}
+
+// rmse and r² of the quadratic neuron coeffs on pair (i, j), over the
+// rows behind gs, in O(1): gs holds statistics of targets less shift (see
+// gram_stats_compute_shifted), shift being the mean of every present
+// target. the same rows, and the same totals, as predicting each row and
+// calling score_predictions
+void gram_score_pair(const gram_stats_t *gs, int i, int j, const double *coeffs, double shift,
+                     double *rmse, double *r2) {
+    quad_moments_t mom;
+    gram_pair_moments(gs, i, j, &mom);
+    double b[6];
+    memcpy(b, coeffs, sizeof(b));
+    b[0] -= shift;
+    double sse = sse_quadratic_moments(&mom, b);
+    *rmse = mom.n > 0 ? sqrt(sse / mom.n) : INFINITY;
+    *r2 = 1.0 - sse / mom.yy;
+}
+
+// dst = a + sign * b, element by element. statistics of disjoint row sets
+// add up, so this gives the statistics of a union or of a difference
+void gram_stats_combine(gram_stats_t *dst, const gram_stats_t *a, const gram_stats_t *b,
+                        double sign) {
+    size_t n = GRAM_ARRAYS * (size_t)a->n_features * a->n_features;
+    for (size_t k = 0; k < n; k++) {
+        dst->block[k] = a->block[k] + sign * b->block[k];
+    }
+}
+
+void free_gram_stats(gram_stats_t *gs) {
+    if (!gs) return;
+    gmdh_free(gs->block);
+    gmdh_free(gs);
+}
@@ -0,0 +1,559 @@
+#include "gmdh.h"
+
+// pivots below this fraction of the column's own norm mark the subset as
+// numerically singular
+#define CHOL_RELATIVE_EPS 1e-12
+
+// empty gram of the design [1, x_0 .. x_{m-1}], to be filled by
+// linear_gram_accumulate
+linear_gram_t* linear_gram_create(int m) {
+    int dim = m + 1;
+    linear_gram_t *g = gmdh_alloc(sizeof(linear_gram_t));
+    g->n_features = m;
+    g->dim = dim;
+    g->xtx = gmdh_calloc((size_t)dim * dim, sizeof(double));
+    g->xty = gmdh_calloc(dim, sizeof(double));
+    g->yy = 0;
+    return g;
+}
+
+// the rows of ds that have a target, as a dataset in out: ds's own
+// columns when no row lacks one, else a copy gathered by the target's
+// presence bitmap into the block returned, to be freed with gmdh_free
+static double* rows_with_target(const dataset_t *ds, dataset_t *out) {
+    int m = ds->n_features;
+    int n_words = mask_words(ds->n_samples);
+    uint64_t *has_target = gmdh_alloc((n_words + 1) * sizeof(uint64_t));
+    mask_build(ds->target, ds->n_samples, has_target);
+    int n = mask_count(has_target, n_words);
+
+    *out = *ds;
+    double *block = NULL;
+    if (n < ds->n_samples) {
+        block = gmdh_alloc(((size_t)(m + 1) * n + 1) * sizeof(double) +
+                           (m + 1) * sizeof(double*));
+        out->cols = (double**)(block + (size_t)(m + 1) * n + 1);
+        for (int c = 0; c <= m; c++) {
+            double *dst = block + (size_t)c * n;
+            mask_gather(c < m ? ds->cols[c] : ds->target, has_target, ds->n_samples, dst);
+            if (c < m) out->cols[c] = dst;
+        }
+        out->target = block + (size_t)m * n;
+        out->n_samples = n;
+    }
+    gmdh_free(has_target);
+    return block;
+}
+
+// add the cross products of ds's target with the design, and y'y. every
+// row of ds has a target
+static void accumulate_target(linear_gram_t *g, const dataset_t *ds) {
+    int dim = g->dim;
+
+    for (int a = 0; a < dim; a++) {
+        const double *xa = a > 0 ? ds->cols[a - 1] : NULL;
+        double sum = 0;
+        for (int r = 0; r < ds->n_samples; r++) {
+            sum += (xa ? xa[r] : 1.0) * ds->target[r];
+        }
+        g->xty[a] += sum;
+    }
+
+    double yy = 0;
+    for (int r = 0; r < ds->n_samples; r++) {
+        yy += ds->target[r] * ds->target[r];
+    }
+    g->yy += yy;
+}
+
+// add the rows of ds that have a target to the gram matrix and its cross
+// products with y. plain sums, so a dataset can be fed in blocks of rows.
+// sums over a feature with gaps come out nan, which marks the subsets
+// reading it as beyond the gram
+void linear_gram_accumulate(linear_gram_t *g, dataset_t *ds) {
+    int dim = g->dim;
+    dataset_t rows;
+    double *block = rows_with_target(ds, &rows);
+
+    // column 0 is the implicit intercept
+    for (int a = 0; a < dim; a++) {
+        const double *xa = a > 0 ? rows.cols[a - 1] : NULL;
+        for (int b = a; b < dim; b++) {
+            const double *xb = b > 0 ? rows.cols[b - 1] : NULL;
+            double sum = 0;
+            for (int r = 0; r < rows.n_samples; r++) {
+                sum += (xa ? xa[r] : 1.0) * (xb ? xb[r] : 1.0);
+            }
+            g->xtx[(size_t)a * dim + b] += sum;
+            if (b != a) g->xtx[(size_t)b * dim + a] = g->xtx[(size_t)a * dim + b];
+        }
+    }
+    accumulate_target(g, &rows);
+    gmdh_free(block);
+}
+
+// gram matrix of a whole dataset. computed once, it serves every subset
+linear_gram_t* linear_gram_compute(dataset_t *ds) {
+    linear_gram_t *g = linear_gram_create(ds->n_features);
+    linear_gram_accumulate(g, ds);
+    return g;
+}
+
+// gram matrices of ds against each of n_targets target columns, as
+// gram_stats_compute_targets: x'x is summed once for every target without
+// gaps, and each adds only its x'y and y'y
+linear_gram_t** linear_gram_compute_targets(dataset_t *ds, double **targets, int n_targets) {
+    linear_gram_t **out = gmdh_alloc((n_targets + 1) * sizeof(linear_gram_t*));
+    linear_gram_t *base = NULL;
+    dataset_t view = *ds;
+
+    for (int t = 0; t < n_targets; t++) {
+        int complete = 1;
+        for (int r = 0; r < ds->n_samples && complete; r++) {
+            complete = !isnan(targets[t][r]);
+        }
+        view.target = targets[t];
+        if (!complete || !base) {
+            out[t] = linear_gram_compute(&view);
+            if (complete) base = out[t];
+            continue;
+        }
+        out[t] = linear_gram_create(ds->n_features);
+        memcpy(out[t]->xtx, base->xtx, (size_t)base->dim * base->dim * sizeof(double));
+        accumulate_target(out[t], &view);
+    }
+    return out;
+}
+
+// gram matrix of ds with shift taken off every target, as
+// gram_stats_compute_shifted
+linear_gram_t* linear_gram_compute_shifted(dataset_t *ds, double shift) {
+    dataset_t view = *ds;
+    double *y = gmdh_alloc((ds->n_samples + 1) * sizeof(double));
+    for (int r = 0; r < ds->n_samples; r++) {
+        y[r] = ds->target[r] - shift;
+    }
+    view.target = y;
+    linear_gram_t *g = linear_gram_compute(&view);
+    gmdh_free(y);
+    return g;
+}
+
+// the normal equations of one subset, intercept first: a is (k + 1)²,
+// c has k + 1 entries
+void linear_gram_subset(const linear_gram_t *g, const int *features, int k,
+                          double *a, double *c) {
+    int n = k + 1;
+    for (int r = 0; r < n; r++) {
+        int gr = r == 0 ? 0 : features[r - 1] + 1;
+        for (int q = 0; q < n; q++) {
+            int gq = q == 0 ? 0 : features[q - 1] + 1;
+            a[(size_t)r * n + q] = g->xtx[(size_t)gr * g->dim + gq];
+        }
+        c[r] = g->xty[gr];
+    }
+}
+
+// least squares fit of y on the k features (intercept first in coeffs)
+// from the gram alone. a rank-deficient subset gets zero coefficients.
+// returns the condition estimate
+double linear_gram_fit(const linear_gram_t *g, const int *features, int k, double *coeffs) {
+    if (k < 0) return INFINITY;
+    int n = k + 1;
+    double a[(size_t)n * n];
+    double c[n];
+    linear_gram_subset(g, features, k, a, c);
+
+    solve_info_t info;
+    if (!solve_normal(a, c, coeffs, n, &info)) {
+        for (int j = 0; j < n; j++) {
+            coeffs[j] = 0;
+        }
+    }
+    return info.cond;
+}
+
+// residual sum of squares of a linear model on the k features over the
+// rows behind g: y'y - 2 b'X'y + b'X'X b, never below 0. nan when a
+// column has missing values
+double linear_gram_sse(const linear_gram_t *g, const int *features, int k,
+                       const double *coeffs) {
+    if (k < 0) return 0;
+    int n = k + 1;
+    double a[(size_t)n * n];
+    double c[n];
+    linear_gram_subset(g, features, k, a, c);
+
+    double sse = g->yy;
+    for (int r = 0; r < n; r++) {
+        double quad = 0;
+        for (int q = 0; q < n; q++) {
+            quad += a[(size_t)r * n + q] * coeffs[q];
+        }
+        sse += coeffs[r] * (quad - 2 * c[r]);
+    }
+    return sse < 0 ? 0 : sse;
+}
+
+// smallest residual sum of squares any linear model on the k features
+// reaches over the rows behind g: linear_gram_sse at the least squares
+// fit, lowered by FLOOR_SLACK * y'y for rounding. 0 when the fit is too
+// ill-conditioned to vouch for
+double linear_gram_floor(const linear_gram_t *g, const int *features, int k) {
+    if (k < 0) return 0;
+    double b[k + 1];
+    if (!(linear_gram_fit(g, features, k, b) <= GMDH_COND_WARN)) return 0;
+
+    double sse = linear_gram_sse(g, features, k, b) - FLOOR_SLACK * g->yy;
+    return sse > 0 ? sse : 0;
+}
+
+// dst = a + sign * b, element by element, as for gram_stats_combine
+void linear_gram_combine(linear_gram_t *dst, const linear_gram_t *a, const linear_gram_t *b,
+                         double sign) {
+    size_t n = (size_t)a->dim * a->dim;
+    for (size_t k = 0; k < n; k++) {
+        dst->xtx[k] = a->xtx[k] + sign * b->xtx[k];
+    }
+    for (int k = 0; k < a->dim; k++) {
+        dst->xty[k] = a->xty[k] + sign * b->xty[k];
+    }
+    dst->yy = a->yy + sign * b->yy;
+}
+
+// most patterns of missing features a stream's grams are split by, and
+// the most memory their grams may take between them
+#define GRAM_PATTERNS_MAX 64
+#define GRAM_PATTERNS_BYTES ((size_t)256 << 20)
+
+// empty grams of the design [1, x_0 .. x_{m-1}] split by missing features,
+// to be filled by linear_gram_patterns_accumulate
+linear_gram_patterns_t* linear_gram_patterns_create(int m) {
+    linear_gram_patterns_t *lp = gmdh_alloc(sizeof(linear_gram_patterns_t));
+    size_t fit = GRAM_PATTERNS_BYTES / ((size_t)(m + 1) * (m + 1) * sizeof(double));
+    lp->n_features = m;
+    lp->n_patterns = 0;
+    lp->capacity = fit < 1 ? 1 : fit < GRAM_PATTERNS_MAX ? (int)fit : GRAM_PATTERNS_MAX;
+    lp->absent = gmdh_calloc((size_t)lp->capacity * m + 1, 1);
+    lp->grams = gmdh_alloc((lp->capacity + 1) * sizeof(linear_gram_t*));
+    lp->rest = linear_gram_create(m);
+    lp->n_rest = 0;
+    lp->gapped = gmdh_calloc(m + 1, 1);
+    return lp;
+}
+
+// index of the pattern lacking exactly the features flagged in absent,
+// added if new. -1 once capacity is reached
+static int gram_pattern(linear_gram_patterns_t *lp, const char *absent) {
+    int m = lp->n_features;
+    for (int p = 0; p < lp->n_patterns; p++) {
+        if (memcmp(lp->absent + (size_t)p * m, absent, m) == 0) return p;
+    }
+    if (lp->n_patterns == lp->capacity) return -1;
+    int p = lp->n_patterns++;
+    memcpy(lp->absent + (size_t)p * m, absent, m);
+    lp->grams[p] = linear_gram_create(m);
+    return p;
+}
+
+// add the rows of ds that have a target to the gram of the features they
+// lack, with those features read as 0. a block without gaps goes to one
+// gram whole; rows past capacity go to rest
+void linear_gram_patterns_accumulate(linear_gram_patterns_t *lp, dataset_t *ds) {
+    int m = lp->n_features;
+    int n = ds->n_samples;
+    column_masks_t *cm = column_masks_build(ds);
+    const uint64_t *has_target = column_mask(cm, m);
+    char *absent = gmdh_calloc(m + 1, 1);
+
+    int gaps = 0;
+    for (int c = 0; c < m; c++) {
+        gaps |= !cm->complete[c];
+    }
+    if (!gaps) {
+        int p = gram_pattern(lp, absent);
+        linear_gram_accumulate(p < 0 ? lp->rest : lp->grams[p], ds);
+        if (p < 0) lp->n_rest += mask_count(has_target, cm->n_words);
+        gmdh_free(absent);
+        free_column_masks(cm);
+        return;
+    }
+
+    int *pattern = gmdh_alloc((n + 1) * sizeof(int));
+    for (int r = 0; r < n; r++) {
+        int w = r / MASK_BITS, bit = r % MASK_BITS;
+        pattern[r] = -2;
+        if (!(has_target[w] >> bit & 1)) continue;
+        for (int c = 0; c < m; c++) {
+            absent[c] = !(column_mask(cm, c)[w] >> bit & 1);
+            lp->gapped[c] |= absent[c];
+        }
+        pattern[r] = gram_pattern(lp, absent);
+    }
+
+    // each pattern's rows, then those past capacity, gathered in turn
+    uint64_t *rows = gmdh_alloc((cm->n_words + 1) * sizeof(uint64_t));
+    double *block = gmdh_alloc(((size_t)(m + 1) * n + 1) * sizeof(double));
+    double **cols = gmdh_alloc((m + 1) * sizeof(double*));
+    dataset_t part = *ds;
+    part.cols = cols;
+    part.target = block + (size_t)m * n;
+    for (int p = -1; p < lp->n_patterns; p++) {
+        memset(rows, 0, cm->n_words * sizeof(uint64_t));
+        for (int r = 0; r < n; r++) {
+            if (pattern[r] == p) rows[r / MASK_BITS] |= (uint64_t)1 << (r % MASK_BITS);
+        }
+        if (!mask_count(rows, cm->n_words)) continue;
+
+        const char *lacks = p < 0 ? NULL : lp->absent + (size_t)p * m;
+        for (int c = 0; c <= m; c++) {
+            double *dst = block + (size_t)c * n;
+            part.n_samples = mask_gather(c < m ? ds->cols[c] : ds->target, rows, n, dst);
+            if (c == m) break;
+            if (lacks && lacks[c]) memset(dst, 0, part.n_samples * sizeof(double));
+            cols[c] = dst;
+        }
+        linear_gram_accumulate(p < 0 ? lp->rest : lp->grams[p], &part);
+        if (p < 0) lp->n_rest += part.n_samples;
+    }
+
+    gmdh_free(cols);
+    gmdh_free(block);
+    gmdh_free(rows);
+    gmdh_free(pattern);
+    gmdh_free(absent);
+    free_column_masks(cm);
+}
+
+// gram of every row, as linear_gram_accumulate sums it: nan over the
+// features some row lacks
+linear_gram_t* linear_gram_patterns_total(const linear_gram_patterns_t *lp) {
+    linear_gram_t *g = linear_gram_create(lp->n_features);
+    for (int p = 0; p < lp->n_patterns; p++) {
+        linear_gram_combine(g, g, lp->grams[p], 1);
+    }
+    linear_gram_combine(g, g, lp->rest, 1);
+
+    for (int c = 0; c < lp->n_features; c++) {
+        if (!lp->gapped[c]) continue;
+        size_t a = c + 1;
+        for (size_t b = 0; b < (size_t)g->dim; b++) {
+            g->xtx[a * g->dim + b] = NAN;
+            g->xtx[b * g->dim + a] = NAN;
+        }
+        g->xty[a] = NAN;
+    }
+    return g;
+}
+
+// the normal equations of one subset over the rows that have all of its
+// features, as linear_gram_subset, and their y'y. nan when rows past
+// capacity lack one of them
+void linear_gram_patterns_subset(const linear_gram_patterns_t *lp, const int *features, int k,
+                                 double *a, double *c, double *yy) {
+    int n = k + 1;
+    double pa[(size_t)n * n];
+    double pc[n];
+    memset(a, 0, (size_t)n * n * sizeof(double));
+    memset(c, 0, n * sizeof(double));
+    *yy = 0;
+
+    for (int p = -1; p < lp->n_patterns; p++) {
+        const char *lacks = p < 0 ? NULL : lp->absent + (size_t)p * lp->n_features;
+        int has = 1;
+        for (int j = 0; j < k && lacks && has; j++) {
+            has = !lacks[features[j]];
+        }
+        if (!has) continue;
+
+        const linear_gram_t *g = p < 0 ? lp->rest : lp->grams[p];
+        linear_gram_subset(g, features, k, pa, pc);
+        for (size_t q = 0; q < (size_t)n * n; q++) {
+            a[q] += pa[q];
+        }
+        for (int q = 0; q < n; q++) {
+            c[q] += pc[q];
+        }
+        *yy += g->yy;
+    }
+}
+
+void free_linear_gram_patterns(linear_gram_patterns_t *lp) {
+    if (!lp) return;
+    for (int p = 0; p < lp->n_patterns; p++) {
+        free_linear_gram(lp->grams[p]);
+    }
+    free_linear_gram(lp->rest);
+    gmdh_free(lp->grams);
+    gmdh_free(lp->absent);
+    gmdh_free(lp->gapped);
+    gmdh_free(lp);
+}
+
+void free_linear_gram(linear_gram_t *g) {
+    if (!g) return;
+    gmdh_free(g->xtx);
+    gmdh_free(g->xty);
+    gmdh_free(g);
+}
+
+void subset_chol_init(subset_chol_t *c, int capacity) {
+    c->size = 0;
+    c->capacity = capacity;
+    c->order = gmdh_alloc(capacity * sizeof(int));
+    c->r = gmdh_calloc((size_t)capacity * capacity, sizeof(double));
+    c->work = gmdh_alloc(capacity * sizeof(double));
+}
+
+void subset_chol_free(subset_chol_t *c) {
+    gmdh_free(c->order);
+    gmdh_free(c->r);
+    gmdh_free(c->work);
+}
+
+// make dst, of at least src's size in capacity, the factor src holds
+void subset_chol_copy(subset_chol_t *dst, const subset_chol_t *src) {
+    int q = src->size;
+    for (int i = 0; i < q; i++) {
+        memcpy(dst->r + (size_t)i * dst->capacity, src->r + (size_t)i * src->capacity,
+               q * sizeof(double));
+    }
+    memcpy(dst->order, src->order, q * sizeof(int));
+    dst->size = q;
+}
+
+// append gram column `col` (0 = intercept, f + 1 = feature f) to the factor.
+// one triangular solve, O(k²). returns 0 if the column is dependent on the
+// ones already factored
+int subset_chol_add(subset_chol_t *c, const linear_gram_t *g, int col) {
+    int q = c->size;
+    int cap = c->capacity;
+    double *r = c->r;
+    const double *gcol = g->xtx + (size_t)col * g->dim;
+
+    // solve R' v = G[order, col]
+    double ss = 0;
+    for (int i = 0; i < q; i++) {
+        double v = gcol[c->order[i]];
+        for (int l = 0; l < i; l++) {
+            v -= r[(size_t)l * cap + i] * r[(size_t)l * cap + q];
+        }
+        v /= r[(size_t)i * cap + i];
+        r[(size_t)i * cap + q] = v;
+        ss += v * v;
+    }
+
+    double d = gcol[col] - ss;
+    c->order[q] = col;
+    c->size = q + 1;
+    if (!(d > CHOL_RELATIVE_EPS * gcol[col])) {
+        r[(size_t)q * cap + q] = 0;
+        return 0;
+    }
+    r[(size_t)q * cap + q] = sqrt(d);
+    return 1;
+}
+
+// drop gram column `col` from the factor, restoring triangular form with
+// givens rotations on the trailing rows, O(k²)
+void subset_chol_remove(subset_chol_t *c, int col) {
+    int q = c->size;
+    int cap = c->capacity;
+    double *r = c->r;
+
+    int p = 0;
+    while (p < q && c->order[p] != col) {
+        p++;
+    }
+    if (p == q) return;
+
+    // shift the columns after p one place left
+    for (int i = 0; i < q; i++) {
+        double *row = r + (size_t)i * cap;
+        for (int j = p; j < q - 1; j++) {
+            row[j] = row[j + 1];
+        }
+        row[q - 1] = 0;
+    }
+    for (int j = p; j < q - 1; j++) {
+        c->order[j] = c->order[j + 1];
+    }
+
+    // rows j and j + 1 now carry a subdiagonal entry at column j
+    for (int j = p; j < q - 1; j++) {
+        double *top = r + (size_t)j * cap;
+        double *bot = r + (size_t)(j + 1) * cap;
+        double a = top[j], b = bot[j];
+        double h = hypot(a, b);
+        if (h == 0) continue;
+        double cs = a / h, sn = b / h;
+        for (int l = j; l < q - 1; l++) {
+            double t1 = top[l], t2 = bot[l];
+            top[l] = cs * t1 + sn * t2;
+            bot[l] = -sn * t1 + cs * t2;
+        }
+        bot[j] = 0;
+    }
+
+    double *last = r + (size_t)(q - 1) * cap;
+    for (int j = 0; j < cap; j++) {
+        last[j] = 0;
+    }
+    c->size = q - 1;
+}
+
+// factor the normal equations of [1, features] from scratch
+int subset_chol_factor(subset_chol_t *c, const linear_gram_t *g, const int *features, int k) {
+    int ok = 1;
+    c->size = 0;
+    ok &= subset_chol_add(c, g, 0);
+    for (int i = 0; i < k; i++) {
+        ok &= subset_chol_add(c, g, features[i] + 1);
+    }
+    return ok;
+}
+
+// coefficients of the factored subset, by factor position, from
+// R'R b = X'y. *cond gets the condition estimate of the equilibrated
+// normal matrix, read off the factor's diagonal: scaling gram column j by
+// 1/sqrt(G_jj) scales R's column j the same way. returns 0 if the factor
+// is singular or not finite
+int subset_chol_solve(subset_chol_t *c, const linear_gram_t *g, double *coeffs, double *cond) {
+    int q = c->size;
+    int cap = c->capacity;
+    const double *r = c->r;
+    double *z = c->work;
+
+    double lo = INFINITY, hi = 0;
+    *cond = INFINITY;
+    for (int i = 0; i < q; i++) {
+        double d = r[(size_t)i * cap + i];
+        if (!(d > 0) || !isfinite(d)) return 0;
+        double scaled = d / sqrt(g->xtx[(size_t)c->order[i] * g->dim + c->order[i]]);
+        if (scaled < lo) lo = scaled;
+        if (scaled > hi) hi = scaled;
+    }
+    *cond = (hi / lo) * (hi / lo);
+
+    // forward: R' z = X'y
+    for (int i = 0; i < q; i++) {
+        double v = g->xty[c->order[i]];
+        for (int l = 0; l < i; l++) {
+            v -= r[(size_t)l * cap + i] * z[l];
+        }
+        z[i] = v / r[(size_t)i * cap + i];
+    }
+    // back: R b = z
+    for (int i = q - 1; i >= 0; i--) {
+        double v = z[i];
+        for (int l = i + 1; l < q; l++) {
+            v -= r[(size_t)i * cap + l] * coeffs[l];
+        }
+        coeffs[i] = v / r[(size_t)i * cap + i];
+    }
+
+    for (int i = 0; i < q; i++) {
+        if (!isfinite(coeffs[i])) return 0;
+    }
+    return 1;
+}
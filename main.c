@@ -1,6 +1,6 @@
 #include "gmdh.h"
 
-void run_demo() {
+void run_demo(const char *model_path) {
     printf("=== gmdh demo on water quality dataset ===\n\n");
     
     // load data (predict pH_tank3 from input features - column 23, 0-indexed)
@@ -14,10 +14,16 @@ void run_demo() {
     
     print_dataset_info(ds);
     
-    // use subset of features for demo (full dataset is slow)
+    // use subset of features for demo (full dataset is slow), unless
+    // screening picks them
     int orig_features = ds->n_features;
-    ds->n_features = 10;
-    printf("\nusing first %d features for demo\n", ds->n_features);
+    if (gmdh_options.screen_budget > 0) {
+        printf("\nscreening %d features down to at most %d\n", ds->n_features,
+               gmdh_options.screen_budget);
+    } else {
+        ds->n_features = 10;
+        printf("\nusing first %d features for demo\n", ds->n_features);
+    }
     
     // split data
     printf("\nsplitting data (70%% train, 30%% validation)...\n");
@@ -56,6 +62,14 @@ void run_demo() {
         print_model(&layers[best_layer].models[0], train->feature_names);
     }
     
+    if (model_path && layers[best_layer].n_models > 0) {
+        gmdh_model_t *model = model_from_multirow(layers, best_layer, 0, train->feature_names);
+        if (save_model(model, model_path)) {
+            printf("\nsaved %d-neuron network to %s\n", model->n_nodes, model_path);
+        }
+        free_model(model);
+    }
+    
     // cleanup
     free(comb_models);
     for (int i = 0; i < 3; i++) {
@@ -73,6 +87,101 @@ void run_demo() {
     printf("\n=== demo complete ===\n");
 }
 
+// every algorithm on the demo data, selected by cross-validation over
+// all of its rows instead of a validation cut
+void run_cv(const gmdh_cv_t *cv) {
+    char scheme[64];
+    printf("=== gmdh with %s ===\n\n", cv_describe(cv, scheme, sizeof(scheme)));
+    dataset_t *ds = load_csv("water_quality.csv", 23);
+    if (!ds) {
+        fprintf(stderr, "failed to load dataset\n");
+        return;
+    }
+    int orig_features = ds->n_features;
+    ds->n_features = 10;
+    
+    int n_models;
+    polynomial_model_t *comb_models = combinatorial_gmdh_cv(ds, cv, &n_models);
+    free(comb_models);
+    
+    printf("\n");
+    gmdh_layer_t *layers = multirow_gmdh_cv(ds, cv, 3, 5);
+    for (int i = 0; i < 3; i++) {
+        if (layers[i].n_models > 0) free(layers[i].models);
+    }
+    free(layers);
+    
+    printf("\n");
+    int n_linear;
+    linear_model_t *linear = linear_combinatorial_gmdh_cv(ds, cv, 1, 3, &n_linear);
+    if (n_linear > 0) {
+        printf("best model: ");
+        print_linear_model(&linear[0], ds->feature_names);
+    }
+    free_linear_models(linear, n_linear);
+    
+    ds->n_features = orig_features;
+    free_dataset(ds);
+}
+
+// every search for several targets of the demo data at once, on one set
+// of shared feature statistics. spec lists csv columns: "23,25,27"
+void run_multi(const char *spec) {
+    int target_cols[MAX_FEATURES] = {0};
+    int n_targets = 0;
+    for (const char *p = spec; *p && n_targets < MAX_FEATURES; p++) {
+        target_cols[n_targets++] = atoi(p);
+        p = strchr(p, ',');
+        if (!p) break;
+    }
+    printf("=== multi-target gmdh on water_quality.csv ===\n\n");
+    multi_dataset_t *md = load_csv_targets("water_quality.csv", target_cols, n_targets);
+    if (!md) {
+        fprintf(stderr, "failed to load dataset\n");
+        return;
+    }
+    multi_dataset_t *train, *valid;
+    split_multi_dataset(md, &train, &valid, 0.7);
+    
+    target_models_t *results = multi_target_gmdh(train, valid, 1, 3, 3, 5);
+    printf("\nbest per target:\n");
+    for (int t = 0; t < n_targets; t++) {
+        target_models_t *res = &results[t];
+        printf("\n%s\n", res->target_name);
+        if (res->n_pairs > 0) {
+            printf("  pairs:  ");
+            print_model(&res->pairs[0], train->features->feature_names);
+        }
+        if (res->n_linear > 0) {
+            printf("  linear: ");
+            print_linear_model(&res->linear[0], train->features->feature_names);
+        }
+    }
+    
+    free_target_models(results, n_targets);
+    free_multi_dataset(md);
+    free_multi_dataset(train);
+    free_multi_dataset(valid);
+}
+
+// combinatorial gmdh over a file read block by block, never held whole
+void run_stream(const char *path, int target_col) {
+    printf("=== streamed combinatorial gmdh on %s ===\n\n", path);
+    row_stream_t *s = row_stream_open(path, target_col, 65536);
+    if (!s) return;
+    
+    int n_models;
+    polynomial_model_t *models = combinatorial_gmdh_stream(s, 0.7, &n_models);
+    printf("\ntop 3 models:\n");
+    for (int i = 0; i < 3 && i < n_models; i++) {
+        printf("\n%d. ", i + 1);
+        print_model(&models[i], s->block->feature_names);
+    }
+    
+    free(models);
+    row_stream_close(s);
+}
+
 int main(int argc, char **argv) {
     if (argc > 1 && strcmp(argv[1], "--test") == 0) {
         // test mode handled by test.c
@@ -80,6 +189,74 @@ int main(int argc, char **argv) {
         return 0;
     }
     
-    run_demo();
+    const char *stream_path = NULL;
+    const char *model_path = NULL;
+    const char *trace_path = NULL;
+    const char *targets_spec = NULL;
+    int stream_target = -1;
+    int use_cv = 0;
+    gmdh_cv_t cv = {GMDH_CV_KFOLD, 5, 0};
+    for (int i = 1; i < argc - 1; i++) {
+        if (strcmp(argv[i], "--threads") == 0) {
+            gmdh_options.n_threads = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--stream") == 0) {
+            stream_path = argv[i + 1];
+            if (i + 2 < argc && argv[i + 2][0] != '-') stream_target = atoi(argv[i + 2]);
+        } else if (strcmp(argv[i], "--save-model") == 0) {
+            model_path = argv[i + 1];
+        } else if (strcmp(argv[i], "--cv") == 0) {
+            // kfold:K, rolling:K or loo
+            const char *colon = strchr(argv[i + 1], ':');
+            use_cv = 1;
+            cv.kind = strncmp(argv[i + 1], "loo", 3) == 0 ? GMDH_CV_LOO
+                    : strncmp(argv[i + 1], "rolling", 7) == 0 ? GMDH_CV_ROLLING
+                    : GMDH_CV_KFOLD;
+            if (colon) cv.k = atoi(colon + 1);
+        } else if (strcmp(argv[i], "--targets") == 0) {
+            targets_spec = argv[i + 1];
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            trace_path = argv[i + 1];
+        } else if (strcmp(argv[i], "--prune") == 0) {
+            gmdh_options.prune = strcmp(argv[i + 1], "off") == 0 ? GMDH_PRUNE_OFF
+                               : strcmp(argv[i + 1], "bound") == 0 ? GMDH_PRUNE_BOUND
+                               : GMDH_PRUNE_ABANDON;
+        } else if (strcmp(argv[i], "--precision") == 0) {
+            gmdh_options.precision = strcmp(argv[i + 1], "mixed") == 0 ? GMDH_PRECISION_MIXED
+                                   : GMDH_PRECISION_DOUBLE;
+        } else if (strcmp(argv[i], "--scoring") == 0) {
+            gmdh_options.scoring = strcmp(argv[i + 1], "moments") == 0 ? GMDH_SCORE_MOMENTS
+                                 : GMDH_SCORE_ROWS;
+        } else if (strcmp(argv[i], "--screen") == 0) {
+            gmdh_options.screen_budget = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--screen-corr") == 0) {
+            gmdh_options.screen_corr = atof(argv[i + 1]);
+        } else if (strcmp(argv[i], "--screen-rank") == 0) {
+            gmdh_options.screen_rank = strcmp(argv[i + 1], "mi") == 0 ? GMDH_SCREEN_MI
+                                     : GMDH_SCREEN_CORR;
+        } else if (strcmp(argv[i], "--beam") == 0) {
+            gmdh_options.linear_mode = GMDH_LINEAR_BEAM;
+            gmdh_options.beam_width = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--beam-swaps") == 0) {
+            gmdh_options.beam_swaps = atoi(argv[i + 1]);
+        }
+    }
+    
+    if (stream_path) {
+        run_stream(stream_path, stream_target);
+    } else if (use_cv) {
+        run_cv(&cv);
+    } else if (targets_spec) {
+        run_multi(targets_spec);
+    } else {
+        run_demo(model_path);
+    }
+    
+    if (trace_path) {
+        // phase breakdown, plus a chrome trace for perfetto
+        profile_report(stdout);
+        if (profile_write_trace(trace_path)) {
+            printf("trace written to %s\n", trace_path);
+        }
+    }
     return 0;
 }
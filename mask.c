@@ -0,0 +1,97 @@
+#include "gmdh.h"
+
+// presence bitmaps of columns, laid out like the present section of a
+// binary dataset file: bit r % 64 of word r / 64 is set when row r holds a
+// value, and the bits past the last row are clear. the statistics kernels
+// combine the bitmaps of the columns they read with a word-wide and, count
+// rows by popcount and treat each word as full, empty or mixed, so no row
+// is tested on its own
+
+int mask_words(int n_rows) {
+    return (n_rows + MASK_BITS - 1) / MASK_BITS;
+}
+
+// presence bits of the len <= MASK_BITS values at x. branch-free: a value
+// is present when it equals itself
+uint64_t mask_word(const double *x, int len) {
+    uint64_t word = 0;
+    for (int i = 0; i < len; i++) {
+        word |= (uint64_t)(x[i] == x[i]) << i;
+    }
+    return word;
+}
+
+// the word w of a bitmap over n_rows rows with every row present
+uint64_t mask_full_word(int n_rows, int w) {
+    int len = n_rows - w * MASK_BITS;
+    return len >= MASK_BITS ? ~(uint64_t)0 : ((uint64_t)1 << len) - 1;
+}
+
+// bitmap of the present values of x, mask_words(n_rows) words
+void mask_build(const double *x, int n_rows, uint64_t *bits) {
+    int n_words = mask_words(n_rows);
+    for (int w = 0; w < n_words; w++) {
+        int len = n_rows - w * MASK_BITS;
+        bits[w] = mask_word(x + (size_t)w * MASK_BITS, len < MASK_BITS ? len : MASK_BITS);
+    }
+}
+
+// rows set in a bitmap
+int mask_count(const uint64_t *bits, int n_words) {
+    int n = 0;
+    for (int w = 0; w < n_words; w++) {
+        n += __builtin_popcountll(bits[w]);
+    }
+    return n;
+}
+
+// copy the rows of src whose bit is set to dst, in order: whole words are
+// copied as blocks, mixed ones bit by bit. returns the rows copied
+int mask_gather(const double *src, const uint64_t *bits, int n_rows, double *dst) {
+    int n_words = mask_words(n_rows);
+    int k = 0;
+    for (int w = 0; w < n_words; w++) {
+        uint64_t word = bits[w];
+        const double *s = src + (size_t)w * MASK_BITS;
+        if (word == ~(uint64_t)0) {
+            memcpy(dst + k, s, MASK_BITS * sizeof(double));
+            k += MASK_BITS;
+            continue;
+        }
+        while (word) {
+            dst[k++] = s[__builtin_ctzll(word)];
+            word &= word - 1;
+        }
+    }
+    return k;
+}
+
+// bitmaps of every feature column of ds and of its target, the target's
+// at index n_features
+column_masks_t* column_masks_build(const dataset_t *ds) {
+    int n_cols = ds->n_features + 1;
+    column_masks_t *cm = gmdh_alloc(sizeof(column_masks_t));
+    cm->n_rows = ds->n_samples;
+    cm->n_words = mask_words(ds->n_samples);
+    cm->n_cols = n_cols;
+    cm->bits = gmdh_alloc(((size_t)n_cols * cm->n_words + 1) * sizeof(uint64_t));
+    cm->complete = gmdh_alloc(n_cols + 1);
+    for (int c = 0; c < n_cols; c++) {
+        uint64_t *bits = cm->bits + (size_t)c * cm->n_words;
+        mask_build(c < ds->n_features ? ds->cols[c] : ds->target, ds->n_samples, bits);
+        cm->complete[c] = mask_count(bits, cm->n_words) == ds->n_samples;
+    }
+    return cm;
+}
+
+// the bitmap of column c
+const uint64_t* column_mask(const column_masks_t *cm, int c) {
+    return cm->bits + (size_t)c * cm->n_words;
+}
+
+void free_column_masks(column_masks_t *cm) {
+    if (!cm) return;
+    gmdh_free(cm->bits);
+    gmdh_free(cm->complete);
+    gmdh_free(cm);
+}
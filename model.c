@@ -0,0 +1,403 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include "gmdh.h"
+
+// compiled model file:
+//   header   magic, version, byte order, n_inputs, n_nodes
+//   inputs   per input: int32 feature, uint32 name length, name bytes
+//   nodes    per node: int32 kind, int32 n_inputs, int32 inputs[n_inputs],
+//            double coeffs[node_coeffs()]
+#define MODEL_MAGIC "GMDHMDL1"
+#define MODEL_VERSION 1
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    int32_t n_inputs;
+    int32_t n_nodes;
+} model_header_t;
+
+static int node_coeffs(const gmdh_node_t *node) {
+    return node->kind == GMDH_NODE_QUADRATIC ? 6 : node->n_inputs + 1;
+}
+
+static gmdh_node_t* add_node(gmdh_model_t *model, int *capacity, gmdh_node_kind_t kind,
+                             int n_inputs) {
+    if (model->n_nodes == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 8;
+        model->nodes = realloc(model->nodes, *capacity * sizeof(gmdh_node_t));
+    }
+    gmdh_node_t *node = &model->nodes[model->n_nodes++];
+    node->kind = kind;
+    node->n_inputs = n_inputs;
+    node->inputs = malloc(n_inputs * sizeof(int));
+    node->coeffs = malloc(node_coeffs(node) * sizeof(double));
+    return node;
+}
+
+// while a model is built, node inputs name raw features as -(f + 1) and
+// earlier nodes by index. this gives each feature used an input slot, in
+// ascending feature order, and rewrites the inputs as slots
+static void assign_inputs(gmdh_model_t *model, char **feature_names) {
+    int max_feature = -1;
+    for (int k = 0; k < model->n_nodes; k++) {
+        for (int j = 0; j < model->nodes[k].n_inputs; j++) {
+            int in = model->nodes[k].inputs[j];
+            if (in < 0 && -in - 1 > max_feature) max_feature = -in - 1;
+        }
+    }
+
+    int *slot_of = malloc((max_feature + 2) * sizeof(int));
+    for (int f = 0; f <= max_feature; f++) {
+        slot_of[f] = -1;
+    }
+    for (int k = 0; k < model->n_nodes; k++) {
+        for (int j = 0; j < model->nodes[k].n_inputs; j++) {
+            int in = model->nodes[k].inputs[j];
+            if (in < 0) slot_of[-in - 1] = 0;
+        }
+    }
+
+    model->n_inputs = 0;
+    for (int f = 0; f <= max_feature; f++) {
+        if (slot_of[f] == 0) model->n_inputs++;
+    }
+    model->input_features = malloc((model->n_inputs + 1) * sizeof(int));
+    model->input_names = malloc((model->n_inputs + 1) * sizeof(char*));
+    int s = 0;
+    for (int f = 0; f <= max_feature; f++) {
+        if (slot_of[f] < 0) continue;
+        const char *name = feature_names && feature_names[f] ? feature_names[f] : "";
+        model->input_features[s] = f;
+        model->input_names[s] = strcpy(malloc(strlen(name) + 1), name);
+        slot_of[f] = s++;
+    }
+
+    for (int k = 0; k < model->n_nodes; k++) {
+        for (int j = 0; j < model->nodes[k].n_inputs; j++) {
+            int *in = &model->nodes[k].inputs[j];
+            *in = *in < 0 ? slot_of[-*in - 1] : model->n_inputs + *in;
+        }
+    }
+    free(slot_of);
+}
+
+// a single quadratic neuron of combinatorial_gmdh
+gmdh_model_t* model_from_polynomial(const polynomial_model_t *m, char **feature_names) {
+    gmdh_model_t *model = calloc(1, sizeof(gmdh_model_t));
+    int capacity = 0;
+    gmdh_node_t *node = add_node(model, &capacity, GMDH_NODE_QUADRATIC, 2);
+    node->inputs[0] = -(m->feature1 + 1);
+    node->inputs[1] = -(m->feature2 + 1);
+    memcpy(node->coeffs, m->coeffs, 6 * sizeof(double));
+    assign_inputs(model, feature_names);
+    return model;
+}
+
+// a linear model of linear_combinatorial_gmdh, as one linear node
+gmdh_model_t* model_from_linear(const linear_model_t *m, char **feature_names) {
+    gmdh_model_t *model = calloc(1, sizeof(gmdh_model_t));
+    int capacity = 0;
+    gmdh_node_t *node = add_node(model, &capacity, GMDH_NODE_LINEAR, m->n_features);
+    for (int j = 0; j < m->n_features; j++) {
+        node->inputs[j] = -(m->feature_indices[j] + 1);
+    }
+    memcpy(node->coeffs, m->coeffs, (m->n_features + 1) * sizeof(double));
+    assign_inputs(model, feature_names);
+    return model;
+}
+
+typedef struct {
+    const gmdh_layer_t *layers;
+    int **node_of;          // node index of layers[l].models[i], -1 until emitted
+    gmdh_model_t *model;
+    int capacity;
+} multirow_builder_t;
+
+// emit the neurons model (layer, index) depends on, then the model itself.
+// a neuron feeding several others is emitted once; neurons the output
+// does not reach are never visited
+static int emit_neuron(multirow_builder_t *b, int layer, int index) {
+    if (b->node_of[layer][index] >= 0) return b->node_of[layer][index];
+
+    const polynomial_model_t *m = &b->layers[layer].models[index];
+    int in1, in2;
+    if (layer == 0) {
+        in1 = -(m->feature1 + 1);
+        in2 = -(m->feature2 + 1);
+    } else {
+        in1 = emit_neuron(b, layer - 1, m->feature1);
+        in2 = emit_neuron(b, layer - 1, m->feature2);
+    }
+
+    gmdh_node_t *node = add_node(b->model, &b->capacity, GMDH_NODE_QUADRATIC, 2);
+    node->inputs[0] = in1;
+    node->inputs[1] = in2;
+    memcpy(node->coeffs, m->coeffs, 6 * sizeof(double));
+    b->node_of[layer][index] = b->model->n_nodes - 1;
+    return b->node_of[layer][index];
+}
+
+// the network behind model `index` of layer `layer` of multirow_gmdh,
+// pruned to the neurons it actually reads
+gmdh_model_t* model_from_multirow(const gmdh_layer_t *layers, int layer, int index,
+                                  char **feature_names) {
+    multirow_builder_t b;
+    b.layers = layers;
+    b.model = calloc(1, sizeof(gmdh_model_t));
+    b.capacity = 0;
+    b.node_of = malloc((layer + 1) * sizeof(int*));
+    for (int l = 0; l <= layer; l++) {
+        b.node_of[l] = malloc((layers[l].n_models + 1) * sizeof(int));
+        for (int i = 0; i < layers[l].n_models; i++) {
+            b.node_of[l][i] = -1;
+        }
+    }
+
+    emit_neuron(&b, layer, index);
+    assign_inputs(b.model, feature_names);
+
+    for (int l = 0; l <= layer; l++) {
+        free(b.node_of[l]);
+    }
+    free(b.node_of);
+    return b.model;
+}
+
+// write the model through a temporary file renamed into place, so a
+// process loading it never sees a partial file. returns 1 on success
+int save_model(const gmdh_model_t *model, const char *path) {
+    size_t len = strlen(path);
+    char *tmp = malloc(len + 5);
+    memcpy(tmp, path, len);
+    memcpy(tmp + len, ".tmp", 5);
+
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp) {
+        fprintf(stderr, "failed to write %s\n", path);
+        free(tmp);
+        return 0;
+    }
+
+    model_header_t h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, MODEL_MAGIC, 8);
+    h.version = MODEL_VERSION;
+    h.byte_order = BIN_BYTE_ORDER;
+    h.n_inputs = model->n_inputs;
+    h.n_nodes = model->n_nodes;
+    int ok = fwrite(&h, sizeof(h), 1, fp) == 1;
+
+    for (int s = 0; ok && s < model->n_inputs; s++) {
+        int32_t feature = model->input_features[s];
+        uint32_t name_len = strlen(model->input_names[s]);
+        ok = fwrite(&feature, sizeof(feature), 1, fp) == 1 &&
+             fwrite(&name_len, sizeof(name_len), 1, fp) == 1 &&
+             fwrite(model->input_names[s], 1, name_len, fp) == name_len;
+    }
+    for (int k = 0; ok && k < model->n_nodes; k++) {
+        const gmdh_node_t *node = &model->nodes[k];
+        int32_t head[2] = {node->kind, node->n_inputs};
+        size_t nc = node_coeffs(node);
+        ok = fwrite(head, sizeof(head), 1, fp) == 1 &&
+             fwrite(node->inputs, sizeof(int32_t), node->n_inputs, fp) == (size_t)node->n_inputs &&
+             fwrite(node->coeffs, sizeof(double), nc, fp) == nc;
+    }
+
+    ok &= fclose(fp) == 0;
+    ok = ok && rename(tmp, path) == 0;
+    if (!ok) {
+        fprintf(stderr, "failed to write %s\n", path);
+        remove(tmp);
+    }
+    free(tmp);
+    return ok;
+}
+
+// read a model written by save_model. every node input must refer to a
+// model input or an earlier node, so the file order is an evaluation order
+gmdh_model_t* load_model(const char *path) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        fprintf(stderr, "failed to open %s\n", path);
+        return NULL;
+    }
+
+    model_header_t h;
+    int ok = fread(&h, sizeof(h), 1, fp) == 1 &&
+             memcmp(h.magic, MODEL_MAGIC, 8) == 0 && h.version == MODEL_VERSION &&
+             h.byte_order == BIN_BYTE_ORDER && h.n_inputs >= 0 && h.n_inputs < (1 << 20) &&
+             h.n_nodes > 0 && h.n_nodes < (1 << 20);
+    if (!ok) {
+        fprintf(stderr, "%s is not a gmdh model file\n", path);
+        fclose(fp);
+        return NULL;
+    }
+
+    gmdh_model_t *model = calloc(1, sizeof(gmdh_model_t));
+    model->input_features = calloc(h.n_inputs + 1, sizeof(int));
+    model->input_names = calloc(h.n_inputs + 1, sizeof(char*));
+    model->n_inputs = h.n_inputs;
+    for (int s = 0; ok && s < h.n_inputs; s++) {
+        int32_t feature;
+        uint32_t name_len;
+        ok = fread(&feature, sizeof(feature), 1, fp) == 1 &&
+             fread(&name_len, sizeof(name_len), 1, fp) == 1 && name_len < (1u << 20);
+        if (!ok) break;
+        model->input_features[s] = feature;
+        model->input_names[s] = malloc(name_len + 1);
+        ok = fread(model->input_names[s], 1, name_len, fp) == name_len;
+        model->input_names[s][name_len] = '\0';
+    }
+
+    int capacity = 0;
+    for (int k = 0; ok && k < h.n_nodes; k++) {
+        int32_t head[2];
+        ok = fread(head, sizeof(head), 1, fp) == 1 &&
+             (head[0] == GMDH_NODE_QUADRATIC ? head[1] == 2
+                                             : head[0] == GMDH_NODE_LINEAR && head[1] >= 0) &&
+             head[1] <= MAX_FEATURES * 16;
+        if (!ok) break;
+        gmdh_node_t *node = add_node(model, &capacity, head[0], head[1]);
+        size_t nc = node_coeffs(node);
+        ok = fread(node->inputs, sizeof(int32_t), node->n_inputs, fp) == (size_t)node->n_inputs &&
+             fread(node->coeffs, sizeof(double), nc, fp) == nc;
+        for (int j = 0; ok && j < node->n_inputs; j++) {
+            ok = node->inputs[j] >= 0 && node->inputs[j] < h.n_inputs + k;
+        }
+    }
+    fclose(fp);
+
+    if (!ok) {
+        fprintf(stderr, "%s: truncated or corrupt model file\n", path);
+        free_model(model);
+        return NULL;
+    }
+    return model;
+}
+
+// shared state of a parallel model_predict
+typedef struct {
+    const gmdh_model_t *model;
+    const double **input_cols;  // dataset column of each model input
+    double *out;
+    int n_rows;
+    double *scratch;            // per thread, n_nodes x MODEL_BATCH_ROWS
+    const double **slots;       // per thread, n_inputs + n_nodes pointers
+} predict_job_t;
+
+// run the plan over one batch of n rows. slots holds n_inputs + n_nodes
+// pointers, the first n_inputs set by the caller to the batch's input
+// columns; scratch holds (n_nodes - 1) * n doubles. the output node writes
+// straight into out
+void model_eval_batch(const gmdh_model_t *model, const double **slots, double *scratch,
+                      double *out, int n) {
+    for (int k = 0; k < model->n_nodes; k++) {
+        const gmdh_node_t *node = &model->nodes[k];
+        double *dst = k == model->n_nodes - 1 ? out : scratch + (size_t)k * n;
+        if (node->kind == GMDH_NODE_QUADRATIC) {
+            predict_polynomial_column(slots[node->inputs[0]], slots[node->inputs[1]],
+                                      node->coeffs, dst, n);
+        } else {
+            for (int i = 0; i < n; i++) {
+                dst[i] = node->coeffs[0];
+            }
+            for (int j = 0; j < node->n_inputs; j++) {
+                const double *x = slots[node->inputs[j]];
+                double c = node->coeffs[j + 1];
+                for (int i = 0; i < n; i++) {
+                    dst[i] += c * x[i];
+                }
+            }
+        }
+        slots[model->n_inputs + k] = dst;
+    }
+}
+
+static void predict_worker(void *arg, int thread_id, long begin, long end) {
+    predict_job_t *job = arg;
+    const gmdh_model_t *model = job->model;
+    int n_slots = model->n_inputs + model->n_nodes;
+    const double **slots = job->slots + (size_t)thread_id * n_slots;
+    double *scratch = job->scratch + (size_t)thread_id * model->n_nodes * MODEL_BATCH_ROWS;
+
+    for (long batch = begin; batch < end; batch++) {
+        int row = (int)(batch * MODEL_BATCH_ROWS);
+        int n = job->n_rows - row < MODEL_BATCH_ROWS ? job->n_rows - row : MODEL_BATCH_ROWS;
+
+        for (int s = 0; s < model->n_inputs; s++) {
+            slots[s] = job->input_cols[s] + row;
+        }
+        model_eval_batch(model, slots, scratch, job->out + row, n);
+    }
+}
+
+// find each model input among the dataset's columns: by name when both
+// sides have one, by training column index otherwise
+static int resolve_inputs(const gmdh_model_t *model, dataset_t *ds, const double **cols) {
+    for (int s = 0; s < model->n_inputs; s++) {
+        const char *name = model->input_names[s];
+        int by_name = name[0] && ds->feature_names;
+        int f = -1;
+        for (int c = 0; by_name && c < ds->n_features && f < 0; c++) {
+            if (ds->feature_names[c] && strcmp(ds->feature_names[c], name) == 0) f = c;
+        }
+        if (!by_name && model->input_features[s] < ds->n_features) {
+            f = model->input_features[s];
+        }
+        if (f < 0) {
+            fprintf(stderr, "model input %s not found in dataset\n", name[0] ? name : "?");
+            return 0;
+        }
+        cols[s] = ds->cols[f];
+    }
+    return 1;
+}
+
+// evaluate the model on every row of ds into out[n_samples]. rows are cut
+// into batches run in parallel; within a batch the nodes run in order, each
+// a column kernel over the batch. returns 0 if an input is missing from ds
+int model_predict(const gmdh_model_t *model, dataset_t *ds, double *out) {
+    const double **input_cols = malloc((model->n_inputs + 1) * sizeof(double*));
+    if (!resolve_inputs(model, ds, input_cols)) {
+        free(input_cols);
+        return 0;
+    }
+
+    int n_threads = gmdh_thread_count();
+    long n_batches = ((long)ds->n_samples + MODEL_BATCH_ROWS - 1) / MODEL_BATCH_ROWS;
+    if (n_threads > n_batches) n_threads = n_batches > 0 ? (int)n_batches : 1;
+
+    predict_job_t job;
+    job.model = model;
+    job.input_cols = input_cols;
+    job.out = out;
+    job.n_rows = ds->n_samples;
+    job.scratch = malloc(((size_t)n_threads * model->n_nodes * MODEL_BATCH_ROWS + 1) *
+                         sizeof(double));
+    job.slots = malloc(((size_t)n_threads * (model->n_inputs + model->n_nodes) + 1) *
+                       sizeof(double*));
+
+    parallel_for(n_batches, 1, n_threads, predict_worker, &job);
+
+    free(job.scratch);
+    free(job.slots);
+    free(input_cols);
+    return 1;
+}
+
+void free_model(gmdh_model_t *model) {
+    if (!model) return;
+    for (int k = 0; k < model->n_nodes; k++) {
+        free(model->nodes[k].inputs);
+        free(model->nodes[k].coeffs);
+    }
+    for (int s = 0; s < model->n_inputs; s++) {
+        if (model->input_names) free(model->input_names[s]);
+    }
+    free(model->nodes);
+    free(model->input_features);
+    free(model->input_names);
+    free(model);
+}
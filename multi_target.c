@@ -0,0 +1,75 @@
+#include "gmdh.h"
+
+// several targets trained in one job. every search fits from moments of
+// its training rows, and the moments that do not involve the target are
+// the same for every target over the same rows: they are summed once for
+// the job, and each target adds only its cross products with the
+// features. the validation passes stay per target
+
+// run the combinatorial, linear (subsets of min_features to max_features,
+// none when max_features < 1) and multi-row (none when n_layers < 1)
+// searches for every target of train, scored on the same targets of
+// valid. returns train->n_targets result sets, in target order. the
+// linear searches walk the shared gram as under GMDH_LINEAR_GRAY, or grow
+// their beams from it under GMDH_LINEAR_BEAM: solving every subset from
+// the rows again is the per-target cost this avoids
+target_models_t* multi_target_gmdh(multi_dataset_t *train, multi_dataset_t *valid,
+                                   int min_features, int max_features,
+                                   int n_layers, int models_per_layer) {
+    int n_targets = train->n_targets;
+    gmdh_log("multi-target gmdh: %d targets, %d training rows\n", n_targets,
+             train->features->n_samples);
+
+    PROF_BEGIN(PROF_NORMAL);
+    gram_stats_t **pair_stats = gram_stats_compute_targets(train->features, train->targets,
+                                                           n_targets);
+    linear_gram_t **grams = max_features > 0
+        ? linear_gram_compute_targets(train->features, train->targets, n_targets) : NULL;
+    PROF_END(PROF_NORMAL);
+    PROF_COUNT(PROF_BYTES_TOUCHED, (uint64_t)(train->features->n_features + n_targets) *
+                                   train->features->n_samples * sizeof(double));
+
+    target_models_t *results = gmdh_calloc(n_targets + 1, sizeof(target_models_t));
+    for (int t = 0; t < n_targets; t++) {
+        target_models_t *res = &results[t];
+        dataset_t tr, va;
+        multi_dataset_target(train, t, &tr);
+        multi_dataset_target(valid, t, &va);
+        res->target_name = train->target_names[t];
+
+        gmdh_log("\ntarget %s:\n", res->target_name);
+        res->pairs = combinatorial_gmdh_gram(&tr, &va, pair_stats[t], &res->n_pairs);
+        if (grams) {
+            res->linear = linear_combinatorial_gmdh_gram(&tr, &va, grams[t], min_features,
+                                                         max_features, &res->n_linear);
+        }
+        if (n_layers > 0) {
+            res->layers = multirow_gmdh_gram(&tr, &va, pair_stats[t], n_layers,
+                                             models_per_layer);
+            res->n_layers = n_layers;
+        }
+    }
+
+    for (int t = 0; t < n_targets; t++) {
+        free_gram_stats(pair_stats[t]);
+        if (grams) free_linear_gram(grams[t]);
+    }
+    gmdh_free(pair_stats);
+    gmdh_free(grams);
+    return results;
+}
+
+void free_target_models(target_models_t *models, int n_targets) {
+    if (!models) return;
+    for (int t = 0; t < n_targets; t++) {
+        gmdh_free(models[t].pairs);
+        free_linear_models(models[t].linear, models[t].n_linear);
+        if (models[t].layers) {
+            for (int l = 0; l < models[t].n_layers; l++) {
+                gmdh_free(models[t].layers[l].models);
+            }
+            gmdh_free(models[t].layers);
+        }
+    }
+    gmdh_free(models);
+}
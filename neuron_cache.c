@@ -0,0 +1,172 @@
+#include "gmdh.h"
+
+// output columns of quadratic neurons, kept across the layers of a
+// multirow run and across runs. a column is named by a 64-bit key: raw
+// feature columns by a hash of their values, a neuron's output by a hash
+// of its input keys and its coefficients. the same neuron fitted again to
+// the same inputs, in a later layer or a later run on the same data, so
+// finds its outputs already computed
+
+// initial slots of the hash table; it doubles when half full
+#define NEURON_CACHE_SLOTS 256
+
+static uint64_t mix64(uint64_t h, uint64_t v) {
+    h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    h ^= h >> 31;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    return h;
+}
+
+static uint64_t double_bits(double v) {
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    return bits;
+}
+
+// key of a raw column, from its training and validation values
+uint64_t column_key(const double *train, int n_train, const double *valid, int n_valid) {
+    uint64_t h = mix64((uint64_t)n_train, (uint64_t)n_valid);
+    for (int i = 0; i < n_train; i++) {
+        h = mix64(h, double_bits(train[i]));
+    }
+    for (int i = 0; i < n_valid; i++) {
+        h = mix64(h, double_bits(valid[i]));
+    }
+    return h;
+}
+
+// key of the output column of neuron coeffs over input columns in1, in2
+uint64_t neuron_key(uint64_t in1, uint64_t in2, const double *coeffs) {
+    uint64_t h = mix64(in1, in2);
+    for (int c = 0; c < 6; c++) {
+        h = mix64(h, double_bits(coeffs[c]));
+    }
+    return h;
+}
+
+neuron_cache_t* neuron_cache_create(size_t max_bytes) {
+    neuron_cache_t *c = calloc(1, sizeof(neuron_cache_t));
+    c->n_slots = NEURON_CACHE_SLOTS;
+    c->slots = calloc(c->n_slots, sizeof(neuron_entry_t*));
+    c->max_bytes = max_bytes;
+    return c;
+}
+
+// first free slot at or after key's home slot
+static int free_slot(const neuron_cache_t *c, uint64_t key) {
+    int mask = c->n_slots - 1;
+    int s = (int)(key & (uint64_t)mask);
+    while (c->slots[s]) {
+        s = (s + 1) & mask;
+    }
+    return s;
+}
+
+static int same_neuron(const neuron_entry_t *e, uint64_t in1, uint64_t in2,
+                       const double *coeffs, int n_train, int n_valid) {
+    return e->in1 == in1 && e->in2 == in2 && e->n_train == n_train &&
+           e->n_valid == n_valid && memcmp(e->coeffs, coeffs, sizeof(e->coeffs)) == 0;
+}
+
+static void insert_entry(neuron_cache_t *c, neuron_entry_t *e) {
+    if (2 * (c->n_entries + 1) > c->n_slots) {
+        neuron_entry_t **old = c->slots;
+        int n_old = c->n_slots;
+        c->n_slots *= 2;
+        c->slots = calloc(c->n_slots, sizeof(neuron_entry_t*));
+        for (int s = 0; s < n_old; s++) {
+            if (old[s]) c->slots[free_slot(c, old[s]->key)] = old[s];
+        }
+        free(old);
+    }
+    c->slots[free_slot(c, e->key)] = e;
+    c->n_entries++;
+    c->bytes += (size_t)(e->n_train + e->n_valid) * sizeof(double);
+}
+
+// the output columns of neuron coeffs over input columns (x1, x2), keyed
+// in1 and in2: from the cache, or evaluated over both row sets and added.
+// the returned columns stay valid until the next neuron_cache_trim
+neuron_entry_t* neuron_cache_get(neuron_cache_t *c, uint64_t in1, uint64_t in2,
+                                 const double *coeffs,
+                                 const double *x1_train, const double *x2_train, int n_train,
+                                 const double *x1_valid, const double *x2_valid, int n_valid) {
+    uint64_t key = neuron_key(in1, in2, coeffs);
+    int mask = c->n_slots - 1;
+    neuron_entry_t *e;
+    for (int s = (int)(key & (uint64_t)mask); (e = c->slots[s]); s = (s + 1) & mask) {
+        if (e->key == key && same_neuron(e, in1, in2, coeffs, n_train, n_valid)) {
+            e->used = c->run;
+            c->hits++;
+            return e;
+        }
+    }
+
+    e = malloc(sizeof(neuron_entry_t));
+    e->key = key;
+    e->in1 = in1;
+    e->in2 = in2;
+    memcpy(e->coeffs, coeffs, sizeof(e->coeffs));
+    e->n_train = n_train;
+    e->n_valid = n_valid;
+    e->train = malloc(((size_t)n_train + n_valid + 1) * sizeof(double));
+    e->valid = e->train + n_train;
+    e->used = c->run;
+    predict_polynomial_column(x1_train, x2_train, coeffs, e->train, n_train);
+    predict_polynomial_column(x1_valid, x2_valid, coeffs, e->valid, n_valid);
+    insert_entry(c, e);
+    c->misses++;
+    return e;
+}
+
+// start a run: entries it touches are not evicted before the next run
+void neuron_cache_begin_run(neuron_cache_t *c) {
+    c->run++;
+}
+
+static int compare_entry_age(const void *pa, const void *pb) {
+    const neuron_entry_t *a = *(neuron_entry_t *const *)pa;
+    const neuron_entry_t *b = *(neuron_entry_t *const *)pb;
+    return (a->used > b->used) - (a->used < b->used);
+}
+
+// evict the entries of the least recent runs until the columns fit in
+// max_bytes, sparing the current run's
+void neuron_cache_trim(neuron_cache_t *c) {
+    if (c->bytes <= c->max_bytes) return;
+    neuron_entry_t **all = malloc((c->n_entries + 1) * sizeof(neuron_entry_t*));
+    int n = 0;
+    for (int s = 0; s < c->n_slots; s++) {
+        if (c->slots[s]) all[n++] = c->slots[s];
+    }
+    qsort(all, n, sizeof(neuron_entry_t*), compare_entry_age);
+
+    int kept = n;
+    for (int i = 0; i < n; i++) {
+        neuron_entry_t *e = all[i];
+        if (e->used == c->run || c->bytes <= c->max_bytes) continue;
+        c->bytes -= (size_t)(e->n_train + e->n_valid) * sizeof(double);
+        free(e->train);
+        free(e);
+        all[i] = NULL;
+        kept--;
+    }
+
+    // rebuild the table from the survivors
+    memset(c->slots, 0, c->n_slots * sizeof(neuron_entry_t*));
+    c->n_entries = kept;
+    for (int i = 0; i < n; i++) {
+        if (all[i]) c->slots[free_slot(c, all[i]->key)] = all[i];
+    }
+    free(all);
+}
+
+void free_neuron_cache(neuron_cache_t *c) {
+    if (!c) return;
+    c->max_bytes = 0;
+    c->run++;
+    neuron_cache_trim(c);
+    free(c->slots);
+    free(c);
+}
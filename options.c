@@ -0,0 +1,29 @@
+#include "gmdh.h"
+
+// the defaults, in one place for both copies below
+#define GMDH_DEFAULT_OPTIONS { \
+    .n_threads = 1, \
+    .top_k = 100, \
+    .linear_mode = GMDH_LINEAR_REFIT, \
+    .simd = GMDH_SIMD_AUTO, \
+    .csv_cache = 1, \
+    .prune = GMDH_PRUNE_OFF, \
+    .neuron_cache_bytes = 256 << 20, \
+    .precision = GMDH_PRECISION_DOUBLE, \
+    .scoring = GMDH_SCORE_ROWS, \
+    .screen_budget = 0, \
+    .screen_corr = 0.98, \
+    .screen_rank = GMDH_SCREEN_CORR, \
+    .beam_width = 16, \
+    .beam_swaps = 1, \
+}
+
+static const gmdh_options_t default_options = GMDH_DEFAULT_OPTIONS;
+
+// process-wide options, read by every algorithm called outside a context
+// run (see gmdh_current_options)
+gmdh_options_t gmdh_options = GMDH_DEFAULT_OPTIONS;
+
+void gmdh_default_options(gmdh_options_t *opts) {
+    *opts = default_options;
+}
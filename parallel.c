@@ -0,0 +1,298 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <unistd.h>
+#include "gmdh.h"
+
+// one worker's share of the task space. the owner takes grain-sized
+// chunks from the front, thieves split off the back half
+typedef struct {
+    pthread_mutex_t lock;
+    long begin;
+    long end;
+} task_range_t;
+
+typedef struct {
+    task_range_t *ranges;
+    int n_threads;
+    long grain;
+    parallel_fn fn;
+    void *ctx;
+} scheduler_t;
+
+typedef struct {
+    scheduler_t *sched;
+    int id;
+    gmdh_context_t *context;
+    uint64_t generation;    // pool workers: loops started before this one joined
+} worker_arg_t;
+
+int gmdh_thread_count(void) {
+    int n_threads = gmdh_current_options()->n_threads;
+    if (n_threads > 0) {
+        return n_threads;
+    }
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+// take the next chunk of our own range
+static int take_local(task_range_t *r, long grain, long *begin, long *end) {
+    int found = 0;
+    pthread_mutex_lock(&r->lock);
+    if (r->begin < r->end) {
+        *begin = r->begin;
+        *end = grain < r->end - r->begin ? r->begin + grain : r->end;
+        r->begin = *end;
+        found = 1;
+    }
+    pthread_mutex_unlock(&r->lock);
+    return found;
+}
+
+// move the back half of some other worker's range into ours
+static int steal(scheduler_t *s, int self) {
+    for (int k = 1; k < s->n_threads; k++) {
+        task_range_t *victim = &s->ranges[(self + k) % s->n_threads];
+        long begin = 0, end = 0;
+
+        pthread_mutex_lock(&victim->lock);
+        if (victim->begin < victim->end) {
+            long mid = victim->begin + (victim->end - victim->begin) / 2;
+            begin = mid;
+            end = victim->end;
+            victim->end = mid;
+        }
+        pthread_mutex_unlock(&victim->lock);
+
+        if (begin < end) {
+            task_range_t *own = &s->ranges[self];
+            pthread_mutex_lock(&own->lock);
+            own->begin = begin;
+            own->end = end;
+            pthread_mutex_unlock(&own->lock);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// work through our own range, then steal until nothing is left
+static void run_worker(scheduler_t *s, int id) {
+    task_range_t *own = &s->ranges[id];
+    PROF_LANE(id);
+
+    for (;;) {
+        long begin, end;
+        while (take_local(own, s->grain, &begin, &end)) {
+            s->fn(s->ctx, id, begin, end);
+        }
+        if (!steal(s, id)) {
+            break;
+        }
+    }
+}
+
+static void* worker_main(void *arg) {
+    worker_arg_t *w = arg;
+    gmdh_context_swap(w->context);
+    run_worker(w->sched, w->id);
+    return NULL;
+}
+
+// workers kept between loops, parked on `start` until the next one. one
+// loop at a time runs on the pool; a loop started while it is busy (from
+// another thread, or from inside a loop body) gets threads of its own
+typedef struct {
+    pthread_mutex_t busy;       // held by the loop running on the pool
+    pthread_mutex_t lock;       // guards everything below
+    pthread_cond_t start;
+    pthread_cond_t done;
+    int n_workers;              // parked threads, ids 1..n_workers
+    int capacity;               // ranges allocated
+    task_range_t *ranges;
+    scheduler_t sched;
+    gmdh_context_t *context;    // the caller's, taken on by every worker
+    uint64_t generation;        // loops started
+    int running;                // workers not yet done with this loop
+} thread_pool_t;
+
+static thread_pool_t pool = {
+    .busy = PTHREAD_MUTEX_INITIALIZER,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .start = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+};
+
+static void* pool_main(void *arg) {
+    worker_arg_t *w = arg;
+    int id = w->id;
+    uint64_t seen = w->generation;
+    free(w);
+
+    for (;;) {
+        pthread_mutex_lock(&pool.lock);
+        while (pool.generation == seen) {
+            pthread_cond_wait(&pool.start, &pool.lock);
+        }
+        seen = pool.generation;
+        int taking_part = id < pool.sched.n_threads;
+        gmdh_context_t *context = pool.context;
+        pthread_mutex_unlock(&pool.lock);
+        if (!taking_part) continue;
+
+        gmdh_context_swap(context);
+        run_worker(&pool.sched, id);
+        gmdh_context_swap(NULL);
+
+        pthread_mutex_lock(&pool.lock);
+        if (--pool.running == 0) pthread_cond_signal(&pool.done);
+        pthread_mutex_unlock(&pool.lock);
+    }
+    return NULL;
+}
+
+// make room for a loop on n_threads workers, starting threads the pool
+// lacks. called holding pool.busy, so no loop is running. returns the
+// number of workers there are room for, which is fewer only when a thread
+// could not be started
+static int pool_reserve(int n_threads) {
+    if (pool.capacity < n_threads) {
+        task_range_t *ranges = malloc(n_threads * sizeof(task_range_t));
+        for (int t = 0; t < n_threads; t++) {
+            pthread_mutex_init(&ranges[t].lock, NULL);
+        }
+        for (int t = 0; t < pool.capacity; t++) {
+            pthread_mutex_destroy(&pool.ranges[t].lock);
+        }
+        free(pool.ranges);
+        pool.ranges = ranges;
+        pool.capacity = n_threads;
+    }
+    while (pool.n_workers < n_threads - 1) {
+        worker_arg_t *w = malloc(sizeof(worker_arg_t));
+        w->id = pool.n_workers + 1;
+        w->generation = pool.generation;
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, pool_main, w) != 0) {
+            free(w);
+            break;
+        }
+        pthread_detach(thread);
+        pool.n_workers++;
+    }
+    return pool.n_workers + 1;
+}
+
+// the same loop on threads started for it alone
+static void spawn_for(scheduler_t *sched, task_range_t *ranges) {
+    int n_threads = sched->n_threads;
+    pthread_t *threads = malloc(n_threads * sizeof(pthread_t));
+    worker_arg_t *args = malloc(n_threads * sizeof(worker_arg_t));
+    for (int t = 0; t < n_threads; t++) {
+        pthread_mutex_init(&ranges[t].lock, NULL);
+    }
+
+    // the calling thread works as worker 0. the ranges of threads that
+    // could not be started are stolen by those that were
+    int n_started = 1;
+    for (int t = 1; t < n_threads; t++) {
+        args[t].sched = sched;
+        args[t].id = t;
+        args[t].context = gmdh_context_current();
+        if (pthread_create(&threads[t], NULL, worker_main, &args[t]) != 0) break;
+        n_started++;
+    }
+    run_worker(sched, 0);
+
+    for (int t = 1; t < n_started; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    for (int t = 0; t < n_threads; t++) {
+        pthread_mutex_destroy(&ranges[t].lock);
+    }
+    free(threads);
+    free(args);
+}
+
+// start of worker t's slice: n_tasks * t / n_threads, computed so that it
+// cannot overflow for task counts near LONG_MAX
+static long slice_start(long n_tasks, int t, int n_threads) {
+    return n_tasks / n_threads * t + n_tasks % n_threads * t / n_threads;
+}
+
+// split [0, n_tasks) into equal slices, one per worker
+static void deal_ranges(task_range_t *ranges, long n_tasks, int n_threads) {
+    for (int t = 0; t < n_threads; t++) {
+        ranges[t].begin = slice_start(n_tasks, t, n_threads);
+        ranges[t].end = slice_start(n_tasks, t + 1, n_threads);
+    }
+}
+
+// run fn over [0, n_tasks) on n_threads workers. each worker starts with
+// an equal slice and steals from the others once its own slice is done.
+// the calling thread works as worker 0 and the rest come from a pool
+// kept between calls, so a loop starts no threads and allocates nothing
+// once the pool has grown to its size. the workers run with the caller's
+// context (see context.c)
+void parallel_for(long n_tasks, long grain, int n_threads, parallel_fn fn, void *ctx) {
+    if (n_tasks <= 0) return;
+    if (grain < 1) grain = 1;
+    if (n_threads > n_tasks) n_threads = (int)n_tasks;
+
+    if (n_threads <= 1) {
+        fn(ctx, 0, 0, n_tasks);
+        return;
+    }
+
+    if (pthread_mutex_trylock(&pool.busy) != 0) {
+        scheduler_t sched = {NULL, n_threads, grain, fn, ctx};
+        sched.ranges = malloc(n_threads * sizeof(task_range_t));
+        deal_ranges(sched.ranges, n_tasks, n_threads);
+        spawn_for(&sched, sched.ranges);
+        free(sched.ranges);
+        return;
+    }
+
+    int room = pool_reserve(n_threads);
+    if (n_threads > room) n_threads = room;
+    deal_ranges(pool.ranges, n_tasks, n_threads);
+
+    pthread_mutex_lock(&pool.lock);
+    pool.sched.ranges = pool.ranges;
+    pool.sched.n_threads = n_threads;
+    pool.sched.grain = grain;
+    pool.sched.fn = fn;
+    pool.sched.ctx = ctx;
+    pool.context = gmdh_context_current();
+    pool.running = n_threads - 1;
+    pool.generation++;
+    pthread_cond_broadcast(&pool.start);
+    pthread_mutex_unlock(&pool.lock);
+
+    run_worker(&pool.sched, 0);
+
+    pthread_mutex_lock(&pool.lock);
+    while (pool.running > 0) {
+        pthread_cond_wait(&pool.done, &pool.lock);
+    }
+    pthread_mutex_unlock(&pool.lock);
+    pthread_mutex_unlock(&pool.busy);
+}
+
+// a bound shared by the workers of one sweep, such as the error a
+// candidate must beat to be kept. reads may be stale; a stale bound is
+// only looser, never wrong
+double shared_bound_read(double *bound) {
+    double v;
+    __atomic_load(bound, &v, __ATOMIC_RELAXED);
+    return v;
+}
+
+// lower the shared bound to value unless it is already lower
+void shared_bound_lower(double *bound, double value) {
+    double cur;
+    __atomic_load(bound, &cur, __ATOMIC_RELAXED);
+    while (value < cur &&
+           !__atomic_compare_exchange(bound, &cur, &value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
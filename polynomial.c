@@ -1,112 +1,149 @@
 #include "gmdh.h"
 
-// solve Ax = b using gaussian elimination
-static void solve_linear_system(double **A, double *b, double *x, int n) {
-    double **aug = malloc(n * sizeof(double*));
-    for (int i = 0; i < n; i++) {
-        aug[i] = malloc((n + 1) * sizeof(double));
-        memcpy(aug[i], A[i], n * sizeof(double));
-        aug[i][n] = b[i];
+// the 6x6 normal equations of a quadratic neuron, from its pair moments
+void quadratic_normal_equations(const quad_moments_t *m, double *XtX, double *Xty) {
+    const double a[36] = {
+        m->n,  m->a1,  m->b1,  m->a2,   m->b2,   m->ab,
+        m->a1, m->a2,  m->ab,  m->a3,   m->ab2,  m->a2b,
+        m->b1, m->ab,  m->b2,  m->a2b,  m->b3,   m->ab2,
+        m->a2, m->a3,  m->a2b, m->a4,   m->a2b2, m->a3b,
+        m->b2, m->ab2, m->b3,  m->a2b2, m->b4,   m->ab3,
+        m->ab, m->a2b, m->ab2, m->a3b,  m->ab3,  m->a2b2
+    };
+    const double b[6] = { m->y, m->ay, m->by, m->a2y, m->b2y, m->aby };
+    memcpy(XtX, a, sizeof(a));
+    memcpy(Xty, b, sizeof(b));
+}
+
+// solve the 6x6 normal equations assembled from pair moments. returns
+// the condition estimate of the system. columns that are numerically
+// dependent (say x1 = x2) get zero coefficients, so a collinear pair still
+// fits on what it has instead of returning garbage
+double fit_quadratic_moments(const quad_moments_t *m, double *coeffs) {
+    double XtX[36], Xty[6];
+    quadratic_normal_equations(m, XtX, Xty);
+
+    solve_info_t info;
+    PROF_BEGIN(PROF_SOLVE);
+    solve_normal(XtX, Xty, coeffs, 6, &info);
+    PROF_END(PROF_SOLVE);
+    return info.cond;
+}
+
+// residual sum of squares of neuron coeffs over the rows behind the
+// moments: y'y - 2 b'X'y + b'X'X b, never below 0
+double sse_quadratic_moments(const quad_moments_t *m, const double *coeffs) {
+    double XtX[36], Xty[6];
+    quadratic_normal_equations(m, XtX, Xty);
+
+    double sse = m->yy;
+    for (int r = 0; r < 6; r++) {
+        double quad = 0;
+        for (int c = 0; c < 6; c++) {
+            quad += XtX[r * 6 + c] * coeffs[c];
+        }
+        sse += coeffs[r] * (quad - 2 * Xty[r]);
     }
-    
-    // forward elimination
-    for (int i = 0; i < n; i++) {
-        // find pivot
-        int max_row = i;
-        for (int k = i + 1; k < n; k++) {
-            if (fabs(aug[k][i]) > fabs(aug[max_row][i])) {
-                max_row = k;
+    return sse < 0 ? 0 : sse;
+}
+
+// smallest residual sum of squares any quadratic neuron reaches over the
+// rows behind the moments: sse_quadratic_moments at the least squares
+// fit, lowered by FLOOR_SLACK * y'y for rounding. 0 when the fit is too
+// ill-conditioned to vouch for
+double floor_quadratic_moments(const quad_moments_t *m) {
+    double b[6];
+    if (!(fit_quadratic_moments(m, b) <= GMDH_COND_WARN)) return 0;
+
+    double sse = sse_quadratic_moments(m, b) - FLOOR_SLACK * m->yy;
+    return sse > 0 ? sse : 0;
+}
+
+// add one row's terms to every sum but the row count
+static inline void add_row(quad_moments_t *s, double a, double b, double t) {
+    double aa = a * a, bb = b * b, ab = a * b;
+    s->a1 += a;
+    s->a2 += aa;
+    s->a3 += aa * a;
+    s->a4 += aa * aa;
+    s->b1 += b;
+    s->b2 += bb;
+    s->b3 += bb * b;
+    s->b4 += bb * bb;
+    s->ab += ab;
+    s->a2b += ab * a;
+    s->ab2 += ab * b;
+    s->a3b += ab * aa;
+    s->ab3 += ab * bb;
+    s->a2b2 += ab * ab;
+    s->y += t;
+    s->ay += a * t;
+    s->by += b * t;
+    s->a2y += aa * t;
+    s->b2y += bb * t;
+    s->aby += ab * t;
+    s->yy += t * t;
+}
+
+// the moments of pair (a, b) against y over the rows where all three are
+// present, MASK_BITS rows at a time. ma, mb and my are their presence
+// bitmaps; a NULL one is worked out from the values word by word. the
+// rows of a full word are summed as they are, an empty word is skipped,
+// and in a mixed word the absent rows are swapped for zeros, which add
+// nothing, by selects rather than branches. the row count comes from
+// popcount
+void quad_moments_masked(const double *a, const double *b, const double *y, int n,
+                         const uint64_t *ma, const uint64_t *mb, const uint64_t *my,
+                         quad_moments_t *mom) {
+    quad_moments_t s;
+    memset(&s, 0, sizeof(s));
+    int n_words = mask_words(n);
+    int count = 0;
+
+    for (int w = 0; w < n_words; w++) {
+        int base = w * MASK_BITS;
+        int len = n - base < MASK_BITS ? n - base : MASK_BITS;
+        const double *pa = a + base, *pb = b + base, *py = y + base;
+        uint64_t word = (ma ? ma[w] : mask_word(pa, len)) &
+                        (mb ? mb[w] : mask_word(pb, len)) &
+                        (my ? my[w] : mask_word(py, len));
+        if (!word) continue;
+        count += __builtin_popcountll(word);
+
+        if (word == mask_full_word(n, w)) {
+            for (int i = 0; i < len; i++) {
+                add_row(&s, pa[i], pb[i], py[i]);
             }
-        }
-        
-        // swap rows
-        double *tmp = aug[i];
-        aug[i] = aug[max_row];
-        aug[max_row] = tmp;
-        
-        // eliminate
-        for (int k = i + 1; k < n; k++) {
-            double factor = aug[k][i] / aug[i][i];
-            for (int j = i; j <= n; j++) {
-                aug[k][j] -= factor * aug[i][j];
+        } else {
+            for (int i = 0; i < len; i++) {
+                int keep = (int)(word >> i & 1);
+                add_row(&s, keep ? pa[i] : 0, keep ? pb[i] : 0, keep ? py[i] : 0);
             }
         }
     }
-    
-    // back substitution
-    for (int i = n - 1; i >= 0; i--) {
-        x[i] = aug[i][n];
-        for (int j = i + 1; j < n; j++) {
-            x[i] -= aug[i][j] * x[j];
-        }
-        x[i] /= aug[i][i];
-    }
-    
-    for (int i = 0; i < n; i++) {
-        free(aug[i]);
-    }
-    free(aug);
+    s.n = count;
+    *mom = s;
 }
 
 // fit polynomial: y = a0 + a1*x1 + a2*x2 + a3*x1^2 + a4*x2^2 + a5*x1*x2
+// one pass over the samples collects the moments of the normal equations,
+// over the rows where x1, x2 and y are all present. returns the condition
+// estimate of the fit
+double fit_polynomial_columns(const double *x1, const double *x2, const double *y, int n,
+                              double *coeffs) {
+    quad_moments_t m;
+
+    PROF_BEGIN(PROF_NORMAL);
+    quad_moments_masked(x1, x2, y, n, NULL, NULL, NULL, &m);
+    PROF_END(PROF_NORMAL);
+    PROF_COUNT(PROF_CANDIDATES, 1);
+    PROF_COUNT(PROF_BYTES_TOUCHED, 3 * (uint64_t)n * sizeof(double));
+
+    return fit_quadratic_moments(&m, coeffs);
+}
+
 void fit_polynomial(double *x1, double *x2, double *y, int n, double *coeffs) {
-    const int n_coeffs = 6;
-    double **X = malloc(n * sizeof(double*));
-    
-    // build design matrix
-    for (int i = 0; i < n; i++) {
-        X[i] = malloc(n_coeffs * sizeof(double));
-        if (isnan(x1[i]) || isnan(x2[i]) || isnan(y[i])) {
-            // skip missing values
-            for (int j = 0; j < n_coeffs; j++) {
-                X[i][j] = 0;
-            }
-            continue;
-        }
-        X[i][0] = 1.0;
-        X[i][1] = x1[i];
-        X[i][2] = x2[i];
-        X[i][3] = x1[i] * x1[i];
-        X[i][4] = x2[i] * x2[i];
-        X[i][5] = x1[i] * x2[i];
-    }
-    
-    // build normal equations: X'X * coeffs = X'y
-    double **XtX = malloc(n_coeffs * sizeof(double*));
-    double *Xty = malloc(n_coeffs * sizeof(double));
-    
-    for (int i = 0; i < n_coeffs; i++) {
-        XtX[i] = malloc(n_coeffs * sizeof(double));
-        for (int j = 0; j < n_coeffs; j++) {
-            XtX[i][j] = 0;
-            for (int k = 0; k < n; k++) {
-                if (!isnan(y[k])) {
-                    XtX[i][j] += X[k][i] * X[k][j];
-                }
-            }
-        }
-        Xty[i] = 0;
-        for (int k = 0; k < n; k++) {
-            if (!isnan(y[k])) {
-                Xty[i] += X[k][i] * y[k];
-            }
-        }
-    }
-    
-    // solve system
-    solve_linear_system(XtX, Xty, coeffs, n_coeffs);
-    
-    // cleanup
-    for (int i = 0; i < n; i++) {
-        free(X[i]);
-    }
-    free(X);
-    
-    for (int i = 0; i < n_coeffs; i++) {
-        free(XtX[i]);
-    }
-    free(XtX);
-    free(Xty);
+    fit_polynomial_columns(x1, x2, y, n, coeffs);
 }
 
 double predict_polynomial(double x1, double x2, double *coeffs) {
@@ -155,11 +192,14 @@ double calculate_r2(double *pred, double *actual, int n) {
 }
 
 void print_model(polynomial_model_t *model, char **feature_names) {
-    printf("model: f(%s, %s)\n", 
+    gmdh_log("model: f(%s, %s)\n", 
            feature_names[model->feature1], 
            feature_names[model->feature2]);
-    printf("  y = %.4f + %.4f*x1 + %.4f*x2 + %.4f*x1² + %.4f*x2² + %.4f*x1*x2\n",
+    gmdh_log("  y = %.4f + %.4f*x1 + %.4f*x2 + %.4f*x1² + %.4f*x2² + %.4f*x1*x2\n",
            model->coeffs[0], model->coeffs[1], model->coeffs[2],
            model->coeffs[3], model->coeffs[4], model->coeffs[5]);
-    printf("  rmse: %.4f, r²: %.4f\n", model->error, model->r2);
+    gmdh_log("  rmse: %.4f, r²: %.4f\n", model->error, model->r2);
+    if (model->cond > GMDH_COND_WARN) {
+        gmdh_log("  warning: ill-conditioned fit (cond %.1e)\n", model->cond);
+    }
 }
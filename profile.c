@@ -0,0 +1,184 @@
+#include "gmdh.h"
+
+// built-in profiler, compiled in with -DGMDH_PROFILE (make PROFILE=1).
+// every thread adds to the counters of its lane: worker t of a parallel
+// sweep is lane t, and any other thread is lane 0. phases accumulate
+// calls and nanoseconds; the coarse ones (load, gather, normal, sort,
+// sweep) are also kept as trace events, up to PROF_TRACE_EVENTS a lane,
+// for profile_write_trace. without GMDH_PROFILE the hooks compile away
+// and these functions do nothing
+
+#ifdef GMDH_PROFILE
+
+#define PROF_LANES 64
+#define PROF_TRACE_EVENTS 8192
+
+typedef struct {
+    uint64_t start;
+    uint64_t dur;
+    int phase;
+} prof_event_t;
+
+typedef struct {
+    uint64_t ns[PROF_PHASES];
+    uint64_t calls[PROF_PHASES];
+    uint64_t counters[PROF_COUNTERS];
+    uint64_t n_events;      // events offered, kept or not
+    prof_event_t events[PROF_TRACE_EVENTS];
+} prof_lane_t;
+
+static prof_lane_t lanes[PROF_LANES];
+static uint64_t epoch;
+static __thread int current_lane;
+
+static const char *phase_names[PROF_PHASES] = {
+    "load", "gather", "normal", "solve", "score", "sort", "sweep"
+};
+static const int phase_traced[PROF_PHASES] = {1, 1, 1, 0, 0, 1, 1};
+
+uint64_t profile_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t t = (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+    uint64_t zero = 0;
+    __atomic_compare_exchange_n(&epoch, &zero, t, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    return t;
+}
+
+void profile_lane(int lane) {
+    current_lane = lane >= 0 && lane < PROF_LANES ? lane : lane % PROF_LANES;
+}
+
+// close a phase opened at start (a profile_now reading)
+void profile_phase(prof_phase_t phase, uint64_t start) {
+    uint64_t dur = profile_now() - start;
+    prof_lane_t *l = &lanes[current_lane];
+    __atomic_add_fetch(&l->ns[phase], dur, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&l->calls[phase], 1, __ATOMIC_RELAXED);
+    if (!phase_traced[phase]) return;
+
+    uint64_t slot = __atomic_fetch_add(&l->n_events, 1, __ATOMIC_RELAXED);
+    if (slot < PROF_TRACE_EVENTS) {
+        l->events[slot].start = start;
+        l->events[slot].dur = dur;
+        l->events[slot].phase = phase;
+    }
+}
+
+void profile_count(prof_counter_t counter, uint64_t n) {
+    __atomic_add_fetch(&lanes[current_lane].counters[counter], n, __ATOMIC_RELAXED);
+}
+
+void profile_reset(void) {
+    memset(lanes, 0, sizeof(lanes));
+    epoch = 0;
+}
+
+// phase breakdown, counters and per-lane load since the last reset
+void profile_report(FILE *out) {
+    uint64_t ns[PROF_PHASES] = {0}, calls[PROF_PHASES] = {0};
+    uint64_t counters[PROF_COUNTERS] = {0};
+    uint64_t dropped = 0;
+    for (int l = 0; l < PROF_LANES; l++) {
+        for (int p = 0; p < PROF_PHASES; p++) {
+            ns[p] += lanes[l].ns[p];
+            calls[p] += lanes[l].calls[p];
+        }
+        for (int c = 0; c < PROF_COUNTERS; c++) {
+            counters[c] += lanes[l].counters[c];
+        }
+        if (lanes[l].n_events > PROF_TRACE_EVENTS) {
+            dropped += lanes[l].n_events - PROF_TRACE_EVENTS;
+        }
+    }
+    double wall = epoch ? (profile_now() - epoch) * 1e-6 : 0;
+
+    fprintf(out, "\nprofile: %.1f ms since the first event\n", wall);
+    fprintf(out, "%-8s %12s %12s %12s %8s\n", "phase", "calls", "total ms", "mean us", "of wall");
+    for (int p = 0; p < PROF_PHASES; p++) {
+        if (calls[p] == 0) continue;
+        fprintf(out, "%-8s %12llu %12.2f %12.3f %7.1f%%\n", phase_names[p],
+                (unsigned long long)calls[p], ns[p] * 1e-6, ns[p] * 1e-3 / calls[p],
+                wall > 0 ? 100 * ns[p] * 1e-6 / wall : 0);
+    }
+    fprintf(out, "candidates %llu, allocations %llu (%.2f MB), bytes touched %.2f MB\n",
+            (unsigned long long)counters[PROF_CANDIDATES],
+            (unsigned long long)counters[PROF_ALLOCS], counters[PROF_ALLOC_BYTES] / 1e6,
+            counters[PROF_BYTES_TOUCHED] / 1e6);
+
+    // per-lane candidates and solve + score time show how evenly a sweep
+    // was spread
+    for (int l = 0; l < PROF_LANES; l++) {
+        const prof_lane_t *ln = &lanes[l];
+        if (ln->counters[PROF_CANDIDATES] == 0) continue;
+        fprintf(out, "  lane %-3d candidates %10llu  solve+score %10.2f ms\n", l,
+                (unsigned long long)ln->counters[PROF_CANDIDATES],
+                (ln->ns[PROF_SOLVE] + ln->ns[PROF_SCORE]) * 1e-6);
+    }
+    if (dropped > 0) {
+        fprintf(out, "trace: %llu events past the per-lane limit were dropped\n",
+                (unsigned long long)dropped);
+    }
+}
+
+// chrome trace-event json of the coarse phases, one track per lane, for
+// chrome://tracing or perfetto. returns 0 if the file cannot be written
+int profile_write_trace(const char *path) {
+    FILE *fp = fopen(path, "w");
+    if (!fp) return 0;
+
+    fprintf(fp, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    int first = 1;
+    for (int l = 0; l < PROF_LANES; l++) {
+        uint64_t n = lanes[l].n_events < PROF_TRACE_EVENTS ? lanes[l].n_events
+                                                            : PROF_TRACE_EVENTS;
+        if (n == 0) continue;
+        fprintf(fp, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, "
+                    "\"args\": {\"name\": \"lane %d\"}}",
+                first ? "" : ",\n", l, l);
+        first = 0;
+        for (uint64_t e = 0; e < n; e++) {
+            const prof_event_t *ev = &lanes[l].events[e];
+            // microseconds from the first event
+            fprintf(fp, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, "
+                        "\"ts\": %.3f, \"dur\": %.3f}",
+                    phase_names[ev->phase], l, (ev->start - epoch) * 1e-3, ev->dur * 1e-3);
+        }
+    }
+    fprintf(fp, "\n]}\n");
+    return fclose(fp) == 0;
+}
+
+#else
+
+uint64_t profile_now(void) {
+    return 0;
+}
+
+void profile_phase(prof_phase_t phase, uint64_t start) {
+    (void)phase;
+    (void)start;
+}
+
+void profile_count(prof_counter_t counter, uint64_t n) {
+    (void)counter;
+    (void)n;
+}
+
+void profile_lane(int lane) {
+    (void)lane;
+}
+
+void profile_reset(void) {
+}
+
+void profile_report(FILE *out) {
+    fprintf(out, "profiling is off: rebuild with make PROFILE=1\n");
+}
+
+int profile_write_trace(const char *path) {
+    (void)path;
+    return 0;
+}
+
+#endif
@@ -0,0 +1,223 @@
+#include "gmdh.h"
+
+// ranking of candidate models. every algorithm orders its candidates with
+// a `before` predicate, a strict total order: lower error first (a NaN
+// error ranks as infinite), then the simpler model, then the higher r²,
+// then the lower feature indices. no two distinct candidates tie, so a
+// ranking is the same whatever the sweep's schedule or the algorithm
+// below. only the models kept need sorting: rank_top selects them in
+// linear time and sorts just those
+
+// ranges this short are finished by insertion sort
+#define RANK_INSERTION 16
+
+static double error_key(double e) {
+    return isnan(e) ? INFINITY : e;
+}
+
+// r² compared higher first, NaN last
+static int r2_before(double a, double b) {
+    if (isnan(a) || isnan(b)) return !isnan(a) && isnan(b);
+    return a > b;
+}
+
+// coefficients a quadratic neuron actually uses: a collinear pair gets
+// zeros for its dependent terms
+static int polynomial_complexity(const polynomial_model_t *m) {
+    int k = 0;
+    for (int c = 0; c < 6; c++) {
+        k += m->coeffs[c] != 0;
+    }
+    return k;
+}
+
+int polynomial_model_before(const void *pa, const void *pb) {
+    const polynomial_model_t *a = pa, *b = pb;
+    double ea = error_key(a->error), eb = error_key(b->error);
+    if (ea != eb) return ea < eb;
+    int ka = polynomial_complexity(a), kb = polynomial_complexity(b);
+    if (ka != kb) return ka < kb;
+    if (r2_before(a->r2, b->r2) || r2_before(b->r2, a->r2)) return r2_before(a->r2, b->r2);
+    if (a->feature1 != b->feature1) return a->feature1 < b->feature1;
+    return a->feature2 < b->feature2;
+}
+
+// fewer features is simpler; equal sizes fall back to the lexicographic
+// feature indices, i.e. the lower enumeration rank
+int linear_model_before(const void *pa, const void *pb) {
+    const linear_model_t *a = pa, *b = pb;
+    double ea = error_key(a->error), eb = error_key(b->error);
+    if (ea != eb) return ea < eb;
+    if (a->n_features != b->n_features) return a->n_features < b->n_features;
+    if (r2_before(a->r2, b->r2) || r2_before(b->r2, a->r2)) return r2_before(a->r2, b->r2);
+    for (int i = 0; i < a->n_features; i++) {
+        if (a->feature_indices[i] != b->feature_indices[i]) {
+            return a->feature_indices[i] < b->feature_indices[i];
+        }
+    }
+    return 0;
+}
+
+// bare errors, for heaps of errors alone
+int error_before(const void *pa, const void *pb) {
+    return error_key(*(const double*)pa) < error_key(*(const double*)pb);
+}
+
+static void swap_items(char *a, char *b, size_t size) {
+    char tmp[size];
+    memcpy(tmp, a, size);
+    memcpy(a, b, size);
+    memcpy(b, tmp, size);
+}
+
+static void insertion_sort(char *items, size_t n, size_t size, rank_before_fn before) {
+    char tmp[size];
+    for (size_t i = 1; i < n; i++) {
+        size_t j = i;
+        memcpy(tmp, items + i * size, size);
+        while (j > 0 && before(tmp, items + (j - 1) * size)) {
+            memcpy(items + j * size, items + (j - 1) * size, size);
+            j--;
+        }
+        if (j != i) memcpy(items + j * size, tmp, size);
+    }
+}
+
+static void merge_sort(char *items, char *tmp, size_t n, size_t size, rank_before_fn before) {
+    if (n <= RANK_INSERTION) {
+        insertion_sort(items, n, size, before);
+        return;
+    }
+    size_t half = n / 2;
+    merge_sort(items, tmp, half, size, before);
+    merge_sort(items + half * size, tmp, n - half, size, before);
+    // already in order: nothing to merge
+    if (!before(items + half * size, items + (half - 1) * size)) return;
+
+    memcpy(tmp, items, half * size);
+    size_t i = 0, j = half, o = 0;
+    while (i < half && j < n) {
+        // take from the right only when strictly before, which keeps the
+        // sort stable
+        if (before(items + j * size, tmp + i * size)) {
+            memcpy(items + o++ * size, items + j++ * size, size);
+        } else {
+            memcpy(items + o++ * size, tmp + i++ * size, size);
+        }
+    }
+    memcpy(items + o * size, tmp + i * size, (half - i) * size);
+}
+
+// stable sort, best first
+void rank_sort(void *items, size_t n, size_t size, rank_before_fn before) {
+    if (n < 2) return;
+    if (n <= RANK_INSERTION) {
+        insertion_sort(items, n, size, before);
+        return;
+    }
+    char *tmp = gmdh_alloc((n / 2 + 1) * size);
+    merge_sort(items, tmp, n, size, before);
+    gmdh_free(tmp);
+}
+
+// partial selection (nth_element): afterwards items[k] is the item a full
+// sort would put there, nothing before it ranks after it and nothing
+// after it ranks before it. quickselect on a median of three; a range
+// that keeps partitioning badly is sorted instead
+void rank_select(void *items, size_t n, size_t size, size_t k, rank_before_fn before) {
+    char *base = items;
+    size_t lo = 0, hi = n;
+    int depth = 0;
+    for (size_t m = n; m > 1; m >>= 1) {
+        depth += 2;
+    }
+
+    while (k >= lo && k < hi && hi - lo > RANK_INSERTION) {
+        if (depth-- == 0) {
+            rank_sort(base + lo * size, hi - lo, size, before);
+            return;
+        }
+        // median of first, middle and last to the end as the pivot
+        size_t mid = lo + (hi - lo) / 2, last = hi - 1;
+        char *a = base + lo * size, *b = base + mid * size, *c = base + last * size;
+        if (before(b, a)) swap_items(a, b, size);
+        if (before(c, b)) {
+            swap_items(b, c, size);
+            if (before(b, a)) swap_items(a, b, size);
+        }
+        swap_items(b, c, size);
+        char *pivot = c;
+
+        size_t store = lo;
+        for (size_t i = lo; i < last; i++) {
+            if (before(base + i * size, pivot)) {
+                if (i != store) swap_items(base + i * size, base + store * size, size);
+                store++;
+            }
+        }
+        swap_items(base + store * size, pivot, size);
+
+        if (k == store) return;
+        if (k < store) {
+            hi = store;
+        } else {
+            lo = store + 1;
+        }
+    }
+    if (k >= lo && k < hi) insertion_sort(base + lo * size, hi - lo, size, before);
+}
+
+// move the best k items to the front in order; the rest follow in no
+// particular order. O(n + k log k). returns the number placed, min(k, n)
+size_t rank_top(void *items, size_t n, size_t size, size_t k, rank_before_fn before) {
+    if (k >= n) {
+        rank_sort(items, n, size, before);
+        return n;
+    }
+    if (k == 0) return 0;
+    rank_select(items, n, size, k - 1, before);
+    rank_sort(items, k, size, before);
+    return k;
+}
+
+// bounded heap of the best items seen, the worst of them at the root so a
+// better one replaces it in O(log n). restore the heap after item i was
+// appended or got worse ...
+void rank_heap_sift_up(void *heap, size_t i, size_t size, rank_before_fn before) {
+    char *h = heap;
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!before(h + parent * size, h + i * size)) break;
+        swap_items(h + parent * size, h + i * size, size);
+        i = parent;
+    }
+}
+
+// ... or after the item at i got better
+void rank_heap_sift_down(void *heap, size_t n, size_t i, size_t size, rank_before_fn before) {
+    char *h = heap;
+    for (;;) {
+        size_t worst = i, l = 2 * i + 1, r = 2 * i + 2;
+        if (l < n && before(h + worst * size, h + l * size)) worst = l;
+        if (r < n && before(h + worst * size, h + r * size)) worst = r;
+        if (worst == i) break;
+        swap_items(h + i * size, h + worst * size, size);
+        i = worst;
+    }
+}
+
+// offer a copy of item to a heap of *n items, capacity at most. returns 1
+// if it was kept
+int rank_heap_offer(void *heap, size_t *n, size_t capacity, size_t size, const void *item,
+                    rank_before_fn before) {
+    char *h = heap;
+    if (*n < capacity) {
+        memcpy(h + *n * size, item, size);
+        rank_heap_sift_up(heap, (*n)++, size, before);
+        return 1;
+    }
+    if (capacity == 0 || !before(item, h)) return 0;
+    memcpy(h, item, size);
+    rank_heap_sift_down(heap, *n, 0, size, before);
+    return 1;
+}
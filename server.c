@@ -0,0 +1,531 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "gmdh.h"
+
+// prediction server: one event loop thread answers every connection, so a
+// request never waits on a lock or a thread handoff. frames that arrive
+// together are coalesced: all rows for the same model in one epoll round
+// go through the model's plan as a single column batch. a watcher thread
+// reloads model files that change and publishes them with an atomic
+// pointer swap; the old model is freed once the loop has finished the
+// round that might still be reading it
+
+// epoll_wait timeout. the loop ticks at least this often, which bounds
+// how long a retired model and a stop request wait
+#define SERVE_TICK_MS 20
+
+// how often the watcher looks at the model files
+#define SERVE_WATCH_NS 100000000L
+
+#define SERVE_MAX_EVENTS 64
+#define SERVE_READ_BYTES 65536
+
+// what a model file looked like when it was last loaded
+typedef struct {
+    int64_t ino;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    int64_t size;
+} file_stamp_t;
+
+typedef struct {
+    char *path;
+    gmdh_model_t *model;        // read and swapped with __atomic builtins
+    file_stamp_t stamp;
+} model_slot_t;
+
+typedef struct {
+    int fd;
+    int eof;                    // the peer will send nothing more
+    int dead;                   // close after this round
+    char *in;                   // bytes received, frames up to in_parsed handled
+    size_t in_len;
+    size_t in_cap;
+    size_t in_parsed;
+    char *out;                  // responses not yet sent, from out_pos
+    size_t out_len;
+    size_t out_cap;
+    size_t out_pos;
+    int want_write;
+} connection_t;
+
+// a predict frame waiting for its batch. values and results are offsets,
+// since the connection buffers may move while the round is parsed
+typedef struct {
+    connection_t *conn;
+    const gmdh_model_t *model;
+    size_t in_off;
+    size_t out_off;
+    int n_rows;
+    int done;                   // rows already evaluated
+} pending_t;
+
+// rows of one pending frame inside the current batch
+typedef struct {
+    pending_t *p;
+    int first;                  // frame row of the chunk's first row
+    int at;                     // batch row it landed in
+    int n;
+} chunk_t;
+
+struct gmdh_server {
+    char *socket_path;
+    int listen_fd;
+    int epoll_fd;
+    model_slot_t *models;
+    int n_models;
+    int running;                // __atomic
+    int loop_done;              // __atomic, set once serve_run's loop has exited
+    uint64_t epoch;             // __atomic, bumped after every loop round
+    pthread_t watcher;
+
+    pending_t *pending;
+    chunk_t *chunks;            // as many as pending
+    int n_pending;
+    size_t pending_cap;
+
+    // batch workspace, grown to the largest model seen
+    double *cols;               // n_inputs columns of MODEL_BATCH_ROWS
+    double *scratch;
+    double *result;
+    const double **slots;
+    size_t cols_cap;
+    size_t scratch_cap;
+    size_t slots_cap;
+};
+
+static int stamp_model(const char *path, file_stamp_t *stamp) {
+    struct stat st;
+    if (stat(path, &st) != 0) return 0;
+    stamp->ino = st.st_ino;
+    stamp->mtime_sec = st.st_mtim.tv_sec;
+    stamp->mtime_nsec = st.st_mtim.tv_nsec;
+    stamp->size = st.st_size;
+    return 1;
+}
+
+static void* grow(void *p, size_t *cap, size_t need, size_t elem) {
+    if (need <= *cap) return p;
+    size_t cap2 = *cap ? *cap : 64;
+    while (cap2 < need) {
+        cap2 *= 2;
+    }
+    *cap = cap2;
+    return realloc(p, cap2 * elem);
+}
+
+static void sleep_ns(long ns) {
+    struct timespec ts = {ns / 1000000000L, ns % 1000000000L};
+    nanosleep(&ts, NULL);
+}
+
+// reload model files whose stamp changed. a file that fails to load keeps
+// the model already serving
+static void* watch_models(void *arg) {
+    gmdh_server_t *sv = arg;
+    while (__atomic_load_n(&sv->running, __ATOMIC_ACQUIRE)) {
+        sleep_ns(SERVE_WATCH_NS);
+        for (int m = 0; m < sv->n_models; m++) {
+            model_slot_t *slot = &sv->models[m];
+            file_stamp_t stamp;
+            if (!stamp_model(slot->path, &stamp) ||
+                memcmp(&stamp, &slot->stamp, sizeof(stamp)) == 0) {
+                continue;
+            }
+            slot->stamp = stamp;
+            gmdh_model_t *model = load_model(slot->path);
+            if (!model) continue;
+
+            gmdh_model_t *old = __atomic_exchange_n(&slot->model, model, __ATOMIC_ACQ_REL);
+            // a round that saw the old pointer started before the swap and
+            // bumps the epoch when it ends; later rounds see the new one
+            uint64_t epoch = __atomic_load_n(&sv->epoch, __ATOMIC_ACQUIRE);
+            while (__atomic_load_n(&sv->epoch, __ATOMIC_ACQUIRE) == epoch &&
+                   !__atomic_load_n(&sv->loop_done, __ATOMIC_ACQUIRE)) {
+                sleep_ns(1000000L);
+            }
+            free_model(old);
+            gmdh_log("reloaded model %d from %s (%d neurons)\n", m, slot->path, model->n_nodes);
+        }
+    }
+    return NULL;
+}
+
+// load every model and listen on socket_path, replacing a stale socket
+// file. returns NULL if a model fails to load or the socket cannot be bound
+gmdh_server_t* serve_create(const char *socket_path, char **model_paths, int n_models) {
+    struct sockaddr_un addr;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "socket path too long: %s\n", socket_path);
+        return NULL;
+    }
+
+    gmdh_server_t *sv = calloc(1, sizeof(gmdh_server_t));
+    sv->listen_fd = -1;
+    sv->epoll_fd = -1;
+    sv->models = calloc(n_models + 1, sizeof(model_slot_t));
+    sv->n_models = n_models;
+    for (int m = 0; m < n_models; m++) {
+        model_slot_t *slot = &sv->models[m];
+        slot->path = strcpy(malloc(strlen(model_paths[m]) + 1), model_paths[m]);
+        stamp_model(slot->path, &slot->stamp);
+        slot->model = load_model(slot->path);
+        if (!slot->model) {
+            serve_free(sv);
+            return NULL;
+        }
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+    unlink(socket_path);
+    sv->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sv->listen_fd < 0 || bind(sv->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+        listen(sv->listen_fd, 128) != 0) {
+        fprintf(stderr, "failed to listen on %s: %s\n", socket_path, strerror(errno));
+        serve_free(sv);
+        return NULL;
+    }
+    sv->socket_path = strcpy(malloc(strlen(socket_path) + 1), socket_path);
+    fcntl(sv->listen_fd, F_SETFL, fcntl(sv->listen_fd, F_GETFL) | O_NONBLOCK);
+
+    sv->epoll_fd = epoll_create1(0);
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    epoll_ctl(sv->epoll_fd, EPOLL_CTL_ADD, sv->listen_fd, &ev);
+    sv->running = 1;
+    return sv;
+}
+
+static void accept_connections(gmdh_server_t *sv) {
+    for (;;) {
+        int fd = accept(sv->listen_fd, NULL, NULL);
+        if (fd < 0) return;
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+        connection_t *c = calloc(1, sizeof(connection_t));
+        c->fd = fd;
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = c;
+        epoll_ctl(sv->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+    }
+}
+
+static void close_connection(gmdh_server_t *sv, connection_t *c) {
+    epoll_ctl(sv->epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    free(c->in);
+    free(c->out);
+    free(c);
+}
+
+// everything the socket has for us
+static void read_available(connection_t *c) {
+    for (;;) {
+        c->in = grow(c->in, &c->in_cap, c->in_len + SERVE_READ_BYTES, 1);
+        ssize_t got = read(c->fd, c->in + c->in_len, c->in_cap - c->in_len);
+        if (got > 0) {
+            c->in_len += got;
+            continue;
+        }
+        if (got < 0 && errno == EINTR) continue;
+        if (got == 0) {
+            c->eof = 1;
+        } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            c->dead = 1;
+        }
+        return;
+    }
+}
+
+// append a response header and room for n_values doubles; returns the
+// offset of the values
+static size_t add_response(connection_t *c, uint32_t id, int status, uint32_t n_values) {
+    serve_response_t resp;
+    resp.id = id;
+    resp.status = status;
+    resp.n_values = n_values;
+    resp.reserved = 0;
+    size_t need = c->out_len + sizeof(resp) + (size_t)n_values * sizeof(double);
+    c->out = grow(c->out, &c->out_cap, need, 1);
+    memcpy(c->out + c->out_len, &resp, sizeof(resp));
+    size_t at = c->out_len + sizeof(resp);
+    c->out_len = need;
+    return at;
+}
+
+// answer the complete frames received so far. info and error replies are
+// written at once; predictions get their place in the output reserved, in
+// request order, and are queued for the round's batches
+static void parse_frames(gmdh_server_t *sv, connection_t *c) {
+    size_t pos = c->in_parsed;
+    while (c->in_len - pos >= sizeof(serve_request_t)) {
+        serve_request_t req;
+        memcpy(&req, c->in + pos, sizeof(req));
+        if (req.n_values > SERVE_MAX_VALUES || req.n_rows > SERVE_MAX_ROWS) {
+            c->dead = 1;
+            return;
+        }
+        size_t frame = sizeof(req) + (size_t)req.n_values * sizeof(double);
+        if (c->in_len - pos < frame) break;
+
+        const gmdh_model_t *model = req.model < sv->n_models
+            ? __atomic_load_n(&sv->models[req.model].model, __ATOMIC_ACQUIRE) : NULL;
+        if (!model) {
+            add_response(c, req.id, SERVE_NO_MODEL, 0);
+        } else if (req.op == SERVE_OP_INFO) {
+            double info[2] = {model->n_inputs, model->n_nodes};
+            size_t at = add_response(c, req.id, SERVE_OK, 2);
+            memcpy(c->out + at, info, sizeof(info));
+        } else if (req.op != SERVE_OP_PREDICT) {
+            add_response(c, req.id, SERVE_BAD_OP, 0);
+        } else if ((uint64_t)req.n_rows * model->n_inputs != req.n_values) {
+            add_response(c, req.id, SERVE_BAD_SHAPE, 0);
+        } else if (req.n_rows > 0) {
+            if ((size_t)sv->n_pending == sv->pending_cap) {
+                size_t cap = sv->pending_cap;
+                sv->pending = grow(sv->pending, &sv->pending_cap, cap + 1, sizeof(pending_t));
+                sv->chunks = grow(sv->chunks, &cap, cap + 1, sizeof(chunk_t));
+            }
+            pending_t *p = &sv->pending[sv->n_pending++];
+            p->conn = c;
+            p->model = model;
+            p->in_off = pos + sizeof(req);
+            p->out_off = add_response(c, req.id, SERVE_OK, req.n_rows);
+            p->n_rows = req.n_rows;
+            p->done = 0;
+        } else {
+            add_response(c, req.id, SERVE_OK, 0);
+        }
+        pos += frame;
+    }
+    c->in_parsed = pos;
+}
+
+static void ensure_workspace(gmdh_server_t *sv, const gmdh_model_t *model) {
+    sv->cols = grow(sv->cols, &sv->cols_cap,
+                    (size_t)(model->n_inputs + 1) * MODEL_BATCH_ROWS, sizeof(double));
+    sv->scratch = grow(sv->scratch, &sv->scratch_cap,
+                       (size_t)model->n_nodes * MODEL_BATCH_ROWS, sizeof(double));
+    sv->slots = grow(sv->slots, &sv->slots_cap, model->n_inputs + model->n_nodes,
+                     sizeof(double*));
+    if (!sv->result) sv->result = malloc(MODEL_BATCH_ROWS * sizeof(double));
+}
+
+// evaluate the round's predictions. rows of every frame for the same model
+// are transposed into one column batch of up to MODEL_BATCH_ROWS rows,
+// run through the plan once, and scattered back into the responses
+static void run_batches(gmdh_server_t *sv) {
+    for (int i = 0; i < sv->n_pending; i++) {
+        const gmdh_model_t *model = sv->pending[i].model;
+        int k = model->n_inputs;
+        ensure_workspace(sv, model);
+
+        while (sv->pending[i].done < sv->pending[i].n_rows) {
+            int n = 0, n_chunks = 0;
+            for (int j = i; j < sv->n_pending && n < MODEL_BATCH_ROWS; j++) {
+                pending_t *p = &sv->pending[j];
+                if (p->model != model || p->done == p->n_rows) continue;
+                int take = p->n_rows - p->done;
+                if (take > MODEL_BATCH_ROWS - n) take = MODEL_BATCH_ROWS - n;
+
+                const char *rows = p->conn->in + p->in_off;
+                for (int r = 0; r < take; r++) {
+                    double v[k + 1];
+                    memcpy(v, rows + (size_t)(p->done + r) * k * sizeof(double),
+                           k * sizeof(double));
+                    for (int s = 0; s < k; s++) {
+                        sv->cols[(size_t)s * MODEL_BATCH_ROWS + n + r] = v[s];
+                    }
+                }
+                chunk_t *ch = &sv->chunks[n_chunks++];
+                ch->p = p;
+                ch->first = p->done;
+                ch->at = n;
+                ch->n = take;
+                p->done += take;
+                n += take;
+            }
+
+            for (int s = 0; s < k; s++) {
+                sv->slots[s] = sv->cols + (size_t)s * MODEL_BATCH_ROWS;
+            }
+            model_eval_batch(model, sv->slots, sv->scratch, sv->result, n);
+
+            for (int c = 0; c < n_chunks; c++) {
+                chunk_t *ch = &sv->chunks[c];
+                memcpy(ch->p->conn->out + ch->p->out_off + (size_t)ch->first * sizeof(double),
+                       sv->result + ch->at, ch->n * sizeof(double));
+            }
+        }
+    }
+    sv->n_pending = 0;
+}
+
+// send what the socket takes now; the rest waits for EPOLLOUT
+static void flush_output(gmdh_server_t *sv, connection_t *c) {
+    while (c->out_pos < c->out_len) {
+        ssize_t sent = send(c->fd, c->out + c->out_pos, c->out_len - c->out_pos, MSG_NOSIGNAL);
+        if (sent > 0) {
+            c->out_pos += sent;
+            continue;
+        }
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        c->dead = 1;
+        return;
+    }
+    if (c->out_pos == c->out_len) c->out_pos = c->out_len = 0;
+
+    int want = c->out_len > 0;
+    if (want != c->want_write) {
+        struct epoll_event ev;
+        ev.events = EPOLLIN | (want ? EPOLLOUT : 0);
+        ev.data.ptr = c;
+        epoll_ctl(sv->epoll_fd, EPOLL_CTL_MOD, c->fd, &ev);
+        c->want_write = want;
+    }
+}
+
+// drop the input frames already answered
+static void compact_input(connection_t *c) {
+    if (c->in_parsed == 0) return;
+    memmove(c->in, c->in + c->in_parsed, c->in_len - c->in_parsed);
+    c->in_len -= c->in_parsed;
+    c->in_parsed = 0;
+}
+
+// serve until serve_stop. the model watcher runs alongside. returns 1
+int serve_run(gmdh_server_t *sv) {
+    struct epoll_event events[SERVE_MAX_EVENTS];
+    pthread_create(&sv->watcher, NULL, watch_models, sv);
+
+    while (__atomic_load_n(&sv->running, __ATOMIC_ACQUIRE)) {
+        int n = epoll_wait(sv->epoll_fd, events, SERVE_MAX_EVENTS, SERVE_TICK_MS);
+        for (int e = 0; e < n; e++) {
+            connection_t *c = events[e].data.ptr;
+            if (!c) {
+                accept_connections(sv);
+                continue;
+            }
+            if (events[e].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                read_available(c);
+                if (!c->dead) parse_frames(sv, c);
+            }
+        }
+
+        run_batches(sv);
+
+        for (int e = 0; e < n; e++) {
+            connection_t *c = events[e].data.ptr;
+            if (!c) continue;
+            if (!c->dead) flush_output(sv, c);
+            // a peer that has hung up still gets the answers it asked for
+            if (c->dead || (c->eof && c->out_len == 0)) {
+                close_connection(sv, c);
+            } else {
+                compact_input(c);
+            }
+        }
+        __atomic_add_fetch(&sv->epoch, 1, __ATOMIC_RELEASE);
+    }
+
+    __atomic_store_n(&sv->loop_done, 1, __ATOMIC_RELEASE);
+    pthread_join(sv->watcher, NULL);
+    return 1;
+}
+
+// ask serve_run to return. safe from a signal handler
+void serve_stop(gmdh_server_t *sv) {
+    __atomic_store_n(&sv->running, 0, __ATOMIC_RELEASE);
+}
+
+// close the socket and free the models. connections still open at this
+// point are closed by the process exiting
+void serve_free(gmdh_server_t *sv) {
+    if (!sv) return;
+    if (sv->epoll_fd >= 0) close(sv->epoll_fd);
+    if (sv->listen_fd >= 0) close(sv->listen_fd);
+    if (sv->socket_path) unlink(sv->socket_path);
+    for (int m = 0; m < sv->n_models; m++) {
+        free(sv->models[m].path);
+        free_model(sv->models[m].model);
+    }
+    free(sv->models);
+    free(sv->socket_path);
+    free(sv->pending);
+    free(sv->chunks);
+    free(sv->cols);
+    free(sv->scratch);
+    free(sv->result);
+    free(sv->slots);
+    free(sv);
+}
+
+// client side: a blocking connection to a gmdh-serve socket, -1 on failure
+int serve_connect(const char *socket_path) {
+    struct sockaddr_un addr;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int send_all(int fd, const void *p, size_t n) {
+    const char *b = p;
+    while (n > 0) {
+        ssize_t sent = send(fd, b, n, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return 0;
+        b += sent;
+        n -= sent;
+    }
+    return 1;
+}
+
+static int recv_all(int fd, void *p, size_t n) {
+    char *b = p;
+    while (n > 0) {
+        ssize_t got = recv(fd, b, n, 0);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return 0;
+        b += got;
+        n -= got;
+    }
+    return 1;
+}
+
+// one request and its response. up to max_out response values land in
+// out, the rest are discarded. returns 0 if the connection failed
+int serve_call(int fd, const serve_request_t *req, const double *values,
+               serve_response_t *resp, double *out, uint32_t max_out) {
+    if (!send_all(fd, req, sizeof(*req)) ||
+        !send_all(fd, values, (size_t)req->n_values * sizeof(double)) ||
+        !recv_all(fd, resp, sizeof(*resp))) {
+        return 0;
+    }
+    uint32_t keep = resp->n_values < max_out ? resp->n_values : max_out;
+    if (!recv_all(fd, out, (size_t)keep * sizeof(double))) return 0;
+    for (uint32_t v = keep; v < resp->n_values; v++) {
+        double x;
+        if (!recv_all(fd, &x, sizeof(x))) return 0;
+    }
+    return 1;
+}
@@ -0,0 +1,467 @@
+#include "gmdh.h"
+
+// vector versions of the per-sample prediction and error loops. every
+// kernel has a portable scalar path; the avx2 and avx-512 ones are built
+// with per-function target attributes and picked at run time from cpuid,
+// so the binary still runs on cpus without them
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GMDH_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+// float32 kernels sum this many rows in float before adding the block's
+// sums to double totals, so float rounding grows with the block and not
+// with the number of rows. a multiple of every vector width
+#define F32_BLOCK_ROWS 256
+
+// the seven cross sums of a quadratic pair: ab, a²b, ab², a³b, ab³, a²b²,
+// aby, added to sums[0..7)
+static void cross_f32_scalar(const float *a, const float *b, const float *y, int begin, int n,
+                             double *sums) {
+    for (int r0 = begin; r0 < n; r0 += F32_BLOCK_ROWS) {
+        int end = n - r0 < F32_BLOCK_ROWS ? n : r0 + F32_BLOCK_ROWS;
+        float s[7] = {0, 0, 0, 0, 0, 0, 0};
+        for (int k = r0; k < end; k++) {
+            float x1 = a[k], x2 = b[k], p = x1 * x2;
+            s[0] += p;
+            s[1] += p * x1;
+            s[2] += p * x2;
+            s[3] += p * x1 * x1;
+            s[4] += p * x2 * x2;
+            s[5] += p * p;
+            s[6] += p * y[k];
+        }
+        for (int c = 0; c < 7; c++) {
+            sums[c] += s[c];
+        }
+    }
+}
+
+// squared residuals of neuron c over rows where the target and the
+// prediction are present; *n_used gets the number of those rows
+static double sse_f32_scalar(const float *x1, const float *x2, const float *c, const float *y,
+                             int begin, int n, double *n_used) {
+    double total = 0;
+    for (int r0 = begin; r0 < n; r0 += F32_BLOCK_ROWS) {
+        int end = n - r0 < F32_BLOCK_ROWS ? n : r0 + F32_BLOCK_ROWS;
+        float res = 0;
+        int used = 0;
+        for (int k = r0; k < end; k++) {
+            float a = x1[k], b = x2[k];
+            float e = y[k] - (c[0] + a * (c[1] + c[3] * a + c[5] * b) + b * (c[2] + c[4] * b));
+            if (e == e) {
+                res += e * e;
+                used++;
+            }
+        }
+        total += res;
+        *n_used += used;
+    }
+    return total;
+}
+
+static void score_scalar_range(const double *pred, const double *actual, int begin, int n,
+                               double shift, score_sums_t *acc) {
+    for (int i = begin; i < n; i++) {
+        if (isnan(actual[i])) continue;
+        double d = actual[i] - shift;
+        acc->n_actual += 1;
+        acc->s_actual += d;
+        if (isnan(pred[i])) continue;
+        double e = actual[i] - pred[i];
+        acc->n += 1;
+        acc->s += d;
+        acc->ss += d * d;
+        acc->res += e * e;
+    }
+}
+
+#ifdef GMDH_X86_KERNELS
+
+__attribute__((target("avx2,fma")))
+static void predict_avx2(const double *x1, const double *x2, const double *coeffs,
+                         double *out, int n) {
+    __m256d c0 = _mm256_set1_pd(coeffs[0]), c1 = _mm256_set1_pd(coeffs[1]);
+    __m256d c2 = _mm256_set1_pd(coeffs[2]), c3 = _mm256_set1_pd(coeffs[3]);
+    __m256d c4 = _mm256_set1_pd(coeffs[4]), c5 = _mm256_set1_pd(coeffs[5]);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d a = _mm256_loadu_pd(x1 + i);
+        __m256d b = _mm256_loadu_pd(x2 + i);
+        // c0 + a*(c1 + c3*a + c5*b) + b*(c2 + c4*b)
+        __m256d ta = _mm256_fmadd_pd(c5, b, _mm256_fmadd_pd(c3, a, c1));
+        __m256d tb = _mm256_fmadd_pd(c4, b, c2);
+        __m256d r = _mm256_fmadd_pd(b, tb, _mm256_fmadd_pd(a, ta, c0));
+        _mm256_storeu_pd(out + i, r);
+    }
+    for (; i < n; i++) {
+        out[i] = predict_polynomial(x1[i], x2[i], (double*)coeffs);
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static double hsum_avx2(__m256d v) {
+    __m128d lo = _mm256_castpd256_pd128(v);
+    __m128d hi = _mm256_extractf128_pd(v, 1);
+    lo = _mm_add_pd(lo, hi);
+    return _mm_cvtsd_f64(_mm_add_sd(lo, _mm_unpackhi_pd(lo, lo)));
+}
+
+// nan lanes are dropped with compare masks: and-ing a lane with a zero
+// mask clears it, so no element takes a branch
+__attribute__((target("avx2,fma")))
+static void score_avx2(const double *pred, const double *actual, int n, double shift,
+                       score_sums_t *acc) {
+    __m256d one = _mm256_set1_pd(1.0), sh = _mm256_set1_pd(shift);
+    __m256d n_actual = _mm256_setzero_pd(), s_actual = _mm256_setzero_pd();
+    __m256d cnt = _mm256_setzero_pd(), s = _mm256_setzero_pd();
+    __m256d ss = _mm256_setzero_pd(), res = _mm256_setzero_pd();
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d y = _mm256_loadu_pd(actual + i);
+        __m256d p = _mm256_loadu_pd(pred + i);
+        __m256d my = _mm256_cmp_pd(y, y, _CMP_ORD_Q);
+        __m256d mb = _mm256_and_pd(my, _mm256_cmp_pd(p, p, _CMP_ORD_Q));
+        __m256d d = _mm256_sub_pd(y, sh);
+        __m256d db = _mm256_and_pd(d, mb);
+        __m256d e = _mm256_and_pd(_mm256_sub_pd(y, p), mb);
+        n_actual = _mm256_add_pd(n_actual, _mm256_and_pd(one, my));
+        s_actual = _mm256_add_pd(s_actual, _mm256_and_pd(d, my));
+        cnt = _mm256_add_pd(cnt, _mm256_and_pd(one, mb));
+        s = _mm256_add_pd(s, db);
+        ss = _mm256_fmadd_pd(db, db, ss);
+        res = _mm256_fmadd_pd(e, e, res);
+    }
+    acc->n_actual += hsum_avx2(n_actual);
+    acc->s_actual += hsum_avx2(s_actual);
+    acc->n += hsum_avx2(cnt);
+    acc->s += hsum_avx2(s);
+    acc->ss += hsum_avx2(ss);
+    acc->res += hsum_avx2(res);
+    score_scalar_range(pred, actual, i, n, shift, acc);
+}
+
+// a float vector's lanes added to a double vector
+__attribute__((target("avx2,fma")))
+static __m256d widen_add_avx2(__m256d total, __m256 v) {
+    total = _mm256_add_pd(total, _mm256_cvtps_pd(_mm256_castps256_ps128(v)));
+    return _mm256_add_pd(total, _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)));
+}
+
+__attribute__((target("avx2,fma")))
+static void cross_f32_avx2(const float *a, const float *b, const float *y, int n,
+                           double *sums) {
+    __m256d t0 = _mm256_setzero_pd(), t1 = t0, t2 = t0, t3 = t0, t4 = t0, t5 = t0, t6 = t0;
+    int i = 0;
+    while (i + 8 <= n) {
+        int stop = n - i < F32_BLOCK_ROWS ? n : i + F32_BLOCK_ROWS;
+        __m256 s0 = _mm256_setzero_ps(), s1 = s0, s2 = s0, s3 = s0, s4 = s0, s5 = s0, s6 = s0;
+        for (; i + 8 <= stop; i += 8) {
+            __m256 x1 = _mm256_loadu_ps(a + i);
+            __m256 x2 = _mm256_loadu_ps(b + i);
+            __m256 p = _mm256_mul_ps(x1, x2);
+            __m256 p1 = _mm256_mul_ps(p, x1);
+            __m256 p2 = _mm256_mul_ps(p, x2);
+            s0 = _mm256_add_ps(s0, p);
+            s1 = _mm256_add_ps(s1, p1);
+            s2 = _mm256_add_ps(s2, p2);
+            s3 = _mm256_fmadd_ps(p1, x1, s3);
+            s4 = _mm256_fmadd_ps(p2, x2, s4);
+            s5 = _mm256_fmadd_ps(p, p, s5);
+            s6 = _mm256_fmadd_ps(p, _mm256_loadu_ps(y + i), s6);
+        }
+        t0 = widen_add_avx2(t0, s0);
+        t1 = widen_add_avx2(t1, s1);
+        t2 = widen_add_avx2(t2, s2);
+        t3 = widen_add_avx2(t3, s3);
+        t4 = widen_add_avx2(t4, s4);
+        t5 = widen_add_avx2(t5, s5);
+        t6 = widen_add_avx2(t6, s6);
+    }
+    sums[0] += hsum_avx2(t0);
+    sums[1] += hsum_avx2(t1);
+    sums[2] += hsum_avx2(t2);
+    sums[3] += hsum_avx2(t3);
+    sums[4] += hsum_avx2(t4);
+    sums[5] += hsum_avx2(t5);
+    sums[6] += hsum_avx2(t6);
+    cross_f32_scalar(a, b, y, i, n, sums);
+}
+
+// nan residuals (a missing input or target) fail the ordered compare and
+// are masked out
+__attribute__((target("avx2,fma")))
+static double sse_f32_avx2(const float *x1, const float *x2, const float *c, const float *y,
+                           int n, double *n_used) {
+    __m256 c0 = _mm256_set1_ps(c[0]), c1 = _mm256_set1_ps(c[1]), c2 = _mm256_set1_ps(c[2]);
+    __m256 c3 = _mm256_set1_ps(c[3]), c4 = _mm256_set1_ps(c[4]), c5 = _mm256_set1_ps(c[5]);
+    __m256d total = _mm256_setzero_pd();
+    long used = 0;
+    int i = 0;
+    while (i + 8 <= n) {
+        int stop = n - i < F32_BLOCK_ROWS ? n : i + F32_BLOCK_ROWS;
+        __m256 res = _mm256_setzero_ps();
+        for (; i + 8 <= stop; i += 8) {
+            __m256 a = _mm256_loadu_ps(x1 + i);
+            __m256 b = _mm256_loadu_ps(x2 + i);
+            __m256 ta = _mm256_fmadd_ps(c5, b, _mm256_fmadd_ps(c3, a, c1));
+            __m256 tb = _mm256_fmadd_ps(c4, b, c2);
+            __m256 p = _mm256_fmadd_ps(b, tb, _mm256_fmadd_ps(a, ta, c0));
+            __m256 e = _mm256_sub_ps(_mm256_loadu_ps(y + i), p);
+            __m256 live = _mm256_cmp_ps(e, e, _CMP_ORD_Q);
+            e = _mm256_and_ps(e, live);
+            res = _mm256_fmadd_ps(e, e, res);
+            used += __builtin_popcount(_mm256_movemask_ps(live));
+        }
+        total = widen_add_avx2(total, res);
+    }
+    *n_used += used;
+    return hsum_avx2(total) + sse_f32_scalar(x1, x2, c, y, i, n, n_used);
+}
+
+// avx-512 handles the tail with masked loads instead of a scalar loop
+__attribute__((target("avx512f")))
+static void predict_avx512(const double *x1, const double *x2, const double *coeffs,
+                           double *out, int n) {
+    __m512d c0 = _mm512_set1_pd(coeffs[0]), c1 = _mm512_set1_pd(coeffs[1]);
+    __m512d c2 = _mm512_set1_pd(coeffs[2]), c3 = _mm512_set1_pd(coeffs[3]);
+    __m512d c4 = _mm512_set1_pd(coeffs[4]), c5 = _mm512_set1_pd(coeffs[5]);
+    for (int i = 0; i < n; i += 8) {
+        __mmask8 live = n - i >= 8 ? 0xff : (__mmask8)((1u << (n - i)) - 1);
+        __m512d a = _mm512_maskz_loadu_pd(live, x1 + i);
+        __m512d b = _mm512_maskz_loadu_pd(live, x2 + i);
+        __m512d ta = _mm512_fmadd_pd(c5, b, _mm512_fmadd_pd(c3, a, c1));
+        __m512d tb = _mm512_fmadd_pd(c4, b, c2);
+        __m512d r = _mm512_fmadd_pd(b, tb, _mm512_fmadd_pd(a, ta, c0));
+        _mm512_mask_storeu_pd(out + i, live, r);
+    }
+}
+
+__attribute__((target("avx512f")))
+static void score_avx512(const double *pred, const double *actual, int n, double shift,
+                         score_sums_t *acc) {
+    __m512d sh = _mm512_set1_pd(shift);
+    __m512d s_actual = _mm512_setzero_pd(), s = _mm512_setzero_pd();
+    __m512d ss = _mm512_setzero_pd(), res = _mm512_setzero_pd();
+    long n_actual = 0, cnt = 0;
+    for (int i = 0; i < n; i += 8) {
+        __mmask8 live = n - i >= 8 ? 0xff : (__mmask8)((1u << (n - i)) - 1);
+        __m512d y = _mm512_maskz_loadu_pd(live, actual + i);
+        __m512d p = _mm512_maskz_loadu_pd(live, pred + i);
+        __mmask8 my = _mm512_mask_cmp_pd_mask(live, y, y, _CMP_ORD_Q);
+        __mmask8 mb = _mm512_mask_cmp_pd_mask(my, p, p, _CMP_ORD_Q);
+        __m512d d = _mm512_sub_pd(y, sh);
+        __m512d db = _mm512_maskz_mov_pd(mb, d);
+        __m512d e = _mm512_maskz_sub_pd(mb, y, p);
+        n_actual += __builtin_popcount(my);
+        cnt += __builtin_popcount(mb);
+        s_actual = _mm512_mask_add_pd(s_actual, my, s_actual, d);
+        s = _mm512_add_pd(s, db);
+        ss = _mm512_fmadd_pd(db, db, ss);
+        res = _mm512_fmadd_pd(e, e, res);
+    }
+    acc->n_actual += n_actual;
+    acc->s_actual += _mm512_reduce_add_pd(s_actual);
+    acc->n += cnt;
+    acc->s += _mm512_reduce_add_pd(s);
+    acc->ss += _mm512_reduce_add_pd(ss);
+    acc->res += _mm512_reduce_add_pd(res);
+}
+
+__attribute__((target("avx512f")))
+static __m512d widen_add_avx512(__m512d total, __m512 v) {
+    __m256 hi = _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(v), 1));
+    total = _mm512_add_pd(total, _mm512_cvtps_pd(_mm512_castps512_ps256(v)));
+    return _mm512_add_pd(total, _mm512_cvtps_pd(hi));
+}
+
+// masked-off tail lanes load as 0 and add nothing to any sum
+__attribute__((target("avx512f")))
+static void cross_f32_avx512(const float *a, const float *b, const float *y, int n,
+                             double *sums) {
+    __m512d t0 = _mm512_setzero_pd(), t1 = t0, t2 = t0, t3 = t0, t4 = t0, t5 = t0, t6 = t0;
+    for (int r0 = 0; r0 < n; r0 += F32_BLOCK_ROWS) {
+        int stop = n - r0 < F32_BLOCK_ROWS ? n : r0 + F32_BLOCK_ROWS;
+        __m512 s0 = _mm512_setzero_ps(), s1 = s0, s2 = s0, s3 = s0, s4 = s0, s5 = s0, s6 = s0;
+        for (int i = r0; i < stop; i += 16) {
+            __mmask16 live = stop - i >= 16 ? 0xffff : (__mmask16)((1u << (stop - i)) - 1);
+            __m512 x1 = _mm512_maskz_loadu_ps(live, a + i);
+            __m512 x2 = _mm512_maskz_loadu_ps(live, b + i);
+            __m512 p = _mm512_mul_ps(x1, x2);
+            __m512 p1 = _mm512_mul_ps(p, x1);
+            __m512 p2 = _mm512_mul_ps(p, x2);
+            s0 = _mm512_add_ps(s0, p);
+            s1 = _mm512_add_ps(s1, p1);
+            s2 = _mm512_add_ps(s2, p2);
+            s3 = _mm512_fmadd_ps(p1, x1, s3);
+            s4 = _mm512_fmadd_ps(p2, x2, s4);
+            s5 = _mm512_fmadd_ps(p, p, s5);
+            s6 = _mm512_fmadd_ps(p, _mm512_maskz_loadu_ps(live, y + i), s6);
+        }
+        t0 = widen_add_avx512(t0, s0);
+        t1 = widen_add_avx512(t1, s1);
+        t2 = widen_add_avx512(t2, s2);
+        t3 = widen_add_avx512(t3, s3);
+        t4 = widen_add_avx512(t4, s4);
+        t5 = widen_add_avx512(t5, s5);
+        t6 = widen_add_avx512(t6, s6);
+    }
+    sums[0] += _mm512_reduce_add_pd(t0);
+    sums[1] += _mm512_reduce_add_pd(t1);
+    sums[2] += _mm512_reduce_add_pd(t2);
+    sums[3] += _mm512_reduce_add_pd(t3);
+    sums[4] += _mm512_reduce_add_pd(t4);
+    sums[5] += _mm512_reduce_add_pd(t5);
+    sums[6] += _mm512_reduce_add_pd(t6);
+}
+
+__attribute__((target("avx512f")))
+static double sse_f32_avx512(const float *x1, const float *x2, const float *c, const float *y,
+                             int n, double *n_used) {
+    __m512 c0 = _mm512_set1_ps(c[0]), c1 = _mm512_set1_ps(c[1]), c2 = _mm512_set1_ps(c[2]);
+    __m512 c3 = _mm512_set1_ps(c[3]), c4 = _mm512_set1_ps(c[4]), c5 = _mm512_set1_ps(c[5]);
+    __m512d total = _mm512_setzero_pd();
+    long used = 0;
+    for (int r0 = 0; r0 < n; r0 += F32_BLOCK_ROWS) {
+        int stop = n - r0 < F32_BLOCK_ROWS ? n : r0 + F32_BLOCK_ROWS;
+        __m512 res = _mm512_setzero_ps();
+        for (int i = r0; i < stop; i += 16) {
+            __mmask16 in = stop - i >= 16 ? 0xffff : (__mmask16)((1u << (stop - i)) - 1);
+            __m512 a = _mm512_maskz_loadu_ps(in, x1 + i);
+            __m512 b = _mm512_maskz_loadu_ps(in, x2 + i);
+            __m512 ta = _mm512_fmadd_ps(c5, b, _mm512_fmadd_ps(c3, a, c1));
+            __m512 tb = _mm512_fmadd_ps(c4, b, c2);
+            __m512 p = _mm512_fmadd_ps(b, tb, _mm512_fmadd_ps(a, ta, c0));
+            __m512 e = _mm512_sub_ps(_mm512_maskz_loadu_ps(in, y + i), p);
+            __mmask16 live = _mm512_mask_cmp_ps_mask(in, e, e, _CMP_ORD_Q);
+            res = _mm512_mask3_fmadd_ps(e, e, res, live);
+            used += __builtin_popcount(live);
+        }
+        total = widen_add_avx512(total, res);
+    }
+    *n_used += used;
+    return _mm512_reduce_add_pd(total);
+}
+
+#endif
+
+// the level the kernels run at: gmdh_options.simd, capped by the cpu
+gmdh_simd_t simd_level(void) {
+    gmdh_simd_t want = gmdh_current_options()->simd;
+    if (want == GMDH_SIMD_SCALAR) return GMDH_SIMD_SCALAR;
+#ifdef GMDH_X86_KERNELS
+    if (want != GMDH_SIMD_AVX2 && __builtin_cpu_supports("avx512f")) {
+        return GMDH_SIMD_AVX512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return GMDH_SIMD_AVX2;
+    }
+#endif
+    return GMDH_SIMD_SCALAR;
+}
+
+// predict_polynomial over whole columns: out[i] = f(x1[i], x2[i])
+void predict_polynomial_column(const double *x1, const double *x2, const double *coeffs,
+                               double *out, int n) {
+    switch (simd_level()) {
+#ifdef GMDH_X86_KERNELS
+    case GMDH_SIMD_AVX512:
+        predict_avx512(x1, x2, coeffs, out, n);
+        return;
+    case GMDH_SIMD_AVX2:
+        predict_avx2(x1, x2, coeffs, out, n);
+        return;
+#endif
+    default:
+        for (int i = 0; i < n; i++) {
+            out[i] = predict_polynomial(x1[i], x2[i], (double*)coeffs);
+        }
+    }
+}
+
+// add a block of predictions to the score sums, every target shifted by
+// `shift`
+void score_accumulate(const double *pred, const double *actual, int n, double shift,
+                      score_sums_t *acc) {
+    switch (simd_level()) {
+#ifdef GMDH_X86_KERNELS
+    case GMDH_SIMD_AVX512:
+        score_avx512(pred, actual, n, shift, acc);
+        break;
+    case GMDH_SIMD_AVX2:
+        score_avx2(pred, actual, n, shift, acc);
+        break;
+#endif
+    default:
+        score_scalar_range(pred, actual, 0, n, shift, acc);
+    }
+}
+
+// rmse and r² from the sums, with the nan rules of calculate_rmse and
+// calculate_r2: the mean runs over every row with a target, the sums of
+// squares over the rows that also have a prediction
+void score_finish(const score_sums_t *acc, double *rmse, double *r2) {
+    // sum (y - mean)² = ss - 2 m s + n m², with m the shifted mean
+    double m = acc->s_actual / acc->n_actual;
+    double ss_tot = acc->ss - 2 * m * acc->s + acc->n * m * m;
+    *rmse = acc->n > 0 ? sqrt(acc->res / acc->n) : INFINITY;
+    *r2 = 1.0 - acc->res / ss_tot;
+}
+
+// calculate_rmse and calculate_r2 fused into one pass
+void score_predictions(const double *pred, const double *actual, int n,
+                       double *rmse, double *r2) {
+    double shift = 0;
+    for (int i = 0; i < n; i++) {
+        if (!isnan(actual[i])) {
+            shift = actual[i];
+            break;
+        }
+    }
+
+    score_sums_t acc = {0, 0, 0, 0, 0, 0};
+    score_accumulate(pred, actual, n, shift, &acc);
+    score_finish(&acc, rmse, r2);
+}
+
+// the seven cross sums of a pair of float32 columns without missing
+// values (ab, a²b, ab², a³b, ab³, a²b², aby), added to sums[0..7). the
+// products run in float at twice the double lane count; each block's sums
+// are carried in double
+void cross_sums_f32(const float *a, const float *b, const float *y, int n, double *sums) {
+    switch (simd_level()) {
+#ifdef GMDH_X86_KERNELS
+    case GMDH_SIMD_AVX512:
+        cross_f32_avx512(a, b, y, n, sums);
+        break;
+    case GMDH_SIMD_AVX2:
+        cross_f32_avx2(a, b, y, n, sums);
+        break;
+#endif
+    default:
+        cross_f32_scalar(a, b, y, 0, n, sums);
+    }
+}
+
+// residual sum of squares of a quadratic neuron over float32 columns,
+// evaluated in float. rows with a missing input or target are skipped;
+// *n_used is set to the number scored
+double sse_polynomial_f32(const float *x1, const float *x2, const double *coeffs,
+                          const float *y, int n, double *n_used) {
+    float c[6];
+    for (int k = 0; k < 6; k++) {
+        c[k] = (float)coeffs[k];
+    }
+    *n_used = 0;
+    switch (simd_level()) {
+#ifdef GMDH_X86_KERNELS
+    case GMDH_SIMD_AVX512:
+        return sse_f32_avx512(x1, x2, c, y, n, n_used);
+    case GMDH_SIMD_AVX2:
+        return sse_f32_avx2(x1, x2, c, y, n, n_used);
+#endif
+    default:
+        return sse_f32_scalar(x1, x2, c, y, 0, n, n_used);
+    }
+}
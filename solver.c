@@ -0,0 +1,294 @@
+#include "gmdh.h"
+
+// dense solvers for the normal equations of every fit. systems are
+// equilibrated first (scaled to a unit diagonal) so the condition estimate
+// measures collinearity rather than the units of the columns. cholesky is
+// tried first; a system it cannot factor, or one too ill-conditioned to
+// trust it on, goes to householder qr with column pivoting, which finds
+// the numerical rank and drops the dependent columns. every buffer lives
+// on the stack or in caller-provided workspace
+
+// columns of the column-block updates in cholesky_blocked
+#define SOLVER_BLOCK 16
+
+#if defined(__GNUC__) && !defined(__clang__)
+#define UNROLL_6 _Pragma("GCC unroll 6")
+#else
+#define UNROLL_6
+#endif
+
+// a'a = a in place for the 6x6 row-major matrix of a quadratic neuron,
+// upper triangle. every loop has constant bounds and is fully unrolled.
+// returns 0 if a pivot is not positive
+static int cholesky6(double *a) {
+    UNROLL_6
+    for (int j = 0; j < 6; j++) {
+        double d = a[j * 6 + j];
+        UNROLL_6
+        for (int l = 0; l < j; l++) {
+            d -= a[l * 6 + j] * a[l * 6 + j];
+        }
+        if (!(d > 0)) return 0;
+        double r = sqrt(d);
+        a[j * 6 + j] = r;
+        UNROLL_6
+        for (int c = j + 1; c < 6; c++) {
+            double v = a[j * 6 + c];
+            UNROLL_6
+            for (int l = 0; l < j; l++) {
+                v -= a[l * 6 + j] * a[l * 6 + c];
+            }
+            a[j * 6 + c] = v / r;
+        }
+    }
+    return 1;
+}
+
+// the same factorisation for any n, by blocks of SOLVER_BLOCK columns: the
+// diagonal block is factored, the panel to its right solved against it,
+// and the trailing matrix updated with the whole panel at once
+static int cholesky_blocked(double *a, int n) {
+    for (int k0 = 0; k0 < n; k0 += SOLVER_BLOCK) {
+        int k1 = k0 + SOLVER_BLOCK < n ? k0 + SOLVER_BLOCK : n;
+
+        for (int j = k0; j < k1; j++) {
+            double d = a[(size_t)j * n + j];
+            for (int l = k0; l < j; l++) {
+                d -= a[(size_t)l * n + j] * a[(size_t)l * n + j];
+            }
+            if (!(d > 0)) return 0;
+            double r = sqrt(d);
+            a[(size_t)j * n + j] = r;
+            for (int c = j + 1; c < n; c++) {
+                double v = a[(size_t)j * n + c];
+                for (int l = k0; l < j; l++) {
+                    v -= a[(size_t)l * n + j] * a[(size_t)l * n + c];
+                }
+                a[(size_t)j * n + c] = v / r;
+            }
+        }
+
+        for (int i = k1; i < n; i++) {
+            for (int c = i; c < n; c++) {
+                double v = 0;
+                for (int l = k0; l < k1; l++) {
+                    v += a[(size_t)l * n + i] * a[(size_t)l * n + c];
+                }
+                a[(size_t)i * n + c] -= v;
+            }
+        }
+    }
+    return 1;
+}
+
+// r'r x = b with r the upper factor, in place in x
+static void cholesky_substitute(const double *r, int n, double *x) {
+    for (int i = 0; i < n; i++) {
+        double v = x[i];
+        for (int l = 0; l < i; l++) {
+            v -= r[(size_t)l * n + i] * x[l];
+        }
+        x[i] = v / r[(size_t)i * n + i];
+    }
+    for (int i = n - 1; i >= 0; i--) {
+        double v = x[i];
+        for (int l = i + 1; l < n; l++) {
+            v -= r[(size_t)i * n + l] * x[l];
+        }
+        x[i] = v / r[(size_t)i * n + i];
+    }
+}
+
+// condition of r'r from the diagonal of r: a lower bound, and a close one
+// once the matrix is equilibrated
+static double factor_condition(const double *r, int n) {
+    double lo = INFINITY, hi = 0;
+    for (int i = 0; i < n; i++) {
+        double d = fabs(r[(size_t)i * n + i]);
+        if (d < lo) lo = d;
+        if (d > hi) hi = d;
+    }
+    return lo > 0 ? (hi / lo) * (hi / lo) : INFINITY;
+}
+
+// least squares a x ~ b by householder qr with column pivoting. a is m x n
+// column-major with leading dimension lda, b has m entries; both are
+// overwritten. columns whose remaining norm falls below tol times the
+// first pivot are treated as dependent and get a zero coefficient.
+// returns the rank; *ratio is |r_00| / |r_kk| over the kept pivots
+static int qr_pivoted(double *a, int m, int n, int lda, double *b, double *x,
+                      double tol, double *ratio) {
+    int perm[n + 1];
+    double norms[n + 1];
+    for (int j = 0; j < n; j++) {
+        perm[j] = j;
+    }
+
+    int rank = 0;
+    double r00 = 0;
+    int steps = m < n ? m : n;
+    for (int k = 0; k < steps; k++) {
+        // pivot: the column with the largest norm below row k
+        int p = k;
+        for (int j = k; j < n; j++) {
+            const double *col = a + (size_t)j * lda;
+            double s = 0;
+            for (int i = k; i < m; i++) {
+                s += col[i] * col[i];
+            }
+            norms[j] = s;
+            if (s > norms[p]) p = j;
+        }
+        if (p != k) {
+            double *ck = a + (size_t)k * lda, *cp = a + (size_t)p * lda;
+            for (int i = 0; i < m; i++) {
+                double t = ck[i];
+                ck[i] = cp[i];
+                cp[i] = t;
+            }
+            int t = perm[k];
+            perm[k] = perm[p];
+            perm[p] = t;
+        }
+
+        double *v = a + (size_t)k * lda;
+        double alpha = sqrt(norms[p]);
+        if (k == 0) r00 = alpha;
+        if (!(alpha > tol * r00)) break;
+
+        // reflector h = i - 2 v v' / v'v taking v[k..m) onto beta e_k
+        double beta = v[k] >= 0 ? -alpha : alpha;
+        v[k] -= beta;
+        double vv = 0;
+        for (int i = k; i < m; i++) {
+            vv += v[i] * v[i];
+        }
+        for (int j = k + 1; j < n; j++) {
+            double *c = a + (size_t)j * lda;
+            double s = 0;
+            for (int i = k; i < m; i++) {
+                s += v[i] * c[i];
+            }
+            s = 2 * s / vv;
+            for (int i = k; i < m; i++) {
+                c[i] -= s * v[i];
+            }
+        }
+        double s = 0;
+        for (int i = k; i < m; i++) {
+            s += v[i] * b[i];
+        }
+        s = 2 * s / vv;
+        for (int i = k; i < m; i++) {
+            b[i] -= s * v[i];
+        }
+        v[k] = beta;
+        rank++;
+    }
+
+    // r z = q'b over the kept columns
+    double z[n + 1];
+    for (int i = rank - 1; i >= 0; i--) {
+        double t = b[i];
+        for (int j = i + 1; j < rank; j++) {
+            t -= a[(size_t)j * lda + i] * z[j];
+        }
+        z[i] = t / a[(size_t)i * lda + i];
+    }
+    for (int j = 0; j < n; j++) {
+        x[perm[j]] = j < rank ? z[j] : 0;
+    }
+    *ratio = rank > 0 ? r00 / fabs(a[(size_t)(rank - 1) * lda + rank - 1]) : INFINITY;
+    return rank;
+}
+
+// solve the n x n normal equations a x = b (row-major, symmetric). the
+// 6x6 system of a quadratic neuron takes the unrolled path. info gets the
+// condition estimate of the equilibrated matrix (infinite when rank
+// deficient), the rank and the method used. returns 1 for a full-rank
+// solution; a rank-deficient system still gets the solution with its
+// dependent columns at zero
+int solve_normal(const double *a, const double *b, double *x, int n, solve_info_t *info) {
+    double s[n + 1];
+    double f[(size_t)n * n + 1];
+    double y[n + 1];
+
+    // equilibrate: f = d a d, d = diag(a)^-1/2
+    for (int i = 0; i < n; i++) {
+        double d = a[(size_t)i * n + i];
+        s[i] = d > 0 ? 1.0 / sqrt(d) : 1.0;
+    }
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            f[(size_t)i * n + j] = a[(size_t)i * n + j] * s[i] * s[j];
+        }
+        y[i] = b[i] * s[i];
+    }
+
+    int ok = n == 6 ? cholesky6(f) : cholesky_blocked(f, n);
+    info->method = SOLVE_CHOLESKY;
+    info->rank = n;
+    info->cond = ok ? factor_condition(f, n) : INFINITY;
+
+    if (!(info->cond <= SOLVER_COND_MAX)) {
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j < n; j++) {
+                f[(size_t)i * n + j] = a[(size_t)i * n + j] * s[i] * s[j];
+            }
+        }
+        double ratio;
+        info->method = SOLVE_QR;
+        info->rank = qr_pivoted(f, n, n, n, y, x, SOLVER_RANK_TOL, &ratio);
+        info->cond = info->rank == n ? ratio : INFINITY;
+    } else {
+        memcpy(x, y, n * sizeof(double));
+        cholesky_substitute(f, n, x);
+    }
+
+    int finite = 1;
+    for (int i = 0; i < n; i++) {
+        x[i] *= s[i];
+        finite &= isfinite(x[i]);
+    }
+    if (!finite) {
+        for (int i = 0; i < n; i++) {
+            x[i] = 0;
+        }
+        info->rank = 0;
+        info->cond = INFINITY;
+    }
+    return info->rank == n;
+}
+
+// least squares fit of y on the columns of a design, straight from the
+// data: qr of the design itself, so the conditioning is not squared the
+// way it is in the normal equations. a NULL column is the intercept.
+// work holds n_rows * (k + 1) doubles. info->cond is reported on the same
+// scale as solve_normal's, the condition of the equilibrated x'x
+int solve_least_squares(const double *const *cols, const double *y, int n_rows, int k,
+                        double *work, double *x, solve_info_t *info) {
+    double *b = work + (size_t)n_rows * k;
+    double s[k + 1];
+    for (int j = 0; j < k; j++) {
+        double *dst = work + (size_t)j * n_rows;
+        double ss = 0;
+        for (int i = 0; i < n_rows; i++) {
+            dst[i] = cols[j] ? cols[j][i] : 1.0;
+            ss += dst[i] * dst[i];
+        }
+        s[j] = ss > 0 ? 1.0 / sqrt(ss) : 1.0;
+        for (int i = 0; i < n_rows; i++) {
+            dst[i] *= s[j];
+        }
+    }
+    memcpy(b, y, n_rows * sizeof(double));
+
+    double ratio;
+    info->method = SOLVE_QR;
+    info->rank = qr_pivoted(work, n_rows, k, n_rows, b, x, sqrt(SOLVER_RANK_TOL), &ratio);
+    info->cond = info->rank == k ? ratio * ratio : INFINITY;
+    for (int j = 0; j < k; j++) {
+        x[j] *= s[j];
+    }
+    return info->rank == k;
+}
@@ -0,0 +1,298 @@
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "gmdh.h"
+
+// initial csv read buffer; it doubles whenever a single line outgrows it
+#define STREAM_BUFFER_BYTES (1 << 20)
+
+static int read_full(int fd, void *dst, size_t bytes, off_t offset) {
+    char *p = dst;
+    while (bytes > 0) {
+        ssize_t got = pread(fd, p, bytes, offset);
+        if (got <= 0) return 0;
+        p += got;
+        bytes -= got;
+        offset += got;
+    }
+    return 1;
+}
+
+// next line of a csv stream, without its newline. the span stays valid
+// until the next call; lines of any length are carried across refills
+static int next_line(row_stream_t *s, const char **start, const char **end) {
+    for (;;) {
+        char *p = s->buf + s->buf_pos;
+        size_t avail = s->buf_len - s->buf_pos;
+        char *nl = memchr(p, '\n', avail);
+        if (nl) {
+            *start = p;
+            *end = nl;
+            s->buf_pos += nl - p + 1;
+            return 1;
+        }
+        if (s->eof) {
+            if (avail == 0) return 0;
+            *start = p;
+            *end = p + avail;
+            s->buf_pos = s->buf_len;
+            return 1;
+        }
+
+        // keep the partial line at the front and read more after it
+        memmove(s->buf, p, avail);
+        s->buf_len = avail;
+        s->buf_pos = 0;
+        if (s->buf_len == s->buf_cap) {
+            s->buf_cap *= 2;
+            s->buf = realloc(s->buf, s->buf_cap);
+        }
+        size_t got = fread(s->buf + s->buf_len, 1, s->buf_cap - s->buf_len, s->fp);
+        if (got == 0) s->eof = 1;
+        s->buf_len += got;
+    }
+}
+
+static int line_is_blank(const char *p, const char *end) {
+    for (; p < end; p++) {
+        if (*p != ' ' && *p != '\t' && *p != '\r') return 0;
+    }
+    return 1;
+}
+
+// feature slot of file column c: every column but the target, in order
+static int feature_of(const row_stream_t *s, int c) {
+    return c < s->target_col ? c : c - 1;
+}
+
+static void set_name(row_stream_t *s, int c, const char *name, size_t len) {
+    while (len > 0 && (name[len - 1] == '\r' || name[len - 1] == ' ')) len--;
+    char *copy = arena_alloc(s->block->arena, len + 1);
+    memcpy(copy, name, len);
+    copy[len] = '\0';
+    if (c == s->target_col) {
+        s->block->target_name = copy;
+    } else if (c < s->n_cols) {
+        s->block->feature_names[feature_of(s, c)] = copy;
+    }
+}
+
+// takes fd, which row_stream_close closes even when this fails
+static int open_binary(row_stream_t *s, int fd, const bin_header_t *h) {
+    s->fd = fd;
+    if (h->version != BIN_VERSION || h->byte_order != BIN_BYTE_ORDER || h->n_cols < 2) {
+        return 0;
+    }
+    s->binary = 1;
+    s->hdr = *h;
+    s->n_cols = h->n_cols;
+    if (s->target_col < 0) s->target_col = h->target_col;
+    if (s->target_col < 0 || s->target_col >= s->n_cols) return 0;
+
+    s->block = dataset_create(s->block_rows, s->n_cols - 1);
+    size_t bytes = h->stats_offset - h->names_offset;
+    char *names = malloc(bytes + 1);
+    if (!read_full(fd, names, bytes, h->names_offset)) {
+        free(names);
+        return 0;
+    }
+    names[bytes] = '\0';
+    const char *p = names;
+    for (int c = 0; c < s->n_cols && p < names + bytes; c++) {
+        size_t len = strlen(p);
+        set_name(s, c, p, len);
+        p += len + 1;
+    }
+    free(names);
+    return 1;
+}
+
+static int open_csv(row_stream_t *s, const char *path) {
+    s->fp = fopen(path, "rb");
+    if (!s->fp) return 0;
+    s->buf_cap = STREAM_BUFFER_BYTES;
+    s->buf = malloc(s->buf_cap);
+
+    const char *p, *end;
+    if (!next_line(s, &p, &end)) return 0;
+    s->body_offset = (long)(end - p) + 1;
+
+    s->n_cols = 1;
+    for (const char *q = p; q < end; q++) {
+        if (*q == ',') s->n_cols++;
+    }
+    if (s->target_col < 0 || s->target_col >= s->n_cols || s->n_cols < 2) return 0;
+
+    s->block = dataset_create(s->block_rows, s->n_cols - 1);
+    for (int c = 0; c < s->n_cols; c++) {
+        const char *comma = memchr(p, ',', end - p);
+        const char *field_end = comma ? comma : end;
+        set_name(s, c, p, field_end - p);
+        p = field_end + 1;
+    }
+    return 1;
+}
+
+// open a dataset file for block reading. binary dataset files (see
+// data_bin.c) are recognised by their magic and read column slice by
+// column slice; anything else is parsed as csv. a negative target_col
+// picks the column a binary file was saved with
+row_stream_t* row_stream_open(const char *path, int target_col, int block_rows) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "failed to open %s\n", path);
+        return NULL;
+    }
+
+    row_stream_t *s = calloc(1, sizeof(row_stream_t));
+    s->fd = -1;
+    s->target_col = target_col;
+    s->block_rows = block_rows > 0 ? block_rows : 4096;
+
+    bin_header_t h;
+    int ok;
+    if (read_full(fd, &h, sizeof(h), 0) && memcmp(h.magic, BIN_MAGIC, 8) == 0) {
+        ok = open_binary(s, fd, &h);
+    } else {
+        close(fd);
+        ok = open_csv(s, path);
+    }
+    if (!ok) {
+        fprintf(stderr, "failed to stream %s (target column %d)\n", path, target_col);
+        row_stream_close(s);
+        return NULL;
+    }
+    return s;
+}
+
+// drop the rows of [from, to) without a target, packing the rest down to
+// `from`. returns the new end
+static int pack_rows(dataset_t *b, int from, int to) {
+    int k = from;
+    for (int i = from; i < to; i++) {
+        if (isnan(b->target[i])) continue;
+        if (i != k) {
+            for (int f = 0; f < b->n_features; f++) {
+                b->cols[f][k] = b->cols[f][i];
+            }
+            b->target[k] = b->target[i];
+        }
+        k++;
+    }
+    return k;
+}
+
+static int next_binary(row_stream_t *s) {
+    dataset_t *b = s->block;
+    const bin_header_t *h = &s->hdr;
+    int row = 0;
+    while (row < s->block_rows && s->next_row < (int64_t)h->n_rows) {
+        int64_t left = (int64_t)h->n_rows - s->next_row;
+        int want = s->block_rows - row < left ? s->block_rows - row : (int)left;
+        for (int c = 0; c < s->n_cols; c++) {
+            double *dst = c == s->target_col ? b->target : b->cols[feature_of(s, c)];
+            off_t offset = h->data_offset + ((uint64_t)c * h->stride + s->next_row) * sizeof(double);
+            if (!read_full(s->fd, dst + row, want * sizeof(double), offset)) {
+                fprintf(stderr, "failed to read rows %lld..%lld of the binary stream\n",
+                        (long long)s->next_row, (long long)(s->next_row + want));
+                s->error = 1;
+                return row;
+            }
+        }
+        s->next_row += want;
+        row = pack_rows(b, row, row + want);
+    }
+    return row;
+}
+
+static int next_csv(row_stream_t *s) {
+    dataset_t *b = s->block;
+    const char *p, *end;
+    int row = 0;
+    while (row < s->block_rows && next_line(s, &p, &end)) {
+        if (line_is_blank(p, end)) continue;
+
+        int col = 0;
+        b->target[row] = NAN;
+        for (;;) {
+            const char *comma = memchr(p, ',', end - p);
+            const char *field_end = comma ? comma : end;
+            if (col < s->n_cols) {
+                double v = csv_parse_field(p, field_end);
+                if (col == s->target_col) {
+                    b->target[row] = v;
+                } else {
+                    b->cols[feature_of(s, col)][row] = v;
+                }
+            }
+            col++;
+            if (!comma) break;
+            p = field_end + 1;
+        }
+        // short line: the columns it lacks are missing
+        for (int c = col; c < s->n_cols; c++) {
+            if (c != s->target_col) b->cols[feature_of(s, c)][row] = NAN;
+        }
+        if (!isnan(b->target[row])) row++;
+    }
+    return row;
+}
+
+// the next block of rows with a target, or NULL at the end of the file.
+// the returned dataset belongs to the stream and is overwritten by the
+// next call
+dataset_t* row_stream_next(row_stream_t *s) {
+    int n = s->binary ? next_binary(s) : next_csv(s);
+    s->block->n_samples = n;
+    return n > 0 ? s->block : NULL;
+}
+
+// go back to the first row
+int row_stream_rewind(row_stream_t *s) {
+    if (s->binary) {
+        s->next_row = 0;
+        return 1;
+    }
+    s->buf_len = s->buf_pos = 0;
+    s->eof = 0;
+    return fseek(s->fp, s->body_offset, SEEK_SET) == 0;
+}
+
+// number of rows with a target. binary files answer from the presence
+// bitmap of the target column; csv files take one full pass. the stream
+// is rewound either way
+int64_t row_stream_count(row_stream_t *s) {
+    int64_t n = 0;
+    if (s->binary) {
+        uint64_t words = bin_present_words(s->hdr.n_rows);
+        uint64_t *present = malloc(words * sizeof(uint64_t) + 1);
+        off_t offset = s->hdr.present_offset + (uint64_t)s->target_col * words * sizeof(uint64_t);
+        if (read_full(s->fd, present, words * sizeof(uint64_t), offset)) {
+            for (uint64_t w = 0; w < words; w++) {
+                n += __builtin_popcountll(present[w]);
+            }
+        } else {
+            fprintf(stderr, "failed to read the target's presence bitmap\n");
+            s->error = 1;
+        }
+        free(present);
+    } else {
+        row_stream_rewind(s);
+        dataset_t *b;
+        while ((b = row_stream_next(s))) {
+            n += b->n_samples;
+        }
+    }
+    row_stream_rewind(s);
+    return n;
+}
+
+void row_stream_close(row_stream_t *s) {
+    if (!s) return;
+    if (s->fd >= 0) close(s->fd);
+    if (s->fp) fclose(s->fp);
+    free(s->buf);
+    free_dataset(s->block);
+    free(s);
+}
@@ -1,8 +1,43 @@
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "gmdh.h"
 
 int tests_run = 0;
 int tests_passed = 0;
 
+// calls this program's objects make to the system allocator, counted by
+// wrapping it at link time as in the benchmark (see make test)
+static uint64_t heap_allocs;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void *p, size_t size);
+int __real_posix_memalign(void **p, size_t align, size_t size);
+
+void* __wrap_malloc(size_t size) {
+    __atomic_add_fetch(&heap_allocs, 1, __ATOMIC_RELAXED);
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t n, size_t size) {
+    __atomic_add_fetch(&heap_allocs, 1, __ATOMIC_RELAXED);
+    return __real_calloc(n, size);
+}
+
+void* __wrap_realloc(void *p, size_t size) {
+    __atomic_add_fetch(&heap_allocs, 1, __ATOMIC_RELAXED);
+    return __real_realloc(p, size);
+}
+
+int __wrap_posix_memalign(void **p, size_t align, size_t size) {
+    __atomic_add_fetch(&heap_allocs, 1, __ATOMIC_RELAXED);
+    return __real_posix_memalign(p, align, size);
+}
+
 #define TEST(name) \
     printf("\ntest: %s\n", #name); \
     tests_run++;
@@ -46,6 +81,167 @@ int test_polynomial_fit() {
     return 1;
 }
 
+int test_dense_solver() {
+    TEST(dense_solver);
+    
+    // well-conditioned systems of the unrolled 6x6 size and of a size
+    // that spans two cholesky blocks: a = m'm + n i, b = a x
+    int sizes[2] = {6, 20};
+    for (int s = 0; s < 2; s++) {
+        int n = sizes[s];
+        double *m = malloc(n * n * sizeof(double));
+        double *a = malloc(n * n * sizeof(double));
+        double *b = malloc(n * sizeof(double));
+        double *x = malloc(n * sizeof(double));
+        double *want = malloc(n * sizeof(double));
+        unsigned seed = 7;
+        for (int i = 0; i < n * n; i++) {
+            seed = seed * 1103515245u + 12345u;
+            m[i] = (double)(seed >> 16) / 65536.0 - 0.5;
+        }
+        for (int i = 0; i < n; i++) {
+            want[i] = i - n / 2.0;
+            for (int j = 0; j < n; j++) {
+                double v = i == j ? n : 0;
+                for (int k = 0; k < n; k++) {
+                    v += m[k * n + i] * m[k * n + j];
+                }
+                a[i * n + j] = v;
+            }
+        }
+        for (int i = 0; i < n; i++) {
+            b[i] = 0;
+            for (int j = 0; j < n; j++) {
+                b[i] += a[i * n + j] * want[j];
+            }
+        }
+        solve_info_t info;
+        ASSERT(solve_normal(a, b, x, n, &info) && info.method == SOLVE_CHOLESKY,
+               "well-conditioned system should solve by cholesky");
+        double worst = 0;
+        for (int i = 0; i < n; i++) {
+            worst = fmax(worst, fabs(x[i] - want[i]));
+        }
+        ASSERT(worst < 1e-10, "cholesky solution should be exact");
+        ASSERT(info.cond > 1 && info.cond < 100, "condition estimate should be small");
+        free(m);
+        free(a);
+        free(b);
+        free(x);
+        free(want);
+    }
+    
+    // a pair with x2 = 3 * x1: the quadratic neuron is rank deficient. the
+    // fit keeps to the independent terms and says so
+    double x1[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    double x2[8], y[8];
+    for (int i = 0; i < 8; i++) {
+        x2[i] = 3 * x1[i];
+        y[i] = 1 + 2 * x1[i] - 0.5 * x1[i] * x1[i];
+    }
+    quad_moments_t mom;
+    memset(&mom, 0, sizeof(mom));
+    for (int i = 0; i < 8; i++) {
+        double a = x1[i], b = x2[i];
+        mom.n += 1;
+        mom.a1 += a; mom.a2 += a * a; mom.a3 += a * a * a; mom.a4 += a * a * a * a;
+        mom.b1 += b; mom.b2 += b * b; mom.b3 += b * b * b; mom.b4 += b * b * b * b;
+        mom.ab += a * b; mom.a2b += a * a * b; mom.ab2 += a * b * b;
+        mom.a3b += a * a * a * b; mom.ab3 += a * b * b * b; mom.a2b2 += a * a * b * b;
+        mom.y += y[i]; mom.ay += a * y[i]; mom.by += b * y[i];
+        mom.a2y += a * a * y[i]; mom.b2y += b * b * y[i]; mom.aby += a * b * y[i];
+    }
+    double coeffs[6];
+    double cond = fit_quadratic_moments(&mom, coeffs);
+    ASSERT(cond > GMDH_COND_WARN, "collinear pair should be flagged");
+    double worst = 0;
+    for (int i = 0; i < 8; i++) {
+        worst = fmax(worst, fabs(predict_polynomial(x1[i], x2[i], coeffs) - y[i]));
+    }
+    ASSERT(worst < 1e-8, "collinear pair should still fit its data");
+    
+    // nearly collinear design: the normal equations are beyond cholesky,
+    // qr on the columns recovers the coefficients
+    int n = 200;
+    double *u = malloc(n * sizeof(double));
+    double *v = malloc(n * sizeof(double));
+    double *t = malloc(n * sizeof(double));
+    double *work = malloc(n * 4 * sizeof(double));
+    for (int i = 0; i < n; i++) {
+        u[i] = sin(i * 0.1);
+        v[i] = u[i] + 1e-6 * cos(i * 0.37);
+        t[i] = 2 + 3 * u[i] - 1 * v[i];
+    }
+    const double *design[3] = {NULL, u, v};
+    double gram[9], rhs[3], x[3];
+    for (int i = 0; i < 3; i++) {
+        rhs[i] = 0;
+        for (int r = 0; r < n; r++) {
+            rhs[i] += (design[i] ? design[i][r] : 1.0) * t[r];
+        }
+        for (int j = 0; j < 3; j++) {
+            gram[i * 3 + j] = 0;
+            for (int r = 0; r < n; r++) {
+                gram[i * 3 + j] += (design[i] ? design[i][r] : 1.0) * (design[j] ? design[j][r] : 1.0);
+            }
+        }
+    }
+    solve_info_t info;
+    solve_normal(gram, rhs, x, 3, &info);
+    ASSERT(info.method == SOLVE_QR && info.cond > SOLVER_COND_MAX,
+           "ill-conditioned normal equations should fall back to qr");
+    ASSERT(solve_least_squares(design, t, n, 3, work, x, &info), "design qr should keep full rank");
+    ASSERT_NEAR(x[0], 2, 1e-6, "intercept should be recovered");
+    ASSERT_NEAR(x[1], 3, 1e-4, "first coefficient should be recovered");
+    ASSERT_NEAR(x[2], -1, 1e-4, "second coefficient should be recovered");
+    free(u);
+    free(v);
+    free(t);
+    free(work);
+    
+    tests_passed++;
+    return 1;
+}
+
+int test_gram_pair_fit() {
+    TEST(gram_pair_fit);
+    
+    dataset_t *ds = load_csv("water_quality.csv", 23);
+    ASSERT(ds != NULL, "dataset should load");
+    
+    gram_stats_t *gs = gram_stats_compute(ds);
+    ASSERT(gs != NULL, "gram statistics should compute");
+    
+    // flow_rate x pH_input, then a pair with missing values
+    int pairs[2][2] = { {1, 2}, {2, 4} };
+    double *x1 = malloc(ds->n_samples * sizeof(double));
+    double *x2 = malloc(ds->n_samples * sizeof(double));
+    
+    for (int p = 0; p < 2; p++) {
+        int i = pairs[p][0], j = pairs[p][1];
+        for (int k = 0; k < ds->n_samples; k++) {
+            x1[k] = ds->cols[i][k];
+            x2[k] = ds->cols[j][k];
+        }
+        
+        double direct[6], gram[6];
+        fit_polynomial(x1, x2, ds->target, ds->n_samples, direct);
+        gram_fit_pair(gs, i, j, gram);
+        
+        for (int c = 0; c < 6; c++) {
+            double tol = 1e-6 * (fabs(direct[c]) + 1e-6);
+            ASSERT_NEAR(gram[c], direct[c], tol, "gram coefficient should match direct fit");
+        }
+    }
+    
+    free(x1);
+    free(x2);
+    free_gram_stats(gs);
+    free_dataset(ds);
+    tests_passed++;
+    return 1;
+}
+
 int test_rmse_calculation() {
     TEST(rmse_calculation);
     
@@ -84,6 +280,49 @@ int test_r2_calculation() {
     return 1;
 }
 
+int test_simd_kernels() {
+    TEST(simd_kernels);
+    
+    // odd length so every kernel runs its tail, targets far from zero and
+    // nan holes in both inputs
+    enum { N = 37 };
+    double x1[N], x2[N], actual[N], pred[N], ref[N], out[N];
+    double coeffs[6] = {3.0, -1.5, 0.25, 0.125, -0.5, 2.0};
+    for (int i = 0; i < N; i++) {
+        x1[i] = sin(i * 0.7) * 3;
+        x2[i] = cos(i * 1.3) * 2;
+        ref[i] = predict_polynomial(x1[i], x2[i], coeffs);
+        actual[i] = i % 7 == 3 ? NAN : 1000 + ref[i] + 0.1 * sin(i * 2.1);
+        pred[i] = i % 11 == 5 ? NAN : 1000 + ref[i];
+    }
+    double ref_rmse = calculate_rmse(pred, actual, N);
+    double ref_r2 = calculate_r2(pred, actual, N);
+    
+    gmdh_simd_t saved = gmdh_options.simd;
+    double max_pred_err = 0, max_rmse_err = 0, max_r2_err = 0;
+    gmdh_simd_t levels[] = {GMDH_SIMD_SCALAR, GMDH_SIMD_AVX2, GMDH_SIMD_AVX512};
+    for (int l = 0; l < 3; l++) {
+        gmdh_options.simd = levels[l];
+        predict_polynomial_column(x1, x2, coeffs, out, N);
+        for (int i = 0; i < N; i++) {
+            max_pred_err = fmax(max_pred_err, fabs(out[i] - ref[i]));
+        }
+        double rmse, r2;
+        score_predictions(pred, actual, N, &rmse, &r2);
+        max_rmse_err = fmax(max_rmse_err, fabs(rmse - ref_rmse));
+        max_r2_err = fmax(max_r2_err, fabs(r2 - ref_r2));
+        printf("  level %d runs as %d\n", levels[l], simd_level());
+    }
+    gmdh_options.simd = saved;
+    
+    ASSERT(max_pred_err < 1e-12, "column predictions should match the scalar formula");
+    ASSERT(max_rmse_err < 1e-12, "fused rmse should match calculate_rmse");
+    ASSERT(max_r2_err < 1e-9, "fused r² should match calculate_r2");
+    
+    tests_passed++;
+    return 1;
+}
+
 int test_csv_loading() {
     TEST(csv_loading);
     
@@ -101,6 +340,137 @@ int test_csv_loading() {
     return 1;
 }
 
+// value written to row r, column c of the generated csv
+static double wide_value(int r, int c) {
+    return (r * 31 + c * 17) % 1000 / 8.0 - 60.0;
+}
+
+int test_wide_csv_loading() {
+    TEST(wide_csv_loading);
+    
+    // lines far beyond the old 8192-byte limit and a file spanning several
+    // parser chunks, with crlf endings, "?" holes, a blank line and no
+    // newline after the last row
+    enum { COLS = 1500, ROWS = 300 };
+    const char *path = "test_wide.csv";
+    FILE *fp = fopen(path, "w");
+    ASSERT(fp != NULL, "temporary csv should be writable");
+    for (int c = 0; c < COLS; c++) {
+        fprintf(fp, "c%d%s", c, c < COLS - 1 ? "," : "\r\n");
+    }
+    for (int r = 0; r < ROWS; r++) {
+        for (int c = 0; c < COLS; c++) {
+            if ((r + c) % 97 == 0 && c != 0) {
+                fputc('?', fp);
+            } else {
+                fprintf(fp, "%.3f", wide_value(r, c));
+            }
+            if (c < COLS - 1) fputc(',', fp);
+        }
+        if (r == ROWS / 2) fputs("\r\n", fp);
+        if (r < ROWS - 1) fputs("\r\n", fp);
+    }
+    fclose(fp);
+    
+    gmdh_options_t saved = gmdh_options;
+    gmdh_options.n_threads = 4;
+    gmdh_options.csv_cache = 0;
+    dataset_t *ds = load_csv(path, 0);
+    gmdh_options = saved;
+    remove(path);
+    ASSERT(ds != NULL, "wide csv should load");
+    
+    ASSERT(ds->n_samples == ROWS, "every non-blank row should load");
+    ASSERT(ds->n_features == COLS - 1, "every column but the target should load");
+    ASSERT(strcmp(ds->feature_names[COLS - 2], "c1499") == 0, "last name should drop the \\r");
+    
+    int mismatches = 0;
+    for (int r = 0; r < ROWS; r++) {
+        if (ds->target[r] != wide_value(r, 0)) mismatches++;
+        for (int c = 1; c < COLS; c++) {
+            double v = ds->cols[c - 1][r];
+            if ((r + c) % 97 == 0 ? !isnan(v) : v != wide_value(r, c)) mismatches++;
+        }
+    }
+    ASSERT(mismatches == 0, "values and missing markers should parse exactly");
+    
+    free_dataset(ds);
+    tests_passed++;
+    return 1;
+}
+
+int test_binary_dataset() {
+    TEST(binary_dataset);
+    
+    dataset_t *ds = load_csv("water_quality.csv", 23);
+    ASSERT(ds != NULL, "dataset should load");
+    
+    const char *path = "test_dataset.bin";
+    ASSERT(save_dataset_bin(ds, path), "dataset should save");
+    dataset_t *back = load_dataset_bin(path, -1);
+    ASSERT(back != NULL, "dataset should load back");
+    ASSERT(back->n_samples == ds->n_samples && back->n_features == ds->n_features,
+           "shape should survive the round trip");
+    ASSERT(strcmp(back->target_name, "pH_tank3") == 0, "target name should survive");
+    
+    int mismatches = 0;
+    for (int f = 0; f < ds->n_features; f++) {
+        if (memcmp(back->cols[f], ds->cols[f], ds->n_samples * sizeof(double)) != 0) {
+            mismatches++;
+        }
+    }
+    if (memcmp(back->target, ds->target, ds->n_samples * sizeof(double)) != 0) mismatches++;
+    ASSERT(mismatches == 0, "columns should round-trip bit for bit");
+    
+    // another target chosen at load time: old target becomes the last feature
+    dataset_t *other = load_dataset_bin(path, 0);
+    ASSERT(other->n_features == ds->n_features, "retargeting should keep the width");
+    ASSERT(strcmp(other->feature_names[ds->n_features - 1], "pH_tank3") == 0,
+           "the saved target should become a feature");
+    
+    int n_cols = 0;
+    column_stats_t *stats = dataset_bin_stats(path, &n_cols);
+    ASSERT(stats != NULL && n_cols == ds->n_features + 1, "stats should cover every column");
+    double lo = INFINITY, hi = -INFINITY;
+    for (int i = 0; i < ds->n_samples; i++) {
+        lo = fmin(lo, ds->target[i]);
+        hi = fmax(hi, ds->target[i]);
+    }
+    ASSERT(stats[ds->n_features].min == lo && stats[ds->n_features].max == hi,
+           "target min/max should be stored");
+    ASSERT(stats[ds->n_features].n_missing == 0, "the target has no missing values");
+    
+    free(stats);
+    free_dataset(other);
+    free_dataset(back);
+    free_dataset(ds);
+    remove(path);
+    
+    // a cache next to a csv is rebuilt once the csv changes
+    const char *csv = "test_cache.csv";
+    FILE *fp = fopen(csv, "w");
+    fprintf(fp, "a,b,y\n1,2,3\n4,5,6\n");
+    fclose(fp);
+    dataset_t *first = load_csv(csv, 2);
+    fp = fopen(csv, "w");
+    fprintf(fp, "a,b,y\n1,2,3\n4,5,70\n");
+    fclose(fp);
+    dataset_t *second = load_csv(csv, 2);
+    ASSERT(first->target[1] == 6 && second->target[1] == 70, "edited csv should not hit a stale cache");
+    dataset_t *third = load_csv(csv, 0);
+    ASSERT(third->target[1] == 4 && third->cols[1][1] == 70, "cache should serve any target column");
+    ASSERT(load_csv(csv, 5) == NULL, "an out-of-range target column should be rejected");
+    
+    free_dataset(first);
+    free_dataset(second);
+    free_dataset(third);
+    remove(csv);
+    remove("test_cache.csv.bin");
+    
+    tests_passed++;
+    return 1;
+}
+
 int test_dataset_split() {
     TEST(dataset_split);
     
@@ -124,6 +494,34 @@ int test_dataset_split() {
     return 1;
 }
 
+int test_columnar_views() {
+    TEST(columnar_views);
+    
+    dataset_t *ds = load_csv("water_quality.csv", 23);
+    ASSERT(ds != NULL, "dataset should load");
+    
+    for (int f = 0; f < ds->n_features; f++) {
+        ASSERT(((uintptr_t)ds->cols[f] % ARENA_ALIGN) == 0, "columns should be aligned");
+    }
+    
+    double **rows = dataset_rows(ds);
+    ASSERT(rows[7][3] == ds->cols[3][7] || (isnan(rows[7][3]) && isnan(ds->cols[3][7])),
+           "row adapter should mirror the columns");
+    
+    double first = ds->cols[0][100];
+    dataset_t *view = dataset_view(ds, 100, 50);
+    free_dataset(ds);
+    
+    // the view keeps the shared block alive
+    ASSERT(view->n_samples == 50, "view should have its own length");
+    ASSERT(view->cols[0][0] == first || (isnan(first) && isnan(view->cols[0][0])),
+           "view should start at its offset");
+    
+    free_dataset(view);
+    tests_passed++;
+    return 1;
+}
+
 int test_combinatorial_gmdh() {
     TEST(combinatorial_gmdh);
     
@@ -189,16 +587,1594 @@ int test_multirow_gmdh() {
     return 1;
 }
 
+int test_layer_cache() {
+    TEST(layer_cache);
+    
+    dataset_t *ds = load_csv("water_quality.csv", 23);
+    ASSERT(ds != NULL, "dataset should load");
+    ds->n_features = 8;
+    dataset_t *train, *valid;
+    split_dataset(ds, &train, &valid, 0.7);
+    
+    // a second run on the same data finds every layer input cached
+    multirow_cache_clear();
+    uint64_t hits, misses;
+    gmdh_layer_t *first = multirow_gmdh(train, valid, 4, 6);
+    multirow_cache_stats(&hits, &misses);
+    ASSERT(hits == 0 && misses == 18, "first run should evaluate each selected neuron once");
+    gmdh_layer_t *second = multirow_gmdh(train, valid, 4, 6);
+    multirow_cache_stats(&hits, &misses);
+    ASSERT(hits == 18 && misses == 18, "second run should reuse every layer output");
+    
+    int same = 1;
+    for (int l = 0; l < 4; l++) {
+        same &= first[l].n_models == second[l].n_models &&
+                memcmp(first[l].models, second[l].models,
+                       first[l].n_models * sizeof(polynomial_model_t)) == 0;
+    }
+    ASSERT(same, "cached runs should select the same networks");
+    
+    // cached columns hold the neuron's outputs; a trim to no budget keeps
+    // only the current run's
+    neuron_cache_t *cache = neuron_cache_create(0);
+    neuron_cache_begin_run(cache);
+    double *coeffs = first[0].models[0].coeffs;
+    int f1 = first[0].models[0].feature1, f2 = first[0].models[0].feature2;
+    neuron_entry_t *e = neuron_cache_get(cache, 1, 2, coeffs,
+                                         train->cols[f1], train->cols[f2], train->n_samples,
+                                         valid->cols[f1], valid->cols[f2], valid->n_samples);
+    double *expect = malloc(valid->n_samples * sizeof(double));
+    predict_polynomial_column(valid->cols[f1], valid->cols[f2], coeffs, expect, valid->n_samples);
+    ASSERT(memcmp(e->valid, expect, valid->n_samples * sizeof(double)) == 0,
+           "cached outputs should match a direct evaluation");
+    neuron_cache_trim(cache);
+    ASSERT(cache->n_entries == 1, "the current run's columns should survive a trim");
+    neuron_cache_begin_run(cache);
+    neuron_cache_trim(cache);
+    ASSERT(cache->n_entries == 0 && cache->bytes == 0, "older runs should be evicted past the budget");
+    free_neuron_cache(cache);
+    free(expect);
+    
+    for (int l = 0; l < 4; l++) {
+        free(first[l].models);
+        free(second[l].models);
+    }
+    free(first);
+    free(second);
+    multirow_cache_clear();
+    free_dataset(ds);
+    free_dataset(train);
+    free_dataset(valid);
+    tests_passed++;
+    return 1;
+}
+
+// loop body adding up the tasks it is handed
+static void count_tasks(void *ctx, int thread_id, long begin, long end) {
+    (void)thread_id;
+    __atomic_add_fetch((long*)ctx, end - begin, __ATOMIC_RELAXED);
+}
+
+int test_parallel_determinism() {
+    TEST(parallel_determinism);
+    
+    // task counts near the saturated subset counts still split exactly
+    long covered = 0;
+    parallel_for(LONG_MAX, LONG_MAX / 8, 4, count_tasks, &covered);
+    ASSERT(covered == LONG_MAX, "a task space near LONG_MAX should be dealt out exactly");
+    
+    dataset_t *ds = load_csv("data/example_test_sample.csv", 8);
+    ASSERT(ds != NULL, "dataset should load");
+    
+    dataset_t *train, *valid;
+    split_dataset(ds, &train, &valid, 0.7);
+    
+    int n_serial, n_parallel;
+    gmdh_options.n_threads = 1;
+    polynomial_model_t *serial = combinatorial_gmdh(train, valid, &n_serial);
+    linear_model_t *lin_serial = linear_combinatorial_gmdh(train, valid, 1, 4, &n_serial);
+    
+    gmdh_options.n_threads = 4;
+    polynomial_model_t *parallel = combinatorial_gmdh(train, valid, &n_parallel);
+    linear_model_t *lin_parallel = linear_combinatorial_gmdh(train, valid, 1, 4, &n_parallel);
+    gmdh_options.n_threads = 1;
+    
+    ASSERT(n_serial == n_parallel, "model counts should match");
+    ASSERT(memcmp(serial, parallel, 28 * sizeof(polynomial_model_t)) == 0,
+           "pair ranking should not depend on thread count");
+    
+    int same = 1;
+    for (int i = 0; i < n_serial; i++) {
+        if (lin_serial[i].error != lin_parallel[i].error ||
+            memcmp(lin_serial[i].feature_indices, lin_parallel[i].feature_indices,
+                   lin_serial[i].n_features * sizeof(int)) != 0) {
+            same = 0;
+        }
+    }
+    ASSERT(same, "subset ranking should not depend on thread count");
+    
+    free(serial);
+    free(parallel);
+    free_linear_models(lin_serial, n_serial);
+    free_linear_models(lin_parallel, n_parallel);
+    free_dataset(ds);
+    free_dataset(train);
+    free_dataset(valid);
+    tests_passed++;
+    return 1;
+}
+
+int test_pruned_search() {
+    TEST(pruned_search);
+    
+    dataset_t *ds = load_csv("water_quality.csv", 23);
+    ASSERT(ds != NULL, "dataset should load");
+    dataset_t *train, *valid;
+    split_dataset(ds, &train, &valid, 0.7);
+    
+    int keep = 20;
+    int n_ref, n_lin_ref;
+    gmdh_options.top_k = keep;
+    polynomial_model_t *ref = combinatorial_gmdh(train, valid, &n_ref);
+    linear_model_t *lin_ref = linear_combinatorial_gmdh(train, valid, 1, 3, &n_lin_ref);
+    
+    // every pruning mode, serial and threaded, keeps the same models with
+    // bit-identical scores
+    gmdh_prune_t modes[2] = {GMDH_PRUNE_ABANDON, GMDH_PRUNE_BOUND};
+    int same_pairs = 1, same_subsets = 1, cut = 1;
+    for (int m = 0; m < 2; m++) {
+        for (int threads = 1; threads <= 4; threads += 3) {
+            gmdh_options.prune = modes[m];
+            gmdh_options.n_threads = threads;
+            int n_pruned, n_lin;
+            polynomial_model_t *pruned = combinatorial_gmdh(train, valid, &n_pruned);
+            linear_model_t *lin = linear_combinatorial_gmdh(train, valid, 1, 3, &n_lin);
+            
+            same_pairs &= n_pruned == n_ref &&
+                          memcmp(pruned, ref, keep * sizeof(polynomial_model_t)) == 0;
+            for (int i = keep; i < n_pruned; i++) {
+                cut &= pruned[i].error >= pruned[keep - 1].error;
+            }
+            same_subsets &= n_lin == n_lin_ref;
+            for (int i = 0; i < n_lin && i < n_lin_ref; i++) {
+                same_subsets &= lin[i].error == lin_ref[i].error &&
+                                lin[i].n_features == lin_ref[i].n_features &&
+                                memcmp(lin[i].feature_indices, lin_ref[i].feature_indices,
+                                       lin[i].n_features * sizeof(int)) == 0;
+            }
+            free(pruned);
+            free_linear_models(lin, n_lin);
+        }
+    }
+    gmdh_options.prune = GMDH_PRUNE_OFF;
+    gmdh_options.n_threads = 1;
+    gmdh_options.top_k = 100;
+    ASSERT(same_pairs, "pruned pair sweeps should keep the same best pairs");
+    ASSERT(cut, "pruned pairs should rank below the kept ones");
+    ASSERT(same_subsets, "pruned subset searches should keep the same subsets");
+    
+    free(ref);
+    free_linear_models(lin_ref, n_lin_ref);
+    free_dataset(ds);
+    free_dataset(train);
+    free_dataset(valid);
+    tests_passed++;
+    return 1;
+}
+
+int test_mixed_precision() {
+    TEST(mixed_precision);
+    
+    dataset_t *ds = load_csv("water_quality.csv", 23);
+    ASSERT(ds != NULL, "dataset should load");
+    dataset_t *train, *valid;
+    split_dataset(ds, &train, &valid, 0.7);
+    
+    // a pair screened from standardized float32 columns scores as it does
+    // in double, though its raw columns are badly conditioned
+    dataset_f32_t *train32 = dataset_to_f32(train, NULL);
+    dataset_f32_t *valid32 = dataset_to_f32(valid, train32);
+    gram_stats_t *gs = gram_stats_compute(train);
+    gram_stats_t *gs32 = gram_stats_compute_f32(train32);
+    double coeffs[6], used, error, r2;
+    double *pred = malloc(valid->n_samples * sizeof(double));
+    gram_fit_pair(gs, 10, 16, coeffs);
+    predict_polynomial_column(valid->cols[10], valid->cols[16], coeffs, pred, valid->n_samples);
+    score_predictions(pred, valid->target, valid->n_samples, &error, &r2);
+    gram_fit_pair(gs32, 10, 16, coeffs);
+    double sse = sse_polynomial_f32(valid32->cols[10], valid32->cols[16], coeffs,
+                                    valid32->target, valid32->n_samples, &used);
+    ASSERT_NEAR(sqrt(sse / used), error, 1e-3 * error, "float32 screen should score like double");
+    free(pred);
+    free_gram_stats(gs);
+    free_gram_stats(gs32);
+    free_dataset_f32(train32);
+    free_dataset_f32(valid32);
+    
+    // screened in float32, the best pairs are still the double ones, with
+    // double fits
+    int keep = 20;
+    int n_ref, n_mixed;
+    gmdh_options.top_k = keep;
+    polynomial_model_t *ref = combinatorial_gmdh(train, valid, &n_ref);
+    gmdh_options.precision = GMDH_PRECISION_MIXED;
+    int same = 1;
+    for (int threads = 1; threads <= 4; threads += 3) {
+        gmdh_options.n_threads = threads;
+        polynomial_model_t *mixed = combinatorial_gmdh(train, valid, &n_mixed);
+        same &= n_mixed == n_ref;
+        for (int i = 0; i < keep && same; i++) {
+            same &= mixed[i].feature1 == ref[i].feature1 && mixed[i].feature2 == ref[i].feature2;
+            same &= fabs(mixed[i].error - ref[i].error) <= 1e-9 * ref[i].error;
+            same &= !isnan(mixed[i].r2);
+            for (int c = 0; c < 6; c++) {
+                same &= fabs(mixed[i].coeffs[c] - ref[i].coeffs[c]) <=
+                        1e-6 * (fabs(ref[i].coeffs[c]) + 1);
+            }
+        }
+        free(mixed);
+    }
+    gmdh_options.precision = GMDH_PRECISION_DOUBLE;
+    gmdh_options.n_threads = 1;
+    gmdh_options.top_k = 100;
+    ASSERT(same, "mixed precision should keep the double search's best pairs");
+    
+    free(ref);
+    free_dataset(ds);
+    free_dataset(train);
+    free_dataset(valid);
+    tests_passed++;
+    return 1;
+}
+
+// log sink counting the bytes it is sent
+static void count_log(void *user, const char *text) {
+    *(size_t*)user += strlen(text);
+}
+
+int test_moment_scoring() {
+    TEST(moment_scoring);
+    
+    dataset_t *ds = load_csv("water_quality.csv", 23);
+    ASSERT(ds != NULL, "dataset should load");
+    dataset_t *train, *valid;
+    split_dataset(ds, &train, &valid, 0.7);
+    
+    int keep = 20;
+    gmdh_options.top_k = keep;
+    int n_ref, n_lin_ref;
+    polynomial_model_t *ref = combinatorial_gmdh(train, valid, &n_ref);
+    linear_model_t *lin_ref = linear_combinatorial_gmdh(train, valid, 1, 3, &n_lin_ref);
+    gmdh_layer_t *layers_ref = multirow_gmdh(train, valid, 2, 8);
+    
+    // the same candidates come out on top, with the same scores up to
+    // rounding, whether each is scored row by row or from the moments
+    gmdh_options.scoring = GMDH_SCORE_MOMENTS;
+    int same = 1;
+    for (int threads = 1; threads <= 4; threads += 3) {
+        gmdh_options.n_threads = threads;
+        int n_pairs, n_lin;
+        polynomial_model_t *pairs = combinatorial_gmdh(train, valid, &n_pairs);
+        linear_model_t *lin = linear_combinatorial_gmdh(train, valid, 1, 3, &n_lin);
+        gmdh_layer_t *layers = multirow_gmdh(train, valid, 2, 8);
+        
+        same &= n_pairs == n_ref && n_lin == n_lin_ref;
+        for (int i = 0; i < keep && same; i++) {
+            same &= pairs[i].feature1 == ref[i].feature1 && pairs[i].feature2 == ref[i].feature2;
+            same &= fabs(pairs[i].error - ref[i].error) <= 1e-7 * ref[i].error;
+            same &= fabs(pairs[i].r2 - ref[i].r2) <= 1e-7;
+        }
+        for (int i = 0; i < n_lin && same; i++) {
+            same &= lin[i].n_features == lin_ref[i].n_features &&
+                    memcmp(lin[i].feature_indices, lin_ref[i].feature_indices,
+                           lin[i].n_features * sizeof(int)) == 0;
+            same &= fabs(lin[i].error - lin_ref[i].error) <= 1e-7 * lin_ref[i].error;
+            same &= fabs(lin[i].r2 - lin_ref[i].r2) <= 1e-7;
+        }
+        for (int l = 0; l < 2; l++) {
+            same &= layers[l].n_models == layers_ref[l].n_models;
+            for (int i = 0; i < layers[l].n_models && same; i++) {
+                same &= fabs(layers[l].models[i].error - layers_ref[l].models[i].error) <=
+                        1e-7 * layers_ref[l].models[i].error;
+            }
+            free(layers[l].models);
+        }
+        free(layers);
+        free(pairs);
+        free_linear_models(lin, n_lin);
+    }
+    gmdh_options.scoring = GMDH_SCORE_ROWS;
+    gmdh_options.n_threads = 1;
+    gmdh_options.top_k = 100;
+    ASSERT(same, "moment scoring should rank and score like row scoring");
+    
+    free(ref);
+    free_linear_models(lin_ref, n_lin_ref);
+    for (int l = 0; l < 2; l++) {
+        free(layers_ref[l].models);
+    }
+    free(layers_ref);
+    free_dataset(ds);
+    free_dataset(train);
+    free_dataset(valid);
+    tests_passed++;
+    return 1;
+}
+
+int test_multi_target() {
+    TEST(multi_target);
+    
+    int target_cols[3] = {23, 25, 27};
+    multi_dataset_t *md = load_csv_targets("water_quality.csv", target_cols, 3);
+    ASSERT(md != NULL, "dataset should load");
+    ASSERT(md->n_targets == 3 && md->features->n_features == 39 - 3,
+           "every target column should leave the features");
+    ASSERT(strcmp(md->target_names[1], "chloride_tank3") == 0, "targets keep their names");
+    int complete = 1;
+    for (int t = 0; t < 3; t++) {
+        for (int r = 0; r < md->features->n_samples; r++) {
+            complete &= !isnan(md->targets[t][r]);
+        }
+    }
+    ASSERT(complete, "only rows with every target should be kept");
+    
+    multi_dataset_t *train, *valid;
+    split_multi_dataset(md, &train, &valid, 0.7);
+    
+    // shared statistics are the ones each target would sum alone, bit for
+    // bit, and a target with gaps (a feature column here) still gets its own
+    double *targets[4] = {train->targets[0], train->targets[1], train->targets[2], NULL};
+    for (int f = 0; f < train->features->n_features && !targets[3]; f++) {
+        for (int r = 0; r < train->features->n_samples; r++) {
+            if (isnan(train->features->cols[f][r])) targets[3] = train->features->cols[f];
+        }
+    }
+    ASSERT(targets[3] != NULL, "some feature should have gaps");
+    gram_stats_t **shared = gram_stats_compute_targets(train->features, targets, 4);
+    linear_gram_t **grams = linear_gram_compute_targets(train->features, targets, 4);
+    int m = train->features->n_features;
+    int same_stats = 1;
+    for (int t = 0; t < 4; t++) {
+        dataset_t view = *train->features;
+        view.target = targets[t];
+        gram_stats_t *alone = gram_stats_compute(&view);
+        linear_gram_t *g = linear_gram_compute(&view);
+        same_stats &= memcmp(shared[t]->block, alone->block, 14 * (size_t)m * m *
+                             sizeof(double)) == 0;
+        same_stats &= memcmp(grams[t]->xty, g->xty, (m + 1) * sizeof(double)) == 0 &&
+                      grams[t]->yy == g->yy;
+        free_gram_stats(alone);
+        free_linear_gram(g);
+        free_gram_stats(shared[t]);
+        free_linear_gram(grams[t]);
+    }
+    free(shared);
+    free(grams);
+    ASSERT(same_stats, "shared statistics should match per-target ones");
+    
+    // and so are the models
+    gmdh_options.top_k = 10;
+    target_models_t *results = multi_target_gmdh(train, valid, 1, 2, 2, 6);
+    gmdh_options.linear_mode = GMDH_LINEAR_GRAY;
+    int same = 1;
+    for (int t = 0; t < 3; t++) {
+        dataset_t tr, va;
+        multi_dataset_target(train, t, &tr);
+        multi_dataset_target(valid, t, &va);
+        int n_pairs, n_lin;
+        polynomial_model_t *pairs = combinatorial_gmdh(&tr, &va, &n_pairs);
+        linear_model_t *lin = linear_combinatorial_gmdh(&tr, &va, 1, 2, &n_lin);
+        gmdh_layer_t *layers = multirow_gmdh(&tr, &va, 2, 6);
+        target_models_t *res = &results[t];
+        
+        same &= strcmp(res->target_name, md->target_names[t]) == 0;
+        same &= res->n_pairs == n_pairs && res->n_linear == n_lin && res->n_layers == 2;
+        for (int i = 0; i < n_pairs && same; i++) {
+            same &= res->pairs[i].feature1 == pairs[i].feature1 &&
+                    res->pairs[i].feature2 == pairs[i].feature2;
+            same &= res->pairs[i].error == pairs[i].error;
+        }
+        for (int i = 0; i < n_lin && same; i++) {
+            same &= memcmp(res->linear[i].feature_indices, lin[i].feature_indices,
+                           lin[i].n_features * sizeof(int)) == 0;
+            same &= res->linear[i].error == lin[i].error;
+        }
+        for (int l = 0; l < 2; l++) {
+            same &= res->layers[l].n_models == layers[l].n_models;
+            for (int i = 0; i < layers[l].n_models && same; i++) {
+                same &= res->layers[l].models[i].error == layers[l].models[i].error;
+            }
+            free(layers[l].models);
+        }
+        free(layers);
+        free(pairs);
+        free_linear_models(lin, n_lin);
+    }
+    gmdh_options.linear_mode = GMDH_LINEAR_REFIT;
+    gmdh_options.top_k = 100;
+    ASSERT(same, "each target's models should match a run of its own");
+    
+    free_target_models(results, 3);
+    free_multi_dataset(md);
+    free_multi_dataset(train);
+    free_multi_dataset(valid);
+    tests_passed++;
+    return 1;
+}
+
+typedef struct {
+    gmdh_context_t *ctx;
+    dataset_t *train;
+    dataset_t *valid;
+    int n_models;
+} context_run_t;
+
+static void* context_linear_thread(void *arg) {
+    context_run_t *run = arg;
+    gmdh_context_linear(run->ctx, run->train, run->valid, 1, 3, &run->n_models);
+    return NULL;
+}
+
+int test_context() {
+    TEST(context);
+    
+    dataset_t *ds = load_csv("water_quality.csv", 23);
+    ASSERT(ds != NULL, "dataset should load");
+    dataset_t *train, *valid;
+    split_dataset(ds, &train, &valid, 0.7);
+    
+    gmdh_options.n_threads = 4;
+    gmdh_options.top_k = 20;
+    int n_ref, n_lin_ref;
+    polynomial_model_t *ref = combinatorial_gmdh(train, valid, &n_ref);
+    linear_model_t *lin_ref = linear_combinatorial_gmdh(train, valid, 1, 3, &n_lin_ref);
+    gmdh_layer_t *layers_ref = multirow_gmdh(train, valid, 3, 8);
+    
+    gmdh_context_t *ctx = gmdh_context_create(NULL);
+    gmdh_options.n_threads = 1;
+    gmdh_options.top_k = 100;
+    size_t logged = 0;
+    gmdh_context_set_log(ctx, count_log, &logged);
+    
+    // every run repeats the process-wide results, and once a round of runs
+    // has sized the pool (the results each kind holds on to included)
+    // the rest take nothing from the system
+    int same = 1;
+    uint64_t warm = 0, heap = 0;
+    for (int run = 0; run < 3; run++) {
+        if (run == 2) heap = __atomic_load_n(&heap_allocs, __ATOMIC_RELAXED);
+        int n_pairs, n_lin;
+        const polynomial_model_t *pairs = gmdh_context_combinatorial(ctx, train, valid, &n_pairs);
+        same &= n_pairs == n_ref && memcmp(pairs, ref, n_ref * sizeof(polynomial_model_t)) == 0;
+        const linear_model_t *lin = gmdh_context_linear(ctx, train, valid, 1, 3, &n_lin);
+        same &= n_lin == n_lin_ref;
+        for (int i = 0; i < n_lin && i < n_lin_ref; i++) {
+            same &= lin[i].error == lin_ref[i].error &&
+                    memcmp(lin[i].feature_indices, lin_ref[i].feature_indices,
+                           lin[i].n_features * sizeof(int)) == 0;
+        }
+        const gmdh_layer_t *layers = gmdh_context_multirow(ctx, train, valid, 3, 8);
+        for (int l = 0; l < 3; l++) {
+            same &= layers[l].n_models == layers_ref[l].n_models &&
+                    memcmp(layers[l].models, layers_ref[l].models,
+                           layers[l].n_models * sizeof(polynomial_model_t)) == 0;
+        }
+        if (run == 1) warm = gmdh_context_allocs(ctx);
+    }
+    heap = __atomic_load_n(&heap_allocs, __ATOMIC_RELAXED) - heap;
+    ASSERT(same, "context runs should match the process-wide ones");
+    ASSERT(warm > 0 && gmdh_context_allocs(ctx) == warm, "repeated runs should take no new blocks");
+    printf("  heap allocations in a warm round: %llu\n", (unsigned long long)heap);
+    ASSERT(heap == 0, "repeated runs should not call the allocator");
+    ASSERT(logged > 0, "progress should go to the log sink");
+    ASSERT(gmdh_options.n_threads == 1 && gmdh_options.top_k == 100,
+           "context runs should leave the process options alone");
+    
+    // a context with options of its own, run beside the first
+    gmdh_context_t *other = gmdh_context_create(NULL);
+    gmdh_context_options(other)->top_k = 5;
+    gmdh_context_options(other)->n_threads = 2;
+    context_run_t run = {other, train, valid, 0};
+    pthread_t thread;
+    pthread_create(&thread, NULL, context_linear_thread, &run);
+    int n_lin;
+    gmdh_context_linear(ctx, train, valid, 1, 3, &n_lin);
+    pthread_join(thread, NULL);
+    ASSERT(run.n_models == 5 && n_lin == n_lin_ref,
+           "concurrent contexts should each run with their own options");
+    
+    gmdh_context_free(other);
+    gmdh_context_free(ctx);
+    free(ref);
+    free_linear_models(lin_ref, n_lin_ref);
+    for (int l = 0; l < 3; l++) {
+        if (layers_ref[l].n_models > 0) free(layers_ref[l].models);
+    }
+    free(layers_ref);
+    free_dataset(ds);
+    free_dataset(train);
+    free_dataset(valid);
+    tests_passed++;
+    return 1;
+}
+
+// rows of ds outside [begin, end), copied into a dataset of their own
+static dataset_t* rows_outside(dataset_t *ds, int begin, int end) {
+    int n = ds->n_samples - (end - begin);
+    dataset_t *out = dataset_create(n, ds->n_features);
+    int k = 0;
+    for (int r = 0; r < ds->n_samples; r++) {
+        if (r >= begin && r < end) continue;
+        for (int f = 0; f < ds->n_features; f++) {
+            out->cols[f][k] = ds->cols[f][r];
+        }
+        out->target[k++] = ds->target[r];
+    }
+    for (int f = 0; f < ds->n_features; f++) {
+        out->feature_names[f] = ds->feature_names[f];
+    }
+    return out;
+}
+
+// pooled validation rmse of every pair when the rows of each segment are
+// scored by a sweep fitted on train_of(segment), refitting from the rows
+static void brute_pair_cv(dataset_t *ds, const gmdh_cv_t *cv, double *rmse) {
+    int m = ds->n_features, n_pairs = m * (m - 1) / 2;
+    int bounds[cv->k + 2];
+    int n_seg = cv_segments(cv, ds->n_samples, bounds);
+    double *sse = calloc(n_pairs, sizeof(double)), *cnt = calloc(n_pairs, sizeof(double));
+    polynomial_model_t *models = malloc(n_pairs * sizeof(polynomial_model_t));
+    for (int s = cv->kind == GMDH_CV_ROLLING; s < n_seg; s++) {
+        dataset_t *train = cv->kind == GMDH_CV_ROLLING
+            ? rows_outside(ds, bounds[s], ds->n_samples)
+            : rows_outside(ds, bounds[s], bounds[s + 1]);
+        dataset_t *valid = dataset_view(ds, bounds[s], bounds[s + 1] - bounds[s]);
+        sweep_quadratic_pairs(train, valid, models, 0);
+        for (int p = 0; p < n_pairs; p++) {
+            double n = 0;
+            for (int r = 0; r < valid->n_samples; r++) {
+                n += !isnan(valid->cols[models[p].feature1][r]) &&
+                     !isnan(valid->cols[models[p].feature2][r]) && !isnan(valid->target[r]);
+            }
+            sse[p] += n > 0 ? models[p].error * models[p].error * n : 0;
+            cnt[p] += n;
+        }
+        free_dataset(train);
+        free_dataset(valid);
+    }
+    for (int p = 0; p < n_pairs; p++) {
+        rmse[p] = sqrt(sse[p] / cnt[p]);
+    }
+    free(sse);
+    free(cnt);
+    free(models);
+}
+
+// least squares line of the target on feature f over the rows outside
+// [begin, end) where both are present
+static void fit_line_outside(dataset_t *ds, int f, int begin, int end, double *a, double *b) {
+    double sx = 0, sy = 0, sxx = 0, sxy = 0, m = 0;
+    for (int r = 0; r < ds->n_samples; r++) {
+        double x = ds->cols[f][r], y = ds->target[r];
+        if ((r >= begin && r < end) || isnan(x) || isnan(y)) continue;
+        m++; sx += x; sy += y; sxx += x * x; sxy += x * y;
+    }
+    *b = (m * sxy - sx * sy) / (m * sxx - sx * sx);
+    *a = (sy - *b * sx) / m;
+}
+
+// pooled cv rmse of the line on feature f refitted for every k-fold
+// segment, or every row under leave one out, on the rows it has
+static double brute_line_cv(dataset_t *ds, const gmdh_cv_t *cv, int f) {
+    int *bounds = malloc((cv->k + ds->n_samples + 2) * sizeof(int));
+    int n_seg = cv_segments(cv, ds->n_samples, bounds);
+    if (n_seg == 0) {
+        n_seg = ds->n_samples;
+        for (int r = 0; r <= n_seg; r++) bounds[r] = r;
+    }
+    double sse = 0, rows = 0;
+    for (int s = 0; s < n_seg; s++) {
+        double a, b;
+        fit_line_outside(ds, f, bounds[s], bounds[s + 1], &a, &b);
+        for (int r = bounds[s]; r < bounds[s + 1]; r++) {
+            if (isnan(ds->cols[f][r]) || isnan(ds->target[r])) continue;
+            double e = ds->target[r] - a - b * ds->cols[f][r];
+            sse += e * e;
+            rows++;
+        }
+    }
+    free(bounds);
+    return sqrt(sse / rows);
+}
+
+int test_missing_masks() {
+    TEST(missing_masks);
+    
+    // about 15% of two features and a few targets missing, over a row
+    // count that leaves a partial last bitmap word
+    int n = 301, m = 5;
+    dataset_t *ds = dataset_create(n, m);
+    uint32_t seed = 12345;
+    for (int r = 0; r < n; r++) {
+        double x[5];
+        for (int f = 0; f < m; f++) {
+            seed = seed * 1103515245u + 12345u;
+            x[f] = (seed >> 8) / (double)(1u << 24) * 4 - 2;
+            ds->cols[f][r] = x[f];
+        }
+        seed = seed * 1103515245u + 12345u;
+        double noise = ((seed >> 8) / (double)(1u << 24) - 0.5) * 0.1;
+        ds->target[r] = 1 + 2 * x[0] - x[1] + 0.5 * x[2] + noise;
+        if (r % 7 == 3) ds->cols[1][r] = NAN;
+        if (r % 9 == 5 || r % 13 == 0) ds->cols[3][r] = NAN;
+        if (r % 31 == 17) ds->target[r] = NAN;
+    }
+    
+    // bitmaps count and gather the present rows
+    uint64_t bits[(301 + MASK_BITS - 1) / MASK_BITS];
+    mask_build(ds->cols[3], n, bits);
+    double gathered[301], expect[301];
+    int n_expect = 0;
+    for (int r = 0; r < n; r++) {
+        if (!isnan(ds->cols[3][r])) expect[n_expect++] = ds->cols[3][r];
+    }
+    ASSERT(mask_count(bits, mask_words(n)) == n_expect, "popcount should count present rows");
+    ASSERT(mask_gather(ds->cols[3], bits, n, gathered) == n_expect &&
+           memcmp(gathered, expect, n_expect * sizeof(double)) == 0,
+           "gather should keep present rows in order");
+    
+    // pair statistics are pairwise complete: the fit on the rows where
+    // both columns and the target are present
+    gram_stats_t *gs = gram_stats_compute(ds);
+    int pairs[2][2] = {{0, 1}, {1, 3}};
+    int pairs_match = 1;
+    for (int p = 0; p < 2; p++) {
+        int i = pairs[p][0], j = pairs[p][1];
+        double a[301], b[301], y[301];
+        int k = 0;
+        for (int r = 0; r < n; r++) {
+            if (isnan(ds->cols[i][r]) || isnan(ds->cols[j][r]) || isnan(ds->target[r])) continue;
+            a[k] = ds->cols[i][r];
+            b[k] = ds->cols[j][r];
+            y[k++] = ds->target[r];
+        }
+        quad_moments_t mom;
+        gram_pair_moments(gs, i, j, &mom);
+        double from_gram[6], from_rows[6], from_gappy[6];
+        gram_fit_pair(gs, i, j, from_gram);
+        fit_polynomial(a, b, y, k, from_rows);
+        fit_polynomial(ds->cols[i], ds->cols[j], ds->target, n, from_gappy);
+        pairs_match &= mom.n == k;
+        for (int c = 0; c < 6; c++) {
+            pairs_match &= fabs(from_gram[c] - from_rows[c]) <= 1e-9 * (1 + fabs(from_rows[c]));
+            pairs_match &= fabs(from_gappy[c] - from_rows[c]) <= 1e-9 * (1 + fabs(from_rows[c]));
+        }
+    }
+    free_gram_stats(gs);
+    ASSERT(pairs_match, "pair fits should use their complete rows");
+    
+    // linear subsets are fitted listwise, on the rows every column of
+    // the subset has, whether refitted or walked from the gram
+    gmdh_options.top_k = 0;
+    int n_refit, n_gray;
+    gmdh_options.linear_mode = GMDH_LINEAR_REFIT;
+    linear_model_t *refit = linear_combinatorial_gmdh(ds, ds, 1, 3, &n_refit);
+    gmdh_options.linear_mode = GMDH_LINEAR_GRAY;
+    linear_model_t *gray = linear_combinatorial_gmdh(ds, ds, 1, 3, &n_gray);
+    gmdh_options.linear_mode = GMDH_LINEAR_REFIT;
+    ASSERT(n_refit == 25 && n_gray == 25, "every subset should be kept");
+    
+    int finite = 1, same = 1;
+    for (int i = 0; i < n_refit; i++) {
+        finite &= isfinite(refit[i].error) && isfinite(gray[i].error);
+        same &= refit[i].n_features == gray[i].n_features &&
+                memcmp(refit[i].feature_indices, gray[i].feature_indices,
+                       refit[i].n_features * sizeof(int)) == 0;
+        for (int c = 0; c <= refit[i].n_features && same; c++) {
+            same &= fabs(refit[i].coeffs[c] - gray[i].coeffs[c]) <=
+                    1e-8 * (1 + fabs(refit[i].coeffs[c]));
+        }
+    }
+    ASSERT(finite, "subsets over columns with gaps should be scored");
+    ASSERT(same, "gray walk should match refits");
+    
+    // the best subset is the true one, fitted on its complete rows
+    int truth[3] = {0, 1, 2};
+    ASSERT(refit[0].n_features == 3 && memcmp(refit[0].feature_indices, truth,
+                                              sizeof(truth)) == 0,
+           "the true subset should rank first");
+    int k = 0;
+    for (int r = 0; r < n; r++) {
+        k += !isnan(ds->cols[1][r]) && !isnan(ds->target[r]);
+    }
+    dataset_t *rows = dataset_create(k, 3);
+    k = 0;
+    for (int r = 0; r < n; r++) {
+        if (isnan(ds->cols[1][r]) || isnan(ds->target[r])) continue;
+        for (int f = 0; f < 3; f++) {
+            rows->cols[f][k] = ds->cols[f][r];
+        }
+        rows->target[k++] = ds->target[r];
+    }
+    linear_gram_t *g = linear_gram_compute(rows);
+    double coeffs[4];
+    linear_gram_fit(g, truth, 3, coeffs);
+    int listwise = 1;
+    for (int c = 0; c < 4; c++) {
+        listwise &= fabs(coeffs[c] - refit[0].coeffs[c]) <= 1e-9 * (1 + fabs(coeffs[c]));
+    }
+    ASSERT(listwise, "coefficients should come from the complete rows");
+    ASSERT_NEAR(refit[0].coeffs[1], 2.0, 0.01, "x0 coefficient should be recovered");
+    
+    free_linear_gram(g);
+    free_dataset(rows);
+    free_linear_models(refit, n_refit);
+    free_linear_models(gray, n_gray);
+    free_dataset(ds);
+    
+    tests_passed++;
+    return 1;
+}
+
+int test_feature_screening() {
+    TEST(feature_screening);
+    
+    // a constant, a copy and a near-copy of the first signal, a second
+    // signal and noise, one column with gaps
+    int n = 2000, m = 8;
+    dataset_t *ds = dataset_create(n, m);
+    uint32_t seed = 777;
+    for (int r = 0; r < n; r++) {
+        double u[4];
+        for (int k = 0; k < 4; k++) {
+            seed = seed * 1103515245u + 12345u;
+            u[k] = (seed >> 8) / (double)(1u << 24) * 2 - 1;
+        }
+        seed = seed * 1103515245u + 12345u;
+        double eps = ((seed >> 8) / (double)(1u << 24) - 0.5) * 0.01;
+        seed = seed * 1103515245u + 12345u;
+        double jitter = ((seed >> 8) / (double)(1u << 24) - 0.5) * 0.3;
+        ds->cols[0][r] = 3.0;
+        ds->cols[1][r] = u[0];
+        ds->cols[2][r] = u[0];
+        ds->cols[3][r] = 2 * u[0] + 1 + jitter;
+        ds->cols[4][r] = u[1];
+        ds->cols[5][r] = u[2];
+        ds->cols[6][r] = r % 5 == 2 ? NAN : u[3];
+        ds->cols[7][r] = u[2] * u[3];
+        ds->target[r] = u[0] + u[1] + eps;
+    }
+    
+    feature_screen_t *fs = screen_features(ds, 2);
+    ASSERT(fs->verdict[0] == SCREEN_CONSTANT, "constant column should drop out");
+    ASSERT(fs->verdict[2] == SCREEN_DUPLICATE && fs->twin[2] == 1,
+           "copy should follow its original out");
+    ASSERT(fs->verdict[3] == SCREEN_CORRELATED && fs->twin[3] == 1,
+           "near-copy should follow the better-ranked feature out");
+    ASSERT(fs->n_kept == 2 && fs->kept[0] == 1 && fs->kept[1] == 4,
+           "the two signals should fill the budget");
+    ASSERT(fs->verdict[5] == SCREEN_BUDGET && fs->verdict[6] == SCREEN_BUDGET,
+           "noise should be ranked out");
+    
+    // the score is the pearson correlation over the rows with both
+    double sx = 0, sy = 0, sxx = 0, syy = 0, sxy = 0;
+    for (int r = 0; r < n; r++) {
+        double x = ds->cols[4][r], y = ds->target[r];
+        sx += x; sy += y; sxx += x * x; syy += y * y; sxy += x * y;
+    }
+    double corr = (n * sxy - sx * sy) / sqrt((n * sxx - sx * sx) * (n * syy - sy * sy));
+    ASSERT_NEAR(fs->score[4], fabs(corr), 1e-9, "score should be |correlation| with the target");
+    free_feature_screen(fs);
+    
+    gmdh_options.screen_rank = GMDH_SCREEN_MI;
+    fs = screen_features(ds, 2);
+    ASSERT(fs->n_kept == 2 && fs->kept[0] == 1 && fs->kept[1] == 4,
+           "mutual information should rank the signals first too");
+    free_feature_screen(fs);
+    gmdh_options.screen_rank = GMDH_SCREEN_CORR;
+    
+    // searches over the screened features name features of ds, and find
+    // what the full searches find among them
+    dataset_t *train, *valid;
+    split_dataset(ds, &train, &valid, 0.7);
+    int n_linear, n_full, n_screened;
+    linear_model_t *full = linear_combinatorial_gmdh(train, valid, 1, 2, &n_linear);
+    polynomial_model_t *pairs_full = combinatorial_gmdh(train, valid, &n_full);
+    gmdh_options.screen_budget = 2;
+    linear_model_t *screened = linear_combinatorial_gmdh(train, valid, 1, 2, &n_screened);
+    ASSERT(n_screened == 3, "only subsets of the kept features should be searched");
+    ASSERT(screened[0].n_features == 2 && screened[0].feature_indices[0] == 1 &&
+           screened[0].feature_indices[1] == 4, "linear models should map back");
+    ASSERT(memcmp(screened[0].feature_indices, full[0].feature_indices, 2 * sizeof(int)) == 0 &&
+           screened[0].error == full[0].error, "best linear model should be unchanged");
+    
+    polynomial_model_t *pairs = combinatorial_gmdh(train, valid, &n_screened);
+    ASSERT(n_screened == 1 && pairs[0].feature1 == 1 && pairs[0].feature2 == 4,
+           "pair models should map back");
+    int same_pair = 0;
+    for (int i = 0; i < n_full; i++) {
+        same_pair |= pairs_full[i].feature1 == 1 && pairs_full[i].feature2 == 4 &&
+                     pairs_full[i].error == pairs[0].error;
+    }
+    ASSERT(same_pair, "pair fit should be unchanged");
+    gmdh_options.screen_budget = 0;
+    
+    free_linear_models(full, n_linear);
+    free_linear_models(screened, 3);
+    free(pairs_full);
+    free(pairs);
+    free_dataset(train);
+    free_dataset(valid);
+    free_dataset(ds);
+    
+    tests_passed++;
+    return 1;
+}
+
+int test_beam_search() {
+    TEST(beam_search);
+    
+    // four signals among sixteen features
+    int n = 1500, m = 16;
+    dataset_t *ds = dataset_create(n, m);
+    uint32_t seed = 4242;
+    for (int r = 0; r < n; r++) {
+        for (int f = 0; f < m; f++) {
+            seed = seed * 1103515245u + 12345u;
+            ds->cols[f][r] = (seed >> 8) / (double)(1u << 24) * 2 - 1;
+        }
+        seed = seed * 1103515245u + 12345u;
+        double eps = ((seed >> 8) / (double)(1u << 24) - 0.5) * 0.1;
+        ds->target[r] = 3 * ds->cols[2][r] - 2 * ds->cols[7][r] + ds->cols[11][r] +
+                        0.5 * ds->cols[13][r] + eps;
+    }
+    dataset_t *train, *valid;
+    split_dataset(ds, &train, &valid, 0.7);
+    
+    gmdh_options.top_k = 0;
+    gmdh_options.linear_mode = GMDH_LINEAR_GRAY;
+    int n_all, n_beam;
+    linear_model_t *all = linear_combinatorial_gmdh(train, valid, 1, 4, &n_all);
+    gmdh_options.linear_mode = GMDH_LINEAR_BEAM;
+    gmdh_options.beam_width = 4;
+    linear_model_t *beam = linear_combinatorial_gmdh(train, valid, 1, 4, &n_beam);
+    ASSERT(n_beam < n_all, "the beam should fit fewer subsets than there are");
+    
+    // the best subset of each size is the exhaustive search's
+    for (int s = 1; s <= 4; s++) {
+        int a = 0, b = 0;
+        while (a < n_all && all[a].n_features != s) a++;
+        while (b < n_beam && beam[b].n_features != s) b++;
+        ASSERT(a < n_all && b < n_beam, "every size should have models");
+        ASSERT(memcmp(all[a].feature_indices, beam[b].feature_indices, s * sizeof(int)) == 0,
+               "beam should find the best subset of each size");
+        ASSERT_NEAR(beam[b].error, all[a].error, 1e-9, "updated factor should fit the same");
+    }
+    ASSERT(beam[0].n_features == 4 && beam[0].feature_indices[0] == 2 &&
+           beam[0].feature_indices[1] == 7 && beam[0].feature_indices[2] == 11 &&
+           beam[0].feature_indices[3] == 13, "beam should find the signals");
+    
+    // subsets grown through below min_features are not results
+    int n_min;
+    linear_model_t *from2 = linear_combinatorial_gmdh(train, valid, 2, 4, &n_min);
+    int small = 0;
+    for (int i = 0; i < n_min; i++) {
+        small |= from2[i].n_features < 2;
+    }
+    ASSERT(!small && n_min < n_beam, "sizes below min_features should not be kept");
+    
+    gmdh_options.linear_mode = GMDH_LINEAR_REFIT;
+    gmdh_options.beam_width = 16;
+    gmdh_options.top_k = 100;
+    
+    free_linear_models(all, n_all);
+    free_linear_models(beam, n_beam);
+    free_linear_models(from2, n_min);
+    free_dataset(train);
+    free_dataset(valid);
+    free_dataset(ds);
+    
+    tests_passed++;
+    return 1;
+}
+
+int test_cross_validation() {
+    TEST(cross_validation);
+    
+    dataset_t *ds = load_csv("water_quality.csv", 23);
+    ASSERT(ds != NULL, "dataset should load");
+    int orig_features = ds->n_features;
+    ds->n_features = 6;
+    int n_pairs = 15;
+    
+    // fold statistics give the errors of refitting on every training fold
+    gmdh_cv_t schemes[2] = {{GMDH_CV_KFOLD, 5, 0}, {GMDH_CV_ROLLING, 3, 300}};
+    double brute[15];
+    polynomial_model_t models[15];
+    for (int c = 0; c < 2; c++) {
+        brute_pair_cv(ds, &schemes[c], brute);
+        sweep_quadratic_pairs_cv(ds, &schemes[c], models);
+        double worst = 0;
+        for (int p = 0; p < n_pairs; p++) {
+            worst = fmax(worst, fabs(models[p].error - brute[p]) / brute[p]);
+        }
+        ASSERT(worst < 1e-6, c == 0 ? "k-fold pair errors should match refits"
+                                    : "rolling-origin pair errors should match refits");
+    }
+    
+    // leave one out from press against n refits
+    dataset_t *small = dataset_view(ds, 0, 60);
+    gmdh_cv_t loo = {GMDH_CV_LOO, 0, 0};
+    sweep_quadratic_pairs_cv(small, &loo, models);
+    double press = 0;
+    int n = 0;
+    for (int r = 0; r < small->n_samples; r++) {
+        int i = models[0].feature1, j = models[0].feature2;
+        if (isnan(small->cols[i][r]) || isnan(small->cols[j][r]) || isnan(small->target[r])) continue;
+        dataset_t *rest = rows_outside(small, r, r + 1);
+        double coeffs[6];
+        fit_polynomial(rest->cols[i], rest->cols[j], rest->target, rest->n_samples, coeffs);
+        double e = small->target[r] - predict_polynomial(small->cols[i][r], small->cols[j][r], coeffs);
+        press += e * e;
+        n++;
+        free_dataset(rest);
+    }
+    ASSERT_NEAR(models[0].error, sqrt(press / n), 1e-6 * sqrt(press / n),
+                "press should match leave-one-out refits");
+    free_dataset(small);
+    
+    // linear subsets and layers take the same criterion
+    gmdh_options.top_k = 0;
+    int n_lin;
+    linear_model_t *lin = linear_combinatorial_gmdh_cv(ds, &schemes[0], 1, 2, &n_lin);
+    int found = 0;
+    for (int k = 0; k < n_lin; k++) {
+        if (lin[k].n_features != 1) continue;
+        int f = lin[k].feature_indices[0];
+        int all_present = 1;
+        for (int r = 0; r < ds->n_samples; r++) all_present &= !isnan(ds->cols[f][r]);
+        if (!all_present) continue;
+        // refit the line on each training fold
+        int bounds[7];
+        int n_seg = cv_segments(&schemes[0], ds->n_samples, bounds);
+        double sse = 0, rows = 0;
+        for (int s = 0; s < n_seg; s++) {
+            dataset_t *train = rows_outside(ds, bounds[s], bounds[s + 1]);
+            double sx = 0, sy = 0, sxx = 0, sxy = 0, m = 0;
+            for (int r = 0; r < train->n_samples; r++) {
+                if (isnan(train->target[r])) continue;
+                double x = train->cols[f][r], y = train->target[r];
+                m++; sx += x; sy += y; sxx += x * x; sxy += x * y;
+            }
+            double b = (m * sxy - sx * sy) / (m * sxx - sx * sx), a = (sy - b * sx) / m;
+            for (int r = bounds[s]; r < bounds[s + 1]; r++) {
+                if (isnan(ds->target[r])) continue;
+                double e = ds->target[r] - a - b * ds->cols[f][r];
+                sse += e * e;
+                rows++;
+            }
+            free_dataset(train);
+        }
+        ASSERT_NEAR(lin[k].error, sqrt(sse / rows), 1e-6 * sqrt(sse / rows),
+                    "k-fold linear errors should match refits");
+        found = 1;
+        break;
+    }
+    ASSERT(found, "a complete single-feature subset should be ranked");
+    free_linear_models(lin, n_lin);
+    
+    // subsets over a feature with gaps are fitted listwise, on the rows
+    // they have, by k-fold and by leave one out alike
+    int gapped = 4;
+    dataset_t *head = dataset_view(ds, 0, 120);
+    for (int c = 0; c < 2; c++) {
+        dataset_t *data = c == 0 ? ds : head;
+        const gmdh_cv_t *scheme = c == 0 ? &schemes[0] : &loo;
+        lin = linear_combinatorial_gmdh_cv(data, scheme, 1, 2, &n_lin);
+        int finite = n_lin == 6 + 15;
+        double error = NAN;
+        for (int k = 0; k < n_lin; k++) {
+            finite &= isfinite(lin[k].error);
+            if (lin[k].n_features == 1 && lin[k].feature_indices[0] == gapped) {
+                error = lin[k].error;
+            }
+        }
+        ASSERT(finite, c == 0 ? "every k-fold subset should be scored"
+                              : "every leave-one-out subset should be scored");
+        double expect = brute_line_cv(data, scheme, gapped);
+        ASSERT_NEAR(error, expect, 1e-6 * expect,
+                    c == 0 ? "k-fold errors over a gapped feature should match refits"
+                           : "leave-one-out errors over a gapped feature should match refits");
+        free_linear_models(lin, n_lin);
+    }
+    free_dataset(head);
+    gmdh_options.top_k = 100;
+    
+    int n_comb;
+    polynomial_model_t *comb = combinatorial_gmdh_cv(ds, &schemes[0], &n_comb);
+    gmdh_layer_t *layers = multirow_gmdh_cv(ds, &schemes[0], 2, 4);
+    ASSERT(layers[0].models[0].error == comb[0].error,
+           "multirow layer 0 should rank pairs like combinatorial gmdh");
+    free(comb);
+    for (int l = 0; l < 2; l++) {
+        free(layers[l].models);
+    }
+    free(layers);
+    
+    ds->n_features = orig_features;
+    free_dataset(ds);
+    tests_passed++;
+    return 1;
+}
+
+int test_combination_ranking() {
+    TEST(combination_ranking);
+    
+    comb_table_t *comb = comb_table_create(60, 8);
+    ASSERT(comb_count(comb, 38, 6) == 2760681ULL, "C(38,6) should be exact");
+    ASSERT(comb_count(comb, 60, 8) == 2558620845ULL, "C(60,8) should not overflow");
+    
+    // walking lexicographically must agree with rank/unrank
+    int idx[4] = {0, 1, 2, 3}, jumped[4];
+    uint64_t rank = 0;
+    int ok = 1;
+    do {
+        comb_unrank(comb, 10, 4, rank, jumped);
+        if (memcmp(idx, jumped, sizeof(idx)) != 0) ok = 0;
+        if (comb_rank(comb, 10, 4, idx) != rank) ok = 0;
+        rank++;
+    } while (comb_next(10, 4, idx));
+    
+    ASSERT(ok, "unrank should reproduce lexicographic order");
+    ASSERT(rank == comb_count(comb, 10, 4), "walk should visit every subset");
+    
+    free_comb_table(comb);
+    tests_passed++;
+    return 1;
+}
+
+int test_model_ranking() {
+    TEST(model_ranking);
+    
+    // pairs of a 12-feature layer with many tied errors, some NaN
+    int n = 66;
+    polynomial_model_t models[66], sorted[66];
+    uint64_t seed = 7;
+    for (int p = 0; p < n; p++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        pair_from_index(12, p, &models[p].feature1, &models[p].feature2);
+        for (int c = 0; c < 6; c++) {
+            models[p].coeffs[c] = 1;
+        }
+        models[p].coeffs[5] = (seed >> 40) % 4 == 0 ? 0 : 1;  // some simpler neurons
+        models[p].error = (seed >> 33) % 9 == 0 ? NAN : (double)((seed >> 20) % 5);
+        models[p].r2 = 1.0 - models[p].error / 10;
+        models[p].cond = 1;
+    }
+    memcpy(sorted, models, sizeof(models));
+    rank_sort(sorted, n, sizeof(polynomial_model_t), polynomial_model_before);
+    
+    int ordered = 1;
+    for (int p = 0; p + 1 < n; p++) {
+        if (!polynomial_model_before(&sorted[p], &sorted[p + 1])) ordered = 0;
+    }
+    ASSERT(ordered, "sorted models should be in strict ranking order");
+    ASSERT(isnan(sorted[n - 1].error), "nan errors should rank last");
+    
+    // the top k by selection should be the first k of the full sort
+    int agree = 1;
+    for (int k = 1; k <= n; k += 7) {
+        polynomial_model_t top[66];
+        memcpy(top, models, sizeof(models));
+        size_t placed = rank_top(top, n, sizeof(polynomial_model_t), k, polynomial_model_before);
+        if ((int)placed != k) agree = 0;
+        for (int p = 0; p < k; p++) {
+            if (top[p].feature1 != sorted[p].feature1 || top[p].feature2 != sorted[p].feature2) {
+                agree = 0;
+            }
+        }
+    }
+    ASSERT(agree, "rank_top should match the first k of a full sort");
+    
+    // a bounded heap of errors keeps the k smallest
+    double errors[200], heap[10];
+    size_t size = 0;
+    for (int i = 0; i < 200; i++) {
+        errors[i] = (i * 37) % 200;
+        rank_heap_offer(heap, &size, 10, sizeof(double), &errors[i], error_before);
+    }
+    rank_select(errors, 200, sizeof(double), 9, error_before);
+    ASSERT(size == 10, "heap should hold its capacity");
+    ASSERT_NEAR(heap[0], 9, 1e-12, "heap root should be the 10th smallest error");
+    ASSERT_NEAR(errors[9], 9, 1e-12, "selection should place the 10th smallest error");
+    
+    tests_passed++;
+    return 1;
+}
+
+int test_linear_rank_ranges() {
+    TEST(linear_rank_ranges);
+    
+    dataset_t *ds = load_csv("data/example_test_sample.csv", 8);
+    ASSERT(ds != NULL, "dataset should load");
+    
+    dataset_t *train, *valid;
+    split_dataset(ds, &train, &valid, 0.7);
+    
+    uint64_t total = linear_subset_count(train->n_features, 2, 5);
+    ASSERT(total == 28 + 56 + 70 + 56, "subset count should cover sizes 2..5");
+    
+    int n_full, n_a, n_b, n_merged;
+    linear_model_t *full = linear_combinatorial_gmdh(train, valid, 2, 5, &n_full);
+    linear_model_t *a = linear_combinatorial_gmdh_range(train, valid, 2, 5, 0, 77, &n_a);
+    linear_model_t *b = linear_combinatorial_gmdh_range(train, valid, 2, 5, 77, total, &n_b);
+    linear_model_t *merged = linear_models_merge(a, n_a, b, n_b, gmdh_options.top_k, &n_merged);
+    
+    ASSERT(n_full == gmdh_options.top_k, "search should keep top_k models");
+    ASSERT(n_merged == n_full, "merged ranges should keep as many models");
+    
+    int same = 1;
+    for (int i = 0; i < n_full; i++) {
+        if (full[i].error != merged[i].error || full[i].n_features != merged[i].n_features) {
+            same = 0;
+        }
+    }
+    ASSERT(same, "merged ranges should rank like the full search");
+    
+    free_linear_models(full, n_full);
+    free_linear_models(merged, n_merged);
+    free_dataset(ds);
+    free_dataset(train);
+    free_dataset(valid);
+    tests_passed++;
+    return 1;
+}
+
+int test_gray_code_search() {
+    TEST(gray_code_search);
+    
+    // consecutive subsets must differ by exactly one swap
+    comb_table_t *comb = comb_table_create(9, 4);
+    int idx[4], jumped[4];
+    revdoor_unrank(comb, 9, 4, 0, idx);
+    int ok = 1;
+    for (uint64_t r = 1; r < comb_count(comb, 9, 4); r++) {
+        int removed, added;
+        revdoor_next(9, 4, idx, &removed, &added);
+        revdoor_unrank(comb, 9, 4, r, jumped);
+        if (removed < 0 || added < 0 || memcmp(idx, jumped, sizeof(idx)) != 0) ok = 0;
+        if (revdoor_rank(comb, 4, idx) != r) ok = 0;
+    }
+    free_comb_table(comb);
+    ASSERT(ok, "revolving-door walk should swap one element per step");
+    
+    dataset_t *ds = load_csv("data/example_test_sample.csv", 8);
+    ASSERT(ds != NULL, "dataset should load");
+    dataset_t *train, *valid;
+    split_dataset(ds, &train, &valid, 0.7);
+    
+    int n_refit, n_gray;
+    linear_model_t *refit = linear_combinatorial_gmdh(train, valid, 2, 6, &n_refit);
+    gmdh_options.linear_mode = GMDH_LINEAR_GRAY;
+    linear_model_t *gray = linear_combinatorial_gmdh(train, valid, 2, 6, &n_gray);
+    gmdh_options.linear_mode = GMDH_LINEAR_REFIT;
+    
+    ASSERT(n_refit == n_gray, "both modes should keep as many models");
+    for (int i = 0; i < 10; i++) {
+        ASSERT(refit[i].n_features == gray[i].n_features &&
+               memcmp(refit[i].feature_indices, gray[i].feature_indices,
+                      refit[i].n_features * sizeof(int)) == 0,
+               "gray mode should rank the same subsets");
+        ASSERT_NEAR(gray[i].error, refit[i].error, 1e-8, "gray mode error should match refit");
+    }
+    
+    free_linear_models(refit, n_refit);
+    free_linear_models(gray, n_gray);
+    free_dataset(ds);
+    free_dataset(train);
+    free_dataset(valid);
+    tests_passed++;
+    return 1;
+}
+
+int test_streaming_training() {
+    TEST(streaming_training);
+    
+    // pairs: streamed in blocks that straddle the train/valid split, from
+    // the csv and from a binary copy, against the in-memory search
+    dataset_t *ds = load_csv("water_quality.csv", 23);
+    ASSERT(ds != NULL, "dataset should load");
+    const char *bin = "test_stream.bin";
+    ASSERT(save_dataset_bin(ds, bin), "binary copy should save");
+    dataset_t *train, *valid;
+    split_dataset(ds, &train, &valid, 0.7);
+    int n_ref;
+    polynomial_model_t *ref = malloc(ds->n_features * ds->n_features * sizeof(polynomial_model_t));
+    sweep_quadratic_pairs(train, valid, ref, 0);
+    n_ref = ds->n_features * (ds->n_features - 1) / 2;
+    
+    const char *sources[2] = {"water_quality.csv", bin};
+    int targets[2] = {23, -1};
+    for (int src = 0; src < 2; src++) {
+        row_stream_t *s = row_stream_open(sources[src], targets[src], 37);
+        ASSERT(s != NULL, "stream should open");
+        ASSERT(row_stream_count(s) == ds->n_samples, "stream should count the rows with a target");
+        int n_streamed;
+        polynomial_model_t *streamed = combinatorial_gmdh_stream(s, 0.7, &n_streamed);
+        row_stream_close(s);
+        ASSERT(n_streamed == n_ref, "every pair should be scored");
+        
+        double worst = 0;
+        for (int k = 0; k < n_streamed; k++) {
+            polynomial_model_t *a = &streamed[k];
+            int p = 0;
+            while (ref[p].feature1 != a->feature1 || ref[p].feature2 != a->feature2) p++;
+            double scale = fmax(1.0, fabs(ref[p].error));
+            if (isfinite(ref[p].error)) worst = fmax(worst, fabs(a->error - ref[p].error) / scale);
+            else if (isfinite(a->error)) worst = INFINITY;
+        }
+        ASSERT(worst < 1e-8, "streamed pair errors should match the in-memory sweep");
+        free(streamed);
+    }
+    free(ref);
+    free_dataset(train);
+    free_dataset(valid);
+    free_dataset(ds);
+    
+    // a damaged binary file fails the search rather than training on the
+    // rows before the damage
+    struct stat st;
+    ASSERT(stat(bin, &st) == 0 && truncate(bin, st.st_size - 1000) == 0,
+           "binary copy should truncate");
+    row_stream_t *cut = row_stream_open(bin, -1, 37);
+    ASSERT(cut != NULL, "a truncated binary file should still open");
+    int n_cut;
+    polynomial_model_t *partial = combinatorial_gmdh_stream(cut, 0.7, &n_cut);
+    ASSERT(partial == NULL && n_cut == 0 && cut->error,
+           "a short read should fail the streamed search");
+    row_stream_close(cut);
+    
+    // nor does one of another version open, or keep its descriptor
+    uint32_t version = BIN_VERSION + 1;
+    int fd = open(bin, O_WRONLY);
+    ASSERT(pwrite(fd, &version, sizeof(version), offsetof(bin_header_t, version)) ==
+           sizeof(version), "binary version should rewrite");
+    close(fd);
+    int free_fd = dup(0);
+    close(free_fd);
+    ASSERT(row_stream_open(bin, -1, 37) == NULL, "another version should not open");
+    fd = dup(0);
+    close(fd);
+    ASSERT(fd == free_fd, "a refused binary file should not keep its descriptor");
+    remove(bin);
+    
+    // linear subsets: ranked from the grams, rescored exactly
+    ds = load_csv("data/example_test_sample.csv", 8);
+    split_dataset(ds, &train, &valid, 0.7);
+    gmdh_options.linear_mode = GMDH_LINEAR_GRAY;
+    int n_mem, n_str;
+    linear_model_t *mem = linear_combinatorial_gmdh(train, valid, 2, 6, &n_mem);
+    gmdh_options.linear_mode = GMDH_LINEAR_REFIT;
+    row_stream_t *s = row_stream_open("data/example_test_sample.csv", 8, 3);
+    linear_model_t *str = linear_combinatorial_gmdh_stream(s, 0.7, 2, 6, &n_str);
+    row_stream_close(s);
+    
+    ASSERT(n_mem == n_str, "both searches should keep as many models");
+    for (int i = 0; i < 10; i++) {
+        ASSERT(mem[i].n_features == str[i].n_features &&
+               memcmp(mem[i].feature_indices, str[i].feature_indices,
+                      mem[i].n_features * sizeof(int)) == 0,
+               "streamed search should rank the same subsets");
+        ASSERT_NEAR(str[i].error, mem[i].error, 1e-8, "streamed error should match");
+    }
+    
+    free_linear_models(mem, n_mem);
+    free_linear_models(str, n_str);
+    free_dataset(train);
+    free_dataset(valid);
+    free_dataset(ds);
+    
+    // subsets over features with gaps: fitted listwise from the grams of
+    // each pattern of missing features, as the in-memory search refits them
+    ds = load_csv("water_quality.csv", 23);
+    split_dataset(ds, &train, &valid, 0.7);
+    column_masks_t *cm = column_masks_build(train);
+    mem = linear_combinatorial_gmdh(train, valid, 1, 2, &n_mem);
+    s = row_stream_open("water_quality.csv", 23, 37);
+    str = linear_combinatorial_gmdh_stream(s, 0.7, 1, 2, &n_str);
+    row_stream_close(s);
+    
+    ASSERT(n_mem == n_str, "both searches should keep as many models");
+    int gapped = 0;
+    for (int i = 0; i < 10; i++) {
+        ASSERT(mem[i].n_features == str[i].n_features &&
+               memcmp(mem[i].feature_indices, str[i].feature_indices,
+                      mem[i].n_features * sizeof(int)) == 0,
+               "streamed search should rank the same subsets over gaps");
+        ASSERT_NEAR(str[i].error, mem[i].error, 1e-8 * mem[i].error,
+                    "streamed error over gaps should match");
+        for (int j = 0; j < str[i].n_features; j++) {
+            gapped |= !cm->complete[str[i].feature_indices[j]];
+        }
+    }
+    ASSERT(gapped, "a subset over a feature with gaps should be ranked");
+    
+    free_column_masks(cm);
+    free_linear_models(mem, n_mem);
+    free_linear_models(str, n_str);
+    free_dataset(train);
+    free_dataset(valid);
+    free_dataset(ds);
+    tests_passed++;
+    return 1;
+}
+
+int test_model_artifact() {
+    TEST(model_artifact);
+    
+    dataset_t *ds = load_csv("water_quality.csv", 23);
+    ASSERT(ds != NULL, "dataset should load");
+    ds->n_features = 6;
+    dataset_t *train, *valid;
+    split_dataset(ds, &train, &valid, 0.7);
+    double *pred = malloc(valid->n_samples * sizeof(double));
+    double *again = malloc(valid->n_samples * sizeof(double));
+    double rmse, r2;
+    
+    // multi-row: the compiled network reproduces the validation score the
+    // search gave its best model, and keeps only the neurons it reads
+    gmdh_layer_t *layers = multirow_gmdh(train, valid, 3, 5);
+    gmdh_model_t *model = model_from_multirow(layers, 2, 0, ds->feature_names);
+    ASSERT(model->n_nodes <= 7, "unused neurons should be pruned");
+    ASSERT(model_predict(model, valid, pred), "model should evaluate");
+    score_predictions(pred, valid->target, valid->n_samples, &rmse, &r2);
+    ASSERT(rmse == layers[2].models[0].error, "compiled network should reproduce the search score");
+    
+    const char *path = "test_model.gmdh";
+    ASSERT(save_model(model, path), "model should save");
+    gmdh_model_t *loaded = load_model(path);
+    ASSERT(loaded != NULL, "model should load");
+    ASSERT(loaded->n_nodes == model->n_nodes && loaded->n_inputs == model->n_inputs,
+           "loaded model should have the same shape");
+    ASSERT(model_predict(loaded, valid, again), "loaded model should evaluate");
+    ASSERT(memcmp(pred, again, valid->n_samples * sizeof(double)) == 0,
+           "loaded model should predict identically");
+    free_model(loaded);
+    free_model(model);
+    remove(path);
+    for (int i = 0; i < 3; i++) {
+        if (layers[i].n_models > 0) free(layers[i].models);
+    }
+    free(layers);
+    
+    // single pair
+    int n_models;
+    polynomial_model_t *pairs = combinatorial_gmdh(train, valid, &n_models);
+    model = model_from_polynomial(&pairs[0], ds->feature_names);
+    ASSERT(model->n_inputs == 2 && model->n_nodes == 1, "a pair should compile to one node");
+    model_predict(model, valid, pred);
+    score_predictions(pred, valid->target, valid->n_samples, &rmse, &r2);
+    ASSERT(rmse == pairs[0].error, "compiled pair should reproduce the search score");
+    free_model(model);
+    free(pairs);
+    free_dataset(train);
+    free_dataset(valid);
+    free_dataset(ds);
+    free(pred);
+    free(again);
+    
+    // linear subset, evaluated on a dataset with its columns reordered:
+    // inputs are found by name
+    ds = load_csv("data/example_test_sample.csv", 8);
+    split_dataset(ds, &train, &valid, 0.7);
+    linear_model_t *lin = linear_combinatorial_gmdh(train, valid, 2, 4, &n_models);
+    model = model_from_linear(&lin[0], ds->feature_names);
+    pred = malloc(valid->n_samples * sizeof(double));
+    model_predict(model, valid, pred);
+    score_predictions(pred, valid->target, valid->n_samples, &rmse, &r2);
+    ASSERT_NEAR(rmse, lin[0].error, 1e-9, "compiled linear model should reproduce the search score");
+    
+    int m = valid->n_features;
+    dataset_t *shuffled = dataset_create(valid->n_samples, m);
+    for (int f = 0; f < m; f++) {
+        memcpy(shuffled->cols[m - 1 - f], valid->cols[f], valid->n_samples * sizeof(double));
+        shuffled->feature_names[m - 1 - f] = valid->feature_names[f];
+    }
+    again = malloc(valid->n_samples * sizeof(double));
+    ASSERT(model_predict(model, shuffled, again), "model should find its inputs by name");
+    ASSERT(memcmp(pred, again, valid->n_samples * sizeof(double)) == 0,
+           "column order should not change predictions");
+    
+    // an input whose name the dataset lacks is missing, not read from the
+    // column at its training index
+    int renamed = m - 1 - lin[0].feature_indices[0];
+    char *name = shuffled->feature_names[renamed];
+    shuffled->feature_names[renamed] = "renamed";
+    ASSERT(!model_predict(model, shuffled, again), "an input missing by name should not evaluate");
+    shuffled->feature_names[renamed] = name;
+    
+    free_dataset(shuffled);
+    free_model(model);
+    free_linear_models(lin, n_models);
+    free_dataset(train);
+    free_dataset(valid);
+    free_dataset(ds);
+    free(pred);
+    free(again);
+    tests_passed++;
+    return 1;
+}
+
+static void* serve_thread(void *arg) {
+    serve_run(arg);
+    return NULL;
+}
+
+// rows of ds in a model's input slot order, row-major
+static double* model_rows(const gmdh_model_t *model, dataset_t *ds) {
+    double *rows = malloc(((size_t)ds->n_samples * model->n_inputs + 1) * sizeof(double));
+    for (int r = 0; r < ds->n_samples; r++) {
+        for (int s = 0; s < model->n_inputs; s++) {
+            rows[(size_t)r * model->n_inputs + s] = ds->cols[model->input_features[s]][r];
+        }
+    }
+    return rows;
+}
+
+static int same_predictions(const double *a, const double *b, int n) {
+    for (int i = 0; i < n; i++) {
+        if (fabs(a[i] - b[i]) > 1e-12 * fmax(1.0, fabs(b[i]))) return 0;
+    }
+    return 1;
+}
+
+int test_prediction_server() {
+    TEST(prediction_server);
+    
+    dataset_t *ds = load_csv("water_quality.csv", 23);
+    ASSERT(ds != NULL, "dataset should load");
+    ds->n_features = 6;
+    dataset_t *train, *valid;
+    split_dataset(ds, &train, &valid, 0.7);
+    int n = valid->n_samples;
+    
+    gmdh_layer_t *layers = multirow_gmdh(train, valid, 3, 5);
+    gmdh_model_t *net = model_from_multirow(layers, 2, 0, ds->feature_names);
+    int n_pairs;
+    polynomial_model_t *pairs = combinatorial_gmdh(train, valid, &n_pairs);
+    gmdh_model_t *pair = model_from_polynomial(&pairs[0], ds->feature_names);
+    char *paths[2] = {"test_serve_a.gmdh", "test_serve_b.gmdh"};
+    ASSERT(save_model(net, paths[0]) && save_model(pair, paths[1]), "models should save");
+    
+    const char *sock = "test_gmdh.sock";
+    gmdh_server_t *server = serve_create(sock, paths, 2);
+    ASSERT(server != NULL, "server should start");
+    pthread_t thread;
+    pthread_create(&thread, NULL, serve_thread, server);
+    int fd = serve_connect(sock);
+    ASSERT(fd >= 0, "client should connect");
+    
+    serve_request_t req = {1, SERVE_OP_INFO, 0, 0, 0};
+    serve_response_t resp;
+    double info[2];
+    ASSERT(serve_call(fd, &req, NULL, &resp, info, 2) && resp.status == SERVE_OK, "info should answer");
+    ASSERT(info[0] == net->n_inputs && info[1] == net->n_nodes, "info should describe the model");
+    
+    // every validation row in one request
+    double *expect = malloc(n * sizeof(double));
+    double *got = malloc(n * sizeof(double));
+    double *rows = model_rows(net, valid);
+    model_predict(net, valid, expect);
+    serve_request_t all = {2, SERVE_OP_PREDICT, 0, n, n * net->n_inputs};
+    ASSERT(serve_call(fd, &all, rows, &resp, got, n) && resp.status == SERVE_OK && resp.id == 2,
+           "batch request should succeed");
+    ASSERT(resp.n_values == (uint32_t)n && same_predictions(got, expect, n),
+           "served batch should match model_predict");
+    
+    // single rows pipelined on the socket: coalesced into batches, answered
+    // in order
+    int k = net->n_inputs;
+    int sent = 1;
+    for (int r = 0; r < 20; r++) {
+        serve_request_t one = {100 + r, SERVE_OP_PREDICT, 0, 1, k};
+        sent &= write(fd, &one, sizeof(one)) == sizeof(one) &&
+                write(fd, rows + (size_t)r * k, k * sizeof(double)) == (ssize_t)(k * sizeof(double));
+    }
+    ASSERT(sent, "pipelined requests should send");
+    int in_order = 1;
+    for (int r = 0; r < 20 && in_order; r++) {
+        double v;
+        in_order = read(fd, &resp, sizeof(resp)) == sizeof(resp) &&
+                   read(fd, &v, sizeof(v)) == sizeof(v) &&
+                   resp.id == (uint32_t)(100 + r) && same_predictions(&v, &expect[r], 1);
+    }
+    ASSERT(in_order, "pipelined responses should come back in order and correct");
+    
+    serve_request_t bad = {3, SERVE_OP_PREDICT, 7, 1, k};
+    ASSERT(serve_call(fd, &bad, rows, &resp, got, n) && resp.status == SERVE_NO_MODEL,
+           "unknown model should be refused");
+    bad.model = 0;
+    bad.n_values = k + 1;
+    ASSERT(serve_call(fd, &bad, rows, &resp, got, n) && resp.status == SERVE_BAD_SHAPE,
+           "wrong row width should be refused");
+    
+    // hot swap: overwrite model 0 with the pair model and wait for the
+    // server to notice
+    ASSERT(save_model(pair, paths[0]), "replacement model should save");
+    int swapped = 0;
+    for (int tries = 0; tries < 300 && !swapped; tries++) {
+        req.id = 4;
+        if (!serve_call(fd, &req, NULL, &resp, info, 2)) break;
+        swapped = info[1] == pair->n_nodes;
+        struct timespec pause = {0, 10000000L};
+        if (!swapped) nanosleep(&pause, NULL);
+    }
+    ASSERT(swapped, "server should pick up the new model file");
+    free(rows);
+    rows = model_rows(pair, valid);
+    model_predict(pair, valid, expect);
+    all.n_values = n * pair->n_inputs;
+    ASSERT(serve_call(fd, &all, rows, &resp, got, n) && resp.status == SERVE_OK &&
+           same_predictions(got, expect, n), "swapped model should serve");
+    
+    close(fd);
+    serve_stop(server);
+    pthread_join(thread, NULL);
+    serve_free(server);
+    remove(paths[0]);
+    remove(paths[1]);
+    
+    free(rows);
+    free(expect);
+    free(got);
+    free_model(net);
+    free_model(pair);
+    free(pairs);
+    for (int i = 0; i < 3; i++) {
+        if (layers[i].n_models > 0) free(layers[i].models);
+    }
+    free(layers);
+    free_dataset(train);
+    free_dataset(valid);
+    free_dataset(ds);
+    tests_passed++;
+    return 1;
+}
+
 int main() {
     printf("=== gmdh unit tests ===\n");
     
     test_polynomial_fit();
+    test_gram_pair_fit();
+    test_dense_solver();
     test_rmse_calculation();
     test_r2_calculation();
+    test_simd_kernels();
     test_csv_loading();
+    test_wide_csv_loading();
+    test_binary_dataset();
     test_dataset_split();
+    test_columnar_views();
     test_combinatorial_gmdh();
     test_multirow_gmdh();
+    test_layer_cache();
+    test_parallel_determinism();
+    test_pruned_search();
+    test_mixed_precision();
+    test_moment_scoring();
+    test_multi_target();
+    test_context();
+    test_missing_masks();
+    test_feature_screening();
+    test_beam_search();
+    test_cross_validation();
+    test_combination_ranking();
+    test_model_ranking();
+    test_linear_rank_ranges();
+    test_gray_code_search();
+    test_streaming_training();
+    test_model_artifact();
+    test_prediction_server();
     
     printf("\n=== results ===\n");
     printf("tests run: %d\n", tests_run);
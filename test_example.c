@@ -1,5 +1,20 @@
 #include "gmdh.h"
 
+// the best model of each size S=3..6, as table 2.2 lists them: S counts
+// the intercept, so S=3 is a0 + a3*x3 + a7*x7. models are ranked, so the
+// first of a size is its best
+static void print_best_per_size(linear_model_t *models, int n_models, char **feature_names) {
+    for (int s = 3; s <= 6; s++) {
+        for (int i = 0; i < n_models; i++) {
+            if (models[i].n_features == s - 1) {
+                printf("\nS=%d: ", s);
+                print_linear_model(&models[i], feature_names);
+                break;
+            }
+        }
+    }
+}
+
 void run_example_test() {
     printf("=== gmdh test on example_test_sample ===\n\n");
 
@@ -20,8 +35,11 @@ void run_example_test() {
     printf("train: %d samples, validation: %d samples\n",
            train->n_samples, valid->n_samples);
 
-    // run linear combinatorial gmdh (paper's approach)
+    // run linear combinatorial gmdh (paper's approach). every subset is
+    // kept, so each size has its best model among the results
     printf("\n=== running linear combinatorial gmdh (paper's approach) ===\n");
+    int top_k = gmdh_options.top_k;
+    gmdh_options.top_k = 0;
     int n_models;
     linear_model_t *linear_models = linear_combinatorial_gmdh(train, valid, 2, 6, &n_models);
 
@@ -31,6 +49,22 @@ void run_example_test() {
         print_linear_model(&linear_models[i], train->feature_names);
     }
 
+    printf("\nbest model of each size:\n");
+    print_best_per_size(linear_models, n_models, train->feature_names);
+
+    // the multistage search grows the best few subsets of each size
+    // instead of trying them all, and should reach the same models
+    printf("\n\n=== running multistage (beam) linear gmdh ===\n");
+    gmdh_options.linear_mode = GMDH_LINEAR_BEAM;
+    gmdh_options.beam_width = 4;
+    int n_beam_models;
+    linear_model_t *beam_models = linear_combinatorial_gmdh(train, valid, 2, 6, &n_beam_models);
+    gmdh_options.linear_mode = GMDH_LINEAR_REFIT;
+    gmdh_options.top_k = top_k;
+
+    printf("\nbest model of each size:\n");
+    print_best_per_size(beam_models, n_beam_models, train->feature_names);
+
     // also run quadratic pairs for comparison
     printf("\n\n=== running quadratic pairs gmdh (current implementation) ===\n");
     int n_quad_models;
@@ -51,6 +85,7 @@ void run_example_test() {
 
     // cleanup
     free_linear_models(linear_models, n_models);
+    free_linear_models(beam_models, n_beam_models);
     free(comb_models);
 
     free_dataset(ds);